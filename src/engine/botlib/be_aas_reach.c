@@ -48,6 +48,9 @@ If you have questions concerning this license or the applicable additional terms
 #include "../../../etmain/src/game/be_aas.h"
 #include "be_aas_funcs.h"
 #include "be_aas_def.h"
+#ifdef BSPC
+#include "../bspc/l_threads.h"
+#endif							//BSPC
 
 extern int      Sys_MilliSeconds(void);
 
@@ -136,6 +139,9 @@ typedef struct aas_lreachability_s
 	vec3_t          end;		//end point of inter area movement
 	int             traveltype;	//type of travel required to get to the area
 	unsigned short int traveltime;	//travel time of the inter area movement
+#ifdef BSPC
+	int            *count;		//reachability counter of the link when calculated on a thread
+#endif							//BSPC
 	//
 	struct aas_lreachability_s *next;
 } aas_lreachability_t;
@@ -146,6 +152,10 @@ aas_lreachability_t *nextreachability;	//next free reachability from the heap
 aas_lreachability_t **areareachability;	//reachability links for every area
 int             numlreachabilities;
 
+#ifdef BSPC
+extern qboolean threaded;
+#endif							//BSPC
+
 typedef struct
 {
 	int             destarea;
@@ -331,19 +341,31 @@ aas_lreachability_t *AAS_AllocReachability(void)
 {
 	aas_lreachability_t *r;
 
-	if(!nextreachability)
+#ifdef BSPC
+	//the links of several areas are calculated at once on the bspc threads
+	if(threaded)
 	{
-		return NULL;
+		ThreadLock();
 	}
-	//make sure the error message only shows up once
-	if(!nextreachability->next)
+#endif							//BSPC
+	r = nextreachability;
+	if(r)
+	{
+		//make sure the error message only shows up once
+		if(!r->next)
+		{
+			AAS_Error("AAS_MAX_REACHABILITYSIZE");
+		}
+		//
+		nextreachability = r->next;
+		numlreachabilities++;
+	}							//end if
+#ifdef BSPC
+	if(threaded)
 	{
-		AAS_Error("AAS_MAX_REACHABILITYSIZE");
+		ThreadUnlock();
 	}
-	//
-	r = nextreachability;
-	nextreachability = nextreachability->next;
-	numlreachabilities++;
+#endif							//BSPC
 	return r;
 }								//end of the function AAS_AllocReachability
 
@@ -363,6 +385,26 @@ void AAS_FreeReachability(aas_lreachability_t * lreach)
 	numlreachabilities--;
 }								//end of the function AAS_FreeReachability
 
+//===========================================================================
+// counts a reachability link of the given type, links calculated on the
+// bspc threads are counted when they're committed in area order
+//
+// Parameter:               -
+// Returns:                 -
+// Changes Globals:     -
+//===========================================================================
+void AAS_CountReachability(aas_lreachability_t * lreach, int *count)
+{
+#ifdef BSPC
+	if(threaded)
+	{
+		lreach->count = count;
+		return;
+	}							//end if
+#endif							//BSPC
+	(*count)++;
+}								//end of the function AAS_CountReachability
+
 //===========================================================================
 // returns qtrue if the area has reachability links
 //
@@ -882,7 +924,7 @@ int AAS_Reachability_Swim(int area1num, int area2num)
 					//link the reachability
 					lreach->next = areareachability[area1num];
 					areareachability[area1num] = lreach;
-					reach_swim++;
+					AAS_CountReachability(lreach, &reach_swim);
 					return qtrue;
 				}				//end if
 			}					//end if
@@ -1052,7 +1094,7 @@ int AAS_Reachability_EqualFloorHeight(int area1num, int area2num)
 		//avoid rather small areas
 		//if (AAS_AreaGroundFaceArea(lreach->areanum) < 500) lreach->traveltime += 100;
 		//
-		reach_equalfloor++;
+		AAS_CountReachability(lreach, &reach_equalfloor);
 		return qtrue;
 	}							//end if
 	return qfalse;
@@ -1438,7 +1480,7 @@ int AAS_Reachability_Step_Barrier_WaterJump_WalkOffLedge(int area1num, int area2
 			//avoid rather small areas
 			//if (AAS_AreaGroundFaceArea(lreach->areanum) < 500) lreach->traveltime += 100;
 			//
-			reach_step++;
+			AAS_CountReachability(lreach, &reach_step);
 			return qtrue;
 		}						//end if
 	}							//end if
@@ -1494,7 +1536,7 @@ int AAS_Reachability_Step_Barrier_WaterJump_WalkOffLedge(int area1num, int area2
 					lreach->next = areareachability[area1num];
 					areareachability[area1num] = lreach;
 					//we've got another waterjump reachability
-					reach_waterjump++;
+					AAS_CountReachability(lreach, &reach_waterjump);
 					return qtrue;
 				}				//end if
 			}					//end if
@@ -1545,7 +1587,7 @@ int AAS_Reachability_Step_Barrier_WaterJump_WalkOffLedge(int area1num, int area2
 					lreach->next = areareachability[area1num];
 					areareachability[area1num] = lreach;
 					//we've got another barrierjump reachability
-					reach_barrier++;
+					AAS_CountReachability(lreach, &reach_barrier);
 					return qtrue;
 				}				//end if
 			}					//end if
@@ -1599,7 +1641,7 @@ int AAS_Reachability_Step_Barrier_WaterJump_WalkOffLedge(int area1num, int area2
 				lreach->next = areareachability[area1num];
 				areareachability[area1num] = lreach;
 				//we've got another walk reachability
-				reach_walk++;
+				AAS_CountReachability(lreach, &reach_walk);
 				return qtrue;
 			}					//end if
 			//trace a bounding box vertically to check for solids
@@ -1644,7 +1686,7 @@ int AAS_Reachability_Step_Barrier_WaterJump_WalkOffLedge(int area1num, int area2
 					lreach->next = areareachability[area1num];
 					areareachability[area1num] = lreach;
 					//
-					reach_walkoffledge++;
+					AAS_CountReachability(lreach, &reach_walkoffledge);
 					//NOTE: don't create a weapon (rl, bfg) jump reachability here
 					//because it interferes with other reachabilities
 					//like the ladder reachability
@@ -2278,7 +2320,7 @@ int AAS_Reachability_Jump(int area1num, int area2num)
 			lreach->next = areareachability[area1num];
 			areareachability[area1num] = lreach;
 			//
-			reach_jump++;
+			AAS_CountReachability(lreach, &reach_jump);
 			return qtrue;
 		}
 	}
@@ -2533,11 +2575,11 @@ int AAS_Reachability_Jump(int area1num, int area2num)
 		//
 		if(traveltype == TRAVEL_JUMP)
 		{
-			reach_jump++;
+			AAS_CountReachability(lreach, &reach_jump);
 		}
 		else
 		{
-			reach_walkoffledge++;
+			AAS_CountReachability(lreach, &reach_walkoffledge);
 		}
 		//
 		return qtrue;
@@ -4964,6 +5006,157 @@ void AAS_StoreReachability(void)
 	}							//end for
 }								//end of the function AAS_StoreReachability
 
+//===========================================================================
+// calculates the reachabilities from the given area towards all other areas
+//
+// Parameter:               -
+// Returns:                 -
+// Changes Globals:     -
+//===========================================================================
+void AAS_CalcAreaReachability(int areanum)
+{
+	int             j;
+
+	//only create jumppad reachabilities from jumppad areas
+	if((*aasworld).areasettings[areanum].contents & AREACONTENTS_JUMPPAD)
+	{
+		return;
+	}							//end if
+	//loop over the areas
+	for(j = 1; j < (*aasworld).numareas; j++)
+	{
+		if(areanum == j)
+		{
+			continue;
+		}
+		//never create reachabilities from teleporter or jumppad areas to regular areas
+		if((*aasworld).areasettings[areanum].contents & (AREACONTENTS_TELEPORTER | AREACONTENTS_JUMPPAD))
+		{
+			if(!((*aasworld).areasettings[j].contents & (AREACONTENTS_TELEPORTER | AREACONTENTS_JUMPPAD)))
+			{
+				continue;
+			}					//end if
+		}						//end if
+		//if there already is a reachability link from the area to j
+		if(AAS_ReachabilityExists(areanum, j))
+		{
+			continue;
+		}
+		//check for a swim reachability
+		if(AAS_Reachability_Swim(areanum, j))
+		{
+			continue;
+		}
+		//check for a simple walk on equal floor height reachability
+		if(AAS_Reachability_EqualFloorHeight(areanum, j))
+		{
+			continue;
+		}
+		//check for step, barrier, waterjump and walk off ledge reachabilities
+		if(AAS_Reachability_Step_Barrier_WaterJump_WalkOffLedge(areanum, j))
+		{
+			continue;
+		}
+		//check for ladder reachabilities
+		if(AAS_Reachability_Ladder(areanum, j))
+		{
+			continue;
+		}
+		//check for a jump reachability
+		if(AAS_Reachability_Jump(areanum, j))
+		{
+			continue;
+		}
+	}							//end for
+	//never create these reachabilities from teleporter or jumppad areas
+	if((*aasworld).areasettings[areanum].contents & (AREACONTENTS_TELEPORTER | AREACONTENTS_JUMPPAD))
+	{
+		return;
+	}							//end if
+	//loop over the areas
+	for(j = 1; j < (*aasworld).numareas; j++)
+	{
+		if(areanum == j)
+		{
+			continue;
+		}
+		//
+		if(AAS_ReachabilityExists(areanum, j))
+		{
+			continue;
+		}
+		//check for a grapple hook reachability
+// Ridah, no grapple
+//          AAS_Reachability_Grapple(areanum, j);
+		//check for a weapon jump reachability
+// Ridah, no weapon jumping
+//          AAS_Reachability_WeaponJump(areanum, j);
+	}							//end for
+}								//end of the function AAS_CalcAreaReachability
+
+#ifdef BSPC
+//===========================================================================
+// calculates the reachabilities from an area on a bspc thread
+//
+// Parameter:               -
+// Returns:                 -
+// Changes Globals:     -
+//===========================================================================
+void AAS_CalcAreaReachabilityThread(int areanum)
+{
+	//ladder areas also create links from the areas they connect to and test
+	//the links of those areas, they are calculated when the threads are done
+	if(!areanum || AAS_AreaLadder(areanum))
+	{
+		return;
+	}							//end if
+	AAS_CalcAreaReachability(areanum);
+}								//end of the function AAS_CalcAreaReachabilityThread
+
+//===========================================================================
+// calculates the reachabilities of all areas on the bspc threads
+// the links of every area are calculated into the list of that area and
+// committed in area order so they end up exactly as if the areas were
+// calculated one after the other
+//
+// Parameter:               -
+// Returns:                 -
+// Changes Globals:     -
+//===========================================================================
+void AAS_ThreadAreaReachability(void)
+{
+	int             i;
+	aas_lreachability_t *lreach, *nextlreach, **threadreachability;
+
+	RunThreadsOnIndividual((*aasworld).numareas, qtrue, AAS_CalcAreaReachabilityThread);
+	//
+	threadreachability = areareachability;
+	areareachability = (aas_lreachability_t **) GetClearedMemory((*aasworld).numareas * sizeof(aas_lreachability_t *));
+	//commit the areas in area order
+	for(i = 1; i < (*aasworld).numareas; i++)
+	{
+		//if calculated on a thread and no ladder area before it created a link from this area
+		if(!AAS_AreaLadder(i) && !areareachability[i])
+		{
+			areareachability[i] = threadreachability[i];
+			for(lreach = areareachability[i]; lreach; lreach = lreach->next)
+			{
+				(*lreach->count)++;
+			}					//end for
+			continue;
+		}						//end if
+		//calculate the area again on top of the links created by the ladder areas
+		for(lreach = threadreachability[i]; lreach; lreach = nextlreach)
+		{
+			nextlreach = lreach->next;
+			AAS_FreeReachability(lreach);
+		}						//end for
+		AAS_CalcAreaReachability(i);
+	}							//end for
+	FreeMemory(threadreachability);
+}								//end of the function AAS_ThreadAreaReachability
+#endif							//BSPC
+
 //===========================================================================
 //
 // TRAVEL_WALK                  100%    equal floor height + steps
@@ -4991,7 +5184,7 @@ void AAS_StoreReachability(void)
 //===========================================================================
 int AAS_ContinueInitReachability(float time)
 {
-	int             i, j, todo, start_time;
+	int             i, todo, start_time;
 	static float    framereachability, reachability_delay;
 	static int      lastpercentage;
 
@@ -5011,6 +5204,14 @@ int AAS_ContinueInitReachability(float time)
 		lastpercentage = 0;
 		framereachability = 2000;
 		reachability_delay = 1000;
+#ifdef BSPC
+		//calculate all areas at once on the bspc threads
+		if(numthreads > 1)
+		{
+			AAS_ThreadAreaReachability();
+			(*aasworld).reachabilityareas = (*aasworld).numareas;
+		}						//end if
+#endif							//BSPC
 	}							//end if
 	//number of areas to calculate reachability for this cycle
 	todo = (*aasworld).reachabilityareas + (int)framereachability;
@@ -5019,81 +5220,8 @@ int AAS_ContinueInitReachability(float time)
 	for(i = (*aasworld).reachabilityareas; i < (*aasworld).numareas && i < todo; i++)
 	{
 		(*aasworld).reachabilityareas++;
-		//only create jumppad reachabilities from jumppad areas
-		if((*aasworld).areasettings[i].contents & AREACONTENTS_JUMPPAD)
-		{
-			continue;
-		}						//end if
-		//loop over the areas
-		for(j = 1; j < (*aasworld).numareas; j++)
-		{
-			if(i == j)
-			{
-				continue;
-			}
-			//never create reachabilities from teleporter or jumppad areas to regular areas
-			if((*aasworld).areasettings[i].contents & (AREACONTENTS_TELEPORTER | AREACONTENTS_JUMPPAD))
-			{
-				if(!((*aasworld).areasettings[j].contents & (AREACONTENTS_TELEPORTER | AREACONTENTS_JUMPPAD)))
-				{
-					continue;
-				}				//end if
-			}					//end if
-			//if there already is a reachability link from area i to j
-			if(AAS_ReachabilityExists(i, j))
-			{
-				continue;
-			}
-			//check for a swim reachability
-			if(AAS_Reachability_Swim(i, j))
-			{
-				continue;
-			}
-			//check for a simple walk on equal floor height reachability
-			if(AAS_Reachability_EqualFloorHeight(i, j))
-			{
-				continue;
-			}
-			//check for step, barrier, waterjump and walk off ledge reachabilities
-			if(AAS_Reachability_Step_Barrier_WaterJump_WalkOffLedge(i, j))
-			{
-				continue;
-			}
-			//check for ladder reachabilities
-			if(AAS_Reachability_Ladder(i, j))
-			{
-				continue;
-			}
-			//check for a jump reachability
-			if(AAS_Reachability_Jump(i, j))
-			{
-				continue;
-			}
-		}						//end for
-		//never create these reachabilities from teleporter or jumppad areas
-		if((*aasworld).areasettings[i].contents & (AREACONTENTS_TELEPORTER | AREACONTENTS_JUMPPAD))
-		{
-			continue;
-		}						//end if
-		//loop over the areas
-		for(j = 1; j < (*aasworld).numareas; j++)
-		{
-			if(i == j)
-			{
-				continue;
-			}
-			//
-			if(AAS_ReachabilityExists(i, j))
-			{
-				continue;
-			}
-			//check for a grapple hook reachability
-// Ridah, no grapple
-//          AAS_Reachability_Grapple(i, j);
-			//check for a weapon jump reachability
-// Ridah, no weapon jumping
-//          AAS_Reachability_WeaponJump(i, j);
-		}						//end for
+		//calculate the reachabilities from this area
+		AAS_CalcAreaReachability(i);
 		//if the calculation took more time than the max reachability delay
 		if(Sys_MilliSeconds() - start_time > (int)reachability_delay)
 		{
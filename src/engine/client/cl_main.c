@@ -3776,6 +3776,7 @@ void CL_InitRef(void)
 	ri.CM_DrawDebugSurface = CM_DrawDebugSurface;
 	
 	ri.FS_ReadFile = FS_ReadFile;
+	ri.FS_ReadFileReadOnly = FS_ReadFileReadOnly;
 	ri.FS_FreeFile = FS_FreeFile;
 	ri.FS_WriteFile = FS_WriteFile;
 	ri.FS_FreeFileList = FS_FreeFileList;
@@ -200,7 +200,6 @@ void CL_Netchan_Transmit(netchan_t * chan, msg_t * msg)
 	Netchan_Transmit(chan, msg->cursize, msg->data);
 }
 
-extern int      oldsize;
 int             newsize = 0;
 
 /*
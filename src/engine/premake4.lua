@@ -281,6 +281,8 @@ project "ETXreaL"
 			"GL",
 			"dl",
 			"m",
+			"pthread",
+			"rt",
 		}
 		defines
 		{
@@ -453,6 +455,8 @@ project "ETXreaL-dedicated"
 		{
 			"dl",
 			"m",
+			"pthread",
+			"rt",
 		}
 		defines
 		{
@@ -52,19 +52,26 @@ void SetPlaneSignbits(cplane_t * out)
 #endif							//BSPC
 
 // to allow boxes to be treated as brush models, we allocate
-// some extra indexes along with those needed by the map
-#define BOX_LEAF_BRUSHES    1	// ydnar
-#define BOX_BRUSHES     1
-#define BOX_SIDES       6
+// some extra indexes along with those needed by the map,
+// one box for every thread
+#define BOX_LEAF_BRUSHES    ( 1 * CM_MAX_THREADS )	// ydnar
+#define BOX_BRUSHES     ( 1 * CM_MAX_THREADS )
+#define BOX_SIDES       ( SIDE_PADDING + BOX_SIDE_STRIDE * CM_MAX_THREADS )
 #define BOX_LEAFS       2
-#define BOX_PLANES      12
+#define BOX_PLANES      ( 12 * CM_MAX_THREADS )
+
+#define SIDE_PADDING    3		// extra SoA lanes so SSE loads never run off the end
+
+// the six sides of each thread's box are spaced out so SSE loads of one
+// thread's box never read lanes another thread is writing
+#define BOX_SIDE_STRIDE 8
+#define BOX_FIRST_SIDE( t ) ( cm.numBrushSides + SIDE_PADDING + ( t ) * BOX_SIDE_STRIDE )
 
 #define LL( x ) x = LittleLong( x )
 
 
 clipMap_t       cm;
-int             c_pointcontents;
-int             c_traces, c_brush_traces, c_patch_traces;
+cmThread_t      cmThreads[CM_MAX_THREADS];
 
 
 byte           *cmod_base;
@@ -76,10 +83,6 @@ cvar_t         *cm_playerCurveClip;
 cvar_t         *cm_optimize;
 #endif
 
-cmodel_t        box_model;
-cplane_t       *box_planes;
-cbrush_t       *box_brush;
-
 
 
 void            CM_InitBoxHull(void);
@@ -494,6 +497,22 @@ void CMod_LoadBrushSides(lump_t * l)
 		}
 		out->surfaceFlags = cm.shaders[out->shaderNum].surfaceFlags;
 	}
+
+#ifdef CM_SSE_BRUSHSIDES
+	for(i = 0; i < 3; i++)
+	{
+		cm.sideNormals[i] = Hunk_Alloc((BOX_SIDES + count + SIDE_PADDING) * sizeof(float), h_high);
+	}
+	cm.sideDists = Hunk_Alloc((BOX_SIDES + count + SIDE_PADDING) * sizeof(float), h_high);
+
+	for(i = 0, out = cm.brushsides; i < count; i++, out++)
+	{
+		cm.sideNormals[0][i] = out->plane->normal[0];
+		cm.sideNormals[1][i] = out->plane->normal[1];
+		cm.sideNormals[2][i] = out->plane->normal[2];
+		cm.sideDists[i] = out->plane->dist;
+	}
+#endif
 }
 
 
@@ -689,6 +708,7 @@ void CM_LoadMap(const char *name, qboolean clientload, int *checksum)
 
 	// free old stuff
 	memset(&cm, 0, sizeof(cm));
+	memset(cmThreads, 0, sizeof(cmThreads));
 	CM_ClearLevelPatches();
 
 	if(!name[0])
@@ -705,7 +725,8 @@ void CM_LoadMap(const char *name, qboolean clientload, int *checksum)
 	// load the file
 	//
 #ifndef BSPC
-	length = FS_ReadFile(name, (void **)&buf);
+	// only read from, so a stored bsp can come straight from the mapped pk3
+	length = FS_ReadFileReadOnly(name, (const void **)&buf);
 #else
 	length = LoadQuakeFile((quakefile_t *) name, (void **)&buf);
 #endif
@@ -767,6 +788,7 @@ CM_ClearMap
 void CM_ClearMap(void)
 {
 	Com_Memset(&cm, 0, sizeof(cm));
+	Com_Memset(cmThreads, 0, sizeof(cmThreads));
 	CM_ClearLevelPatches();
 }
 
@@ -776,10 +798,22 @@ CM_ClipHandleToModel
 ==================
 */
 cmodel_t       *CM_ClipHandleToModel(clipHandle_t handle)
+{
+	return CM_ClipHandleToThreadModel(handle, &cmThreads[0]);
+}
+
+/*
+==================
+CM_ClipHandleToThreadModel
+
+The temp box model handles resolve to the box of the given thread
+==================
+*/
+cmodel_t       *CM_ClipHandleToThreadModel(clipHandle_t handle, cmThread_t * thread)
 {
 	if(handle < 0)
 	{
-		Com_Error(ERR_DROP, "CM_ClipHandleToModel: bad handle %i", handle);
+		Com_Error(ERR_DROP, "CM_ClipHandleToThreadModel: bad handle %i", handle);
 	}
 	if(handle < cm.numSubModels)
 	{
@@ -787,13 +821,13 @@ cmodel_t       *CM_ClipHandleToModel(clipHandle_t handle)
 	}
 	if(handle == BOX_MODEL_HANDLE || handle == CAPSULE_MODEL_HANDLE)
 	{
-		return &box_model;
+		return &thread->boxModel;
 	}
 	if(handle < MAX_SUBMODELS)
 	{
-		Com_Error(ERR_DROP, "CM_ClipHandleToModel: bad handle %i < %i < %i", cm.numSubModels, handle, MAX_SUBMODELS);
+		Com_Error(ERR_DROP, "CM_ClipHandleToThreadModel: bad handle %i < %i < %i", cm.numSubModels, handle, MAX_SUBMODELS);
 	}
-	Com_Error(ERR_DROP, "CM_ClipHandleToModel: bad handle %i", handle + MAX_SUBMODELS);
+	Com_Error(ERR_DROP, "CM_ClipHandleToThreadModel: bad handle %i", handle + MAX_SUBMODELS);
 
 	return NULL;
 
@@ -849,56 +883,92 @@ int CM_LeafArea(int leafnum)
 //=======================================================================
 
 
+/*
+===================
+CM_GetThread
+===================
+*/
+cmThread_t     *CM_GetThread(int threadNum)
+{
+	if(threadNum < 0 || threadNum >= CM_MAX_THREADS)
+	{
+		Com_Error(ERR_FATAL, "CM_GetThread: bad threadNum %i", threadNum);
+	}
+	return &cmThreads[threadNum];
+}
+
 /*
 ===================
 CM_InitBoxHull
 
 Set up the planes and nodes so that the six floats of a bounding box
 can just be stored out and get a proper clipping hull structure.
+Every thread gets its own box and its own checkcounts.
 ===================
 */
 void CM_InitBoxHull(void)
 {
-	int             i;
+	int             i, t;
 	int             side;
+	int             firstSide;
 	cplane_t       *p;
 	cbrushside_t   *s;
+	cmThread_t     *thread;
 
-	box_planes = &cm.planes[cm.numPlanes];
-
-	box_brush = &cm.brushes[cm.numBrushes];
-	box_brush->numsides = 6;
-	box_brush->sides = cm.brushsides + cm.numBrushSides;
-	box_brush->contents = CONTENTS_BODY;
+	for(t = 0; t < CM_MAX_THREADS; t++)
+	{
+		thread = &cmThreads[t];
+		firstSide = BOX_FIRST_SIDE(t);
 
-	box_model.leaf.numLeafBrushes = 1;
-//  box_model.leaf.firstLeafBrush = cm.numBrushes;
-	box_model.leaf.firstLeafBrush = cm.numLeafBrushes;
-	cm.leafbrushes[cm.numLeafBrushes] = cm.numBrushes;
+		thread->brushChecks = Hunk_Alloc((BOX_BRUSHES + cm.numBrushes) * sizeof(*thread->brushChecks), h_high);
+		thread->surfaceChecks = Hunk_Alloc((cm.numSurfaces + 1) * sizeof(*thread->surfaceChecks), h_high);
+		thread->checkcount = 0;
 
-	for(i = 0; i < 6; i++)
-	{
-		side = i & 1;
+		thread->boxPlanes = &cm.planes[cm.numPlanes + t * 12];
 
-		// brush sides
-		s = &cm.brushsides[cm.numBrushSides + i];
-		s->plane = cm.planes + (cm.numPlanes + i * 2 + side);
-		s->surfaceFlags = 0;
+		thread->boxBrush = &cm.brushes[cm.numBrushes + t];
+		thread->boxBrush->numsides = 6;
+		thread->boxBrush->sides = cm.brushsides + firstSide;
+		thread->boxBrush->contents = CONTENTS_BODY;
 
-		// planes
-		p = &box_planes[i * 2];
-		p->type = i >> 1;
-		p->signbits = 0;
-		VectorClear(p->normal);
-		p->normal[i >> 1] = 1;
+		thread->boxModel.leaf.numLeafBrushes = 1;
+		thread->boxModel.leaf.firstLeafBrush = cm.numLeafBrushes + t;
+		cm.leafbrushes[cm.numLeafBrushes + t] = cm.numBrushes + t;
 
-		p = &box_planes[i * 2 + 1];
-		p->type = 3 + (i >> 1);
-		p->signbits = 0;
-		VectorClear(p->normal);
-		p->normal[i >> 1] = -1;
+		for(i = 0; i < 6; i++)
+		{
+			side = i & 1;
+
+			// brush sides
+			s = &cm.brushsides[firstSide + i];
+			s->plane = thread->boxPlanes + (i * 2 + side);
+			s->surfaceFlags = 0;
+
+			// planes
+			p = &thread->boxPlanes[i * 2];
+			p->type = i >> 1;
+			p->signbits = 0;
+			VectorClear(p->normal);
+			p->normal[i >> 1] = 1;
+
+			p = &thread->boxPlanes[i * 2 + 1];
+			p->type = 3 + (i >> 1);
+			p->signbits = 0;
+			VectorClear(p->normal);
+			p->normal[i >> 1] = -1;
+
+			SetPlaneSignbits(p);
+		}
 
-		SetPlaneSignbits(p);
+#ifdef CM_SSE_BRUSHSIDES
+		for(i = 0; i < 6; i++)
+		{
+			s = &cm.brushsides[firstSide + i];
+			cm.sideNormals[0][firstSide + i] = s->plane->normal[0];
+			cm.sideNormals[1][firstSide + i] = s->plane->normal[1];
+			cm.sideNormals[2][firstSide + i] = s->plane->normal[2];
+		}
+#endif
 	}
 }
 
@@ -913,15 +983,33 @@ Capsules are handled differently though.
 */
 clipHandle_t CM_TempBoxModel(const vec3_t mins, const vec3_t maxs, int capsule)
 {
+	return CM_TempBoxModelForThread(0, mins, maxs, capsule);
+}
 
-	VectorCopy(mins, box_model.mins);
-	VectorCopy(maxs, box_model.maxs);
+/*
+===================
+CM_TempBoxModelForThread
 
-	if(capsule)
-	{
-		return CAPSULE_MODEL_HANDLE;
-	}
+The returned handle is only valid for queries by the same thread
+===================
+*/
+clipHandle_t CM_TempBoxModelForThread(int threadNum, const vec3_t mins, const vec3_t maxs, int capsule)
+{
+	cmThread_t     *thread;
+	cplane_t       *box_planes;
+#ifdef CM_SSE_BRUSHSIDES
+	int             i;
+	int             firstSide;
+#endif
+
+	thread = CM_GetThread(threadNum);
 
+	VectorCopy(mins, thread->boxModel.mins);
+	VectorCopy(maxs, thread->boxModel.maxs);
+
+	// the box is set up for capsules too, with ALWAYS_BBOX_VS_BBOX they are
+	// clipped as this box and must not get the one of an earlier query
+	box_planes = thread->boxPlanes;
 	box_planes[0].dist = maxs[0];
 	box_planes[1].dist = -maxs[0];
 	box_planes[2].dist = mins[0];
@@ -935,17 +1023,35 @@ clipHandle_t CM_TempBoxModel(const vec3_t mins, const vec3_t maxs, int capsule)
 	box_planes[10].dist = mins[2];
 	box_planes[11].dist = -mins[2];
 
-	VectorCopy(mins, box_brush->bounds[0]);
-	VectorCopy(maxs, box_brush->bounds[1]);
+#ifdef CM_SSE_BRUSHSIDES
+	firstSide = thread->boxBrush->sides - cm.brushsides;
+	for(i = 0; i < 6; i++)
+	{
+		cm.sideDists[firstSide + i] = thread->boxBrush->sides[i].plane->dist;
+	}
+#endif
+
+	VectorCopy(mins, thread->boxBrush->bounds[0]);
+	VectorCopy(maxs, thread->boxBrush->bounds[1]);
+
+	if(capsule)
+	{
+		return CAPSULE_MODEL_HANDLE;
+	}
 
 	return BOX_MODEL_HANDLE;
 }
 
 // DHM - Nerve
 void CM_SetTempBoxModelContents(int contents)
+{
+	CM_SetTempBoxModelContentsForThread(0, contents);
+}
+
+void CM_SetTempBoxModelContentsForThread(int threadNum, int contents)
 {
 
-	box_brush->contents = contents;
+	CM_GetThread(threadNum)->boxBrush->contents = contents;
 }
 
 // dhm
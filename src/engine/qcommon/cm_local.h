@@ -43,6 +43,13 @@ If you have questions concerning this license or the applicable additional terms
 // enable to make the collision detection a bunch faster
 #define MRE_OPTIMIZE
 
+// test four brush sides at a time with SSE, only where the scalar float
+// math is SSE too so both paths round exactly the same way
+#if !defined(C_ONLY) && (defined(__SSE_MATH__) || defined(_M_X64)) && !defined(__FMA__)
+#define CM_SSE_BRUSHSIDES
+#include <xmmintrin.h>
+#endif
+
 typedef struct
 {
 	cplane_t       *plane;
@@ -81,13 +88,11 @@ typedef struct
 	vec3_t          bounds[2];
 	int             numsides;
 	cbrushside_t   *sides;
-	int             checkcount;	// to avoid repeated testings
 } cbrush_t;
 
 
 typedef struct
 {
-	int             checkcount;	// to avoid repeated testings
 	int             surfaceFlags;
 	int             contents;
 	struct patchCollide_s *pc;
@@ -109,6 +114,12 @@ typedef struct
 
 	int             numBrushSides;
 	cbrushside_t   *brushsides;
+#ifdef CM_SSE_BRUSHSIDES
+	// structure of arrays copy of the brush side planes, indexed like
+	// brushsides and padded so four sides can always be loaded at once
+	float          *sideNormals[3];
+	float          *sideDists;
+#endif
 
 	int             numPlanes;
 	cplane_t       *planes;
@@ -147,17 +158,38 @@ typedef struct
 	cPatch_t      **surfaces;	// non-patches will be NULL
 
 	int             floodvalid;
-	int             checkcount;	// incremented on each trace
 } clipMap_t;
 
+// Everything a query writes lives in here instead of in cm, so each
+// job thread can trace through the same map at the same time.
+// Thread 0 is the main thread and the one the plain calls use.
+#define CM_MAX_THREADS          ( MAX_JOB_THREADS + 1 )
+
+typedef struct
+{
+	int             checkcount;	// incremented on each query
+	int            *brushChecks;	// [numBrushes + CM_MAX_THREADS], checkcount of the last query that tested the brush
+	int            *surfaceChecks;	// [numSurfaces], same for the patches
+
+	// each thread has its own temp box model
+	cmodel_t        boxModel;
+	cplane_t       *boxPlanes;
+	cbrush_t       *boxBrush;
+
+	// statistics, may be zeroed
+	int             c_traces, c_brush_traces, c_patch_traces;
+	int             c_pointcontents;
+
+	byte            pad[64];	// keep the counters of different threads off the same cache line
+} cmThread_t;
+
 
 // keep 1/8 unit away to keep the position valid before network snapping
 // and to avoid various numeric issues
 #define SURFACE_CLIP_EPSILON    ( 0.125 )
 
 extern clipMap_t cm;
-extern int      c_pointcontents;
-extern int      c_traces, c_brush_traces, c_patch_traces;
+extern cmThread_t cmThreads[CM_MAX_THREADS];
 extern cvar_t  *cm_noAreas;
 extern cvar_t  *cm_noCurves;
 extern cvar_t  *cm_playerCurveClip;
@@ -176,6 +208,7 @@ typedef struct
 
 typedef struct
 {
+	cmThread_t     *thread;		// the thread doing the trace
 	vec3_t          start;
 	vec3_t          end;
 	vec3_t          size[2];	// size of the box being swept through the model
@@ -205,6 +238,7 @@ typedef struct leafList_s
 	int            *list;
 	vec3_t          bounds[2];
 	int             lastLeaf;	// for overflows where each leaf can't be stored individually
+	cmThread_t     *thread;		// for the brush checkcounts of CM_StoreBrushes
 	void            (*storeLeafs) (struct leafList_s * ll, int nodenum);
 } leafList_t;
 
@@ -217,6 +251,8 @@ void            CM_StoreBrushes(leafList_t * ll, int nodenum);
 void            CM_BoxLeafnums_r(leafList_t * ll, int nodenum);
 
 cmodel_t       *CM_ClipHandleToModel(clipHandle_t handle);
+cmodel_t       *CM_ClipHandleToThreadModel(clipHandle_t handle, cmThread_t * thread);
+cmThread_t     *CM_GetThread(int threadNum);
 
 // cm_patch.c
 
@@ -1675,14 +1675,18 @@ void CM_TracePointThroughPatchCollide(traceWork_t * tw, const struct patchCollid
 		{
 			// we hit this facet
 #ifndef BSPC
-			if(!cv)
+			// only the main thread feeds the debug surface
+			if(tw->thread == cmThreads)
 			{
-				cv = Cvar_Get("r_debugSurfaceUpdate", "1", 0);
-			}
-			if(cv->integer)
-			{
-				debugPatchCollide = pc;
-				debugFacet = facet;
+				if(!cv)
+				{
+					cv = Cvar_Get("r_debugSurfaceUpdate", "1", 0);
+				}
+				if(cv->integer)
+				{
+					debugPatchCollide = pc;
+					debugFacet = facet;
+				}
 			}
 #endif							//BSPC
 			planes = &pc->planes[facet->surfacePlane];
@@ -1910,14 +1914,18 @@ void CM_TraceThroughPatchCollide(traceWork_t * tw, const struct patchCollide_s *
 					enterFrac = 0;
 				}
 #ifndef BSPC
-				if(!cv)
+				// only the main thread feeds the debug surface
+				if(tw->thread == cmThreads)
 				{
-					cv = Cvar_Get("r_debugSurfaceUpdate", "1", 0);
-				}
-				if(cv && cv->integer)
-				{
-					debugPatchCollide = pc;
-					debugFacet = facet;
+					if(!cv)
+					{
+						cv = Cvar_Get("r_debugSurfaceUpdate", "1", 0);
+					}
+					if(cv && cv->integer)
+					{
+						debugPatchCollide = pc;
+						debugFacet = facet;
+					}
 				}
 #endif							//BSPC
 
@@ -71,6 +71,27 @@ qboolean        CM_AreasConnected(int area1, int area2);
 
 int             CM_WriteAreaBits(byte * buffer, int area);
 
+// The ForThread variants keep all their working state per thread, so job
+// threads can run them concurrently as long as each passes the threadNum
+// its jobFunc_t was called with.  The plain calls above are thread 0.
+// A temp box model handle is only valid for the thread that made it.
+int             CM_PointLeafnumForThread(int threadNum, const vec3_t p);
+clipHandle_t    CM_TempBoxModelForThread(int threadNum, const vec3_t mins, const vec3_t maxs, int capsule);
+void            CM_SetTempBoxModelContentsForThread(int threadNum, int contents);
+int             CM_PointContentsForThread(int threadNum, const vec3_t p, clipHandle_t model);
+int             CM_TransformedPointContentsForThread(int threadNum, const vec3_t p, clipHandle_t model, const vec3_t origin,
+													 const vec3_t angles);
+void            CM_BoxTraceForThread(int threadNum, trace_t * results, const vec3_t start, const vec3_t end,
+									 const vec3_t mins, const vec3_t maxs, clipHandle_t model, int brushmask, int capsule);
+void            CM_TransformedBoxTraceForThread(int threadNum, trace_t * results, const vec3_t start, const vec3_t end,
+												const vec3_t mins, const vec3_t maxs,
+												clipHandle_t model, int brushmask, const vec3_t origin, const vec3_t angles,
+												int capsule);
+
+// sums the com_showtrace counters of all threads and zeroes them
+void            CM_TakeTraceCounts(int *traces, int *brushTraces, int *patchTraces, int *pointContents);
+void            CM_ThreadTest_f(void);
+
 // cm_tag.c
 int             CM_LerpTag(orientation_t * tag, const refEntity_t * refent, const char *tagName, int startIndex);
 
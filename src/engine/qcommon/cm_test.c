@@ -64,17 +64,26 @@ int CM_PointLeafnum_r(const vec3_t p, int num)
 		}
 	}
 
-	c_pointcontents++;			// optimize counter
-
 	return -1 - num;
 }
 
 int CM_PointLeafnum(const vec3_t p)
+{
+	return CM_PointLeafnumForThread(0, p);
+}
+
+/*
+==================
+CM_PointLeafnumForThread
+==================
+*/
+int CM_PointLeafnumForThread(int threadNum, const vec3_t p)
 {
 	if(!cm.numNodes)
 	{							// map not loaded
 		return 0;
 	}
+	CM_GetThread(threadNum)->c_pointcontents++;	// optimize counter
 	return CM_PointLeafnum_r(p, 0);
 }
 
@@ -124,11 +133,11 @@ void CM_StoreBrushes(leafList_t * ll, int nodenum)
 	{
 		brushnum = cm.leafbrushes[leaf->firstLeafBrush + k];
 		b = &cm.brushes[brushnum];
-		if(b->checkcount == cm.checkcount)
+		if(ll->thread->brushChecks[brushnum] == ll->thread->checkcount)
 		{
 			continue;			// already checked this brush in another leaf
 		}
-		b->checkcount = cm.checkcount;
+		ll->thread->brushChecks[brushnum] = ll->thread->checkcount;
 		for(i = 0; i < 3; i++)
 		{
 			if(b->bounds[0][i] >= ll->bounds[1][i] || b->bounds[1][i] <= ll->bounds[0][i])
@@ -211,8 +220,6 @@ int CM_BoxLeafnums(const vec3_t mins, const vec3_t maxs, int *list, int listsize
 {
 	leafList_t      ll;
 
-	cm.checkcount++;
-
 	VectorCopy(mins, ll.bounds[0]);
 	VectorCopy(maxs, ll.bounds[1]);
 	ll.count = 0;
@@ -221,6 +228,7 @@ int CM_BoxLeafnums(const vec3_t mins, const vec3_t maxs, int *list, int listsize
 	ll.storeLeafs = CM_StoreLeafs;
 	ll.lastLeaf = 0;
 	ll.overflowed = qfalse;
+	ll.thread = NULL;
 
 	CM_BoxLeafnums_r(&ll, 0);
 
@@ -237,8 +245,6 @@ int CM_BoxBrushes(const vec3_t mins, const vec3_t maxs, cbrush_t ** list, int li
 {
 	leafList_t      ll;
 
-	cm.checkcount++;
-
 	VectorCopy(mins, ll.bounds[0]);
 	VectorCopy(maxs, ll.bounds[1]);
 	ll.count = 0;
@@ -247,6 +253,8 @@ int CM_BoxBrushes(const vec3_t mins, const vec3_t maxs, cbrush_t ** list, int li
 	ll.storeLeafs = CM_StoreBrushes;
 	ll.lastLeaf = 0;
 	ll.overflowed = qfalse;
+	ll.thread = &cmThreads[0];
+	ll.thread->checkcount++;
 
 	CM_BoxLeafnums_r(&ll, 0);
 
@@ -265,6 +273,17 @@ CM_PointContents
 */
 int CM_PointContents(const vec3_t p, clipHandle_t model)
 {
+	return CM_PointContentsForThread(0, p, model);
+}
+
+/*
+==================
+CM_PointContentsForThread
+==================
+*/
+int CM_PointContentsForThread(int threadNum, const vec3_t p, clipHandle_t model)
+{
+	cmThread_t     *thread;
 	int             leafnum;
 	int             i, k;
 	int             brushnum;
@@ -279,13 +298,16 @@ int CM_PointContents(const vec3_t p, clipHandle_t model)
 		return 0;
 	}
 
+	thread = CM_GetThread(threadNum);
+
 	if(model)
 	{
-		clipm = CM_ClipHandleToModel(model);
+		clipm = CM_ClipHandleToThreadModel(model, thread);
 		leaf = &clipm->leaf;
 	}
 	else
 	{
+		thread->c_pointcontents++;	// optimize counter
 		leafnum = CM_PointLeafnum_r(p, 0);
 		leaf = &cm.leafs[leafnum];
 	}
@@ -342,6 +364,17 @@ rotating entities
 ==================
 */
 int CM_TransformedPointContents(const vec3_t p, clipHandle_t model, const vec3_t origin, const vec3_t angles)
+{
+	return CM_TransformedPointContentsForThread(0, p, model, origin, angles);
+}
+
+/*
+==================
+CM_TransformedPointContentsForThread
+==================
+*/
+int CM_TransformedPointContentsForThread(int threadNum, const vec3_t p, clipHandle_t model, const vec3_t origin,
+										 const vec3_t angles)
 {
 	vec3_t          p_l;
 	vec3_t          temp;
@@ -361,7 +394,7 @@ int CM_TransformedPointContents(const vec3_t p, clipHandle_t model, const vec3_t
 		p_l[2] = DotProduct(temp, up);
 	}
 
-	return CM_PointContents(p_l, model);
+	return CM_PointContentsForThread(threadNum, p_l, model);
 }
 
 
@@ -609,4 +642,255 @@ qboolean CM_BoundsIntersectPoint(const vec3_t mins, const vec3_t maxs, const vec
 	return qtrue;
 }
 
-// XreaL END
\ No newline at end of file
+// XreaL END
+
+/*
+===============================================================================
+
+THREAD TEST
+
+===============================================================================
+*/
+
+#ifndef BSPC
+
+#define CM_TEST_JOBS    64
+#define CM_TEST_MASK    ( CONTENTS_SOLID | CONTENTS_BODY | CONTENTS_PLAYERCLIP )
+
+typedef struct
+{
+	int             type;
+	vec3_t          start, end;
+	vec3_t          mins, maxs;
+	vec3_t          origin, angles;
+	vec3_t          boxMins, boxMaxs;
+	clipHandle_t    model;
+	int             capsule;
+} cmTestQuery_t;
+
+typedef struct
+{
+	cmTestQuery_t  *queries;
+	trace_t        *traces;
+	int            *contents;
+	int             numQueries;
+} cmTest_t;
+
+/*
+==================
+CM_RunTestQuery
+==================
+*/
+static void CM_RunTestQuery(int threadNum, const cmTestQuery_t * q, trace_t * trace, int *contents)
+{
+	clipHandle_t    h;
+
+	switch (q->type)
+	{
+		case 0:
+			// through the world
+			CM_BoxTraceForThread(threadNum, trace, q->start, q->end, q->mins, q->maxs, 0, CM_TEST_MASK, q->capsule);
+			*contents = CM_PointContentsForThread(threadNum, q->start, 0);
+			break;
+
+		case 1:
+			// against an entity box, the way SV_ClipMoveToEntities does it
+			h = CM_TempBoxModelForThread(threadNum, q->boxMins, q->boxMaxs, q->capsule);
+			CM_TransformedBoxTraceForThread(threadNum, trace, q->start, q->end, q->mins, q->maxs, h, CM_TEST_MASK,
+											q->origin, vec3_origin, q->capsule);
+			*contents = CM_TransformedPointContentsForThread(threadNum, q->end, h, q->origin, vec3_origin);
+			break;
+
+		default:
+			// against a rotated inline model
+			CM_TransformedBoxTraceForThread(threadNum, trace, q->start, q->end, q->mins, q->maxs, q->model, CM_TEST_MASK,
+											q->origin, q->angles, q->capsule);
+			*contents = CM_TransformedPointContentsForThread(threadNum, q->end, q->model, q->origin, q->angles);
+			break;
+	}
+}
+
+/*
+==================
+CM_ThreadTestJob
+==================
+*/
+static void CM_ThreadTestJob(void *data, int jobNum, int threadNum)
+{
+	cmTest_t       *test = data;
+	int             i, first, last;
+
+	first = test->numQueries * jobNum / CM_TEST_JOBS;
+	last = test->numQueries * (jobNum + 1) / CM_TEST_JOBS;
+
+	for(i = first; i < last; i++)
+	{
+		CM_RunTestQuery(threadNum, &test->queries[i], &test->traces[i], &test->contents[i]);
+	}
+}
+
+/*
+==================
+CM_TracesEqual
+==================
+*/
+static qboolean CM_TracesEqual(const trace_t * a, const trace_t * b)
+{
+	return a->allsolid == b->allsolid && a->startsolid == b->startsolid && a->fraction == b->fraction
+		&& VectorCompare(a->endpos, b->endpos) && VectorCompare(a->plane.normal, b->plane.normal)
+		&& a->plane.dist == b->plane.dist && a->surfaceFlags == b->surfaceFlags && a->contents == b->contents;
+}
+
+/*
+==================
+CM_ThreadTest_f
+
+Runs the same random traces once on the main thread and once spread
+over the job threads and reports any result that differs.
+==================
+*/
+void CM_ThreadTest_f(void)
+{
+	cmTest_t        test;
+	cmTestQuery_t  *q;
+	trace_t        *serialTraces;
+	int            *serialContents;
+	trace_t         trace;
+	int             contents;
+	int             i, j, seed;
+	int             startedThreads, numThreads;
+	int             serialTime, threadedTime, start;
+	int             mismatches;
+	float           size;
+	vec3_t          worldMins, worldMaxs;
+
+	if(!cm.numNodes)
+	{
+		Com_Printf("cm_threadtest: no map loaded\n");
+		return;
+	}
+
+	test.numQueries = 20000;
+	if(Cmd_Argc() > 1)
+	{
+		test.numQueries = atoi(Cmd_Argv(1));
+		if(test.numQueries < 1)
+		{
+			test.numQueries = 1;
+		}
+	}
+
+	startedThreads = 0;
+	numThreads = Sys_NumJobThreads();
+	if(!numThreads)
+	{
+		numThreads = startedThreads = Sys_InitJobThreads(4);
+		if(!numThreads)
+		{
+			Com_Printf("cm_threadtest: couldn't start any job threads\n");
+			return;
+		}
+	}
+
+	test.queries = Z_Malloc(test.numQueries * sizeof(*test.queries));
+	test.traces = Z_Malloc(test.numQueries * sizeof(*test.traces));
+	test.contents = Z_Malloc(test.numQueries * sizeof(*test.contents));
+
+	VectorCopy(cm.cmodels[0].mins, worldMins);
+	VectorCopy(cm.cmodels[0].maxs, worldMaxs);
+
+	seed = 0x1234;
+	for(i = 0, q = test.queries; i < test.numQueries; i++, q++)
+	{
+		q->type = Q_rand(&seed) % (cm.numSubModels > 1 ? 3 : 2);
+		q->capsule = Q_rand(&seed) & 1;
+
+		for(j = 0; j < 3; j++)
+		{
+			q->start[j] = worldMins[j] + Q_random(&seed) * (worldMaxs[j] - worldMins[j]);
+			q->end[j] = q->start[j] + Q_crandom(&seed) * 512;
+		}
+
+		if(Q_rand(&seed) & 3)
+		{
+			size = 4 + Q_random(&seed) * 28;
+			VectorSet(q->mins, -size, -size, -size);
+			VectorSet(q->maxs, size, size, size + Q_random(&seed) * 24);
+		}
+		else
+		{
+			VectorClear(q->mins);
+			VectorClear(q->maxs);
+		}
+
+		// entity boxes sit somewhere along the trace
+		size = 8 + Q_random(&seed) * 56;
+		VectorSet(q->boxMins, -size, -size, -size);
+		VectorSet(q->boxMaxs, size, size, size);
+		VectorLerp(q->start, q->end, Q_random(&seed), q->origin);
+
+		q->model = 1 + Q_rand(&seed) % (cm.numSubModels > 1 ? cm.numSubModels - 1 : 1);
+		VectorSet(q->angles, Q_random(&seed) * 360, Q_random(&seed) * 360, 0);
+		if(q->type == 2)
+		{
+			VectorClear(q->origin);
+		}
+	}
+
+	start = Sys_Milliseconds();
+	for(i = 0; i < CM_TEST_JOBS; i++)
+	{
+		CM_ThreadTestJob(&test, i, 0);
+	}
+	serialTime = Sys_Milliseconds() - start;
+
+	// keep the serial results and run everything again concurrently
+	serialTraces = test.traces;
+	serialContents = test.contents;
+	test.traces = Z_Malloc(test.numQueries * sizeof(*test.traces));
+	test.contents = Z_Malloc(test.numQueries * sizeof(*test.contents));
+
+	start = Sys_Milliseconds();
+	Sys_RunJobs(CM_ThreadTestJob, &test, CM_TEST_JOBS);
+	threadedTime = Sys_Milliseconds() - start;
+
+	mismatches = 0;
+	for(i = 0; i < test.numQueries; i++)
+	{
+		if(!CM_TracesEqual(&serialTraces[i], &test.traces[i]) || serialContents[i] != test.contents[i])
+		{
+			if(mismatches < 8)
+			{
+				Com_Printf("query %i (type %i): fraction %f/%f contents %i/%i\n", i, test.queries[i].type,
+						   serialTraces[i].fraction, test.traces[i].fraction, serialContents[i], test.contents[i]);
+			}
+			mismatches++;
+		}
+	}
+
+	// and serially once more, to be sure the threads left nothing behind
+	for(i = 0; i < test.numQueries; i++)
+	{
+		CM_RunTestQuery(0, &test.queries[i], &trace, &contents);
+		if(!CM_TracesEqual(&serialTraces[i], &trace) || serialContents[i] != contents)
+		{
+			mismatches++;
+		}
+	}
+
+	Com_Printf("%i queries on %i threads: serial %i msec, threaded %i msec, %i mismatches\n",
+			   test.numQueries, numThreads + 1, serialTime, threadedTime, mismatches);
+
+	Z_Free(test.queries);
+	Z_Free(test.traces);
+	Z_Free(test.contents);
+	Z_Free(serialTraces);
+	Z_Free(serialContents);
+
+	if(startedThreads)
+	{
+		Sys_ShutdownJobThreads();
+	}
+}
+
+#endif							// !BSPC
@@ -208,6 +208,92 @@ POSITION TESTING
 ===============================================================================
 */
 
+#ifdef CM_SSE_BRUSHSIDES
+/*
+================
+CM_BoxSideDistances
+
+Evaluates the scalar brush side distances of the box trace for
+four consecutive brush sides starting at firstSide.  Every lane does
+the same float operations in the same order as the scalar code, so
+the results are bit-identical.
+================
+*/
+static ID_INLINE void CM_BoxSideDistances(const traceWork_t * tw, int firstSide, float *d1, float *d2)
+{
+	__m128          nx, ny, nz, neg;
+	__m128          ox, oy, oz;
+	__m128          dist;
+
+	nx = _mm_loadu_ps(cm.sideNormals[0] + firstSide);
+	ny = _mm_loadu_ps(cm.sideNormals[1] + firstSide);
+	nz = _mm_loadu_ps(cm.sideNormals[2] + firstSide);
+
+	// pick the corner tw->offsets[plane->signbits] would give
+	neg = _mm_cmplt_ps(nx, _mm_setzero_ps());
+	ox = _mm_or_ps(_mm_and_ps(neg, _mm_set1_ps(tw->size[1][0])), _mm_andnot_ps(neg, _mm_set1_ps(tw->size[0][0])));
+	neg = _mm_cmplt_ps(ny, _mm_setzero_ps());
+	oy = _mm_or_ps(_mm_and_ps(neg, _mm_set1_ps(tw->size[1][1])), _mm_andnot_ps(neg, _mm_set1_ps(tw->size[0][1])));
+	neg = _mm_cmplt_ps(nz, _mm_setzero_ps());
+	oz = _mm_or_ps(_mm_and_ps(neg, _mm_set1_ps(tw->size[1][2])), _mm_andnot_ps(neg, _mm_set1_ps(tw->size[0][2])));
+
+	// adjust the plane distance apropriately for mins/maxs
+	dist = _mm_add_ps(_mm_add_ps(_mm_mul_ps(ox, nx), _mm_mul_ps(oy, ny)), _mm_mul_ps(oz, nz));
+	dist = _mm_sub_ps(_mm_loadu_ps(cm.sideDists + firstSide), dist);
+
+	_mm_storeu_ps(d1, _mm_sub_ps(_mm_add_ps(_mm_add_ps(_mm_mul_ps(_mm_set1_ps(tw->start[0]), nx),
+														  _mm_mul_ps(_mm_set1_ps(tw->start[1]), ny)),
+											   _mm_mul_ps(_mm_set1_ps(tw->start[2]), nz)), dist));
+	_mm_storeu_ps(d2, _mm_sub_ps(_mm_add_ps(_mm_add_ps(_mm_mul_ps(_mm_set1_ps(tw->end[0]), nx),
+														  _mm_mul_ps(_mm_set1_ps(tw->end[1]), ny)),
+											   _mm_mul_ps(_mm_set1_ps(tw->end[2]), nz)), dist));
+}
+
+/*
+================
+CM_SphereSideDistances
+
+Same as CM_BoxSideDistances for a capsule trace.
+================
+*/
+static ID_INLINE void CM_SphereSideDistances(const traceWork_t * tw, int firstSide, float *d1, float *d2)
+{
+	__m128          nx, ny, nz, front;
+	__m128          px, py, pz;
+	__m128          dist;
+	vec3_t          startMinus, startPlus;
+	vec3_t          endMinus, endPlus;
+
+	VectorSubtract(tw->start, tw->sphere.offset, startMinus);
+	VectorAdd(tw->start, tw->sphere.offset, startPlus);
+	VectorSubtract(tw->end, tw->sphere.offset, endMinus);
+	VectorAdd(tw->end, tw->sphere.offset, endPlus);
+
+	nx = _mm_loadu_ps(cm.sideNormals[0] + firstSide);
+	ny = _mm_loadu_ps(cm.sideNormals[1] + firstSide);
+	nz = _mm_loadu_ps(cm.sideNormals[2] + firstSide);
+
+	// adjust the plane distance apropriately for radius
+	dist = _mm_add_ps(_mm_loadu_ps(cm.sideDists + firstSide), _mm_set1_ps(tw->sphere.radius));
+
+	// find the closest point on the capsule to the plane
+	front = _mm_add_ps(_mm_add_ps(_mm_mul_ps(nx, _mm_set1_ps(tw->sphere.offset[0])),
+								  _mm_mul_ps(ny, _mm_set1_ps(tw->sphere.offset[1]))),
+					   _mm_mul_ps(nz, _mm_set1_ps(tw->sphere.offset[2])));
+	front = _mm_cmpgt_ps(front, _mm_setzero_ps());
+
+	px = _mm_or_ps(_mm_and_ps(front, _mm_set1_ps(startMinus[0])), _mm_andnot_ps(front, _mm_set1_ps(startPlus[0])));
+	py = _mm_or_ps(_mm_and_ps(front, _mm_set1_ps(startMinus[1])), _mm_andnot_ps(front, _mm_set1_ps(startPlus[1])));
+	pz = _mm_or_ps(_mm_and_ps(front, _mm_set1_ps(startMinus[2])), _mm_andnot_ps(front, _mm_set1_ps(startPlus[2])));
+	_mm_storeu_ps(d1, _mm_sub_ps(_mm_add_ps(_mm_add_ps(_mm_mul_ps(px, nx), _mm_mul_ps(py, ny)), _mm_mul_ps(pz, nz)), dist));
+
+	px = _mm_or_ps(_mm_and_ps(front, _mm_set1_ps(endMinus[0])), _mm_andnot_ps(front, _mm_set1_ps(endPlus[0])));
+	py = _mm_or_ps(_mm_and_ps(front, _mm_set1_ps(endMinus[1])), _mm_andnot_ps(front, _mm_set1_ps(endPlus[1])));
+	pz = _mm_or_ps(_mm_and_ps(front, _mm_set1_ps(endMinus[2])), _mm_andnot_ps(front, _mm_set1_ps(endPlus[2])));
+	_mm_storeu_ps(d2, _mm_sub_ps(_mm_add_ps(_mm_add_ps(_mm_mul_ps(px, nx), _mm_mul_ps(py, ny)), _mm_mul_ps(pz, nz)), dist));
+}
+#endif
+
 /*
 ================
 CM_TestBoxInBrush
@@ -216,12 +302,17 @@ CM_TestBoxInBrush
 void CM_TestBoxInBrush(traceWork_t * tw, cbrush_t * brush)
 {
 	int             i;
+	float           d1;
+#ifdef CM_SSE_BRUSHSIDES
+	int             firstSide;
+	float           d1s[4], d2s[4];
+#else
 	cplane_t       *plane;
 	float           dist;
-	float           d1;
 	cbrushside_t   *side;
 	float           t;
 	vec3_t          startp;
+#endif
 
 	if(!brush->numsides)
 	{
@@ -239,12 +330,23 @@ void CM_TestBoxInBrush(traceWork_t * tw, cbrush_t * brush)
 		return;
 	}
 
+#ifdef CM_SSE_BRUSHSIDES
+	firstSide = brush->sides - cm.brushsides;
+#endif
+
 	if(tw->sphere.use)
 	{
 		// the first six planes are the axial planes, so we only
 		// need to test the remainder
 		for(i = 6; i < brush->numsides; i++)
 		{
+#ifdef CM_SSE_BRUSHSIDES
+			if(!((i - 6) & 3))
+			{
+				CM_SphereSideDistances(tw, firstSide + i, d1s, d2s);
+			}
+			d1 = d1s[(i - 6) & 3];
+#else
 			side = brush->sides + i;
 			plane = side->plane;
 
@@ -261,6 +363,7 @@ void CM_TestBoxInBrush(traceWork_t * tw, cbrush_t * brush)
 				VectorAdd(tw->start, tw->sphere.offset, startp);
 			}
 			d1 = DotProduct(startp, plane->normal) - dist;
+#endif
 			// if completely in front of face, no intersection
 			if(d1 > 0)
 			{
@@ -274,6 +377,13 @@ void CM_TestBoxInBrush(traceWork_t * tw, cbrush_t * brush)
 		// need to test the remainder
 		for(i = 6; i < brush->numsides; i++)
 		{
+#ifdef CM_SSE_BRUSHSIDES
+			if(!((i - 6) & 3))
+			{
+				CM_BoxSideDistances(tw, firstSide + i, d1s, d2s);
+			}
+			d1 = d1s[(i - 6) & 3];
+#else
 			side = brush->sides + i;
 			plane = side->plane;
 
@@ -281,6 +391,7 @@ void CM_TestBoxInBrush(traceWork_t * tw, cbrush_t * brush)
 			dist = plane->dist - DotProduct(tw->offsets[plane->signbits], plane->normal);
 
 			d1 = DotProduct(tw->start, plane->normal) - dist;
+#endif
 
 			// if completely in front of face, no intersection
 			if(d1 > 0)
@@ -307,6 +418,7 @@ void CM_TestInLeaf(traceWork_t * tw, cLeaf_t * leaf)
 {
 	int             k;
 	int             brushnum;
+	int             surfacenum;
 	cbrush_t       *b;
 	cPatch_t       *patch;
 
@@ -315,11 +427,11 @@ void CM_TestInLeaf(traceWork_t * tw, cLeaf_t * leaf)
 	{
 		brushnum = cm.leafbrushes[leaf->firstLeafBrush + k];
 		b = &cm.brushes[brushnum];
-		if(b->checkcount == cm.checkcount)
+		if(tw->thread->brushChecks[brushnum] == tw->thread->checkcount)
 		{
 			continue;			// already checked this brush in another leaf
 		}
-		b->checkcount = cm.checkcount;
+		tw->thread->brushChecks[brushnum] = tw->thread->checkcount;
 
 		if(!(b->contents & tw->contents))
 		{
@@ -343,16 +455,17 @@ void CM_TestInLeaf(traceWork_t * tw, cLeaf_t * leaf)
 #endif							//BSPC
 		for(k = 0; k < leaf->numLeafSurfaces; k++)
 		{
-			patch = cm.surfaces[cm.leafsurfaces[leaf->firstLeafSurface + k]];
+			surfacenum = cm.leafsurfaces[leaf->firstLeafSurface + k];
+			patch = cm.surfaces[surfacenum];
 			if(!patch)
 			{
 				continue;
 			}
-			if(patch->checkcount == cm.checkcount)
+			if(tw->thread->surfaceChecks[surfacenum] == tw->thread->checkcount)
 			{
 				continue;		// already checked this brush in another leaf
 			}
-			patch->checkcount = cm.checkcount;
+			tw->thread->surfaceChecks[surfacenum] = tw->thread->checkcount;
 
 			if(!(patch->contents & tw->contents))
 			{
@@ -381,12 +494,15 @@ void CM_TestCapsuleInCapsule(traceWork_t * tw, clipHandle_t model)
 {
 	int             i;
 	vec3_t          mins, maxs;
+	cmodel_t       *cmod;
 	vec3_t          top, bottom;
 	vec3_t          p1, p2, tmp;
 	vec3_t          offset, symetricSize[2];
 	float           radius, halfwidth, halfheight, offs, r;
 
-	CM_ModelBounds(model, mins, maxs);
+	cmod = CM_ClipHandleToThreadModel(model, tw->thread);
+	VectorCopy(cmod->mins, mins);
+	VectorCopy(cmod->maxs, maxs);
 
 	VectorAdd(tw->start, tw->sphere.offset, top);
 	VectorSubtract(tw->start, tw->sphere.offset, bottom);
@@ -461,7 +577,9 @@ void CM_TestBoundingBoxInCapsule(traceWork_t * tw, clipHandle_t model)
 	int             i;
 
 	// mins maxs of the capsule
-	CM_ModelBounds(model, mins, maxs);
+	cmod = CM_ClipHandleToThreadModel(model, tw->thread);
+	VectorCopy(cmod->mins, mins);
+	VectorCopy(cmod->maxs, maxs);
 
 	// offset for capsule center
 	for(i = 0; i < 3; i++)
@@ -480,9 +598,9 @@ void CM_TestBoundingBoxInCapsule(traceWork_t * tw, clipHandle_t model)
 	VectorSet(tw->sphere.offset, 0, 0, size[1][2] - tw->sphere.radius);
 
 	// replace the capsule with the bounding box
-	h = CM_TempBoxModel(tw->size[0], tw->size[1], qfalse);
+	h = CM_TempBoxModelForThread(tw->thread - cmThreads, tw->size[0], tw->size[1], qfalse);
 	// calculate collision
-	cmod = CM_ClipHandleToModel(h);
+	cmod = CM_ClipHandleToThreadModel(h, tw->thread);
 	CM_TestInLeaf(tw, &cmod->leaf);
 }
 
@@ -514,13 +632,12 @@ void CM_PositionTest(traceWork_t * tw)
 	ll.storeLeafs = CM_StoreLeafs;
 	ll.lastLeaf = 0;
 	ll.overflowed = qfalse;
-
-	cm.checkcount++;
+	ll.thread = tw->thread;
 
 	CM_BoxLeafnums_r(&ll, 0);
 
 
-	cm.checkcount++;
+	tw->thread->checkcount++;
 
 	// test the contents of the leafs
 	for(i = 0; i < ll.count; i++)
@@ -552,7 +669,7 @@ static void CM_TraceThroughPatch(traceWork_t * tw, cPatch_t * patch)
 {
 	float           oldFrac;
 
-	c_patch_traces++;
+	tw->thread->c_patch_traces++;
 
 	oldFrac = tw->trace.fraction;
 
@@ -695,15 +812,22 @@ static void CM_TraceThroughBrush(traceWork_t * tw, cbrush_t * brush)
 {
 	int             i;
 	cplane_t       *plane, *clipplane;
+#ifndef CM_SSE_BRUSHSIDES
 	float           dist;
+#endif
 	float           enterFrac, leaveFrac;
 	float           d1, d2;
 	qboolean        getout, startout;
 	float           f;
 	cbrushside_t   *side, *leadside;
+#ifdef CM_SSE_BRUSHSIDES
+	int             firstSide;
+	float           d1s[4], d2s[4];
+#else
 	float           t;
 	vec3_t          startp;
 	vec3_t          endp;
+#endif
 
 	enterFrac = -1.0;
 	leaveFrac = 1.0;
@@ -714,13 +838,17 @@ static void CM_TraceThroughBrush(traceWork_t * tw, cbrush_t * brush)
 		return;
 	}
 
-	c_brush_traces++;
+	tw->thread->c_brush_traces++;
 
 	getout = qfalse;
 	startout = qfalse;
 
 	leadside = NULL;
 
+#ifdef CM_SSE_BRUSHSIDES
+	firstSide = brush->sides - cm.brushsides;
+#endif
+
 	if(tw->sphere.use)
 	{
 		//
@@ -733,6 +861,14 @@ static void CM_TraceThroughBrush(traceWork_t * tw, cbrush_t * brush)
 			side = brush->sides + i;
 			plane = side->plane;
 
+#ifdef CM_SSE_BRUSHSIDES
+			if(!(i & 3))
+			{
+				CM_SphereSideDistances(tw, firstSide + i, d1s, d2s);
+			}
+			d1 = d1s[i & 3];
+			d2 = d2s[i & 3];
+#else
 			// adjust the plane distance apropriately for radius
 			dist = plane->dist + tw->sphere.radius;
 
@@ -751,6 +887,7 @@ static void CM_TraceThroughBrush(traceWork_t * tw, cbrush_t * brush)
 
 			d1 = DotProduct(startp, plane->normal) - dist;
 			d2 = DotProduct(endp, plane->normal) - dist;
+#endif
 
 			if(d2 > 0)
 			{
@@ -814,11 +951,20 @@ static void CM_TraceThroughBrush(traceWork_t * tw, cbrush_t * brush)
 			side = brush->sides + i;
 			plane = side->plane;
 
+#ifdef CM_SSE_BRUSHSIDES
+			if(!(i & 3))
+			{
+				CM_BoxSideDistances(tw, firstSide + i, d1s, d2s);
+			}
+			d1 = d1s[i & 3];
+			d2 = d2s[i & 3];
+#else
 			// adjust the plane distance apropriately for mins/maxs
 			dist = plane->dist - DotProduct(tw->offsets[plane->signbits], plane->normal);
 
 			d1 = DotProduct(tw->start, plane->normal) - dist;
 			d2 = DotProduct(tw->end, plane->normal) - dist;
+#endif
 
 			if(d2 > 0)
 			{
@@ -911,6 +1057,7 @@ static void CM_TraceThroughLeaf(traceWork_t * tw, cLeaf_t * leaf)
 {
 	int             k;
 	int             brushnum;
+	int             surfacenum;
 	cbrush_t       *brush;
 	cPatch_t       *patch;
 
@@ -924,11 +1071,11 @@ static void CM_TraceThroughLeaf(traceWork_t * tw, cLeaf_t * leaf)
 		brushnum = cm.leafbrushes[leaf->firstLeafBrush + k];
 
 		brush = &cm.brushes[brushnum];
-		if(brush->checkcount == cm.checkcount)
+		if(tw->thread->brushChecks[brushnum] == tw->thread->checkcount)
 		{
 			continue;			// already checked this brush in another leaf
 		}
-		brush->checkcount = cm.checkcount;
+		tw->thread->brushChecks[brushnum] = tw->thread->checkcount;
 
 		if(!(brush->contents & tw->contents))
 		{
@@ -974,16 +1121,17 @@ static void CM_TraceThroughLeaf(traceWork_t * tw, cLeaf_t * leaf)
 #endif
 		for(k = 0; k < leaf->numLeafSurfaces; k++)
 		{
-			patch = cm.surfaces[cm.leafsurfaces[leaf->firstLeafSurface + k]];
+			surfacenum = cm.leafsurfaces[leaf->firstLeafSurface + k];
+			patch = cm.surfaces[surfacenum];
 			if(!patch)
 			{
 				continue;
 			}
-			if(patch->checkcount == cm.checkcount)
+			if(tw->thread->surfaceChecks[surfacenum] == tw->thread->checkcount)
 			{
 				continue;		// already checked this patch in another leaf
 			}
-			patch->checkcount = cm.checkcount;
+			tw->thread->surfaceChecks[surfacenum] = tw->thread->checkcount;
 
 			if(!(patch->contents & tw->contents))
 			{
@@ -1246,11 +1394,14 @@ static void CM_TraceCapsuleThroughCapsule(traceWork_t * tw, clipHandle_t model)
 {
 	int             i;
 	vec3_t          mins, maxs;
+	cmodel_t       *cmod;
 	vec3_t          top, bottom, starttop, startbottom, endtop, endbottom;
 	vec3_t          offset, symetricSize[2];
 	float           radius, halfwidth, halfheight, offs, h;
 
-	CM_ModelBounds(model, mins, maxs);
+	cmod = CM_ClipHandleToThreadModel(model, tw->thread);
+	VectorCopy(cmod->mins, mins);
+	VectorCopy(cmod->maxs, maxs);
 	// test trace bounds vs. capsule bounds
 	if(tw->bounds[0][0] > maxs[0] + RADIUS_EPSILON
 	   || tw->bounds[0][1] > maxs[1] + RADIUS_EPSILON
@@ -1315,7 +1466,9 @@ static void CM_TraceBoundingBoxThroughCapsule(traceWork_t * tw, clipHandle_t mod
 	int             i;
 
 	// mins maxs of the capsule
-	CM_ModelBounds(model, mins, maxs);
+	cmod = CM_ClipHandleToThreadModel(model, tw->thread);
+	VectorCopy(cmod->mins, mins);
+	VectorCopy(cmod->maxs, maxs);
 
 	// offset for capsule center
 	for(i = 0; i < 3; i++)
@@ -1334,9 +1487,9 @@ static void CM_TraceBoundingBoxThroughCapsule(traceWork_t * tw, clipHandle_t mod
 	VectorSet(tw->sphere.offset, 0, 0, size[1][2] - tw->sphere.radius);
 
 	// replace the capsule with the bounding box
-	h = CM_TempBoxModel(tw->size[0], tw->size[1], qfalse);
+	h = CM_TempBoxModelForThread(tw->thread - cmThreads, tw->size[0], tw->size[1], qfalse);
 	// calculate collision
-	cmod = CM_ClipHandleToModel(h);
+	cmod = CM_ClipHandleToThreadModel(h, tw->thread);
 	CM_TraceThroughLeaf(tw, &cmod->leaf);
 }
 
@@ -1500,7 +1653,7 @@ static void CM_TraceThroughTree(traceWork_t * tw, int num, float p1f, float p2f,
 CM_Trace
 ==================
 */
-static void CM_Trace(trace_t * results, const vec3_t start, const vec3_t end,
+static void CM_Trace(cmThread_t * thread, trace_t * results, const vec3_t start, const vec3_t end,
 					 const vec3_t mins, const vec3_t maxs,
 					 clipHandle_t model, const vec3_t origin, int brushmask, int capsule, sphere_t * sphere)
 {
@@ -1515,14 +1668,15 @@ static void CM_Trace(trace_t * results, const vec3_t start, const vec3_t end,
 	float           dist;
 #endif
 
-	cmod = CM_ClipHandleToModel(model);
+	cmod = CM_ClipHandleToThreadModel(model, thread);
 
-	cm.checkcount++;			// for multi-check avoidance
+	thread->checkcount++;		// for multi-check avoidance
 
-	c_traces++;					// for statistics, may be zeroed
+	thread->c_traces++;			// for statistics, may be zeroed
 
 	// fill in a default trace
 	memset(&tw, 0, sizeof(tw));
+	tw.thread = thread;
 	tw.trace.fraction = 1.0f;	// assume it goes the entire distance until shown otherwise
 	VectorCopy(origin, tw.modelOrigin);
 
@@ -1813,7 +1967,18 @@ CM_BoxTrace
 void CM_BoxTrace(trace_t * results, const vec3_t start, const vec3_t end,
 				 const vec3_t mins, const vec3_t maxs, clipHandle_t model, int brushmask, int capsule)
 {
-	CM_Trace(results, start, end, mins, maxs, model, vec3_origin, brushmask, capsule, NULL);
+	CM_Trace(&cmThreads[0], results, start, end, mins, maxs, model, vec3_origin, brushmask, capsule, NULL);
+}
+
+/*
+==================
+CM_BoxTraceForThread
+==================
+*/
+void CM_BoxTraceForThread(int threadNum, trace_t * results, const vec3_t start, const vec3_t end,
+						  const vec3_t mins, const vec3_t maxs, clipHandle_t model, int brushmask, int capsule)
+{
+	CM_Trace(CM_GetThread(threadNum), results, start, end, mins, maxs, model, vec3_origin, brushmask, capsule, NULL);
 }
 
 /*
@@ -1827,6 +1992,18 @@ rotating entities
 void CM_TransformedBoxTrace(trace_t * results, const vec3_t start, const vec3_t end,
 							const vec3_t mins, const vec3_t maxs,
 							clipHandle_t model, int brushmask, const vec3_t origin, const vec3_t angles, int capsule)
+{
+	CM_TransformedBoxTraceForThread(0, results, start, end, mins, maxs, model, brushmask, origin, angles, capsule);
+}
+
+/*
+==================
+CM_TransformedBoxTraceForThread
+==================
+*/
+void CM_TransformedBoxTraceForThread(int threadNum, trace_t * results, const vec3_t start, const vec3_t end,
+									 const vec3_t mins, const vec3_t maxs,
+									 clipHandle_t model, int brushmask, const vec3_t origin, const vec3_t angles, int capsule)
 {
 	trace_t         trace;
 	vec3_t          start_l, end_l;
@@ -1905,7 +2082,7 @@ void CM_TransformedBoxTrace(trace_t * results, const vec3_t start, const vec3_t
 	}
 
 	// sweep the box through the model
-	CM_Trace(&trace, start_l, end_l, symetricSize[0], symetricSize[1], model, origin, brushmask, capsule, &sphere);
+	CM_Trace(CM_GetThread(threadNum), &trace, start_l, end_l, symetricSize[0], symetricSize[1], model, origin, brushmask, capsule, &sphere);
 
 	// if the bmodel was rotated and there was a collision
 	if(rotated && trace.fraction != 1.0)
@@ -1923,3 +2100,29 @@ void CM_TransformedBoxTrace(trace_t * results, const vec3_t start, const vec3_t
 
 	*results = trace;
 }
+
+/*
+==================
+CM_TakeTraceCounts
+==================
+*/
+void CM_TakeTraceCounts(int *traces, int *brushTraces, int *patchTraces, int *pointContents)
+{
+	int             i;
+	cmThread_t     *thread;
+
+	*traces = *brushTraces = *patchTraces = *pointContents = 0;
+
+	for(i = 0, thread = cmThreads; i < CM_MAX_THREADS; i++, thread++)
+	{
+		*traces += thread->c_traces;
+		*brushTraces += thread->c_brush_traces;
+		*patchTraces += thread->c_patch_traces;
+		*pointContents += thread->c_pointcontents;
+
+		thread->c_traces = 0;
+		thread->c_brush_traces = 0;
+		thread->c_patch_traces = 0;
+		thread->c_pointcontents = 0;
+	}
+}
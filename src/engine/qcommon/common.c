@@ -3351,6 +3351,8 @@ void Com_Init(char *commandLine)
 		Cmd_AddCommand("crash", Com_Crash_f);
 		Cmd_AddCommand("freeze", Com_Freeze_f);
 		Cmd_AddCommand("cpuspeed", Com_CPUSpeed_f);
+		Cmd_AddCommand("huffbench", MSG_HuffmanBenchmark_f);
+		Cmd_AddCommand("cm_threadtest", CM_ThreadTest_f);
 	}
 	Cmd_AddCommand("quit", Com_Quit_f);
 	Cmd_AddCommand("changeVectors", MSG_ReportChangeVectors_f);
@@ -3599,6 +3601,8 @@ void Com_Frame(void)
 
 	if(setjmp(abortframe))
 	{
+		// don't leave the packets of the aborted frame queued
+		Sys_FlushPacketBatch();
 		return;					// an ERR_DROP was thrown
 	}
 
@@ -3785,15 +3789,11 @@ void Com_Frame(void)
 	//
 	if(com_showtrace->integer)
 	{
+		int             c_traces, c_brush_traces, c_patch_traces;
+		int             c_pointcontents;
 
-		extern int      c_traces, c_brush_traces, c_patch_traces;
-		extern int      c_pointcontents;
-
+		CM_TakeTraceCounts(&c_traces, &c_brush_traces, &c_patch_traces, &c_pointcontents);
 		Com_Printf("%4i traces  (%ib %ip) %4i points\n", c_traces, c_brush_traces, c_patch_traces, c_pointcontents);
-		c_traces = 0;
-		c_brush_traces = 0;
-		c_patch_traces = 0;
-		c_pointcontents = 0;
 	}
 
 	// old net chan encryption key
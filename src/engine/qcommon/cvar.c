@@ -34,6 +34,7 @@ If you have questions concerning this license or the applicable additional terms
 cvar_t         *cvar_vars;
 cvar_t         *cvar_cheats;
 int             cvar_modifiedFlags;
+int             cvar_modificationCount;
 
 #define MAX_CVARS   2048
 cvar_t          cvar_indexes[MAX_CVARS];
@@ -311,6 +312,10 @@ cvar_t         *Cvar_Get(const char *var_name, const char *var_value, int flags)
 			cvar_modifiedFlags |= flags;
 		}
 
+		if((var->flags | flags) != var->flags)
+		{
+			cvar_modificationCount++;
+		}
 		var->flags |= flags;
 		// only allow one non-empty reset string without a warning
 		if(!var->resetString[0])
@@ -371,6 +376,7 @@ cvar_t         *Cvar_Get(const char *var_name, const char *var_value, int flags)
 	var->string = CopyString(var_value);
 	var->modified = qtrue;
 	var->modificationCount = 1;
+	cvar_modificationCount++;
 	var->value = atof(var->string);
 	var->integer = atoi(var->string);
 	var->resetString = CopyString(var_value);
@@ -534,6 +540,7 @@ cvar_t         *Cvar_Set2(const char *var_name, const char *value, qboolean forc
 	}
 	var->modified = qtrue;
 	var->modificationCount++;
+	cvar_modificationCount++;
 
 	Z_Free(var->string);		// free the old value string
 
@@ -834,6 +841,7 @@ void Cvar_SetS_f(void)
 		return;
 	}
 	v->flags |= CVAR_SERVERINFO;
+	cvar_modificationCount++;
 }
 
 /*
@@ -1070,6 +1078,7 @@ void Cvar_Restart_f(void)
 			// clear the var completely, since we
 			// can't remove the index from the list
 			memset(var, 0, sizeof(var));
+			cvar_modificationCount++;
 			continue;
 		}
 
@@ -235,6 +235,13 @@ typedef struct
 	int             hashSize;	// hash table size (power of 2)
 	fileInPack_t  **hashTable;	// hash table
 	fileInPack_t   *buildBuffer;	// buffer with the filenames etc.
+	int            *headerLongs;	// file crcs the checksums are built from, kept for the pak cache
+	int             numHeaderLongs;
+	int             namesLength;	// bytes of names following the buildBuffer entries
+	int             fileSize;	// size and mtime of the pk3, the pak cache key
+	int             fileTime;
+	byte           *mapped;		// whole pk3, mapped on the first FS_ReadFileReadOnly
+	int             mappedLength;	// -1 if it couldn't be mapped
 } pack_t;
 
 typedef struct
@@ -249,8 +256,20 @@ typedef struct searchpath_s
 
 	pack_t         *pack;		// only one of pack / dir will be non NULL
 	directory_t    *dir;
+
+	int             order;		// position in fs_searchpaths, set by FS_BuildFileIndex
+	struct searchpath_s *nextDir;	// next directory element after this one
 } searchpath_t;
 
+// one entry for every file of every pack, hashed by name over all the packs
+// in the search path, so a lookup doesn't have to probe each pack in turn
+typedef struct fileIndex_s
+{
+	fileInPack_t   *file;
+	searchpath_t   *search;
+	struct fileIndex_s *next;	// next entry in the hash, in search path order
+} fileIndex_t;
+
 //bani - made fs_gamedir non-static
 char            fs_gamedir[MAX_OSPATH];	// this will be a single file name with no separators
 static cvar_t  *fs_debug;
@@ -264,6 +283,10 @@ static cvar_t  *fs_copyfiles;
 static cvar_t  *fs_gamedirvar;
 static cvar_t  *fs_restrict;
 static searchpath_t *fs_searchpaths;
+static searchpath_t *fs_dirpaths;	// first directory in fs_searchpaths
+static int      fs_indexSize;	// hash table size (power of 2)
+static fileIndex_t **fs_indexTable;
+static fileIndex_t *fs_indexEntries;
 static int      fs_readCount;	// total bytes read
 static int      fs_loadCount;	// total files read
 static int      fs_loadStack;	// total files in memory
@@ -292,12 +315,17 @@ typedef struct
 	int             fileSize;
 	int             zipFilePos;
 	qboolean        zipFile;
+	pack_t         *zipPak;		// pack the file was opened from
 	qboolean        streamed;
 	char            name[MAX_ZPATH];
 } fileHandleData_t;
 
 static fileHandleData_t fsh[MAX_FILE_HANDLES];
 
+// buffers handed out by FS_ReadFileReadOnly that point into mapped pk3s
+#define MAX_MAPPED_FILES    64
+static const void *fs_mappedFiles[MAX_MAPPED_FILES];
+
 // TTimo - show_bug.cgi?id=540
 // wether we did a reorder on the current search path when joining the server
 static qboolean fs_reordered;
@@ -420,6 +448,150 @@ static long FS_HashFileName(const char *fname, int hashSize)
 	return hash;
 }
 
+/*
+================
+FS_FreeFileIndex
+================
+*/
+static void FS_FreeFileIndex(void)
+{
+	if(fs_indexTable)
+	{
+		Z_Free(fs_indexTable);
+	}
+	if(fs_indexEntries)
+	{
+		Z_Free(fs_indexEntries);
+	}
+	fs_indexTable = NULL;
+	fs_indexEntries = NULL;
+	fs_indexSize = 0;
+	fs_dirpaths = NULL;
+}
+
+/*
+================
+FS_BuildFileIndex
+
+Hashes the files of all the packs in the search path into a single table,
+and links the directory elements together so lookups can skip the packs.
+Must be redone whenever fs_searchpaths changes.
+================
+*/
+static void FS_BuildFileIndex(void)
+{
+	searchpath_t   *search, *lastDir;
+	fileIndex_t    *entry;
+	pack_t         *pak;
+	int             numEntries;
+	int             i, order;
+	long            hash;
+
+	FS_FreeFileIndex();
+
+	numEntries = 0;
+	order = 0;
+	lastDir = NULL;
+	for(search = fs_searchpaths; search; search = search->next)
+	{
+		search->order = order++;
+		search->nextDir = NULL;
+		if(search->pack)
+		{
+			numEntries += search->pack->numfiles;
+		}
+		else if(search->dir)
+		{
+			if(lastDir)
+			{
+				lastDir->nextDir = search;
+			}
+			else
+			{
+				fs_dirpaths = search;
+			}
+			lastDir = search;
+		}
+	}
+
+	fs_indexSize = 1;
+	while(fs_indexSize < numEntries)
+	{
+		fs_indexSize <<= 1;
+	}
+
+	fs_indexTable = Z_Malloc(fs_indexSize * sizeof(*fs_indexTable));
+	fs_indexEntries = Z_Malloc((numEntries + 1) * sizeof(*fs_indexEntries));
+
+	entry = fs_indexEntries;
+	for(search = fs_searchpaths; search; search = search->next)
+	{
+		if(!search->pack)
+		{
+			continue;
+		}
+
+		pak = search->pack;
+		for(i = 0; i < pak->numfiles; i++)
+		{
+			if(!pak->buildBuffer[i].name)
+			{
+				continue;
+			}
+			entry->file = &pak->buildBuffer[i];
+			entry->search = search;
+			entry++;
+		}
+	}
+
+	// insert back to front so every hash chain ends up in search path order
+	while(entry > fs_indexEntries)
+	{
+		entry--;
+		hash = FS_HashFileName(entry->file->name, fs_indexSize);
+		entry->next = fs_indexTable[hash];
+		fs_indexTable[hash] = entry;
+	}
+}
+
+/*
+================
+FS_FindFileInPaks
+
+Returns the index entry of the first pack in the search path that holds
+the file, NULL if there is none.  Packs that are not pure are skipped
+when pureOnly is set.
+================
+*/
+static fileIndex_t *FS_FindFileInPaks(const char *filename, qboolean pureOnly)
+{
+	fileIndex_t    *entry;
+
+	if(!fs_indexTable)
+	{
+		return NULL;
+	}
+
+	for(entry = fs_indexTable[FS_HashFileName(filename, fs_indexSize)]; entry; entry = entry->next)
+	{
+		// case and separator insensitive comparisons
+		if(FS_FilenameCompare(entry->file->name, filename))
+		{
+			continue;
+		}
+
+		// disregard if it doesn't match one of the allowed pure pak files
+		if(pureOnly && !FS_PakIsPure(entry->search->pack))
+		{
+			continue;
+		}
+
+		return entry;
+	}
+
+	return NULL;
+}
+
 static fileHandle_t FS_HandleForFile(void)
 {
 	int             i;
@@ -1151,15 +1323,13 @@ int FS_FOpenFileRead(const char *filename, fileHandle_t * file, qboolean uniqueF
 	char           *netpath;
 	pack_t         *pak;
 	fileInPack_t   *pakFile;
+	fileIndex_t    *pakHit;
 	directory_t    *dir;
-	long            hash;
 	unz_s          *zfi;
 	FILE           *temp;
 	int             l;
 	char            demoExt[16];
 
-	hash = 0;
-
 	if(!fs_searchpaths)
 	{
 		Com_Error(ERR_FATAL, "Filesystem call made without initialization\n");
@@ -1171,53 +1341,28 @@ int FS_FOpenFileRead(const char *filename, fileHandle_t * file, qboolean uniqueF
 	if(file == NULL)
 	{
 		// just wants to see if file is there
-		for(search = fs_searchpaths; search; search = search->next)
+		if(!(fs_filter_flag & FS_EXCLUDE_PK3) && FS_FindFileInPaks(filename, qfalse))
 		{
-			//
-			if(search->pack)
-			{
-				hash = FS_HashFileName(filename, search->pack->hashSize);
-			}
-			// is the element a pak file?
-			if(search->pack && search->pack->hashTable[hash])
-			{
-				if(fs_filter_flag & FS_EXCLUDE_PK3)
-				{
-					continue;
-				}
+			return qtrue;
+		}
 
-				// look through all the pak file elements
-				pak = search->pack;
-				pakFile = pak->hashTable[hash];
-				do
-				{
-					// case and separator insensitive comparisons
-					if(!FS_FilenameCompare(pakFile->name, filename))
-					{
-						// found it!
-						return qtrue;
-					}
-					pakFile = pakFile->next;
-				} while(pakFile != NULL);
-			}
-			else if(search->dir)
-			{
-				if(fs_filter_flag & FS_EXCLUDE_DIR)
-				{
-					continue;
-				}
+		if(fs_filter_flag & FS_EXCLUDE_DIR)
+		{
+			return qfalse;
+		}
 
-				dir = search->dir;
+		for(search = fs_dirpaths; search; search = search->nextDir)
+		{
+			dir = search->dir;
 
-				netpath = FS_BuildOSPath(dir->path, dir->gamedir, filename);
-				temp = fopen(netpath, "rb");
-				if(!temp)
-				{
-					continue;
-				}
-				fclose(temp);
-				return qtrue;
+			netpath = FS_BuildOSPath(dir->path, dir->gamedir, filename);
+			temp = fopen(netpath, "rb");
+			if(!temp)
+			{
+				continue;
 			}
+			fclose(temp);
+			return qtrue;
 		}
 		return qfalse;
 	}
@@ -1258,87 +1403,151 @@ int FS_FOpenFileRead(const char *filename, fileHandle_t * file, qboolean uniqueF
 	*file = FS_HandleForFile();
 	fsh[*file].handleFiles.unique = uniqueFILE;
 
-	for(search = fs_searchpaths; search; search = search->next)
+	// find the first pack holding the file, only the directories in front
+	// of it in the search path can override it
+	pakHit = NULL;
+	if(!(fs_filter_flag & FS_EXCLUDE_PK3))
 	{
-		//
-		if(search->pack)
+		pakHit = FS_FindFileInPaks(filename, qtrue);
+	}
+
+	for(search = fs_dirpaths; search; search = search->nextDir)
+	{
+		if(pakHit && pakHit->search->order < search->order)
 		{
-			hash = FS_HashFileName(filename, search->pack->hashSize);
+			break;
 		}
-		// is the element a pak file?
-		if(search->pack && search->pack->hashTable[hash])
+
+		if(fs_filter_flag & FS_EXCLUDE_DIR)
 		{
-			if(fs_filter_flag & FS_EXCLUDE_PK3)
-			{
-				continue;
-			}
+			continue;
+		}
 
-			// disregard if it doesn't match one of the allowed pure pak files
-			if(!FS_PakIsPure(search->pack))
+		// check a file in the directory tree
+
+		// if we are running restricted, or if the filesystem is configured for pure (fs_numServerPaks)
+		// the only files we will allow to come from the directory are .cfg files
+		l = strlen(filename);
+		if(fs_restrict->integer || fs_numServerPaks)
+		{
+
+			if(Q_stricmp(filename + l - 4, ".cfg")	// for config files
+			   && Q_stricmp(filename + l - 5, ".menu")	// menu files
+			   && Q_stricmp(filename + l - 5, ".game")	// menu files
+			   && Q_stricmp(filename + l - strlen(demoExt), demoExt)	// menu files
+			   && Q_stricmp(filename + l - 4, ".dat")	// for journal files
+			   && Q_stricmp(filename + l - 8, "bots.txt") && Q_stricmp(filename + l - 8, ".botents")
+#ifdef __MACOS__
+			   // even when pure is on, let the server game be loaded
+			   && Q_stricmp(filename, "qagame_mac")
+#endif
+				)
 			{
 				continue;
 			}
+		}
 
-			// look through all the pak file elements
-			pak = search->pack;
-			pakFile = pak->hashTable[hash];
-			do
+		dir = search->dir;
+
+		netpath = FS_BuildOSPath(dir->path, dir->gamedir, filename);
+		fsh[*file].handleFiles.file.o = fopen(netpath, "rb");
+		if(!fsh[*file].handleFiles.file.o)
+		{
+			continue;
+		}
+
+		if(Q_stricmp(filename + l - 4, ".cfg")	// for config files
+		   && Q_stricmp(filename + l - 5, ".menu")	// menu files
+		   && Q_stricmp(filename + l - 5, ".game")	// menu files
+		   && Q_stricmp(filename + l - strlen(demoExt), demoExt)	// menu files
+		   && Q_stricmp(filename + l - 4, ".dat") && Q_stricmp(filename + l - 8, ".botents")
+		   /*&& !strstr( filename, "botfiles" ) */ )
+		{					// RF, need this for dev
+			fs_fakeChkSum = random();
+		}
+
+		Q_strncpyz(fsh[*file].name, filename, sizeof(fsh[*file].name));
+		fsh[*file].zipFile = qfalse;
+		if(fs_debug->integer)
+		{
+			Com_Printf("FS_FOpenFileRead: %s (found in '%s/%s')\n", filename, dir->path, dir->gamedir);
+		}
+
+		// if we are getting it from the cdpath, optionally copy it
+		//  to the basepath
+		if(fs_copyfiles->integer && !Q_stricmp(dir->path, fs_cdpath->string))
+		{
+			char           *copypath;
+
+			copypath = FS_BuildOSPath(fs_basepath->string, dir->gamedir, filename);
+			FS_CopyFile(netpath, copypath);
+		}
+		else if(fs_copyfiles->integer && fs_buildpath->string[0] && Q_stricmp(dir->path, fs_buildpath->string))
+		{
+			char           *copypath;
+
+			copypath = FS_BuildOSPath(fs_buildpath->string, fs_buildgame->string, filename);
+			FS_CopyFile(netpath, copypath);
+		}
+
+		return FS_filelength(*file);
+	}
+
+	if(pakHit)
+	{
+		pak = pakHit->search->pack;
+		pakFile = pakHit->file;
+
+		// mark the pak as having been referenced and mark specifics on cgame and ui
+		// shaders, txt, arena files  by themselves do not count as a reference as
+		// these are loaded from all pk3s
+		// from every pk3 file..
+		l = strlen(filename);
+		if(!(pak->referenced & FS_GENERAL_REF))
+		{
+			if(Q_stricmp(filename + l - 7, ".shader") != 0 &&
+			   Q_stricmp(filename + l - 4, ".txt") != 0 &&
+			   Q_stricmp(filename + l - 4, ".cfg") != 0 &&
+			   Q_stricmp(filename + l - 7, ".config") != 0 &&
+			   strstr(filename, "levelshots") == NULL &&
+			   Q_stricmp(filename + l - 4, ".bot") != 0 &&
+			   Q_stricmp(filename + l - 6, ".arena") != 0 && Q_stricmp(filename + l - 5, ".menu") != 0)
 			{
-				// case and separator insensitive comparisons
-				if(!FS_FilenameCompare(pakFile->name, filename))
-				{
-					// found it!
-
-					// mark the pak as having been referenced and mark specifics on cgame and ui
-					// shaders, txt, arena files  by themselves do not count as a reference as
-					// these are loaded from all pk3s
-					// from every pk3 file..
-					l = strlen(filename);
-					if(!(pak->referenced & FS_GENERAL_REF))
-					{
-						if(Q_stricmp(filename + l - 7, ".shader") != 0 &&
-						   Q_stricmp(filename + l - 4, ".txt") != 0 &&
-						   Q_stricmp(filename + l - 4, ".cfg") != 0 &&
-						   Q_stricmp(filename + l - 7, ".config") != 0 &&
-						   strstr(filename, "levelshots") == NULL &&
-						   Q_stricmp(filename + l - 4, ".bot") != 0 &&
-						   Q_stricmp(filename + l - 6, ".arena") != 0 && Q_stricmp(filename + l - 5, ".menu") != 0)
-						{
-							pak->referenced |= FS_GENERAL_REF;
-						}
-					}
+				pak->referenced |= FS_GENERAL_REF;
+			}
+		}
 
-					// for OS client/server interoperability, we expect binaries for .so and .dll to be in the same pk3
-					// so that when we reference the DLL files on any platform, this covers everyone else
+		// for OS client/server interoperability, we expect binaries for .so and .dll to be in the same pk3
+		// so that when we reference the DLL files on any platform, this covers everyone else
 
 // XreaL BEGIN
 #if 0							// TTimo: use that stuff for shifted strings
-					Com_Printf("SYS_DLLNAME_QAGAME + %d: '%s'\n", SYS_DLLNAME_QAGAME_SHIFT,
-							   FS_ShiftStr("qagame.mp.x86_64.so" /*"qagame_mp_x86.dll"*/ /*"qagame.mp.i386.so" */ , SYS_DLLNAME_QAGAME_SHIFT));
-					Com_Printf("SYS_DLLNAME_CGAME + %d: '%s'\n", SYS_DLLNAME_CGAME_SHIFT,
-							   FS_ShiftStr("cgame.mp.x86_64.so" /*"cgame_mp_x86.dll"*/ /*"cgame.mp.i386.so" */ , SYS_DLLNAME_CGAME_SHIFT));
-					Com_Printf("SYS_DLLNAME_UI + %d: '%s'\n", SYS_DLLNAME_UI_SHIFT,
-							   FS_ShiftStr("ui.mp.x86_64.so" /*"ui_mp_x86.dll"*/ /*"ui.mp.i386.so" */ , SYS_DLLNAME_UI_SHIFT));
+		Com_Printf("SYS_DLLNAME_QAGAME + %d: '%s'\n", SYS_DLLNAME_QAGAME_SHIFT,
+				   FS_ShiftStr("qagame.mp.x86_64.so" /*"qagame_mp_x86.dll"*/ /*"qagame.mp.i386.so" */ , SYS_DLLNAME_QAGAME_SHIFT));
+		Com_Printf("SYS_DLLNAME_CGAME + %d: '%s'\n", SYS_DLLNAME_CGAME_SHIFT,
+				   FS_ShiftStr("cgame.mp.x86_64.so" /*"cgame_mp_x86.dll"*/ /*"cgame.mp.i386.so" */ , SYS_DLLNAME_CGAME_SHIFT));
+		Com_Printf("SYS_DLLNAME_UI + %d: '%s'\n", SYS_DLLNAME_UI_SHIFT,
+				   FS_ShiftStr("ui.mp.x86_64.so" /*"ui_mp_x86.dll"*/ /*"ui.mp.i386.so" */ , SYS_DLLNAME_UI_SHIFT));
 #endif
 // XreaL END
 
-					// qagame dll
-					if(!(pak->referenced & FS_QAGAME_REF) &&
-					   FS_ShiftedStrStr(filename, SYS_DLLNAME_QAGAME, -SYS_DLLNAME_QAGAME_SHIFT))
-					{
-						pak->referenced |= FS_QAGAME_REF;
-					}
-					// cgame dll
-					if(!(pak->referenced & FS_CGAME_REF) &&
-					   FS_ShiftedStrStr(filename, SYS_DLLNAME_CGAME, -SYS_DLLNAME_CGAME_SHIFT))
-					{
-						pak->referenced |= FS_CGAME_REF;
-					}
-					// ui dll
-					if(!(pak->referenced & FS_UI_REF) && FS_ShiftedStrStr(filename, SYS_DLLNAME_UI, -SYS_DLLNAME_UI_SHIFT))
-					{
-						pak->referenced |= FS_UI_REF;
-					}
+		// qagame dll
+		if(!(pak->referenced & FS_QAGAME_REF) &&
+		   FS_ShiftedStrStr(filename, SYS_DLLNAME_QAGAME, -SYS_DLLNAME_QAGAME_SHIFT))
+		{
+			pak->referenced |= FS_QAGAME_REF;
+		}
+		// cgame dll
+		if(!(pak->referenced & FS_CGAME_REF) &&
+		   FS_ShiftedStrStr(filename, SYS_DLLNAME_CGAME, -SYS_DLLNAME_CGAME_SHIFT))
+		{
+			pak->referenced |= FS_CGAME_REF;
+		}
+		// ui dll
+		if(!(pak->referenced & FS_UI_REF) && FS_ShiftedStrStr(filename, SYS_DLLNAME_UI, -SYS_DLLNAME_UI_SHIFT))
+		{
+			pak->referenced |= FS_UI_REF;
+		}
 
 //#if !defined(PRE_RELEASE_DEMO) && !defined(DO_LIGHT_DEDICATED)
 //                  // DHM -- Nerve :: Don't allow maps to be loaded from pak0 (singleplayer)
@@ -1350,153 +1559,74 @@ int FS_FOpenFileRead(const char *filename, fileHandle_t * file, qboolean uniqueF
 //                  }
 //#endif
 
-					if(uniqueFILE)
-					{
-						// open a new file on the pakfile
-						fsh[*file].handleFiles.file.z = unzReOpen(pak->pakFilename, pak->handle);
-						if(fsh[*file].handleFiles.file.z == NULL)
-						{
-							Com_Error(ERR_FATAL, "Couldn't reopen %s", pak->pakFilename);
-						}
-					}
-					else
-					{
-						fsh[*file].handleFiles.file.z = pak->handle;
-					}
-					Q_strncpyz(fsh[*file].name, filename, sizeof(fsh[*file].name));
-					fsh[*file].zipFile = qtrue;
-					zfi = (unz_s *) fsh[*file].handleFiles.file.z;
-					// in case the file was new
-					temp = zfi->file;
-					// set the file position in the zip file (also sets the current file info)
-					unzSetCurrentFileInfoPosition(pak->handle, pakFile->pos);
-					// copy the file info into the unzip structure
-					// rain - don't copy zfi over itself
-					if(zfi != pak->handle)
-					{
-						Com_Memcpy(zfi, pak->handle, sizeof(unz_s));
-					}
-					// we copy this back into the structure
-					zfi->file = temp;
-					// open the file in the zip
-					unzOpenCurrentFile(fsh[*file].handleFiles.file.z);
-					fsh[*file].zipFilePos = pakFile->pos;
-
-					if(fs_debug->integer)
-					{
-						Com_Printf("FS_FOpenFileRead: %s (found in '%s')\n", filename, pak->pakFilename);
-					}
-
-					// Arnout: let's make this thing work from pakfiles as well
-					// FIXME: doing this seems to break things?
-					/*if ( fs_copyfiles->integer && fs_buildpath->string[0] && Q_stricmpn( fs_buildpath->string, pak->pakFilename, strlen(fs_buildpath->string) ) ) {
-					   char         copypath[MAX_OSPATH];
-					   fileHandle_t f;
-					   byte         *srcData;
-					   int              len = zfi->cur_file_info.uncompressed_size;
-
-					   Q_strncpyz( copypath, FS_BuildOSPath( fs_buildpath->string, fs_buildgame->string, filename ), sizeof(copypath) );
-					   netpath = FS_BuildOSPath( fs_basepath->string, fs_gamedir, filename );
-
-					   f = FS_FOpenFileWrite( filename );
-					   if ( !f ) {
-					   Com_Printf( "FS_FOpenFileRead Failed to open %s for copying\n", filename );
-					   } else {
-					   srcData = Hunk_AllocateTempMemory( len) ;
-					   FS_Read( srcData, len, *file );
-					   FS_Write( srcData, len, f );
-					   FS_FCloseFile( f );
-					   Hunk_FreeTempMemory( srcData );
-
-					   if (rename( netpath, copypath )) {
-					   // Failed, try copying it and deleting the original
-					   FS_CopyFile ( netpath, copypath );
-					   FS_Remove ( netpath );
-					   }
-					   }
-					   } */
-
-					return zfi->cur_file_info.uncompressed_size;
-				}
-				pakFile = pakFile->next;
-			} while(pakFile != NULL);
-		}
-		else if(search->dir)
+		if(uniqueFILE)
 		{
-			if(fs_filter_flag & FS_EXCLUDE_DIR)
-			{
-				continue;
-			}
-
-			// check a file in the directory tree
-
-			// if we are running restricted, or if the filesystem is configured for pure (fs_numServerPaks)
-			// the only files we will allow to come from the directory are .cfg files
-			l = strlen(filename);
-			if(fs_restrict->integer || fs_numServerPaks)
-			{
-
-				if(Q_stricmp(filename + l - 4, ".cfg")	// for config files
-				   && Q_stricmp(filename + l - 5, ".menu")	// menu files
-				   && Q_stricmp(filename + l - 5, ".game")	// menu files
-				   && Q_stricmp(filename + l - strlen(demoExt), demoExt)	// menu files
-				   && Q_stricmp(filename + l - 4, ".dat")	// for journal files
-				   && Q_stricmp(filename + l - 8, "bots.txt") && Q_stricmp(filename + l - 8, ".botents")
-#ifdef __MACOS__
-				   // even when pure is on, let the server game be loaded
-				   && Q_stricmp(filename, "qagame_mac")
-#endif
-					)
-				{
-					continue;
-				}
-			}
-
-			dir = search->dir;
-
-			netpath = FS_BuildOSPath(dir->path, dir->gamedir, filename);
-			fsh[*file].handleFiles.file.o = fopen(netpath, "rb");
-			if(!fsh[*file].handleFiles.file.o)
+			// open a new file on the pakfile
+			fsh[*file].handleFiles.file.z = unzReOpen(pak->pakFilename, pak->handle);
+			if(fsh[*file].handleFiles.file.z == NULL)
 			{
-				continue;
-			}
-
-			if(Q_stricmp(filename + l - 4, ".cfg")	// for config files
-			   && Q_stricmp(filename + l - 5, ".menu")	// menu files
-			   && Q_stricmp(filename + l - 5, ".game")	// menu files
-			   && Q_stricmp(filename + l - strlen(demoExt), demoExt)	// menu files
-			   && Q_stricmp(filename + l - 4, ".dat") && Q_stricmp(filename + l - 8, ".botents")
-			   /*&& !strstr( filename, "botfiles" ) */ )
-			{					// RF, need this for dev
-				fs_fakeChkSum = random();
-			}
-
-			Q_strncpyz(fsh[*file].name, filename, sizeof(fsh[*file].name));
-			fsh[*file].zipFile = qfalse;
-			if(fs_debug->integer)
-			{
-				Com_Printf("FS_FOpenFileRead: %s (found in '%s/%s')\n", filename, dir->path, dir->gamedir);
-			}
-
-			// if we are getting it from the cdpath, optionally copy it
-			//  to the basepath
-			if(fs_copyfiles->integer && !Q_stricmp(dir->path, fs_cdpath->string))
-			{
-				char           *copypath;
-
-				copypath = FS_BuildOSPath(fs_basepath->string, dir->gamedir, filename);
-				FS_CopyFile(netpath, copypath);
-			}
-			else if(fs_copyfiles->integer && fs_buildpath->string[0] && Q_stricmp(dir->path, fs_buildpath->string))
-			{
-				char           *copypath;
-
-				copypath = FS_BuildOSPath(fs_buildpath->string, fs_buildgame->string, filename);
-				FS_CopyFile(netpath, copypath);
+				Com_Error(ERR_FATAL, "Couldn't reopen %s", pak->pakFilename);
 			}
+		}
+		else
+		{
+			fsh[*file].handleFiles.file.z = pak->handle;
+		}
+		Q_strncpyz(fsh[*file].name, filename, sizeof(fsh[*file].name));
+		fsh[*file].zipFile = qtrue;
+		fsh[*file].zipPak = pak;
+		zfi = (unz_s *) fsh[*file].handleFiles.file.z;
+		// in case the file was new
+		temp = zfi->file;
+		// set the file position in the zip file (also sets the current file info)
+		unzSetCurrentFileInfoPosition(pak->handle, pakFile->pos);
+		// copy the file info into the unzip structure
+		// rain - don't copy zfi over itself
+		if(zfi != pak->handle)
+		{
+			Com_Memcpy(zfi, pak->handle, sizeof(unz_s));
+		}
+		// we copy this back into the structure
+		zfi->file = temp;
+		// open the file in the zip
+		unzOpenCurrentFile(fsh[*file].handleFiles.file.z);
+		fsh[*file].zipFilePos = pakFile->pos;
 
-			return FS_filelength(*file);
+		if(fs_debug->integer)
+		{
+			Com_Printf("FS_FOpenFileRead: %s (found in '%s')\n", filename, pak->pakFilename);
 		}
+
+		// Arnout: let's make this thing work from pakfiles as well
+		// FIXME: doing this seems to break things?
+		/*if ( fs_copyfiles->integer && fs_buildpath->string[0] && Q_stricmpn( fs_buildpath->string, pak->pakFilename, strlen(fs_buildpath->string) ) ) {
+		   char         copypath[MAX_OSPATH];
+		   fileHandle_t f;
+		   byte         *srcData;
+		   int              len = zfi->cur_file_info.uncompressed_size;
+
+		   Q_strncpyz( copypath, FS_BuildOSPath( fs_buildpath->string, fs_buildgame->string, filename ), sizeof(copypath) );
+		   netpath = FS_BuildOSPath( fs_basepath->string, fs_gamedir, filename );
+
+		   f = FS_FOpenFileWrite( filename );
+		   if ( !f ) {
+		   Com_Printf( "FS_FOpenFileRead Failed to open %s for copying\n", filename );
+		   } else {
+		   srcData = Hunk_AllocateTempMemory( len) ;
+		   FS_Read( srcData, len, *file );
+		   FS_Write( srcData, len, f );
+		   FS_FCloseFile( f );
+		   Hunk_FreeTempMemory( srcData );
+
+		   if (rename( netpath, copypath )) {
+		   // Failed, try copying it and deleting the original
+		   FS_CopyFile ( netpath, copypath );
+		   FS_Remove ( netpath );
+		   }
+		   }
+		   } */
+
+		return zfi->cur_file_info.uncompressed_size;
 	}
 
 	Com_DPrintf("Can't find %s\n", filename);
@@ -1773,6 +1903,41 @@ int FS_OSStatFile(char *ospath)
 }
 #endif
 
+/*
+==============
+FS_OSFileInfo
+
+Size and modification time of a file, qfalse if it can't be stat'ed
+==============
+*/
+#ifdef WIN32
+static qboolean FS_OSFileInfo(const char *ospath, int *size, int *mtime)
+{
+	struct _stat    stat;
+
+	if(_stat(ospath, &stat) == -1)
+	{
+		return qfalse;
+	}
+	*size = (int)stat.st_size;
+	*mtime = (int)stat.st_mtime;
+	return qtrue;
+}
+#else
+static qboolean FS_OSFileInfo(const char *ospath, int *size, int *mtime)
+{
+	struct stat     stat_buf;
+
+	if(stat(ospath, &stat_buf) == -1)
+	{
+		return qfalse;
+	}
+	*size = (int)stat_buf.st_size;
+	*mtime = (int)stat_buf.st_mtime;
+	return qtrue;
+}
+#endif
+
 /*
 ==============
 FS_Delete
@@ -2073,10 +2238,8 @@ CONVENIENCE FUNCTIONS FOR ENTIRE FILES
 
 int FS_FileIsInPAK(const char *filename, int *pChecksum)
 {
-	searchpath_t   *search;
+	fileIndex_t    *pakHit;
 	pack_t         *pak;
-	fileInPack_t   *pakFile;
-	long            hash = 0;
 
 	if(!fs_searchpaths)
 	{
@@ -2102,52 +2265,24 @@ int FS_FileIsInPAK(const char *filename, int *pChecksum)
 		return -1;
 	}
 
-	//
-	// search through the path, one element at a time
-	//
-
-	for(search = fs_searchpaths; search; search = search->next)
+	pakHit = FS_FindFileInPaks(filename, qtrue);
+	if(pakHit)
 	{
-		//
-		if(search->pack)
+		pak = pakHit->search->pack;
+		if(pChecksum)
 		{
-			hash = FS_HashFileName(filename, search->pack->hashSize);
+			*pChecksum = pak->pure_checksum;
 		}
-		// is the element a pak file?
-		if(search->pack && search->pack->hashTable[hash])
+		// Mac hack
+		if(pak->checksum == MP_LEGACY_PAK)
 		{
-			// disregard if it doesn't match one of the allowed pure pak files
-			if(!FS_PakIsPure(search->pack))
-			{
-				continue;
-			}
-
-			// look through all the pak file elements
-			pak = search->pack;
-			pakFile = pak->hashTable[hash];
-			do
-			{
-				// case and separator insensitive comparisons
-				if(!FS_FilenameCompare(pakFile->name, filename))
-				{
-					if(pChecksum)
-					{
-						*pChecksum = pak->pure_checksum;
-					}
-					// Mac hack
-					if(pak->checksum == MP_LEGACY_PAK)
-					{
-						legacy_mp_bin = qtrue;
-					}
-					else
-					{
-						legacy_mp_bin = qfalse;
-					}
-					return 1;
-				}
-				pakFile = pakFile->next;
-			} while(pakFile != NULL);
+			legacy_mp_bin = qtrue;
+		}
+		else
+		{
+			legacy_mp_bin = qfalse;
 		}
+		return 1;
 	}
 	return -1;
 }
@@ -2255,21 +2390,154 @@ int FS_ReadFile(const char *qpath, void **buffer)
 		return -1;
 	}
 
-	if(!buffer)
+	if(!buffer)
+	{
+		if(isConfig && com_journal && com_journal->integer == 1)
+		{
+			Com_DPrintf("Writing len for %s to journal file.\n", qpath);
+			FS_Write(&len, sizeof(len), com_journalDataFile);
+			FS_Flush(com_journalDataFile);
+		}
+		FS_FCloseFile(h);
+		return len;
+	}
+
+	fs_loadCount++;
+	fs_loadStack++;
+
+	buf = Hunk_AllocateTempMemory(len + 1);
+	*buffer = buf;
+
+	FS_Read(buf, len, h);
+
+	// guarantee that it will have a trailing 0 for string operations
+	buf[len] = 0;
+	FS_FCloseFile(h);
+
+	// if we are journalling and it is a config file, write it to the journal file
+	if(isConfig && com_journal && com_journal->integer == 1)
+	{
+		Com_DPrintf("Writing %s to journal file.\n", qpath);
+		FS_Write(&len, sizeof(len), com_journalDataFile);
+		FS_Write(buf, len, com_journalDataFile);
+		FS_Flush(com_journalDataFile);
+	}
+	return len;
+}
+
+/*
+============
+FS_MappedFileData
+
+Returns where the contents of a file opened from a pack can be found in
+the mapped pk3, NULL if it is compressed or the pk3 can't be mapped
+============
+*/
+static const byte *FS_MappedFileData(fileHandle_t f, int len)
+{
+	pack_t         *pak;
+	unz_s          *zfi;
+	file_in_zip_read_info_s *zfile;
+	unsigned long   offset;
+
+	if(!fsh[f].zipFile || !fsh[f].zipPak)
+	{
+		return NULL;
+	}
+
+	zfi = (unz_s *) fsh[f].handleFiles.file.z;
+	zfile = zfi->pfile_in_zip_read;
+	if(!zfile || zfile->compression_method != 0 || zfi->cur_file_info.compressed_size != len)
+	{
+		return NULL;
+	}
+
+	pak = fsh[f].zipPak;
+	if(!pak->mapped && pak->mappedLength != -1)
+	{
+		pak->mapped = Sys_MapFile(pak->pakFilename, &pak->mappedLength);
+		if(!pak->mapped)
+		{
+			pak->mappedLength = -1;
+		}
+	}
+	if(!pak->mapped)
+	{
+		return NULL;
+	}
+
+	offset = zfile->pos_in_zipfile + zfile->byte_before_the_zipfile;
+	if(offset > pak->mappedLength || pak->mappedLength - offset < len)
+	{
+		return NULL;
+	}
+
+	return pak->mapped + offset;
+}
+
+/*
+============
+FS_ReadFileReadOnly
+
+Same as FS_ReadFile, except that files stored without compression in a pk3
+are not copied.  The buffer points straight into the mapped pk3 then.
+============
+*/
+int FS_ReadFileReadOnly(const char *qpath, const void **buffer)
+{
+	fileHandle_t    h;
+	const byte     *data;
+	byte           *buf;
+	int             len;
+	int             i;
+
+	if(!fs_searchpaths)
+	{
+		Com_Error(ERR_FATAL, "Filesystem call made without initialization\n");
+	}
+
+	if(!qpath || !qpath[0])
+	{
+		Com_Error(ERR_FATAL, "FS_ReadFileReadOnly with empty name\n");
+	}
+
+	// configs can come from the journal, and a length check needs no data
+	if(!buffer || strstr(qpath, ".cfg"))
+	{
+		return FS_ReadFile(qpath, (void **)buffer);
+	}
+
+	for(i = 0; i < MAX_MAPPED_FILES; i++)
+	{
+		if(!fs_mappedFiles[i])
+		{
+			break;
+		}
+	}
+	if(i == MAX_MAPPED_FILES)
+	{
+		return FS_ReadFile(qpath, (void **)buffer);
+	}
+
+	len = FS_FOpenFileRead(qpath, &h, qfalse);
+	if(h == 0)
+	{
+		*buffer = NULL;
+		return -1;
+	}
+
+	fs_loadCount++;
+	fs_loadStack++;
+
+	data = FS_MappedFileData(h, len);
+	if(data)
 	{
-		if(isConfig && com_journal && com_journal->integer == 1)
-		{
-			Com_DPrintf("Writing len for %s to journal file.\n", qpath);
-			FS_Write(&len, sizeof(len), com_journalDataFile);
-			FS_Flush(com_journalDataFile);
-		}
+		fs_mappedFiles[i] = data;
+		*buffer = data;
 		FS_FCloseFile(h);
 		return len;
 	}
 
-	fs_loadCount++;
-	fs_loadStack++;
-
 	buf = Hunk_AllocateTempMemory(len + 1);
 	*buffer = buf;
 
@@ -2279,14 +2547,6 @@ int FS_ReadFile(const char *qpath, void **buffer)
 	buf[len] = 0;
 	FS_FCloseFile(h);
 
-	// if we are journalling and it is a config file, write it to the journal file
-	if(isConfig && com_journal && com_journal->integer == 1)
-	{
-		Com_DPrintf("Writing %s to journal file.\n", qpath);
-		FS_Write(&len, sizeof(len), com_journalDataFile);
-		FS_Write(buf, len, com_journalDataFile);
-		FS_Flush(com_journalDataFile);
-	}
 	return len;
 }
 
@@ -2297,6 +2557,8 @@ FS_FreeFile
 */
 void FS_FreeFile(void *buffer)
 {
+	int             i;
+
 	if(!fs_searchpaths)
 	{
 		Com_Error(ERR_FATAL, "Filesystem call made without initialization\n");
@@ -2307,7 +2569,19 @@ void FS_FreeFile(void *buffer)
 	}
 	fs_loadStack--;
 
-	Hunk_FreeTempMemory(buffer);
+	// buffers in mapped pk3s have nothing to free
+	for(i = 0; i < MAX_MAPPED_FILES; i++)
+	{
+		if(fs_mappedFiles[i] == buffer)
+		{
+			fs_mappedFiles[i] = NULL;
+			break;
+		}
+	}
+	if(i == MAX_MAPPED_FILES)
+	{
+		Hunk_FreeTempMemory(buffer);
+	}
 
 	// if all of our temp files are free, clear all of our space
 	if(fs_loadStack == 0)
@@ -2359,6 +2633,362 @@ ZIP FILE LOADING
 ==========================================================================
 */
 
+/*
+==========================================================================
+
+PAK DIRECTORY CACHE
+
+Reading the central directory of a pk3 takes a seek and a pile of tiny
+reads for every file in it.  The names, positions and crcs of all the
+packs are kept in a cache file in fs_homepath, keyed by the path, size and
+modification time of each pk3, so unchanged packs skip the scan on the
+next startup or FS_Restart.  The cache is only read back by the machine
+that wrote it, so it is in native byte order.
+
+==========================================================================
+*/
+
+#define PAKCACHE_NAME       "pakcache.dat"
+#define PAKCACHE_IDENT      (('C'<<24)+('K'<<16)+('A'<<8)+'P')
+#define PAKCACHE_VERSION    1
+
+#define PAKCACHE_ALIGN(x)   (((x) + 3) & ~3)
+
+typedef struct
+{
+	int             ident;
+	int             version;
+	int             numPaks;
+} pakCacheHeader_t;
+
+// followed by the path, the file positions, the header longs and the
+// names, each padded to 4 bytes
+typedef struct
+{
+	int             length;		// of the whole record
+	int             fileSize;
+	int             fileTime;
+	int             numFiles;
+	int             numHeaderLongs;
+	int             namesLength;
+	int             pathLength;
+} pakCacheRecord_t;
+
+static cvar_t  *fs_pakcache;
+static byte    *fs_pakCache;	// mapped cache file
+static int      fs_pakCacheLength;
+static int      fs_pakCacheNext;	// offset of the record after the last hit
+static int      fs_pakCacheHits;
+static int      fs_pakCacheMisses;
+
+/*
+=================
+FS_PakCachePath
+=================
+*/
+static const char *FS_PakCachePath(void)
+{
+	static char     path[MAX_OSPATH];
+
+	Com_sprintf(path, sizeof(path), "%s%c%s", fs_homepath->string, PATH_SEP, PAKCACHE_NAME);
+	return path;
+}
+
+/*
+=================
+FS_ValidatePakCache
+
+Makes sure every record lies inside the file so lookups can trust it
+=================
+*/
+static qboolean FS_ValidatePakCache(void)
+{
+	pakCacheHeader_t *header;
+	pakCacheRecord_t *record;
+	char           *path, *names;
+	int             offset, length, nulls;
+	int             i, j;
+
+	if(fs_pakCacheLength < sizeof(*header))
+	{
+		return qfalse;
+	}
+
+	header = (pakCacheHeader_t *) fs_pakCache;
+	if(header->ident != PAKCACHE_IDENT || header->version != PAKCACHE_VERSION || header->numPaks < 0)
+	{
+		return qfalse;
+	}
+
+	offset = sizeof(*header);
+	for(i = 0; i < header->numPaks; i++)
+	{
+		if(fs_pakCacheLength - offset < sizeof(*record))
+		{
+			return qfalse;
+		}
+
+		record = (pakCacheRecord_t *) (fs_pakCache + offset);
+		if(record->numFiles < 0 || record->numHeaderLongs < 0 || record->numHeaderLongs > record->numFiles ||
+		   record->namesLength < 0 || record->pathLength <= 0 || (record->pathLength & 3))
+		{
+			return qfalse;
+		}
+
+		length = sizeof(*record) + record->pathLength + (record->numFiles + record->numHeaderLongs) * sizeof(int) +
+			PAKCACHE_ALIGN(record->namesLength);
+		if(record->length != length || fs_pakCacheLength - offset < length)
+		{
+			return qfalse;
+		}
+
+		path = (char *)(record + 1);
+		if(path[record->pathLength - 1])
+		{
+			return qfalse;
+		}
+
+		// there must be exactly one name per file
+		names = (char *)record + length - PAKCACHE_ALIGN(record->namesLength);
+		nulls = 0;
+		for(j = 0; j < record->namesLength; j++)
+		{
+			if(!names[j])
+			{
+				nulls++;
+			}
+		}
+		if(nulls != record->numFiles || (record->namesLength && names[record->namesLength - 1]))
+		{
+			return qfalse;
+		}
+
+		offset += length;
+	}
+
+	return qtrue;
+}
+
+/*
+=================
+FS_OpenPakCache
+=================
+*/
+static void FS_OpenPakCache(void)
+{
+	fs_pakCache = NULL;
+	fs_pakCacheLength = 0;
+	fs_pakCacheNext = sizeof(pakCacheHeader_t);
+	fs_pakCacheHits = 0;
+	fs_pakCacheMisses = 0;
+
+	if(!fs_pakcache->integer)
+	{
+		return;
+	}
+
+	fs_pakCache = Sys_MapFile(FS_PakCachePath(), &fs_pakCacheLength);
+	if(fs_pakCache && !FS_ValidatePakCache())
+	{
+		Com_Printf("Ignoring bad pak cache %s\n", FS_PakCachePath());
+		Sys_UnmapFile(fs_pakCache, fs_pakCacheLength);
+		fs_pakCache = NULL;
+	}
+}
+
+/*
+=================
+FS_FindCachedPak
+=================
+*/
+static pakCacheRecord_t *FS_FindCachedPak(const char *zipfile, int fileSize, int fileTime)
+{
+	pakCacheRecord_t *record;
+	int             numPaks;
+	int             offset;
+	int             i;
+
+	if(!fs_pakCache)
+	{
+		return NULL;
+	}
+
+	// the records are written in load order, so the one following the
+	// last hit is nearly always the one we are looking for
+	numPaks = ((pakCacheHeader_t *) fs_pakCache)->numPaks;
+	offset = fs_pakCacheNext;
+	for(i = 0; i <= numPaks; i++)
+	{
+		if(offset >= fs_pakCacheLength)
+		{
+			offset = sizeof(pakCacheHeader_t);
+			continue;
+		}
+
+		record = (pakCacheRecord_t *) (fs_pakCache + offset);
+		offset += record->length;
+
+		if(record->fileSize == fileSize && record->fileTime == fileTime && !strcmp((char *)(record + 1), zipfile))
+		{
+			fs_pakCacheNext = offset;
+			return record;
+		}
+	}
+
+	return NULL;
+}
+
+/*
+=================
+FS_WritePakCache
+
+Writes the directories of all the loaded packs, in load order.
+The cache is written next to the old one and renamed over it, another
+process sharing the home path may still have the old one mapped
+=================
+*/
+static void FS_WritePakCache(void)
+{
+	pakCacheHeader_t header;
+	pakCacheRecord_t record;
+	searchpath_t   *search;
+	pack_t        **paks;
+	pack_t         *pak;
+	const char     *path;
+	char            tempPath[MAX_OSPATH];
+	FILE           *f;
+	qboolean        failed;
+	int             numPaks;
+	int             pos;
+	int             i, j;
+	static const char pad[4] = { 0, 0, 0, 0 };
+
+	numPaks = 0;
+	for(search = fs_searchpaths; search; search = search->next)
+	{
+		if(search->pack)
+		{
+			numPaks++;
+		}
+	}
+
+	path = FS_PakCachePath();
+	Com_sprintf(tempPath, sizeof(tempPath), "%s.tmp", path);
+	FS_CreatePath(tempPath);
+	f = fopen(tempPath, "wb");
+	if(!f)
+	{
+		Com_DPrintf("Couldn't write pak cache %s\n", tempPath);
+		return;
+	}
+
+	// the search path has the most recently loaded pack first
+	paks = Z_Malloc((numPaks + 1) * sizeof(*paks));
+	i = numPaks;
+	for(search = fs_searchpaths; search; search = search->next)
+	{
+		if(search->pack)
+		{
+			paks[--i] = search->pack;
+		}
+	}
+
+	header.ident = PAKCACHE_IDENT;
+	header.version = PAKCACHE_VERSION;
+	header.numPaks = numPaks;
+	fwrite(&header, sizeof(header), 1, f);
+
+	for(i = 0; i < numPaks; i++)
+	{
+		pak = paks[i];
+
+		record.fileSize = pak->fileSize;
+		record.fileTime = pak->fileTime;
+		record.numFiles = pak->numfiles;
+		record.numHeaderLongs = pak->numHeaderLongs;
+		record.namesLength = pak->namesLength;
+		record.pathLength = PAKCACHE_ALIGN(strlen(pak->pakFilename) + 1);
+		record.length = sizeof(record) + record.pathLength + (record.numFiles + record.numHeaderLongs) * sizeof(int) +
+			PAKCACHE_ALIGN(record.namesLength);
+		fwrite(&record, sizeof(record), 1, f);
+
+		fwrite(pak->pakFilename, strlen(pak->pakFilename), 1, f);
+		fwrite(pad, record.pathLength - strlen(pak->pakFilename), 1, f);
+
+		for(j = 0; j < pak->numfiles; j++)
+		{
+			pos = pak->buildBuffer[j].pos;
+			fwrite(&pos, sizeof(pos), 1, f);
+		}
+		fwrite(pak->headerLongs, sizeof(int), pak->numHeaderLongs, f);
+
+		if(pak->numfiles)
+		{
+			fwrite(pak->buildBuffer[0].name, pak->namesLength, 1, f);
+		}
+		fwrite(pad, PAKCACHE_ALIGN(pak->namesLength) - pak->namesLength, 1, f);
+	}
+
+	failed = ferror(f) != 0;
+	if(fclose(f))
+	{
+		failed = qtrue;
+	}
+	Z_Free(paks);
+
+	if(failed)
+	{
+		Com_DPrintf("Couldn't write pak cache %s\n", tempPath);
+		remove(tempPath);
+		return;
+	}
+
+	// rename doesn't replace an existing file on windows
+	if(rename(tempPath, path))
+	{
+		remove(path);
+		if(rename(tempPath, path))
+		{
+			Com_DPrintf("Couldn't replace pak cache %s\n", path);
+			remove(tempPath);
+		}
+	}
+}
+
+/*
+=================
+FS_ClosePakCache
+
+Drops the mapping and rewrites the cache if any pack was missing from it
+=================
+*/
+static void FS_ClosePakCache(void)
+{
+	int             numPaks;
+
+	numPaks = 0;
+	if(fs_pakCache)
+	{
+		numPaks = ((pakCacheHeader_t *) fs_pakCache)->numPaks;
+		Sys_UnmapFile(fs_pakCache, fs_pakCacheLength);
+		fs_pakCache = NULL;
+	}
+
+	if(!fs_pakcache->integer)
+	{
+		return;
+	}
+
+	Com_DPrintf("%d of %d pk3 directories read from %s\n", fs_pakCacheHits, fs_pakCacheHits + fs_pakCacheMisses,
+				PAKCACHE_NAME);
+
+	// stale records are dropped too
+	if(fs_pakCacheMisses || fs_pakCacheHits != numPaks)
+	{
+		FS_WritePakCache();
+	}
+}
+
 /*
 =================
 FS_LoadZipFile
@@ -2381,6 +3011,10 @@ static pack_t  *FS_LoadZipFile(char *zipfile, const char *basename)
 	int             fs_numHeaderLongs;
 	int            *fs_headerLongs;
 	char           *namePtr;
+	pakCacheRecord_t *cached;
+	int            *cachedPos;
+	int             numFiles;
+	int             fileSize, fileTime;
 // XreaL BEGIN
 	// RB: added for debugging
 	int             sizeOfHeaderLongs;
@@ -2400,22 +3034,47 @@ static pack_t  *FS_LoadZipFile(char *zipfile, const char *basename)
 
 	fs_packFiles += gi.number_entry;
 
-	len = 0;
-	unzGoToFirstFile(uf);
-	for(i = 0; i < gi.number_entry; i++)
+	cached = NULL;
+	if(!FS_OSFileInfo(zipfile, &fileSize, &fileTime))
+	{
+		fileSize = fileTime = -1;
+	}
+	else
 	{
-		err = unzGetCurrentFileInfo(uf, &file_info, filename_inzip, sizeof(filename_inzip), NULL, 0, NULL, 0);
-		if(err != UNZ_OK)
+		cached = FS_FindCachedPak(zipfile, fileSize, fileTime);
+		if(cached && cached->numFiles > gi.number_entry)
 		{
-			break;
+			cached = NULL;
+		}
+	}
+
+	if(cached)
+	{
+		fs_pakCacheHits++;
+		numFiles = cached->numFiles;
+		len = cached->namesLength;
+	}
+	else
+	{
+		fs_pakCacheMisses++;
+		len = 0;
+		unzGoToFirstFile(uf);
+		for(i = 0; i < gi.number_entry; i++)
+		{
+			err = unzGetCurrentFileInfo(uf, &file_info, filename_inzip, sizeof(filename_inzip), NULL, 0, NULL, 0);
+			if(err != UNZ_OK)
+			{
+				break;
+			}
+			len += strlen(filename_inzip) + 1;
+			unzGoToNextFile(uf);
 		}
-		len += strlen(filename_inzip) + 1;
-		unzGoToNextFile(uf);
+		numFiles = i;
 	}
 
-	buildBuffer = Z_Malloc((gi.number_entry * sizeof(fileInPack_t)) + len);
-	namePtr = ((char *)buildBuffer) + gi.number_entry * sizeof(fileInPack_t);
-	fs_headerLongs = Z_Malloc(gi.number_entry * sizeof(int));
+	buildBuffer = Z_Malloc((numFiles * (sizeof(fileInPack_t) + sizeof(int))) + len);
+	fs_headerLongs = (int *)(buildBuffer + numFiles);
+	namePtr = (char *)(fs_headerLongs + numFiles);
 
 	// get the hash table size from the number of files in the zip
 	// because lots of custom pk3 files have less than 32 or 64 files
@@ -2445,31 +3104,53 @@ static pack_t  *FS_LoadZipFile(char *zipfile, const char *basename)
 	}
 
 	pack->handle = uf;
-	pack->numfiles = gi.number_entry;
-	unzGoToFirstFile(uf);
+	pack->numfiles = numFiles;
 
-	for(i = 0; i < gi.number_entry; i++)
+	if(cached)
 	{
-		err = unzGetCurrentFileInfo(uf, &file_info, filename_inzip, sizeof(filename_inzip), NULL, 0, NULL, 0);
-		if(err != UNZ_OK)
+		cachedPos = (int *)((char *)(cached + 1) + cached->pathLength);
+		fs_numHeaderLongs = cached->numHeaderLongs;
+		Com_Memcpy(fs_headerLongs, cachedPos + numFiles, fs_numHeaderLongs * sizeof(int));
+		Com_Memcpy(namePtr, cachedPos + numFiles + fs_numHeaderLongs, len);
+
+		for(i = 0; i < numFiles; i++)
 		{
-			break;
+			hash = FS_HashFileName(namePtr, pack->hashSize);
+			buildBuffer[i].name = namePtr;
+			namePtr += strlen(namePtr) + 1;
+			buildBuffer[i].pos = (unsigned int)cachedPos[i];
+			//
+			buildBuffer[i].next = pack->hashTable[hash];
+			pack->hashTable[hash] = &buildBuffer[i];
 		}
-		if(file_info.uncompressed_size > 0)
+	}
+	else
+	{
+		unzGoToFirstFile(uf);
+
+		for(i = 0; i < numFiles; i++)
 		{
-			fs_headerLongs[fs_numHeaderLongs++] = LittleLong(file_info.crc);
+			err = unzGetCurrentFileInfo(uf, &file_info, filename_inzip, sizeof(filename_inzip), NULL, 0, NULL, 0);
+			if(err != UNZ_OK)
+			{
+				break;
+			}
+			if(file_info.uncompressed_size > 0)
+			{
+				fs_headerLongs[fs_numHeaderLongs++] = LittleLong(file_info.crc);
+			}
+			Q_strlwr(filename_inzip);
+			hash = FS_HashFileName(filename_inzip, pack->hashSize);
+			buildBuffer[i].name = namePtr;
+			strcpy(buildBuffer[i].name, filename_inzip);
+			namePtr += strlen(filename_inzip) + 1;
+			// store the file position in the zip
+			unzGetCurrentFileInfoPosition(uf, &buildBuffer[i].pos);
+			//
+			buildBuffer[i].next = pack->hashTable[hash];
+			pack->hashTable[hash] = &buildBuffer[i];
+			unzGoToNextFile(uf);
 		}
-		Q_strlwr(filename_inzip);
-		hash = FS_HashFileName(filename_inzip, pack->hashSize);
-		buildBuffer[i].name = namePtr;
-		strcpy(buildBuffer[i].name, filename_inzip);
-		namePtr += strlen(filename_inzip) + 1;
-		// store the file position in the zip
-		unzGetCurrentFileInfoPosition(uf, &buildBuffer[i].pos);
-		//
-		buildBuffer[i].next = pack->hashTable[hash];
-		pack->hashTable[hash] = &buildBuffer[i];
-		unzGoToNextFile(uf);
 	}
 
 // XreaL BEGIN
@@ -2482,9 +3163,12 @@ static pack_t  *FS_LoadZipFile(char *zipfile, const char *basename)
 	pack->checksum = LittleLong(pack->checksum);
 	pack->pure_checksum = LittleLong(pack->pure_checksum);
 
-	Z_Free(fs_headerLongs);
-
 	pack->buildBuffer = buildBuffer;
+	pack->headerLongs = fs_headerLongs;
+	pack->numHeaderLongs = fs_numHeaderLongs;
+	pack->namesLength = len;
+	pack->fileSize = fileSize;
+	pack->fileTime = fileTime;
 	return pack;
 }
 
@@ -3650,6 +4334,10 @@ void FS_Shutdown(qboolean closemfp)
 
 		if(p->pack)
 		{
+			if(p->pack->mapped)
+			{
+				Sys_UnmapFile(p->pack->mapped, p->pack->mappedLength);
+			}
 			unzClose(p->pack->handle);
 			Z_Free(p->pack->buildBuffer);
 			Z_Free(p->pack);
@@ -3661,6 +4349,8 @@ void FS_Shutdown(qboolean closemfp)
 		Z_Free(p);
 	}
 
+	FS_FreeFileIndex();
+
 	// any FS_ calls will now be an error until reinitialized
 	fs_searchpaths = NULL;
 
@@ -3749,6 +4439,9 @@ static void FS_Startup(const char *gameName)
 	fs_homepath = Cvar_Get("fs_homepath", homePath, CVAR_INIT);
 	fs_gamedirvar = Cvar_Get("fs_game", "", CVAR_INIT | CVAR_SYSTEMINFO);
 	fs_restrict = Cvar_Get("fs_restrict", "", CVAR_INIT);
+	fs_pakcache = Cvar_Get("fs_pakcache", "1", CVAR_INIT);
+
+	FS_OpenPakCache();
 
 	// add search path elements in reverse priority order
 	if(fs_cdpath->string[0])
@@ -3802,6 +4495,8 @@ static void FS_Startup(const char *gameName)
 	}
 #endif							// PRE_RELEASE_DEMO
 
+	FS_ClosePakCache();
+
 	Com_ReadCDKey(BASEGAME);
 	fs = Cvar_Get("fs_game", "", CVAR_INIT | CVAR_SYSTEMINFO);
 	if(fs && fs->string[0] != 0)
@@ -3819,6 +4514,8 @@ static void FS_Startup(const char *gameName)
 	// reorder the pure pk3 files according to server order
 	FS_ReorderPurePaks();
 
+	FS_BuildFileIndex();
+
 	// print the current search paths
 	FS_Path_f();
 
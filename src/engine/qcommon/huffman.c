@@ -36,22 +36,23 @@ If you have questions concerning this license or the applicable additional terms
 
 static int      bloc = 0;
 
+// the offset versions below never touch bloc, so messages
+// can be written and read from several threads at once
+
 //bani - optimized version
 //clears data along the way so we dont have to memset() it ahead of time
 void Huff_putBit(int bit, byte * fout, int *offset)
 {
 	int             x, y;
 
-	bloc = *offset;
-	x = bloc >> 3;
-	y = bloc & 7;
+	x = *offset >> 3;
+	y = *offset & 7;
 	if(!y)
 	{
 		fout[x] = 0;
 	}
 	fout[x] |= bit << y;
-	bloc++;
-	*offset = bloc;
+	(*offset)++;
 }
 
 //bani - optimized version
@@ -60,13 +61,39 @@ int Huff_getBit(byte * fin, int *offset)
 {
 	int             t;
 
-	bloc = *offset;
-	t = fin[bloc >> 3] >> (bloc & 7) & 0x1;
-	bloc++;
-	*offset = bloc;
+	t = fin[*offset >> 3] >> (*offset & 7) & 0x1;
+	(*offset)++;
 	return t;
 }
 
+//clears data along the way like Huff_putBit, but a byte at a time,
+//bits go out starting with bit 0
+void Huff_putBits(unsigned int bits, int numBits, byte * fout, int *offset)
+{
+	int             x, y, n;
+	int             pos = *offset;
+
+	while(numBits > 0)
+	{
+		x = pos >> 3;
+		y = pos & 7;
+		if(!y)
+		{
+			fout[x] = 0;
+		}
+		n = 8 - y;
+		if(n > numBits)
+		{
+			n = numBits;
+		}
+		fout[x] |= (bits & ((1 << n) - 1)) << y;
+		bits >>= n;
+		numBits -= n;
+		pos += n;
+	}
+	*offset = pos;
+}
+
 //bani - optimized version
 //clears data along the way so we dont have to memset() it ahead of time
 static void add_bit(char bit, byte * fout)
@@ -367,10 +394,11 @@ int Huff_Receive(node_t * node, int *ch, byte * fin)
 /* Get a symbol */
 void Huff_offsetReceive(node_t * node, int *ch, byte * fin, int *offset)
 {
-	bloc = *offset;
+	int             pos = *offset;
+
 	while(node && node->symbol == INTERNAL_NODE)
 	{
-		if(get_bit(fin))
+		if(Huff_getBit(fin, &pos))
 		{
 			node = node->right;
 		}
@@ -386,7 +414,7 @@ void Huff_offsetReceive(node_t * node, int *ch, byte * fin, int *offset)
 //      Com_Error(ERR_DROP, "Illegal tree!\n");
 	}
 	*ch = node->symbol;
-	*offset = bloc;
+	*offset = pos;
 }
 
 /* Send the prefix code for this node */
@@ -409,6 +437,19 @@ static void send(node_t * node, node_t * child, byte * fout)
 	}
 }
 
+/* Send the prefix code for this node at offset */
+static void offsetSend(node_t * node, node_t * child, byte * fout, int *offset)
+{
+	if(node->parent)
+	{
+		offsetSend(node->parent, node, fout, offset);
+	}
+	if(child)
+	{
+		Huff_putBit(node->right == child, fout, offset);
+	}
+}
+
 /* Send a symbol */
 void Huff_transmit(huff_t * huff, int ch, byte * fout)
 {
@@ -431,9 +472,89 @@ void Huff_transmit(huff_t * huff, int ch, byte * fout)
 
 void Huff_offsetTransmit(huff_t * huff, int ch, byte * fout, int *offset)
 {
-	bloc = *offset;
-	send(huff->loc[ch], NULL, fout);
-	*offset = bloc;
+	offsetSend(huff->loc[ch], NULL, fout, offset);
+}
+
+/* Precompute the codes of a tree that isn't going to change anymore */
+void Huff_BuildTable(huffTable_t * table, huff_t * huff)
+{
+	int             ch, i, len;
+	unsigned int    code;
+	node_t         *node;
+
+	Com_Memset(table, 0, sizeof(*table));
+	table->huff = huff;
+
+	for(ch = 0; ch <= HMAX; ch++)
+	{
+		if(!huff->loc[ch])
+		{
+			continue;
+		}
+
+		// collect the code from the leaf up, so the bit next to
+		// the root, which goes out first, ends up at bit 0
+		code = 0;
+		len = 0;
+		for(node = huff->loc[ch]; node->parent; node = node->parent)
+		{
+			if(len == 32)
+			{
+				break;
+			}
+			code = (code << 1) | (node->parent->right == node);
+			len++;
+		}
+		if(node->parent)
+		{
+			continue;			// too long, leave it to the tree
+		}
+
+		table->code[ch] = code;
+		table->codeLen[ch] = len;
+
+		// every index starting with the code decodes to the symbol
+		if(len && len <= HUFF_LOOKUP_BITS)
+		{
+			for(i = code; i < (1 << HUFF_LOOKUP_BITS); i += 1 << len)
+			{
+				table->lookup[i] = ch;
+				table->lookupLen[i] = len;
+			}
+		}
+	}
+}
+
+/* Send a symbol at offset, same bits as Huff_offsetTransmit */
+void Huff_TableTransmit(const huffTable_t * table, int ch, byte * fout, int *offset)
+{
+	if(!table->codeLen[ch])
+	{
+		Huff_offsetTransmit(table->huff, ch, fout, offset);
+		return;
+	}
+	Huff_putBits(table->code[ch], table->codeLen[ch], fout, offset);
+}
+
+/* Get a symbol at offset, same as Huff_offsetReceive, maxsize is the size of fin in bytes */
+void Huff_TableReceive(const huffTable_t * table, int *ch, byte * fin, int *offset, int maxsize)
+{
+	int             x, peek, len;
+
+	// the next HUFF_LOOKUP_BITS bits are always within three bytes
+	x = *offset >> 3;
+	if(x + 2 < maxsize)
+	{
+		peek = ((fin[x] | (fin[x + 1] << 8) | (fin[x + 2] << 16)) >> (*offset & 7)) & ((1 << HUFF_LOOKUP_BITS) - 1);
+		len = table->lookupLen[peek];
+		if(len)
+		{
+			*ch = table->lookup[peek];
+			*offset += len;
+			return;
+		}
+	}
+	Huff_offsetReceive(table->huff->tree, ch, fin, offset);
 }
 
 void Huff_Decompress(msg_t * mbuf, int offset)
@@ -495,8 +616,6 @@ void Huff_Decompress(msg_t * mbuf, int offset)
 	Com_Memcpy(mbuf->data + offset, seq, cch);
 }
 
-extern int      oldsize;
-
 void Huff_Compress(msg_t * mbuf, int offset)
 {
 	int             i, ch, size;
@@ -30,12 +30,11 @@ If you have questions concerning this license or the applicable additional terms
 #include "qcommon.h"
 
 static huffman_t msgHuff;
+static huffTable_t msgHuffCompressor;
+static huffTable_t msgHuffDecompressor;
 static qboolean msgInit = qfalse;
 
 int             pcount[256];
-int             wastedbits = 0;
-
-static int      oldsize = 0;
 
 // static int overflows = 0;
 
@@ -144,7 +143,7 @@ void MSG_WriteBits(msg_t * msg, int value, int bits)
 
 //  FILE*   fp;
 
-	oldsize += bits;
+	msg->oldsize += bits;
 
 	msg->uncompsize += bits;	// NERVE - SMF - net debugging
 
@@ -226,11 +225,8 @@ void MSG_WriteBits(msg_t * msg, int value, int bits)
 			int             nbits;
 
 			nbits = bits & 7;
-			for(i = 0; i < nbits; i++)
-			{
-				Huff_putBit((value & 1), msg->data, &msg->bit);
-				value = (value >> 1);
-			}
+			Huff_putBits(value, nbits, msg->data, &msg->bit);
+			value = ((unsigned int)value >> nbits);
 			bits = bits - nbits;
 		}
 		if(bits)
@@ -238,7 +234,7 @@ void MSG_WriteBits(msg_t * msg, int value, int bits)
 			for(i = 0; i < bits; i += 8)
 			{
 //              fwrite(bp, 1, 1, fp);
-				Huff_offsetTransmit(&msgHuff.compressor, (value & 0xff), msg->data, &msg->bit);
+				Huff_TableTransmit(&msgHuffCompressor, (value & 0xff), msg->data, &msg->bit);
 				value = (value >> 8);
 			}
 		}
@@ -247,6 +243,59 @@ void MSG_WriteBits(msg_t * msg, int value, int bits)
 	}
 }
 
+/*
+==================
+MSG_WriteEncodedBits
+
+Appends numBits of an already Huffman coded bitstream, as left in the
+data of a message that was written from bit 0 with MSG_WriteBits.
+uncompBits is the uncompressed size of what was coded.
+==================
+*/
+void MSG_WriteEncodedBits(msg_t * msg, const byte * data, int numBits, int uncompBits)
+{
+	int             i, numBytes, shift;
+	byte           *out;
+
+	msg->oldsize += uncompBits;
+
+	msg->uncompsize += uncompBits;	// NERVE - SMF - net debugging
+
+	// this isn't an exact overflow check, but close enough
+	if(msg->maxsize - msg->cursize < 32 + (numBits >> 3))
+	{
+		msg->overflowed = qtrue;
+		return;
+	}
+
+	if(msg->oob)
+	{
+		Com_Error(ERR_DROP, "MSG_WriteEncodedBits: out of band message");
+	}
+
+	numBytes = (numBits + 7) >> 3;
+	shift = msg->bit & 7;
+	out = msg->data + (msg->bit >> 3);
+
+	if(!shift)
+	{
+		memcpy(out, data, numBytes);
+	}
+	else
+	{
+		// keep the bits already written to the first byte
+		out[0] &= (1 << shift) - 1;
+		for(i = 0; i < numBytes; i++)
+		{
+			out[i] |= data[i] << shift;
+			out[i + 1] = data[i] >> (8 - shift);
+		}
+	}
+
+	msg->bit += numBits;
+	msg->cursize = (msg->bit >> 3) + 1;
+}
+
 int MSG_ReadBits(msg_t * msg, int bits)
 {
 	int             value;
@@ -314,7 +363,7 @@ int MSG_ReadBits(msg_t * msg, int bits)
 //          fp = fopen("c:\\netchan.bin", "a");
 			for(i = 0; i < bits; i += 8)
 			{
-				Huff_offsetReceive(msgHuff.decompressor.tree, &get, msg->data, &msg->bit);
+				Huff_TableReceive(&msgHuffDecompressor, &get, msg->data, &msg->bit, msg->maxsize);
 //              fwrite(&get, 1, 1, fp);
 				value |= (get << (i + nbits));
 			}
@@ -887,7 +936,7 @@ void MSG_WriteDeltaUsercmdKey(msg_t * msg, int key, usercmd_t * from, usercmd_t
 	   from->flags == to->flags && from->doubleTap == to->doubleTap && from->identClient == to->identClient)
 	{							// NERVE - SMF
 		MSG_WriteBits(msg, 0, 1);	// no change
-		oldsize += 7;
+		msg->oldsize += 7;
 		return;
 	}
 	key ^= to->serverTime;
@@ -1198,7 +1247,7 @@ void MSG_WriteDeltaEntity(msg_t * msg, struct entityState_s *from, struct entity
 
 	MSG_WriteByte(msg, lc);		// # of changes
 
-	oldsize += numFields;
+	msg->oldsize += numFields;
 
 //  Com_Printf( "Delta for ent %i: ", to->number );
 
@@ -1211,7 +1260,7 @@ void MSG_WriteDeltaEntity(msg_t * msg, struct entityState_s *from, struct entity
 		{
 			MSG_WriteBits(msg, 0, 1);	// no change
 
-			wastedbits++;
+			msg->wastedbits++;
 
 			continue;
 		}
@@ -1227,7 +1276,7 @@ void MSG_WriteDeltaEntity(msg_t * msg, struct entityState_s *from, struct entity
 			if(fullFloat == 0.0f)
 			{
 				MSG_WriteBits(msg, 0, 1);
-				oldsize += FLOAT_INT_BITS;
+				msg->oldsize += FLOAT_INT_BITS;
 			}
 			else
 			{
@@ -1737,7 +1786,7 @@ void MSG_WriteDeltaPlayerstate(msg_t * msg, struct playerState_s *from, struct p
 
 	MSG_WriteByte(msg, lc);		// # of changes
 
-	oldsize += numFields - lc;
+	msg->oldsize += numFields - lc;
 
 	for(i = 0, field = playerStateFields; i < lc; i++, field++)
 	{
@@ -1746,7 +1795,7 @@ void MSG_WriteDeltaPlayerstate(msg_t * msg, struct playerState_s *from, struct p
 
 		if(*fromF == *toF)
 		{
-			wastedbits++;
+			msg->wastedbits++;
 
 			MSG_WriteBits(msg, 0, 1);	// no change
 			continue;
@@ -1903,7 +1952,7 @@ void MSG_WriteDeltaPlayerstate(msg_t * msg, struct playerState_s *from, struct p
 	else
 	{
 		MSG_WriteBits(msg, 0, 1);	// no change to any
-		oldsize += 4;
+		msg->oldsize += 4;
 	}
 
 
@@ -2625,6 +2674,113 @@ void MSG_initHuffman()
 			Huff_addRef(&msgHuff.decompressor, (byte) i);	/* Do update */
 		}
 	}
+
+	// the trees never change after this
+	Huff_BuildTable(&msgHuffCompressor, &msgHuff.compressor);
+	Huff_BuildTable(&msgHuffDecompressor, &msgHuff.decompressor);
+}
+
+/*
+=================
+MSG_HuffmanBenchmark_f
+
+Codes bytes distributed like msg_hData with the tree walk and with the
+lookup tables, checks that both agree and prints how long each took
+=================
+*/
+void MSG_HuffmanBenchmark_f(void)
+{
+	static byte     src[MAX_MSGLEN / 2];
+	static byte     treeBits[MAX_MSGLEN], tableBits[MAX_MSGLEN];
+	static byte     treeOut[MAX_MSGLEN / 2], tableOut[MAX_MSGLEN / 2];
+	int             i, j, loops, total, r, ch;
+	int             treeOfs, tableOfs;
+	int             treeSend, treeReceive, tableSend, tableReceive;
+	int             start;
+
+	if(!msgInit)
+	{
+		MSG_initHuffman();
+	}
+
+	loops = 100;
+	if(Cmd_Argc() > 1)
+	{
+		loops = atoi(Cmd_Argv(1));
+		if(loops < 1)
+		{
+			loops = 1;
+		}
+	}
+
+	total = 0;
+	for(i = 0; i < 256; i++)
+	{
+		total += msg_hData[i];
+	}
+	for(i = 0; i < sizeof(src); i++)
+	{
+		r = random() * (total - 1);
+		for(ch = 0; ch < 255 && r >= msg_hData[ch]; ch++)
+		{
+			r -= msg_hData[ch];
+		}
+		src[i] = ch;
+	}
+
+	treeOfs = tableOfs = 0;
+
+	start = Sys_Milliseconds();
+	for(j = 0; j < loops; j++)
+	{
+		for(i = 0, treeOfs = 0; i < sizeof(src); i++)
+		{
+			Huff_offsetTransmit(&msgHuff.compressor, src[i], treeBits, &treeOfs);
+		}
+	}
+	treeSend = Sys_Milliseconds() - start;
+
+	start = Sys_Milliseconds();
+	for(j = 0; j < loops; j++)
+	{
+		for(i = 0, tableOfs = 0; i < sizeof(src); i++)
+		{
+			Huff_TableTransmit(&msgHuffCompressor, src[i], tableBits, &tableOfs);
+		}
+	}
+	tableSend = Sys_Milliseconds() - start;
+
+	start = Sys_Milliseconds();
+	for(j = 0; j < loops; j++)
+	{
+		for(i = 0, r = 0; i < sizeof(src); i++)
+		{
+			Huff_offsetReceive(msgHuff.decompressor.tree, &ch, treeBits, &r);
+			treeOut[i] = ch;
+		}
+	}
+	treeReceive = Sys_Milliseconds() - start;
+
+	start = Sys_Milliseconds();
+	for(j = 0; j < loops; j++)
+	{
+		for(i = 0, r = 0; i < sizeof(src); i++)
+		{
+			Huff_TableReceive(&msgHuffDecompressor, &ch, tableBits, &r, sizeof(tableBits));
+			tableOut[i] = ch;
+		}
+	}
+	tableReceive = Sys_Milliseconds() - start;
+
+	Com_Printf("%i x %i bytes coded to %i bits\n", loops, (int)sizeof(src), treeOfs);
+	Com_Printf("tree:  send %5i msec, receive %5i msec\n", treeSend, treeReceive);
+	Com_Printf("table: send %5i msec, receive %5i msec\n", tableSend, tableReceive);
+
+	if(treeOfs != tableOfs || memcmp(treeBits, tableBits, (treeOfs + 7) >> 3) ||
+	   memcmp(treeOut, src, sizeof(src)) || memcmp(tableOut, src, sizeof(src)))
+	{
+		Com_Printf(S_COLOR_RED "tree and table coding differ\n");
+	}
 }
 
 /*
@@ -58,6 +58,8 @@ typedef struct
 	int             maxsize;
 	int             cursize;
 	int             uncompsize;	// NERVE - SMF - net debugging
+	int             oldsize;	// net debugging, kept per message so snapshot jobs can encode concurrently
+	int             wastedbits;	// net debugging
 	int             readcount;
 	int             bit;		// for bitwise reads and writes
 } msg_t;
@@ -81,6 +83,7 @@ struct entityState_s;
 struct playerState_s;
 
 void            MSG_WriteBits(msg_t * msg, int value, int bits);
+void            MSG_WriteEncodedBits(msg_t * msg, const byte * data, int numBits, int uncompBits);
 
 void            MSG_WriteChar(msg_t * sb, int c);
 void            MSG_WriteByte(msg_t * sb, int c);
@@ -123,6 +126,7 @@ void            MSG_ReadDeltaPlayerstate(msg_t * msg, struct playerState_s *from
 
 
 void            MSG_ReportChangeVectors_f(void);
+void            MSG_HuffmanBenchmark_f(void);
 
 //============================================================================
 
@@ -201,6 +205,7 @@ const char     *NET_AdrToString(netadr_t a);
 qboolean        NET_StringToAdr(const char *s, netadr_t * a);
 qboolean        NET_GetLoopPacket(netsrc_t sock, netadr_t * net_from, msg_t * net_message);
 void            NET_Sleep(int msec);
+void            NET_SleepUntil(int64_t usec);
 
 
 //----(SA)  increased for larger submodel entity counts
@@ -615,6 +620,11 @@ extern int      cvar_modifiedFlags;
 // etc, variables have been modified since the last check.  The bit
 // can then be cleared to allow another change detection.
 
+extern int      cvar_modificationCount;
+
+// incremented whenever any cvar is created, removed, changes value or gains
+// flags, so a cache built from cvars can tell whether it is still current
+
 /*
 ==============================================================
 
@@ -728,6 +738,13 @@ int             FS_ReadFile(const char *qpath, void **buffer);
 // the buffer should be considered read-only, because it may be cached
 // for other uses.
 
+int             FS_ReadFileReadOnly(const char *qpath, const void **buffer);
+
+// like FS_ReadFile, but files stored uncompressed in a pk3 are returned
+// as a pointer into the memory mapped pk3 instead of a copy, so the buffer
+// really must not be written to and has no trailing 0.
+// Release it with FS_FreeFile.
+
 void            FS_ForceFlush(fileHandle_t f);
 
 // forces flush on files we're writing to.
@@ -1207,6 +1224,18 @@ void           *Sys_InitializeCriticalSection();
 void            Sys_EnterCriticalSection(void *ptr);
 void            Sys_LeaveCriticalSection(void *ptr);
 
+// worker threads for spreading independent jobs over several cores,
+// Sys_RunJobs runs func for every jobNum in [0, numJobs) and returns when all are done,
+// threadNum is 0 for the calling thread and 1 .. Sys_NumJobThreads() for the workers
+#define MAX_JOB_THREADS 32
+
+typedef void    (*jobFunc_t) (void *data, int jobNum, int threadNum);
+
+int             Sys_InitJobThreads(int numThreads);
+void            Sys_ShutdownJobThreads(void);
+int             Sys_NumJobThreads(void);
+void            Sys_RunJobs(jobFunc_t func, void *data, int numJobs);
+
 char           *Sys_GetDLLName(const char *name);
 
 
@@ -1248,6 +1277,9 @@ void            Sys_Print(const char *msg);
 // any game related timing information should come from event timestamps
 int             Sys_Milliseconds(void);
 
+// microseconds on the Sys_Milliseconds clock, for frame scheduling and profiling
+int64_t         Sys_Microseconds(void);
+
 // XreaL BEGIN
 qboolean        Sys_RandomBytes(byte * string, int len);
 // XreaL END
@@ -1269,6 +1301,11 @@ void            Sys_SetErrorText(const char *text);
 
 void            Sys_SendPacket(int length, const void *data, netadr_t to);
 
+// queue the packets sent in between and send them with as few syscalls
+// as the platform allows, a no-op where there is no batched send
+void            Sys_BeginPacketBatch(void);
+void            Sys_FlushPacketBatch(void);
+
 qboolean        Sys_StringToAdr(const char *s, netadr_t * a);
 
 //Does NOT parse port numbers, only base addresses.
@@ -1288,6 +1325,10 @@ char           *Sys_DefaultHomePath(void);
 char          **Sys_ListFiles(const char *directory, const char *extension, char *filter, int *numfiles, qboolean wantsubs);
 void            Sys_FreeFileList(char **list);
 
+// read-only view of a whole file, NULL if it doesn't exist or can't be mapped
+void           *Sys_MapFile(const char *ospath, int *length);
+void            Sys_UnmapFile(void *base, int length);
+
 void            Sys_BeginProfiling(void);
 void            Sys_EndProfiling(void);
 
@@ -1355,6 +1396,24 @@ void            Huff_offsetReceive(node_t * node, int *ch, byte * fin, int *offs
 void            Huff_offsetTransmit(huff_t * huff, int ch, byte * fout, int *offset);
 void            Huff_putBit(int bit, byte * fout, int *offset);
 int             Huff_getBit(byte * fout, int *offset);
+void            Huff_putBits(unsigned int bits, int numBits, byte * fout, int *offset);
+
+// the codes of a tree that is not going to be updated anymore, so symbols can
+// be sent and received with table lookups instead of walking the tree bit by bit
+#define HUFF_LOOKUP_BITS 11
+
+typedef struct
+{
+	huff_t         *huff;		// for whatever the tables don't cover
+	unsigned int    code[HMAX + 1];	// bits in transmit order, starting at bit 0
+	byte            codeLen[HMAX + 1];	// 0 = walk the tree
+	short           lookup[1 << HUFF_LOOKUP_BITS];	// symbol starting with these bits
+	byte            lookupLen[1 << HUFF_LOOKUP_BITS];	// 0 = longer code, walk the tree
+} huffTable_t;
+
+void            Huff_BuildTable(huffTable_t * table, huff_t * huff);
+void            Huff_TableTransmit(const huffTable_t * table, int ch, byte * fout, int *offset);
+void            Huff_TableReceive(const huffTable_t * table, int *ch, byte * fin, int *offset, int maxsize);
 
 extern huffman_t clientHuffTables;
 
@@ -2967,7 +2967,7 @@ Called directly from cgame
 void RE_LoadWorldMap(const char *name)
 {
 	int             i;
-	dheader_t      *header;
+	dheader_t       header;
 	byte           *buffer;
 	byte           *startMarker;
 
@@ -3005,7 +3005,7 @@ void RE_LoadWorldMap(const char *name)
 	tr.worldDir[0] = '\0';
 
 	// load it
-	ri.FS_ReadFile(name, (void **)&buffer);
+	ri.FS_ReadFileReadOnly(name, (const void **)&buffer);
 	if(!buffer)
 	{
 		ri.Error(ERR_DROP, "RE_LoadWorldMap: %s not found", name);
@@ -3028,10 +3028,11 @@ void RE_LoadWorldMap(const char *name)
 	startMarker = ri.Hunk_Alloc(0, h_low);
 	c_gridVerts = 0;
 
-	header = (dheader_t *) buffer;
-	fileBase = (byte *) header;
+	// the buffer may point into a mapped pk3, so only the copied header is swapped
+	header = *(dheader_t *) buffer;
+	fileBase = buffer;
 
-	i = LittleLong(header->version);
+	i = LittleLong(header.version);
 	if(i != BSP_VERSION)
 	{
 		ri.Error(ERR_DROP, "RE_LoadWorldMap: %s has wrong version number (%i should be %i)", name, i, BSP_VERSION);
@@ -3040,37 +3041,37 @@ void RE_LoadWorldMap(const char *name)
 	// swap all the lumps
 	for(i = 0; i < sizeof(dheader_t) / 4; i++)
 	{
-		((int *)header)[i] = LittleLong(((int *)header)[i]);
+		((int *)&header)[i] = LittleLong(((int *)&header)[i]);
 	}
 
 	// load into heap
 	ri.Cmd_ExecuteText(EXEC_NOW, "updatescreen\n");
-	R_LoadShaders(&header->lumps[LUMP_SHADERS]);
+	R_LoadShaders(&header.lumps[LUMP_SHADERS]);
 	ri.Cmd_ExecuteText(EXEC_NOW, "updatescreen\n");
-	R_LoadLightmaps(&header->lumps[LUMP_LIGHTMAPS]);
+	R_LoadLightmaps(&header.lumps[LUMP_LIGHTMAPS]);
 	ri.Cmd_ExecuteText(EXEC_NOW, "updatescreen\n");
-	R_LoadPlanes(&header->lumps[LUMP_PLANES]);
+	R_LoadPlanes(&header.lumps[LUMP_PLANES]);
 	ri.Cmd_ExecuteText(EXEC_NOW, "updatescreen\n");
-	//% R_LoadFogs( &header->lumps[LUMP_FOGS], &header->lumps[LUMP_BRUSHES], &header->lumps[LUMP_BRUSHSIDES] );
+	//% R_LoadFogs( &header.lumps[LUMP_FOGS], &header.lumps[LUMP_BRUSHES], &header.lumps[LUMP_BRUSHSIDES] );
 	//% ri.Cmd_ExecuteText( EXEC_NOW, "updatescreen\n" );
-	R_LoadSurfaces(&header->lumps[LUMP_SURFACES], &header->lumps[LUMP_DRAWVERTS], &header->lumps[LUMP_DRAWINDEXES]);
+	R_LoadSurfaces(&header.lumps[LUMP_SURFACES], &header.lumps[LUMP_DRAWVERTS], &header.lumps[LUMP_DRAWINDEXES]);
 	ri.Cmd_ExecuteText(EXEC_NOW, "updatescreen\n");
-	R_LoadMarksurfaces(&header->lumps[LUMP_LEAFSURFACES]);
+	R_LoadMarksurfaces(&header.lumps[LUMP_LEAFSURFACES]);
 	ri.Cmd_ExecuteText(EXEC_NOW, "updatescreen\n");
-	R_LoadNodesAndLeafs(&header->lumps[LUMP_NODES], &header->lumps[LUMP_LEAFS]);
+	R_LoadNodesAndLeafs(&header.lumps[LUMP_NODES], &header.lumps[LUMP_LEAFS]);
 	ri.Cmd_ExecuteText(EXEC_NOW, "updatescreen\n");
-	R_LoadSubmodels(&header->lumps[LUMP_MODELS]);
+	R_LoadSubmodels(&header.lumps[LUMP_MODELS]);
 	ri.Cmd_ExecuteText(EXEC_NOW, "updatescreen\n");
 
 	// moved fog lump loading here, so fogs can be tagged with a model num
-	R_LoadFogs(&header->lumps[LUMP_FOGS], &header->lumps[LUMP_BRUSHES], &header->lumps[LUMP_BRUSHSIDES]);
+	R_LoadFogs(&header.lumps[LUMP_FOGS], &header.lumps[LUMP_BRUSHES], &header.lumps[LUMP_BRUSHSIDES]);
 	ri.Cmd_ExecuteText(EXEC_NOW, "updatescreen\n");
 
-	R_LoadVisibility(&header->lumps[LUMP_VISIBILITY]);
+	R_LoadVisibility(&header.lumps[LUMP_VISIBILITY]);
 	ri.Cmd_ExecuteText(EXEC_NOW, "updatescreen\n");
-	R_LoadEntities(&header->lumps[LUMP_ENTITIES]);
+	R_LoadEntities(&header.lumps[LUMP_ENTITIES]);
 	ri.Cmd_ExecuteText(EXEC_NOW, "updatescreen\n");
-	R_LoadLightGrid(&header->lumps[LUMP_LIGHTGRID]);
+	R_LoadLightGrid(&header.lumps[LUMP_LIGHTGRID]);
 	ri.Cmd_ExecuteText(EXEC_NOW, "updatescreen\n");
 
 	s_worldData.dataSize = (byte *) ri.Hunk_Alloc(0, h_low) - startMarker;
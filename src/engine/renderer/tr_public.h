@@ -226,6 +226,7 @@ typedef struct
 	// NULL can be passed for buf to just determine existance
 	int             (*FS_FileIsInPAK) (const char *name, int *pChecksum);
 	int             (*FS_ReadFile) (const char *name, void **buf);
+	int             (*FS_ReadFileReadOnly) (const char *name, const void **buf);
 	void            (*FS_FreeFile) (void *buf);
 	char          **(*FS_ListFiles) (const char *name, const char *extension, int *numfilesfound);
 	void            (*FS_FreeFileList) (char **filelist);
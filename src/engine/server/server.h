@@ -59,7 +59,6 @@ typedef struct svEntity_s
 	int             clusternums[MAX_ENT_CLUSTERS];
 	int             lastCluster;	// if all the clusters don't fit in clusternums
 	int             areanum, areanum2;
-	int             snapshotCounter;	// used to prevent double adding from portal views
 	int             originCluster;	// Gordon: calced upon linking, for origin only bmodel vis checks
 } svEntity_t;
 
@@ -80,7 +79,6 @@ typedef struct
 	// show_bug.cgi?id=475
 	// the serverId associated with the current checksumFeed (always <= serverId)
 	int             checksumFeedServerId;
-	int             snapshotCounter;	// incremented for each snapshot built
 	int             timeResidual;	// <= 1000 / sv_frame->value
 	int             nextFrameTime;	// when time > nextFrameTime, process world
 	struct cmodel_s *models[MAX_MODELS];
@@ -114,6 +112,9 @@ typedef struct
 	int             ucompNum;
 	// -NERVE - SMF
 
+	int             deltaCacheHits;	// entity deltas bit-copied from the delta cache
+	int             deltaCacheMisses;
+
 	md3Tag_t        tags[MAX_SERVER_TAGS];
 	tagHeaderExt_t  tagHeadersExt[MAX_TAG_FILES];
 
@@ -262,6 +263,8 @@ typedef struct tempBan_s
 #define SERVER_PERFORMANCECOUNTER_FRAMES    600
 #define SERVER_PERFORMANCECOUNTER_SAMPLES   6
 
+#define SERVER_FRAMELATENESS_BUCKETS        10
+
 // this structure will be cleared only when the game dll changes
 typedef struct
 {
@@ -289,6 +292,11 @@ typedef struct
 	int             totalFrameTime;
 	int             currentFrameIndex;
 	int             serverLoad;
+
+	// dedicated frame starts by microseconds after they were due, see SV_FrameTiming_f
+	int             frameLateness[SERVER_FRAMELATENESS_BUCKETS];
+	int             frameLatenessMax;
+	int64_t         frameLatenessTotal;
 } serverStatic_t;
 
 
@@ -336,6 +344,15 @@ extern cvar_t  *sv_onlyVisibleClients;
 
 extern cvar_t  *sv_showAverageBPS;	// NERVE - SMF - net debugging
 
+extern cvar_t  *sv_snapshotThreads;
+extern cvar_t  *sv_snapshotDeltaCache;
+extern cvar_t  *sv_traceBatchThreads;
+extern cvar_t  *sv_broadphase;
+extern cvar_t  *sv_queryRate;
+extern cvar_t  *sv_queryBurst;
+extern cvar_t  *sv_queryRateTotal;
+extern cvar_t  *sv_profile;
+
 extern cvar_t  *g_gameType;
 
 // Rafael gameskill
@@ -385,6 +402,11 @@ void            SV_MasterGameCompleteStatus();	// NERVE - SMF
 //bani - bugtraq 12534
 qboolean        SV_VerifyChallenge(char *challenge);
 
+void            SV_FrameTiming_f(void);
+
+void            SV_InvalidateQueryResponses(void);
+void            SV_CheckQueryResponses(void);
+
 
 //
 // sv_init.c
@@ -416,6 +438,7 @@ void            SV_AuthorizeIpPacket(netadr_t from);
 void            SV_ExecuteClientMessage(client_t * cl, msg_t * msg);
 void            SV_UserinfoChanged(client_t * cl);
 
+void            SV_SendClientGameState(client_t * client);
 void            SV_ClientEnterWorld(client_t * client, usercmd_t * cmd);
 void            SV_FreeClientNetChan(client_t * client);
 void            SV_DropClient(client_t * drop, const char *reason);
@@ -442,6 +465,7 @@ void            SV_WriteFrameToClient(client_t * client, msg_t * msg);
 void            SV_SendMessageToClient(msg_t * msg, client_t * client);
 void            SV_SendClientMessages(void);
 void            SV_SendClientSnapshot(client_t * client);
+void            SV_ShutdownSnapshotThreads(void);
 
 //bani
 void            SV_SendClientIdle(client_t * client);
@@ -512,6 +536,7 @@ clipHandle_t    SV_ClipHandleForEntity(const sharedEntity_t * ent);
 
 
 void            SV_SectorList_f(void);
+void            SV_BroadphaseBench_f(void);
 
 
 int             SV_AreaEntities(const vec3_t mins, const vec3_t maxs, int *entityList, int maxcount);
@@ -531,6 +556,7 @@ int             SV_PointContents(const vec3_t p, int passEntityNum);
 
 void            SV_Trace(trace_t * results, const vec3_t start, const vec3_t mins, const vec3_t maxs, const vec3_t end,
 						 int passEntityNum, int contentmask, int capsule);
+void            SV_TraceBatch(const traceRequest_t * requests, trace_t * results, int numTraces);
 // mins and maxs are relative
 
 // if the entire move stays in a solid volume, trace.allsolid will be set,
@@ -553,6 +579,48 @@ void            SV_Netchan_Transmit(client_t * client, msg_t * msg);
 void            SV_Netchan_TransmitNextFragment(client_t * client);
 qboolean        SV_Netchan_Process(client_t * client, msg_t * msg);
 
+//
+// sv_profile.c
+//
+typedef enum
+{
+	PROF_FRAME,
+	PROF_GAME_RUN_FRAME,
+	PROF_BOT_FRAME,
+	PROF_SEND_CLIENT_MESSAGES,
+	PROF_PACKET,
+	PROF_NUM_ZONES
+} svProfileZone_t;
+
+typedef enum
+{
+	PROF_TRACES,
+	PROF_POINTCONTENTS,
+	PROF_NUM_COUNTERS
+} svProfileCounter_t;
+
+extern qboolean sv_profiling;
+extern int      sv_profileCounters[PROF_NUM_COUNTERS];
+
+#define SV_ProfileCount( counter ) ( sv_profiling ? sv_profileCounters[counter]++ : 0 )
+
+int64_t         SV_ProfileFrameBegin(void);
+int64_t         SV_ProfileBegin(void);
+void            SV_ProfileEnd(svProfileZone_t zone, int64_t start);
+void            SV_ProfileClearTotals(void);
+void            SV_ProfilePrintTotals(int frames);
+void            SV_ProfileDump_f(void);
+
+//
+// sv_bench.c
+//
+extern qboolean sv_benchmarking;
+
+void            SV_BenchRecordUsercmd(client_t * cl, usercmd_t * cmd);
+void            SV_BenchShutdown(void);
+void            SV_BenchRecord_f(void);
+void            SV_Bench_f(void);
+
 //bani - cl->downloadnotify
 #define DLNOTIFY_REDIRECT   0x00000001	// "Redirecting client ..."
 #define DLNOTIFY_BEGIN      0x00000002	// "clientDownload: 4 : beginning ..."
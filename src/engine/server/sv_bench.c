@@ -0,0 +1,595 @@
+/*
+===========================================================================
+
+Wolfenstein: Enemy Territory GPL Source Code
+Copyright (C) 1999-2010 id Software LLC, a ZeniMax Media company. 
+
+This file is part of the Wolfenstein: Enemy Territory GPL Source Code (Wolf ET Source Code).  
+
+Wolf ET Source Code is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+Wolf ET Source Code is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with Wolf ET Source Code.  If not, see <http://www.gnu.org/licenses/>.
+
+In addition, the Wolf: ET Source Code is also subject to certain additional terms. You should have received a copy of these additional terms immediately following the terms and conditions of the GNU General Public License which accompanied the Wolf ET Source Code.  If not, please request a copy in writing from id Software at the address below.
+
+If you have questions concerning this license or the applicable additional terms, you may contact in writing id Software LLC, c/o ZeniMax Media Inc., Suite 120, Rockville, Maryland 20850 USA.
+
+===========================================================================
+*/
+
+
+// sv_bench.c -- replays recorded usercmds with synthetic clients to time SV_Frame
+
+#include "server.h"
+
+#define BENCH_IDENT             ( ( 'M' << 24 ) + ( 'C' << 16 ) + ( 'V' << 8 ) + 'S' )	// "SVCM"
+#define BENCH_VERSION           1
+#define BENCH_HEADER_SIZE       ( 12 + MAX_QPATH )
+#define BENCH_RECORD_SIZE       26
+#define BENCH_QPORT             0x4000	// synthetic clients use BENCH_QPORT + their number
+
+typedef struct
+{
+	usercmd_t      *cmds;
+	int             numCmds;
+} benchStream_t;
+
+typedef struct
+{
+	client_t       *cl;
+	benchStream_t  *stream;
+	int             nextCmd;
+	int             timeShift;	// added to the recorded serverTime
+	int             countedSequence;	// netchan.outgoingSequence already added to the bytes sent
+} benchClient_t;
+
+qboolean        sv_benchmarking;
+
+static fileHandle_t svBenchRecordFile;
+static int      svBenchRecordedCmds;
+static qboolean svBenchClients[MAX_CLIENTS];	// synthetic clients are never recorded
+
+/*
+==================
+SV_BenchPutLong / SV_BenchGetLong
+
+The recording is little endian whatever the host is
+==================
+*/
+static void SV_BenchPutLong(byte * p, int l)
+{
+	p[0] = l & 255;
+	p[1] = (l >> 8) & 255;
+	p[2] = (l >> 16) & 255;
+	p[3] = (l >> 24) & 255;
+}
+
+static int SV_BenchGetLong(const byte * p)
+{
+	return p[0] | (p[1] << 8) | (p[2] << 16) | (p[3] << 24);
+}
+
+/*
+==================
+SV_BenchRecordUsercmd
+
+Called from SV_ClientThink for every usercmd the game runs
+==================
+*/
+void SV_BenchRecordUsercmd(client_t * cl, usercmd_t * cmd)
+{
+	byte            record[BENCH_RECORD_SIZE];
+	int             clientNum;
+
+	if(!svBenchRecordFile)
+	{
+		return;
+	}
+
+	clientNum = cl - svs.clients;
+	if(svBenchClients[clientNum])
+	{
+		return;
+	}
+
+	record[0] = clientNum;
+	SV_BenchPutLong(record + 1, cmd->serverTime);
+	SV_BenchPutLong(record + 5, cmd->angles[0]);
+	SV_BenchPutLong(record + 9, cmd->angles[1]);
+	SV_BenchPutLong(record + 13, cmd->angles[2]);
+	record[17] = cmd->buttons;
+	record[18] = cmd->wbuttons;
+	record[19] = cmd->weapon;
+	record[20] = cmd->flags;
+	record[21] = cmd->forwardmove;
+	record[22] = cmd->rightmove;
+	record[23] = cmd->upmove;
+	record[24] = cmd->doubleTap;
+	record[25] = cmd->identClient;
+
+	FS_Write(record, sizeof(record), svBenchRecordFile);
+	svBenchRecordedCmds++;
+}
+
+/*
+==================
+SV_BenchShutdown
+
+Stops a recording, called from SV_Shutdown and SV_SpawnServer so the
+usercmds of the next map don't end up under the old map's header
+==================
+*/
+void SV_BenchShutdown(void)
+{
+	if(!svBenchRecordFile)
+	{
+		return;
+	}
+
+	FS_FCloseFile(svBenchRecordFile);
+	svBenchRecordFile = 0;
+	Com_Printf("recorded %i usercmds\n", svBenchRecordedCmds);
+}
+
+/*
+==================
+SV_BenchRecord_f
+
+sv_benchrecord <name> starts writing the usercmds of all connected
+clients for sv_bench, sv_benchrecord without a name stops
+==================
+*/
+void SV_BenchRecord_f(void)
+{
+	char            filename[MAX_QPATH];
+	byte            header[BENCH_HEADER_SIZE];
+
+	if(svBenchRecordFile)
+	{
+		SV_BenchShutdown();
+		return;
+	}
+
+	if(Cmd_Argc() != 2)
+	{
+		Com_Printf("usage: sv_benchrecord <name>, again without a name to stop\n");
+		return;
+	}
+
+	if(!com_sv_running->integer)
+	{
+		Com_Printf("Server is not running.\n");
+		return;
+	}
+
+	Q_strncpyz(filename, Cmd_Argv(1), sizeof(filename));
+	COM_DefaultExtension(filename, sizeof(filename), ".svcmds");
+
+	svBenchRecordFile = FS_FOpenFileWrite(filename);
+	if(!svBenchRecordFile)
+	{
+		Com_Printf("couldn't open %s\n", filename);
+		return;
+	}
+
+	memset(header, 0, sizeof(header));
+	SV_BenchPutLong(header, BENCH_IDENT);
+	SV_BenchPutLong(header + 4, BENCH_VERSION);
+	SV_BenchPutLong(header + 8, sv_fps->integer);
+	Q_strncpyz((char *)header + 12, sv_mapname->string, MAX_QPATH);
+	FS_Write(header, sizeof(header), svBenchRecordFile);
+
+	svBenchRecordedCmds = 0;
+	Com_Printf("recording usercmds to %s\n", filename);
+}
+
+/*
+==================
+SV_BenchLoadStreams
+
+Splits a recording into one usercmd stream per recorded client,
+returns the number of streams
+==================
+*/
+static int SV_BenchLoadStreams(const char *filename, benchStream_t * streams)
+{
+	byte           *buffer, *record;
+	usercmd_t      *cmd;
+	int             len, numRecords, numStreams;
+	int             i, clientNum;
+
+	memset(streams, 0, sizeof(benchStream_t) * MAX_CLIENTS);
+
+	len = FS_ReadFile(filename, (void **)&buffer);
+	if(len < 0)
+	{
+		Com_Printf("couldn't load %s\n", filename);
+		return 0;
+	}
+
+	if(len < BENCH_HEADER_SIZE || SV_BenchGetLong(buffer) != BENCH_IDENT || SV_BenchGetLong(buffer + 4) != BENCH_VERSION)
+	{
+		Com_Printf("%s is not a usercmd recording\n", filename);
+		FS_FreeFile(buffer);
+		return 0;
+	}
+
+	if(Q_stricmp((char *)buffer + 12, sv_mapname->string))
+	{
+		Com_Printf("WARNING: %s was recorded on %s\n", filename, (char *)buffer + 12);
+	}
+	if(SV_BenchGetLong(buffer + 8) != sv_fps->integer)
+	{
+		Com_Printf("WARNING: %s was recorded with sv_fps %i\n", filename, SV_BenchGetLong(buffer + 8));
+	}
+
+	numRecords = (len - BENCH_HEADER_SIZE) / BENCH_RECORD_SIZE;
+
+	// count first so every stream gets a single allocation
+	for(i = 0, record = buffer + BENCH_HEADER_SIZE; i < numRecords; i++, record += BENCH_RECORD_SIZE)
+	{
+		if(record[0] < MAX_CLIENTS)
+		{
+			streams[record[0]].numCmds++;
+		}
+	}
+
+	for(clientNum = 0; clientNum < MAX_CLIENTS; clientNum++)
+	{
+		if(streams[clientNum].numCmds)
+		{
+			streams[clientNum].cmds = Z_Malloc(streams[clientNum].numCmds * sizeof(usercmd_t));
+			streams[clientNum].numCmds = 0;
+		}
+	}
+
+	for(i = 0, record = buffer + BENCH_HEADER_SIZE; i < numRecords; i++, record += BENCH_RECORD_SIZE)
+	{
+		if(record[0] >= MAX_CLIENTS)
+		{
+			continue;
+		}
+
+		cmd = &streams[record[0]].cmds[streams[record[0]].numCmds++];
+		cmd->serverTime = SV_BenchGetLong(record + 1);
+		cmd->angles[0] = SV_BenchGetLong(record + 5);
+		cmd->angles[1] = SV_BenchGetLong(record + 9);
+		cmd->angles[2] = SV_BenchGetLong(record + 13);
+		cmd->buttons = record[17];
+		cmd->wbuttons = record[18];
+		cmd->weapon = record[19];
+		cmd->flags = record[20];
+		cmd->forwardmove = (signed char)record[21];
+		cmd->rightmove = (signed char)record[22];
+		cmd->upmove = (signed char)record[23];
+		cmd->doubleTap = record[24];
+		cmd->identClient = record[25];
+	}
+
+	FS_FreeFile(buffer);
+
+	// pack the streams to the front
+	numStreams = 0;
+	for(clientNum = 0; clientNum < MAX_CLIENTS; clientNum++)
+	{
+		if(streams[clientNum].numCmds)
+		{
+			streams[numStreams++] = streams[clientNum];
+		}
+	}
+
+	return numStreams;
+}
+
+/*
+==================
+SV_BenchConnect
+
+Sets up a client on the loopback address the way SV_DirectConnect does
+and sends it the gamestate, it enters the world with its first usercmd
+==================
+*/
+static client_t *SV_BenchConnect(int num)
+{
+	client_t       *cl;
+	netadr_t        adr;
+	char            userinfo[MAX_INFO_STRING];
+	char           *denied;
+	int             clientNum;
+
+	for(clientNum = 0, cl = svs.clients; clientNum < sv_maxclients->integer; clientNum++, cl++)
+	{
+		if(cl->state == CS_FREE)
+		{
+			break;
+		}
+	}
+
+	if(clientNum == sv_maxclients->integer)
+	{
+		return NULL;
+	}
+
+	memset(cl, 0, sizeof(*cl));
+	cl->gentity = SV_GentityNum(clientNum);
+	svBenchClients[clientNum] = qtrue;
+
+	memset(&adr, 0, sizeof(adr));
+	adr.type = NA_LOOPBACK;
+	Netchan_Setup(NS_SERVER, &cl->netchan, adr, BENCH_QPORT + num);
+
+	Com_sprintf(userinfo, sizeof(userinfo), "\\name\\bench%i\\rate\\25000\\snaps\\20\\cl_guid\\BENCH%08X\\ip\\localhost", num, num);
+	Q_strncpyz(cl->userinfo, userinfo, sizeof(cl->userinfo));
+
+	denied = (char *)VM_Call(gvm, GAME_CLIENT_CONNECT, clientNum, qtrue, qfalse);
+	if(denied)
+	{
+		denied = VM_ExplicitArgPtr(gvm, (intptr_t) denied);
+		Com_Printf("game rejected bench%i: %s\n", num, denied);
+		cl->state = CS_FREE;
+		svBenchClients[clientNum] = qfalse;
+		return NULL;
+	}
+
+	SV_UserinfoChanged(cl);
+
+	cl->state = CS_CONNECTED;
+	cl->nextSnapshotTime = svs.time;
+	cl->lastPacketTime = svs.time;
+	cl->lastConnectTime = svs.time;
+
+	SV_SendClientGameState(cl);
+
+	// there is no pk3 list to check
+	cl->gotCP = qtrue;
+	cl->pureAuthentic = 1;
+
+	return cl;
+}
+
+/*
+==================
+SV_BenchSendUsercmds
+
+Feeds the usercmds that are due to SV_ExecuteClientMessage in the message a
+client would send, acknowledging everything the server sent so far
+==================
+*/
+static void SV_BenchSendUsercmds(benchClient_t * bc)
+{
+	client_t       *cl = bc->cl;
+	benchStream_t  *stream = bc->stream;
+	usercmd_t       cmds[MAX_PACKET_USERCMDS];
+	usercmd_t       nullcmd, *oldcmd;
+	msg_t           msg;
+	byte            msgBuffer[MAX_MSGLEN];
+	int             i, count, key, messageAcknowledge;
+
+	for(count = 0; count < MAX_PACKET_USERCMDS; count++)
+	{
+		cmds[count] = stream->cmds[bc->nextCmd];
+		cmds[count].serverTime += bc->timeShift;
+		if(cmds[count].serverTime > svs.time)
+		{
+			break;
+		}
+
+		if(++bc->nextCmd == stream->numCmds)
+		{
+			// loop the stream
+			bc->timeShift += stream->cmds[stream->numCmds - 1].serverTime - stream->cmds[0].serverTime + 1;
+			bc->nextCmd = 0;
+		}
+	}
+
+	if(!count)
+	{
+		return;
+	}
+
+	messageAcknowledge = cl->netchan.outgoingSequence - 1;
+
+	MSG_Init(&msg, msgBuffer, sizeof(msgBuffer));
+	MSG_WriteLong(&msg, sv.serverId);
+	MSG_WriteLong(&msg, messageAcknowledge);
+	MSG_WriteLong(&msg, cl->reliableSequence);
+
+	MSG_WriteByte(&msg, clc_move);
+	MSG_WriteByte(&msg, count);
+
+	// same key SV_UserMove reads them with
+	key = sv.checksumFeed ^ messageAcknowledge;
+	key ^= Com_HashKey(cl->reliableCommands[cl->reliableSequence & (MAX_RELIABLE_COMMANDS - 1)], 32);
+
+	memset(&nullcmd, 0, sizeof(nullcmd));
+	oldcmd = &nullcmd;
+	for(i = 0; i < count; i++)
+	{
+		MSG_WriteDeltaUsercmdKey(&msg, key, oldcmd, &cmds[i]);
+		oldcmd = &cmds[i];
+	}
+
+	MSG_WriteByte(&msg, clc_EOF);
+
+	MSG_BeginReading(&msg);
+	cl->lastPacketTime = svs.time;
+	SV_ExecuteClientMessage(cl, &msg);
+}
+
+/*
+==================
+SV_Bench_f
+
+sv_bench <name> [clients] [frames]
+Connects synthetic clients that replay the streams of a sv_benchrecord
+recording, runs frames server frames back to back and reports where the
+time went and how many bytes the clients were sent
+==================
+*/
+void SV_Bench_f(void)
+{
+	static benchStream_t streams[MAX_CLIENTS];
+	static benchClient_t benchClients[MAX_CLIENTS];
+	char            filename[MAX_QPATH];
+	char            oldProfile[MAX_CVAR_VALUE_STRING];
+	benchClient_t  *bc;
+	int             numStreams, numClients, frames, frame;
+	int             frameMsec, i;
+	int64_t         start, elapsed, bytes;
+
+	if(Cmd_Argc() < 2)
+	{
+		Com_Printf("usage: sv_bench <name> [clients] [frames]\n");
+		return;
+	}
+
+	if(!com_sv_running->integer || sv.state != SS_GAME)
+	{
+		Com_Printf("Server is not running.\n");
+		return;
+	}
+
+	// a local client would pick up the synthetic clients' snapshots from the loopback
+	if(!com_dedicated->integer)
+	{
+		Com_Printf("sv_bench only runs on a dedicated server\n");
+		return;
+	}
+
+	if(sv_benchmarking || svBenchRecordFile)
+	{
+		Com_Printf("can't benchmark while recording\n");
+		return;
+	}
+
+	Q_strncpyz(filename, Cmd_Argv(1), sizeof(filename));
+	COM_DefaultExtension(filename, sizeof(filename), ".svcmds");
+
+	numStreams = SV_BenchLoadStreams(filename, streams);
+	if(!numStreams)
+	{
+		Com_Printf("no usercmds in %s\n", filename);
+		return;
+	}
+
+	numClients = Cmd_Argc() > 2 ? atoi(Cmd_Argv(2)) : numStreams;
+	if(numClients < 1)
+	{
+		numClients = 1;
+	}
+	else if(numClients > MAX_CLIENTS)
+	{
+		numClients = MAX_CLIENTS;
+	}
+	frames = Cmd_Argc() > 3 ? atoi(Cmd_Argv(3)) : 1000;
+	if(frames < 1)
+	{
+		frames = 1;
+	}
+
+	if(sv_fps->integer < 1)
+	{
+		Cvar_Set("sv_fps", "10");
+	}
+	frameMsec = 1000 / sv_fps->integer;
+
+	sv_benchmarking = qtrue;
+
+	// clients past the number of streams replay them again
+	for(i = 0; i < numClients; i++)
+	{
+		bc = &benchClients[i];
+		bc->cl = SV_BenchConnect(i);
+		if(!bc->cl)
+		{
+			break;
+		}
+		bc->stream = &streams[i % numStreams];
+		bc->nextCmd = 0;
+		bc->timeShift = svs.time - bc->stream->cmds[0].serverTime;
+		bc->countedSequence = bc->cl->netchan.outgoingSequence;	// don't count the gamestate
+	}
+	if(i < numClients)
+	{
+		Com_Printf("only room for %i of %i clients\n", i, numClients);
+		numClients = i;
+	}
+
+	Q_strncpyz(oldProfile, sv_profile->string, sizeof(oldProfile));
+	Cvar_Set("sv_profile", "1");
+	SV_ProfileClearTotals();
+
+	bytes = 0;
+	start = Sys_Microseconds();
+
+	for(frame = 0; frame < frames; frame++)
+	{
+		for(i = 0, bc = benchClients; i < numClients; i++, bc++)
+		{
+			if(bc->cl->state >= CS_PRIMED)
+			{
+				SV_BenchSendUsercmds(bc);
+			}
+		}
+
+		SV_Frame(frameMsec);
+
+		if(!com_sv_running->integer || sv.state != SS_GAME)
+		{
+			Com_Printf("server stopped after %i frames\n", frame);
+			break;
+		}
+
+		for(i = 0, bc = benchClients; i < numClients; i++, bc++)
+		{
+			while(bc->countedSequence < bc->cl->netchan.outgoingSequence)
+			{
+				bytes += bc->cl->frames[bc->countedSequence & PACKET_MASK].messageSize;
+				bc->countedSequence++;
+			}
+		}
+	}
+
+	elapsed = Sys_Microseconds() - start;
+
+	Cvar_Set("sv_profile", oldProfile);
+	sv_benchmarking = qfalse;
+
+	if(frame)
+	{
+		Com_Printf("%i frames with %i clients in %.2f seconds, %.3f ms a frame, %.1fx real time\n", frame, numClients,
+				   elapsed / 1000000.0, elapsed / 1000.0 / frame, (double)frame * frameMsec * 1000 / (elapsed ? elapsed : 1));
+		Com_Printf("%i bytes sent, %i bytes a client a second\n", (int)bytes,
+				   numClients ? (int)(bytes * 1000 / ((int64_t) frame * frameMsec * numClients)) : 0);
+		SV_ProfilePrintTotals(frame);
+	}
+
+	// the clients are gone with the server if it stopped
+	if(com_sv_running->integer)
+	{
+		for(i = 0, bc = benchClients; i < numClients; i++, bc++)
+		{
+			if(bc->cl->state >= CS_CONNECTED)
+			{
+				SV_DropClient(bc->cl, "benchmark finished");
+			}
+			// nobody to wait for as a zombie
+			bc->cl->state = CS_FREE;
+		}
+	}
+	memset(svBenchClients, 0, sizeof(svBenchClients));
+
+	for(i = 0; i < numStreams; i++)
+	{
+		Z_Free(streams[i].cmds);
+	}
+}
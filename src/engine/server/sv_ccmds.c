@@ -1294,6 +1294,11 @@ void SV_AddOperatorCommands(void)
 	Cmd_AddCommand("map_restart", SV_MapRestart_f);
 	Cmd_AddCommand("fieldinfo", SV_FieldInfo_f);
 	Cmd_AddCommand("sectorlist", SV_SectorList_f);
+	Cmd_AddCommand("broadphasebench", SV_BroadphaseBench_f);
+	Cmd_AddCommand("frametiming", SV_FrameTiming_f);
+	Cmd_AddCommand("sv_profiledump", SV_ProfileDump_f);
+	Cmd_AddCommand("sv_benchrecord", SV_BenchRecord_f);
+	Cmd_AddCommand("sv_bench", SV_Bench_f);
 	Cmd_AddCommand("map", SV_Map_f);
 	Cmd_AddCommand("gameCompleteStatus", SV_GameCompleteStatus_f);	// NERVE - SMF
 #ifndef PRE_RELEASE_DEMO_NODEVMAP
@@ -1565,6 +1565,9 @@ void SV_UserinfoChanged(client_t * cl)
 	// name for C code
 	Q_strncpyz(cl->name, Info_ValueForKey(cl->userinfo, "name"), sizeof(cl->name));
 
+	// getstatus lists the name
+	SV_InvalidateQueryResponses();
+
 	// rate command
 
 	// if the client is on the same subnet as the server and we aren't running an
@@ -1819,6 +1822,8 @@ void SV_ClientThink(client_t * cl, usercmd_t * cmd)
 {
 	cl->lastUsercmd = *cmd;
 
+	SV_BenchRecordUsercmd(cl, cmd);
+
 	if(cl->state != CS_ACTIVE)
 	{
 		return;					// may have been kicked during the last usercmd
@@ -579,6 +579,9 @@ void SV_SpawnServer(char *server, qboolean killBots)
 		SV_FinalCommand("spawnserver", qfalse);
 	}
 
+	// a usercmd recording belongs to the map it was started on
+	SV_BenchShutdown();
+
 	// shut down the existing game if it is running
 	SV_ShutdownGameProgs();
 
@@ -918,6 +921,15 @@ void SV_Init(void)
 
 	sv_showAverageBPS = Cvar_Get("sv_showAverageBPS", "0", 0);	// NERVE - SMF - net debugging
 
+	sv_snapshotThreads = Cvar_Get("sv_snapshotThreads", "0", CVAR_ARCHIVE);
+	sv_snapshotDeltaCache = Cvar_Get("sv_snapshotDeltaCache", "1", 0);
+	sv_traceBatchThreads = Cvar_Get("sv_traceBatchThreads", "0", CVAR_ARCHIVE);
+	sv_broadphase = Cvar_Get("sv_broadphase", "0", CVAR_ARCHIVE);	// takes effect on the next map
+	sv_queryRate = Cvar_Get("sv_queryRate", "2", CVAR_ARCHIVE);
+	sv_queryBurst = Cvar_Get("sv_queryBurst", "8", CVAR_ARCHIVE);
+	sv_queryRateTotal = Cvar_Get("sv_queryRateTotal", "300", CVAR_ARCHIVE);
+	sv_profile = Cvar_Get("sv_profile", "0", 0);
+
 	// NERVE - SMF - create user set cvars
 	Cvar_Get("g_userTimeLimit", "0", 0);
 	Cvar_Get("g_userAlliedRespawnTime", "0", 0);
@@ -1034,6 +1046,9 @@ void SV_Shutdown(char *finalmsg)
 
 	Com_Printf("----- Server Shutdown -----\n");
 
+	// an error may have aborted SV_SendClientMessages with the batch still open
+	Sys_FlushPacketBatch();
+
 	if(svs.clients && !com_errorEntered)
 	{
 		SV_FinalCommand(va("print \"%s\"", finalmsg), qtrue);
@@ -1041,7 +1056,9 @@ void SV_Shutdown(char *finalmsg)
 
 	SV_RemoveOperatorCommands();
 	SV_MasterShutdown();
+	SV_BenchShutdown();
 	SV_ShutdownGameProgs();
+	SV_ShutdownSnapshotThreads();
 
 	// free current level
 	SV_ClearServer();
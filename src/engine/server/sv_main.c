@@ -78,6 +78,16 @@ cvar_t         *sv_reloading;
 
 cvar_t         *sv_showAverageBPS;	// NERVE - SMF - net debugging
 
+cvar_t         *sv_snapshotThreads;	// worker threads building client snapshots
+cvar_t         *sv_snapshotDeltaCache;	// bit-copy entity deltas shared by several clients
+cvar_t         *sv_traceBatchThreads;	// trace G_TRACEBATCH groups on the snapshot job threads
+cvar_t         *sv_broadphase;	// entity broadphase for area queries and traces, 0 = sector tree, 1 = grid
+
+cvar_t         *sv_queryRate;	// getstatus / getinfo answered per second for one address, 0 = unlimited
+cvar_t         *sv_queryBurst;	// queries one address can send at once
+cvar_t         *sv_queryRateTotal;	// getstatus / getinfo answered per second for all addresses, 0 = unlimited
+cvar_t         *sv_profile;		// record a frame timeline for sv_profiledump
+
 cvar_t         *sv_wwwDownload;	// server does a www dl redirect
 cvar_t         *sv_wwwBaseURL;	// base URL for redirect
 
@@ -446,16 +456,288 @@ qboolean SV_VerifyChallenge(char *challenge)
 	return qtrue;
 }
 
+/*
+==============================================================================
+
+QUERY RESPONSES
+
+getstatus and getinfo are answered from cached responses that are only
+rebuilt after a cvar, userinfo, score, ping or client count change, and
+every source address is limited by a token bucket, so query floods
+cost a bucket update and a copy instead of building info strings.
+
+==============================================================================
+*/
+
+// challenge value the cached responses are built with, SV_VerifyChallenge
+// never lets it through so it can't be confused with a real one
+#define QUERY_CHALLENGE         "\x01"
+#define QUERY_CHALLENGE_MARKER  "\\challenge\\" QUERY_CHALLENGE
+
+#define QUERY_BUCKETS           1024	// must be a power of two
+#define QUERY_BUCKET_PROBES     8
+
+typedef struct
+{
+	qboolean        valid;
+	char           *tail;		// text after the challenge, NULL if the challenge didn't fit
+	char            text[MAX_MSGLEN];	// text before the challenge
+} queryResponse_t;
+
+typedef struct
+{
+	qboolean        inuse;
+	netadr_t        adr;
+	int             lastTime;
+	int             tokens;		// thousandths of a query
+} queryBucket_t;
+
+static queryResponse_t svStatusResponse;
+static queryResponse_t svInfoResponse;
+
+// what the cached responses were built from
+static int      svQueryCvarCount;
+static int      svQueryServerLoad;
+static int      svQueryScores[MAX_CLIENTS];
+static int      svQueryPings[MAX_CLIENTS];	// -1 when not connected
+
+static queryBucket_t svQueryBuckets[QUERY_BUCKETS];
+static queryBucket_t svQueryTotalBucket;
+
+/*
+================
+SV_InvalidateQueryResponses
+================
+*/
+void SV_InvalidateQueryResponses(void)
+{
+	svStatusResponse.valid = qfalse;
+	svInfoResponse.valid = qfalse;
+}
+
 /*
 ================
-SVC_Status
+SV_CheckQueryResponses
 
-Responds with all the info that qplug or qspy can see about the server
-and all connected players.  Used for getting detailed information after
-the simple info query.
+Called once a server frame, drops the cached responses when
+a client connected, left or changed score or ping
 ================
 */
-void SVC_Status(netadr_t from)
+void SV_CheckQueryResponses(void)
+{
+	int             i, ping, score;
+	client_t       *cl;
+
+	if(svQueryServerLoad != svs.serverLoad)
+	{
+		svQueryServerLoad = svs.serverLoad;
+		SV_InvalidateQueryResponses();
+	}
+
+	for(i = 0, cl = svs.clients; i < sv_maxclients->integer && i < MAX_CLIENTS; i++, cl++)
+	{
+		if(cl->state >= CS_CONNECTED)
+		{
+			ping = cl->ping;
+			score = SV_GameClientNum(i)->persistant[PERS_SCORE];
+		}
+		else
+		{
+			ping = -1;
+			score = 0;
+		}
+
+		if(svQueryPings[i] != ping || svQueryScores[i] != score)
+		{
+			svQueryPings[i] = ping;
+			svQueryScores[i] = score;
+			SV_InvalidateQueryResponses();
+		}
+	}
+}
+
+/*
+================
+SV_QueryResponseValid
+================
+*/
+static qboolean SV_QueryResponseValid(queryResponse_t * response)
+{
+	if(svQueryCvarCount != cvar_modificationCount)
+	{
+		svQueryCvarCount = cvar_modificationCount;
+		SV_InvalidateQueryResponses();
+	}
+
+	return response->valid;
+}
+
+/*
+================
+SV_SetQueryResponse
+
+Splits a response built with QUERY_CHALLENGE around the challenge
+================
+*/
+static void SV_SetQueryResponse(queryResponse_t * response)
+{
+	char           *marker;
+
+	marker = strstr(response->text, QUERY_CHALLENGE_MARKER);
+	if(marker)
+	{
+		*marker = 0;
+		response->tail = marker + strlen(QUERY_CHALLENGE_MARKER);
+	}
+	else
+	{
+		response->tail = NULL;
+	}
+
+	response->valid = qtrue;
+}
+
+/*
+================
+SV_SendQueryResponse
+================
+*/
+static void SV_SendQueryResponse(netadr_t from, queryResponse_t * response, const char *challenge)
+{
+	if(!response->tail)
+	{
+		NET_OutOfBandPrint(NS_SERVER, from, "%s", response->text);
+	}
+	else if(!*challenge)
+	{
+		// an empty value removes the key
+		NET_OutOfBandPrint(NS_SERVER, from, "%s%s", response->text, response->tail);
+	}
+	else
+	{
+		NET_OutOfBandPrint(NS_SERVER, from, "%s\\challenge\\%s%s", response->text, challenge, response->tail);
+	}
+}
+
+/*
+================
+SV_QueryBucketAllowed
+
+Refills the bucket for the time since it was last used and takes a query out of it
+================
+*/
+static qboolean SV_QueryBucketAllowed(queryBucket_t * bucket, int now, int rate, int burst)
+{
+	int             elapsed;
+
+	elapsed = now - bucket->lastTime;
+	if(elapsed < 0 || elapsed > burst * 1000 / rate + 1)
+	{
+		bucket->tokens = burst * 1000;
+	}
+	else
+	{
+		bucket->tokens += elapsed * rate;
+		if(bucket->tokens > burst * 1000)
+		{
+			bucket->tokens = burst * 1000;
+		}
+	}
+	bucket->lastTime = now;
+
+	if(bucket->tokens < 1000)
+	{
+		return qfalse;
+	}
+
+	bucket->tokens -= 1000;
+	return qtrue;
+}
+
+/*
+================
+SV_QueryAllowed
+
+Token bucket limit on getstatus / getinfo per source address and for all of them
+================
+*/
+static qboolean SV_QueryAllowed(netadr_t from)
+{
+	queryBucket_t  *bucket, *oldest;
+	unsigned int    hash;
+	int             i, now;
+
+	if(from.type == NA_LOOPBACK)
+	{
+		return qtrue;
+	}
+
+	now = Sys_Milliseconds();
+
+	if(sv_queryRate->integer > 0)
+	{
+		hash = 2166136261u;
+		for(i = 0; i < 4; i++)
+		{
+			hash = (hash ^ from.ip[i]) * 16777619u;
+		}
+		if(from.type == NA_IPX)
+		{
+			for(i = 0; i < 10; i++)
+			{
+				hash = (hash ^ from.ipx[i]) * 16777619u;
+			}
+		}
+
+		// find the address, or take over a free or the least recently used bucket
+		bucket = NULL;
+		oldest = NULL;
+		for(i = 0; i < QUERY_BUCKET_PROBES; i++)
+		{
+			queryBucket_t  *b = &svQueryBuckets[(hash + i) & (QUERY_BUCKETS - 1)];
+
+			if(b->inuse && NET_CompareBaseAdr(b->adr, from))
+			{
+				bucket = b;
+				break;
+			}
+			if(!oldest || !b->inuse || (oldest->inuse && now - b->lastTime > now - oldest->lastTime))
+			{
+				oldest = b;
+			}
+		}
+
+		if(!bucket)
+		{
+			bucket = oldest;
+			bucket->inuse = qtrue;
+			bucket->adr = from;
+			bucket->lastTime = now - 0x10000000;	// starts full
+		}
+
+		if(!SV_QueryBucketAllowed(bucket, now, sv_queryRate->integer, sv_queryBurst->integer > 0 ? sv_queryBurst->integer : 1))
+		{
+			return qfalse;
+		}
+	}
+
+	if(sv_queryRateTotal->integer > 0)
+	{
+		if(!SV_QueryBucketAllowed(&svQueryTotalBucket, now, sv_queryRateTotal->integer, sv_queryRateTotal->integer))
+		{
+			return qfalse;
+		}
+	}
+
+	return qtrue;
+}
+
+/*
+================
+SV_BuildStatusResponse
+================
+*/
+static void SV_BuildStatusResponse(char *response, int size, const char *challenge)
 {
 	char            player[1024];
 	char            status[MAX_MSGLEN];
@@ -466,23 +748,11 @@ void SVC_Status(netadr_t from)
 	int             playerLength;
 	char            infostring[MAX_INFO_STRING];
 
-	// ignore if we are in single player
-	if(SV_GameIsSinglePlayer())
-	{
-		return;
-	}
-
-	//bani - bugtraq 12534
-	if(!SV_VerifyChallenge(Cmd_Argv(1)))
-	{
-		return;
-	}
-
 	strcpy(infostring, Cvar_InfoString(CVAR_SERVERINFO | CVAR_SERVERINFO_NOUPDATE));
 
 	// echo back the parameter to status. so master servers can use it as a challenge
 	// to prevent timed spoofed reply packets that add ghost servers
-	Info_SetValueForKey(infostring, "challenge", Cmd_Argv(1));
+	Info_SetValueForKey(infostring, "challenge", challenge);
 
 	// add "demo" to the sv_keywords if restricted
 	if(Cvar_VariableValue("fs_restrict"))
@@ -513,7 +783,44 @@ void SVC_Status(netadr_t from)
 		}
 	}
 
-	NET_OutOfBandPrint(NS_SERVER, from, "statusResponse\n%s\n%s", infostring, status);
+	Com_sprintf(response, size, "statusResponse\n%s\n%s", infostring, status);
+}
+
+/*
+================
+SVC_Status
+
+Responds with all the info that qplug or qspy can see about the server
+and all connected players.  Used for getting detailed information after
+the simple info query.
+================
+*/
+void SVC_Status(netadr_t from)
+{
+	// ignore if we are in single player
+	if(SV_GameIsSinglePlayer())
+	{
+		return;
+	}
+
+	//bani - bugtraq 12534
+	if(!SV_VerifyChallenge(Cmd_Argv(1)))
+	{
+		return;
+	}
+
+	if(!SV_QueryAllowed(from))
+	{
+		return;
+	}
+
+	if(!SV_QueryResponseValid(&svStatusResponse))
+	{
+		SV_BuildStatusResponse(svStatusResponse.text, sizeof(svStatusResponse.text), QUERY_CHALLENGE);
+		SV_SetQueryResponse(&svStatusResponse);
+	}
+
+	SV_SendQueryResponse(from, &svStatusResponse, Cmd_Argv(1));
 }
 
 /*
@@ -587,13 +894,10 @@ void SVC_GameCompleteStatus(netadr_t from)
 
 /*
 ================
-SVC_Info
-
-Responds with a short info message that should be enough to determine
-if a user is interested in a server to do a full status
+SV_BuildInfoResponse
 ================
 */
-void SVC_Info(netadr_t from)
+static void SV_BuildInfoResponse(char *response, int size, const char *challenge)
 {
 	int             i, count;
 	char           *gamedir;
@@ -602,18 +906,6 @@ void SVC_Info(netadr_t from)
 	char           *weaprestrict;
 	char           *balancedteams;
 
-	// ignore if we are in single player
-	if(SV_GameIsSinglePlayer())
-	{
-		return;
-	}
-
-	//bani - bugtraq 12534
-	if(!SV_VerifyChallenge(Cmd_Argv(1)))
-	{
-		return;
-	}
-
 	// don't count privateclients
 	count = 0;
 	for(i = sv_privateClients->integer; i < sv_maxclients->integer; i++)
@@ -628,7 +920,7 @@ void SVC_Info(netadr_t from)
 
 	// echo back the parameter to status. so servers can use it as a challenge
 	// to prevent timed spoofed reply packets that add ghost servers
-	Info_SetValueForKey(infostring, "challenge", Cmd_Argv(1));
+	Info_SetValueForKey(infostring, "challenge", challenge);
 
 	Info_SetValueForKey(infostring, "protocol", va("%i", PROTOCOL_VERSION));
 	Info_SetValueForKey(infostring, "hostname", sv_hostname->string);
@@ -683,7 +975,43 @@ void SVC_Info(netadr_t from)
 		Info_SetValueForKey(infostring, "balancedteams", balancedteams);
 	}
 
-	NET_OutOfBandPrint(NS_SERVER, from, "infoResponse\n%s", infostring);
+	Com_sprintf(response, size, "infoResponse\n%s", infostring);
+}
+
+/*
+================
+SVC_Info
+
+Responds with a short info message that should be enough to determine
+if a user is interested in a server to do a full status
+================
+*/
+void SVC_Info(netadr_t from)
+{
+	// ignore if we are in single player
+	if(SV_GameIsSinglePlayer())
+	{
+		return;
+	}
+
+	//bani - bugtraq 12534
+	if(!SV_VerifyChallenge(Cmd_Argv(1)))
+	{
+		return;
+	}
+
+	if(!SV_QueryAllowed(from))
+	{
+		return;
+	}
+
+	if(!SV_QueryResponseValid(&svInfoResponse))
+	{
+		SV_BuildInfoResponse(svInfoResponse.text, sizeof(svInfoResponse.text), QUERY_CHALLENGE);
+		SV_SetQueryResponse(&svInfoResponse);
+	}
+
+	SV_SendQueryResponse(from, &svInfoResponse, Cmd_Argv(1));
 }
 
 /*
@@ -860,7 +1188,7 @@ void SV_ConnectionlessPacket(netadr_t from, msg_t * msg)
 SV_ReadPackets
 =================
 */
-void SV_PacketEvent(netadr_t from, msg_t * msg)
+static void SV_ProcessPacket(netadr_t from, msg_t * msg)
 {
 	int             i;
 	client_t       *cl;
@@ -926,6 +1254,20 @@ void SV_PacketEvent(netadr_t from, msg_t * msg)
 	NET_OutOfBandPrint(NS_SERVER, from, "disconnect");
 }
 
+/*
+=================
+SV_PacketEvent
+=================
+*/
+void SV_PacketEvent(netadr_t from, msg_t * msg)
+{
+	int64_t         profileStart;
+
+	profileStart = SV_ProfileBegin();
+	SV_ProcessPacket(from, msg);
+	SV_ProfileEnd(PROF_PACKET, profileStart);
+}
+
 
 /*
 ===================
@@ -1093,6 +1435,94 @@ qboolean SV_CheckPaused(void)
 	return qtrue;
 }
 
+/*
+==================
+SV_FrameLatenessBucket
+==================
+*/
+static const int svFrameLatenessLimits[SERVER_FRAMELATENESS_BUCKETS - 1] = {
+	50, 100, 250, 500, 1000, 2000, 5000, 10000, 20000
+};
+
+static void SV_AddFrameLateness(int64_t usec)
+{
+	int             i;
+
+	if(usec < 0)
+	{
+		usec = 0;
+	}
+	else if(usec > 0x7fffffff)
+	{
+		usec = 0x7fffffff;
+	}
+
+	for(i = 0; i < SERVER_FRAMELATENESS_BUCKETS - 1; i++)
+	{
+		if(usec < svFrameLatenessLimits[i])
+		{
+			break;
+		}
+	}
+
+	svs.frameLateness[i]++;
+	svs.frameLatenessTotal += usec;
+	if(usec > svs.frameLatenessMax)
+	{
+		svs.frameLatenessMax = (int)usec;
+	}
+}
+
+/*
+==================
+SV_FrameTiming_f
+
+frametiming [reset]
+Prints how late dedicated server frames started
+==================
+*/
+void SV_FrameTiming_f(void)
+{
+	int             i, frames, low;
+
+	if(!Q_stricmp(Cmd_Argv(1), "reset"))
+	{
+		memset(svs.frameLateness, 0, sizeof(svs.frameLateness));
+		svs.frameLatenessMax = 0;
+		svs.frameLatenessTotal = 0;
+		return;
+	}
+
+	frames = 0;
+	for(i = 0; i < SERVER_FRAMELATENESS_BUCKETS; i++)
+	{
+		frames += svs.frameLateness[i];
+	}
+
+	if(!frames)
+	{
+		Com_Printf("no dedicated server frames timed\n");
+		return;
+	}
+
+	Com_Printf("frame start lateness over %i frames:\n", frames);
+	low = 0;
+	for(i = 0; i < SERVER_FRAMELATENESS_BUCKETS; i++)
+	{
+		if(i < SERVER_FRAMELATENESS_BUCKETS - 1)
+		{
+			Com_Printf("%6i - %6i us: %8i (%5.1f%%)\n", low, svFrameLatenessLimits[i] - 1, svs.frameLateness[i],
+					   100.0f * svs.frameLateness[i] / frames);
+			low = svFrameLatenessLimits[i];
+		}
+		else
+		{
+			Com_Printf("%6i+         us: %8i (%5.1f%%)\n", low, svs.frameLateness[i], 100.0f * svs.frameLateness[i] / frames);
+		}
+	}
+	Com_Printf("average %i us, max %i us\n", (int)(svs.frameLatenessTotal / frames), svs.frameLatenessMax);
+}
+
 /*
 ==================
 SV_Frame
@@ -1107,6 +1537,7 @@ void SV_Frame(int msec)
 	int             startTime;
 	char            mapname[MAX_QPATH];
 	int             frameStartTime = 0, frameEndTime;
+	int64_t         profileFrameStart, profileStart;
 
 	// the menu kills the server with this cvar
 	if(sv_killserver->integer)
@@ -1143,17 +1574,27 @@ void SV_Frame(int msec)
 
 	if(!com_dedicated->integer)
 	{
+		profileStart = SV_ProfileBegin();
 		SV_BotFrame(svs.time + sv.timeResidual);
+		SV_ProfileEnd(PROF_BOT_FRAME, profileStart);
 	}
 
 	if(com_dedicated->integer && sv.timeResidual < frameMsec)
 	{
-		// NET_Sleep will give the OS time slices until either get a packet
-		// or time enough for a server frame has gone by
-		NET_Sleep(frameMsec - sv.timeResidual);
+		// NET_SleepUntil will give the OS time slices until either get a packet
+		// or the millisecond the next server frame is due begins
+		NET_SleepUntil((int64_t) (com_frameTime + frameMsec - sv.timeResidual) * 1000);
 		return;
 	}
 
+	if(com_dedicated->integer && !sv_benchmarking)
+	{
+		// the frame was due when the residual reached frameMsec
+		SV_AddFrameLateness(Sys_Microseconds() - (int64_t) (com_frameTime - (sv.timeResidual - frameMsec)) * 1000);
+	}
+
+	profileFrameStart = SV_ProfileFrameBegin();
+
 	// if time is about to hit the 32nd bit, kick all clients
 	// and clear sv.time, rather
 	// than checking for negative time wraparound everywhere.
@@ -1224,7 +1665,9 @@ void SV_Frame(int msec)
 
 	if(com_dedicated->integer)
 	{
+		profileStart = SV_ProfileBegin();
 		SV_BotFrame(svs.time);
+		SV_ProfileEnd(PROF_BOT_FRAME, profileStart);
 	}
 
 	// run the game simulation in chunks
@@ -1234,7 +1677,9 @@ void SV_Frame(int msec)
 		svs.time += frameMsec;
 
 		// let everything in the world think and move
+		profileStart = SV_ProfileBegin();
 		VM_Call(gvm, GAME_RUN_FRAME, svs.time);
+		SV_ProfileEnd(PROF_GAME_RUN_FRAME, profileStart);
 	}
 
 	if(com_speeds->integer)
@@ -1246,7 +1691,9 @@ void SV_Frame(int msec)
 	SV_CheckTimeouts();
 
 	// send messages back to the clients
+	profileStart = SV_ProfileBegin();
 	SV_SendClientMessages();
+	SV_ProfileEnd(PROF_SEND_CLIENT_MESSAGES, profileStart);
 
 	// send a heartbeat to the master if needed
 	SV_MasterHeartbeat(HEARTBEAT_GAME);
@@ -1300,6 +1747,11 @@ void SV_Frame(int msec)
 	{
 		svs.serverLoad = -1;
 	}
+
+	// forget cached getstatus / getinfo responses that changed this frame
+	SV_CheckQueryResponses();
+
+	SV_ProfileEnd(PROF_FRAME, profileFrameStart);
 }
 
 /*
@@ -0,0 +1,269 @@
+/*
+===========================================================================
+
+Wolfenstein: Enemy Territory GPL Source Code
+Copyright (C) 1999-2010 id Software LLC, a ZeniMax Media company. 
+
+This file is part of the Wolfenstein: Enemy Territory GPL Source Code (Wolf ET Source Code).  
+
+Wolf ET Source Code is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+Wolf ET Source Code is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with Wolf ET Source Code.  If not, see <http://www.gnu.org/licenses/>.
+
+In addition, the Wolf: ET Source Code is also subject to certain additional terms. You should have received a copy of these additional terms immediately following the terms and conditions of the GNU General Public License which accompanied the Wolf ET Source Code.  If not, please request a copy in writing from id Software at the address below.
+
+If you have questions concerning this license or the applicable additional terms, you may contact in writing id Software LLC, c/o ZeniMax Media Inc., Suite 120, Rockville, Maryland 20850 USA.
+
+===========================================================================
+*/
+
+
+// sv_profile.c -- server frame timeline for attributing frame spikes
+
+#include "server.h"
+
+#define MAX_PROFILE_EVENTS      32768	// must be a power of two
+
+typedef struct
+{
+	int64_t         start;		// Sys_Microseconds
+	int             duration;	// microseconds
+	int             frame;
+	int             zone;
+	int             counters[PROF_NUM_COUNTERS];	// only for PROF_FRAME
+} profileEvent_t;
+
+static const char *svProfileZoneNames[PROF_NUM_ZONES] = {
+	"SV_Frame",
+	"GAME_RUN_FRAME",
+	"SV_BotFrame",
+	"SV_SendClientMessages",
+	"SV_PacketEvent"
+};
+
+static const char *svProfileCounterNames[PROF_NUM_COUNTERS] = {
+	"SV_Trace",
+	"SV_PointContents"
+};
+
+typedef struct
+{
+	int             calls;
+	int64_t         total;		// microseconds
+	int             max;
+} profileTotal_t;
+
+static profileEvent_t svProfileEvents[MAX_PROFILE_EVENTS];
+static profileTotal_t svProfileTotals[PROF_NUM_ZONES];
+static int64_t  svProfileCounterTotals[PROF_NUM_COUNTERS];
+static int      svProfileNumEvents;	// total ever recorded, the ring keeps the last MAX_PROFILE_EVENTS
+static int      svProfileFrame;
+
+qboolean        sv_profiling;
+int             sv_profileCounters[PROF_NUM_COUNTERS];
+
+/*
+==================
+SV_ProfileFrameBegin
+
+Picks up sv_profile once a frame, so a frame is either profiled entirely or not at all
+==================
+*/
+int64_t SV_ProfileFrameBegin(void)
+{
+	if(!sv_profiling && sv_profile->integer)
+	{
+		memset(sv_profileCounters, 0, sizeof(sv_profileCounters));
+	}
+	sv_profiling = sv_profile->integer ? qtrue : qfalse;
+
+	return SV_ProfileBegin();
+}
+
+/*
+==================
+SV_ProfileBegin
+
+Returns the start time for SV_ProfileEnd, 0 when not profiling
+==================
+*/
+int64_t SV_ProfileBegin(void)
+{
+	if(!sv_profiling)
+	{
+		return 0;
+	}
+
+	return Sys_Microseconds();
+}
+
+/*
+==================
+SV_ProfileEnd
+==================
+*/
+void SV_ProfileEnd(svProfileZone_t zone, int64_t start)
+{
+	profileEvent_t *ev;
+	profileTotal_t *total;
+	int             i;
+
+	if(!sv_profiling || !start)
+	{
+		return;
+	}
+
+	ev = &svProfileEvents[svProfileNumEvents & (MAX_PROFILE_EVENTS - 1)];
+	svProfileNumEvents++;
+
+	ev->start = start;
+	ev->duration = (int)(Sys_Microseconds() - start);
+	ev->frame = svProfileFrame;
+	ev->zone = zone;
+
+	total = &svProfileTotals[zone];
+	total->calls++;
+	total->total += ev->duration;
+	if(ev->duration > total->max)
+	{
+		total->max = ev->duration;
+	}
+
+	if(zone == PROF_FRAME)
+	{
+		// counted since the end of the previous frame, which includes the packets in between
+		for(i = 0; i < PROF_NUM_COUNTERS; i++)
+		{
+			ev->counters[i] = sv_profileCounters[i];
+			svProfileCounterTotals[i] += sv_profileCounters[i];
+		}
+		memset(sv_profileCounters, 0, sizeof(sv_profileCounters));
+		svProfileFrame++;
+	}
+}
+
+/*
+==================
+SV_ProfileClearTotals
+==================
+*/
+void SV_ProfileClearTotals(void)
+{
+	memset(svProfileTotals, 0, sizeof(svProfileTotals));
+	memset(svProfileCounterTotals, 0, sizeof(svProfileCounterTotals));
+}
+
+/*
+==================
+SV_ProfilePrintTotals
+
+Per zone time since SV_ProfileClearTotals, averaged over frames
+==================
+*/
+void SV_ProfilePrintTotals(int frames)
+{
+	profileTotal_t *total;
+	int             i;
+
+	if(frames < 1)
+	{
+		frames = 1;
+	}
+
+	Com_Printf("%-22s %8s %10s %10s %10s\n", "zone", "calls", "total ms", "us/frame", "max us");
+	for(i = 0; i < PROF_NUM_ZONES; i++)
+	{
+		total = &svProfileTotals[i];
+		Com_Printf("%-22s %8i %10.1f %10i %10i\n", svProfileZoneNames[i], total->calls, total->total / 1000.0,
+				   (int)(total->total / frames), total->max);
+	}
+
+	for(i = 0; i < PROF_NUM_COUNTERS; i++)
+	{
+		Com_Printf("%-22s %8i calls, %.1f a frame\n", svProfileCounterNames[i], (int)svProfileCounterTotals[i],
+				   (double)svProfileCounterTotals[i] / frames);
+	}
+}
+
+/*
+==================
+SV_ProfileDump_f
+
+sv_profiledump [filename]
+Writes the recorded events as a Chrome trace, open it in chrome://tracing or Perfetto
+==================
+*/
+void SV_ProfileDump_f(void)
+{
+	char            filename[MAX_QPATH];
+	fileHandle_t    f;
+	profileEvent_t *ev;
+	int64_t         base;
+	int             i, j, first, count;
+
+	if(!svProfileNumEvents)
+	{
+		Com_Printf("nothing profiled, set sv_profile 1 first\n");
+		return;
+	}
+
+	if(Cmd_Argc() > 1)
+	{
+		Q_strncpyz(filename, Cmd_Argv(1), sizeof(filename));
+		COM_DefaultExtension(filename, sizeof(filename), ".json");
+	}
+	else
+	{
+		Q_strncpyz(filename, "profile.json", sizeof(filename));
+	}
+
+	f = FS_FOpenFileWrite(filename);
+	if(!f)
+	{
+		Com_Printf("couldn't open %s\n", filename);
+		return;
+	}
+
+	count = svProfileNumEvents < MAX_PROFILE_EVENTS ? svProfileNumEvents : MAX_PROFILE_EVENTS;
+	first = svProfileNumEvents - count;
+
+	// timestamps are written relative to the oldest event so they fit an int
+	base = svProfileEvents[first & (MAX_PROFILE_EVENTS - 1)].start;
+
+	FS_Printf(f, "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[\n");
+	FS_Printf(f, "{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":1,\"args\":{\"name\":\"server\"}}");
+
+	for(i = first; i < svProfileNumEvents; i++)
+	{
+		ev = &svProfileEvents[i & (MAX_PROFILE_EVENTS - 1)];
+
+		FS_Printf(f, ",\n{\"name\":\"%s\",\"cat\":\"server\",\"ph\":\"X\",\"pid\":1,\"tid\":1,\"ts\":%i,\"dur\":%i,"
+				  "\"args\":{\"frame\":%i}}", svProfileZoneNames[ev->zone], (int)(ev->start - base), ev->duration, ev->frame);
+
+		if(ev->zone != PROF_FRAME)
+		{
+			continue;
+		}
+
+		for(j = 0; j < PROF_NUM_COUNTERS; j++)
+		{
+			FS_Printf(f, ",\n{\"name\":\"%s\",\"ph\":\"C\",\"pid\":1,\"ts\":%i,\"args\":{\"calls\":%i}}",
+					  svProfileCounterNames[j], (int)(ev->start - base), ev->counters[j]);
+		}
+	}
+
+	FS_Printf(f, "\n]}\n");
+	FS_FCloseFile(f);
+
+	ev = &svProfileEvents[(svProfileNumEvents - 1) & (MAX_PROFILE_EVENTS - 1)];
+	Com_Printf("wrote %i events over %.1f seconds to %s\n", count, (ev->start - base) / 1000000.0, filename);
+}
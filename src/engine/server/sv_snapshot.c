@@ -52,6 +52,210 @@ A normal server packet will look like:
 =============================================================================
 */
 
+/*
+=============================================================================
+
+Entity delta cache
+
+Clients that acknowledged the same frames get the very same entity deltas,
+and new entities are always sent from the same baseline.  Every thread
+encoding snapshots keeps a memo of the Huffman coded bits of the deltas it
+wrote, keyed by the from and to states, so a delta seen before is bit-copied
+into the message instead of being compared and coded field by field again.
+
+=============================================================================
+*/
+
+#define DELTA_CACHE_HASH_SIZE   1024	// must be a power of two
+#define DELTA_CACHE_ENTRIES     1024
+#define DELTA_CACHE_BITS_SIZE   0x20000
+#define MAX_ENTITY_DELTA_BYTES  1024	// scratch space a single coded delta may take
+
+typedef struct deltaCacheEntry_s
+{
+	entityState_t   from;
+	entityState_t   to;
+	qboolean        force;
+	int             ofs;		// into deltaCache_t->bits
+	int             numBits;
+	int             uncompBits;
+	struct deltaCacheEntry_s *next;
+} deltaCacheEntry_t;
+
+typedef struct
+{
+	int             frame;		// deltaCacheFrame the entries were coded in
+	int             numEntries;
+	int             bitsUsed;	// bytes of bits taken
+	int             hits;
+	int             misses;
+	deltaCacheEntry_t *hashTable[DELTA_CACHE_HASH_SIZE];
+	deltaCacheEntry_t entries[DELTA_CACHE_ENTRIES];
+	byte            bits[DELTA_CACHE_BITS_SIZE];
+} deltaCache_t;
+
+static deltaCache_t *deltaCaches[MAX_JOB_THREADS + 1];	// one per thread, only touched by that thread
+static int      deltaCacheFrame;
+
+/*
+=============
+SV_DeltaCacheForThread
+
+The memo only lives for a server frame, so it can never fill up with
+states nobody is going to delta from again
+=============
+*/
+static deltaCache_t *SV_DeltaCacheForThread(int threadNum)
+{
+	deltaCache_t   *cache;
+
+	if(!sv_snapshotDeltaCache->integer)
+	{
+		return NULL;
+	}
+
+	cache = deltaCaches[threadNum];
+	if(!cache)
+	{
+		// RF, avoid trying to allocate large chunk on a fragmented zone
+		cache = deltaCaches[threadNum] = malloc(sizeof(*cache));
+		if(!cache)
+		{
+			return NULL;
+		}
+		cache->frame = deltaCacheFrame - 1;
+		cache->hits = cache->misses = 0;
+	}
+
+	if(cache->frame != deltaCacheFrame)
+	{
+		cache->frame = deltaCacheFrame;
+		cache->numEntries = 0;
+		cache->bitsUsed = 0;
+		memset(cache->hashTable, 0, sizeof(cache->hashTable));
+	}
+
+	return cache;
+}
+
+/*
+=============
+SV_ShutdownDeltaCaches
+=============
+*/
+static void SV_ShutdownDeltaCaches(void)
+{
+	int             i;
+
+	for(i = 0; i < MAX_JOB_THREADS + 1; i++)
+	{
+		if(deltaCaches[i])
+		{
+			free(deltaCaches[i]);
+			deltaCaches[i] = NULL;
+		}
+	}
+}
+
+/*
+=============
+SV_HashEntityDelta
+=============
+*/
+static int SV_HashEntityDelta(const entityState_t * from, const entityState_t * to, qboolean force)
+{
+	const int      *f, *t;
+	unsigned int    hash;
+	int             i;
+
+	f = (const int *)from;
+	t = (const int *)to;
+	hash = force;
+	for(i = 0; i < sizeof(entityState_t) / 4; i++)
+	{
+		hash = hash * 31 + f[i];
+		hash = hash * 17 + t[i];
+	}
+
+	return (hash ^ (hash >> 10) ^ (hash >> 20)) & (DELTA_CACHE_HASH_SIZE - 1);
+}
+
+/*
+=============
+SV_WriteCachedDeltaEntity
+
+Same as MSG_WriteDeltaEntity for an entity that is still present,
+but looks the coded bits up in the memo first
+=============
+*/
+static void SV_WriteCachedDeltaEntity(deltaCache_t * cache, msg_t * msg, entityState_t * from, entityState_t * to,
+									  qboolean force)
+{
+	deltaCacheEntry_t *entry;
+	msg_t           scratch;
+	byte            scratchData[MAX_ENTITY_DELTA_BYTES];
+	int             hash;
+
+	if(!cache)
+	{
+		MSG_WriteDeltaEntity(msg, from, to, force);
+		return;
+	}
+
+	hash = SV_HashEntityDelta(from, to, force);
+	for(entry = cache->hashTable[hash]; entry; entry = entry->next)
+	{
+		if(entry->force == force && !memcmp(&entry->to, to, sizeof(*to)) && !memcmp(&entry->from, from, sizeof(*from)))
+		{
+			cache->hits++;
+			if(entry->numBits)
+			{
+				MSG_WriteEncodedBits(msg, cache->bits + entry->ofs, entry->numBits, entry->uncompBits);
+			}
+			return;
+		}
+	}
+
+	cache->misses++;
+
+	// the Huffman codes don't depend on the bit position,
+	// so the delta can be coded on its own and copied in afterwards
+	MSG_Init(&scratch, scratchData, sizeof(scratchData));
+	scratch.allowoverflow = qtrue;
+	MSG_WriteDeltaEntity(&scratch, from, to, force);
+
+	if(scratch.overflowed)
+	{
+		MSG_WriteDeltaEntity(msg, from, to, force);
+		return;
+	}
+
+	if(scratch.bit)
+	{
+		MSG_WriteEncodedBits(msg, scratchData, scratch.bit, scratch.uncompsize);
+	}
+
+	if(cache->numEntries == DELTA_CACHE_ENTRIES || cache->bitsUsed + scratch.cursize > DELTA_CACHE_BITS_SIZE)
+	{
+		return;					// full for this frame
+	}
+
+	entry = &cache->entries[cache->numEntries++];
+	entry->from = *from;
+	entry->to = *to;
+	entry->force = force;
+	entry->ofs = cache->bitsUsed;
+	entry->numBits = scratch.bit;
+	entry->uncompBits = scratch.uncompsize;
+	if(scratch.bit)
+	{
+		memcpy(cache->bits + entry->ofs, scratchData, (scratch.bit + 7) >> 3);
+		cache->bitsUsed += (scratch.bit + 7) >> 3;
+	}
+	entry->next = cache->hashTable[hash];
+	cache->hashTable[hash] = entry;
+}
+
 /*
 =============
 SV_EmitPacketEntities
@@ -59,8 +263,9 @@ SV_EmitPacketEntities
 Writes a delta update of an entityState_t list to the message.
 =============
 */
-static void SV_EmitPacketEntities(clientSnapshot_t * from, clientSnapshot_t * to, msg_t * msg)
+static void SV_EmitPacketEntities(clientSnapshot_t * from, clientSnapshot_t * to, msg_t * msg, int threadNum)
 {
+	deltaCache_t   *cache;
 	entityState_t  *oldent, *newent;
 	int             oldindex, newindex;
 	int             oldnum, newnum;
@@ -76,6 +281,8 @@ static void SV_EmitPacketEntities(clientSnapshot_t * from, clientSnapshot_t * to
 		from_num_entities = from->num_entities;
 	}
 
+	cache = SV_DeltaCacheForThread(threadNum);
+
 	newent = NULL;
 	oldent = NULL;
 	newindex = 0;
@@ -107,7 +314,7 @@ static void SV_EmitPacketEntities(clientSnapshot_t * from, clientSnapshot_t * to
 			// delta update from old position
 			// because the force parm is qfalse, this will not result
 			// in any bytes being emited if the entity has not changed at all
-			MSG_WriteDeltaEntity(msg, oldent, newent, qfalse);
+			SV_WriteCachedDeltaEntity(cache, msg, oldent, newent, qfalse);
 			oldindex++;
 			newindex++;
 			continue;
@@ -116,7 +323,7 @@ static void SV_EmitPacketEntities(clientSnapshot_t * from, clientSnapshot_t * to
 		if(newnum < oldnum)
 		{
 			// this is a new entity, send it from the baseline
-			MSG_WriteDeltaEntity(msg, &sv.svEntities[newnum].baseline, newent, qtrue);
+			SV_WriteCachedDeltaEntity(cache, msg, &sv.svEntities[newnum].baseline, newent, qtrue);
 			newindex++;
 			continue;
 		}
@@ -137,48 +344,63 @@ static void SV_EmitPacketEntities(clientSnapshot_t * from, clientSnapshot_t * to
 
 /*
 ==================
-SV_WriteSnapshotToClient
+SV_SnapshotDeltaFrame
+
+Picks the previous frame the current snapshot will be delta compressed
+against, or NULL if the client needs a full snapshot
 ==================
 */
-static void SV_WriteSnapshotToClient(client_t * client, msg_t * msg)
+static clientSnapshot_t *SV_SnapshotDeltaFrame(client_t * client, int *lastframe)
 {
-	clientSnapshot_t *frame, *oldframe;
-	int             lastframe;
-	int             i;
-	int             snapFlags;
-
-	// this is the snapshot we are creating
-	frame = &client->frames[client->netchan.outgoingSequence & PACKET_MASK];
+	clientSnapshot_t *oldframe;
 
 	// try to use a previous frame as the source for delta compressing the snapshot
 	if(client->deltaMessage <= 0 || client->state != CS_ACTIVE)
 	{
 		// client is asking for a retransmit
 		oldframe = NULL;
-		lastframe = 0;
+		*lastframe = 0;
 	}
 	else if(client->netchan.outgoingSequence - client->deltaMessage >= (PACKET_BACKUP - 3))
 	{
 		// client hasn't gotten a good message through in a long time
 		Com_DPrintf("%s: Delta request from out of date packet.\n", client->name);
 		oldframe = NULL;
-		lastframe = 0;
+		*lastframe = 0;
 	}
 	else
 	{
 		// we have a valid snapshot to delta from
 		oldframe = &client->frames[client->deltaMessage & PACKET_MASK];
-		lastframe = client->netchan.outgoingSequence - client->deltaMessage;
+		*lastframe = client->netchan.outgoingSequence - client->deltaMessage;
 
 		// the snapshot's entities may still have rolled off the buffer, though
 		if(oldframe->first_entity <= svs.nextSnapshotEntities - svs.numSnapshotEntities)
 		{
 			Com_DPrintf("%s: Delta request from out of date entities.\n", client->name);
 			oldframe = NULL;
-			lastframe = 0;
+			*lastframe = 0;
 		}
 	}
 
+	return oldframe;
+}
+
+/*
+==================
+SV_WriteSnapshotToClient
+==================
+*/
+static void SV_WriteSnapshotToClient(client_t * client, clientSnapshot_t * oldframe, int lastframe, msg_t * msg,
+									 int threadNum)
+{
+	clientSnapshot_t *frame;
+	int             i;
+	int             snapFlags;
+
+	// this is the snapshot we are creating
+	frame = &client->frames[client->netchan.outgoingSequence & PACKET_MASK];
+
 	MSG_WriteByte(msg, svc_snapshot);
 
 	// NOTE, MRE: now sent at the start of every message from server to client
@@ -226,7 +448,7 @@ static void SV_WriteSnapshotToClient(client_t * client, msg_t * msg)
 	}
 
 	// delta encode the entities
-	SV_EmitPacketEntities(oldframe, frame, msg);
+	SV_EmitPacketEntities(oldframe, frame, msg, threadNum);
 
 	// padding for rate debugging
 	if(sv_padPackets->integer)
@@ -275,8 +497,11 @@ typedef struct
 {
 	int             numSnapshotEntities;
 	int             snapshotEntities[MAX_SNAPSHOT_ENTITIES];
+	byte            added[MAX_GENTITIES / 8];	// used to prevent double adding from portal views
 } snapshotEntityNumbers_t;
 
+#define SV_SnapshotEntityAdded( eNums, num )    ( ( eNums )->added[( num ) >> 3] & ( 1 << ( ( num ) & 7 ) ) )
+
 /*
 =======================
 SV_QsortEntityNumbers
@@ -306,17 +531,22 @@ static int QDECL SV_QsortEntityNumbers(const void *a, const void *b)
 /*
 ===============
 SV_AddEntToSnapshot
+
+Entities with a snapshotCallback are only filtered later on in
+SV_EndClientSnapshot, because the game VM may only be called from
+the main thread
 ===============
 */
-static void SV_AddEntToSnapshot(sharedEntity_t * clientEnt, svEntity_t * svEnt, sharedEntity_t * gEnt,
-								snapshotEntityNumbers_t * eNums)
+static void SV_AddEntToSnapshot(sharedEntity_t * gEnt, snapshotEntityNumbers_t * eNums)
 {
+	int             num = gEnt->s.number;
+
 	// if we have already added this entity to this snapshot, don't add again
-	if(svEnt->snapshotCounter == sv.snapshotCounter)
+	if(SV_SnapshotEntityAdded(eNums, num))
 	{
 		return;
 	}
-	svEnt->snapshotCounter = sv.snapshotCounter;
+	eNums->added[num >> 3] |= 1 << (num & 7);
 
 	// if we are full, silently discard entities
 	if(eNums->numSnapshotEntities == MAX_SNAPSHOT_ENTITIES)
@@ -324,62 +554,63 @@ static void SV_AddEntToSnapshot(sharedEntity_t * clientEnt, svEntity_t * svEnt,
 		return;
 	}
 
-	if(gEnt->r.snapshotCallback)
-	{
-		if(!(qboolean) VM_Call(gvm, GAME_SNAPSHOT_CALLBACK, gEnt->s.number, clientEnt->s.number))
-		{
-			return;
-		}
-	}
-
-	eNums->snapshotEntities[eNums->numSnapshotEntities] = gEnt->s.number;
+	eNums->snapshotEntities[eNums->numSnapshotEntities] = num;
 	eNums->numSnapshotEntities++;
 }
 
+/*
+=============================================================================
+
+Shared visibility sets
+
+Most clients in a frame look out of a handful of clusters, so the part of
+the entity visibility test that doesn't depend on the client is done once
+per (cluster, area) and frame, and every client in there reuses the set.
+
+=============================================================================
+*/
+
+#define MAX_SNAPSHOT_VIS_SETS   256
+
+typedef struct
+{
+	int             cluster;
+	int             area;
+	byte            visible[MAX_GENTITIES / 8];
+} snapshotVisSet_t;
+
+typedef struct
+{
+	qboolean        active;		// only while SV_SendClientMessages builds the snapshots of a frame
+	qboolean        frozen;		// no new sets while worker threads are reading them
+	int             numSets;
+	snapshotVisSet_t sets[MAX_SNAPSHOT_VIS_SETS];
+} snapshotVisCache_t;
+
+static snapshotVisCache_t snapshotVisCache;
+
 /*
 ===============
-SV_AddEntitiesVisibleFromPoint
+SV_BuildSnapshotVisSet
+
+Flags every linked entity that would be visible from the given cluster and
+area to any client, ignoring the SVF_SINGLECLIENT / SVF_NOTSINGLECLIENT
+restrictions and what was already added through portals
 ===============
 */
-static void SV_AddEntitiesVisibleFromPoint(vec3_t origin, clientSnapshot_t * frame,
-//                                  snapshotEntityNumbers_t *eNums, qboolean portal, clientSnapshot_t *oldframe, qboolean localClient ) {
-//                                  snapshotEntityNumbers_t *eNums, qboolean portal ) {
-										   snapshotEntityNumbers_t * eNums /*, qboolean portal, qboolean localClient */ )
+static void SV_BuildSnapshotVisSet(snapshotVisSet_t * set, int clientcluster, int clientarea)
 {
 	int             e, i;
-	sharedEntity_t *ent, *playerEnt;
+	sharedEntity_t *ent;
 	svEntity_t     *svEnt;
 	int             l;
-	int             clientarea, clientcluster;
-	int             leafnum;
-	int             c_fullsend;
-	byte           *clientpvs;
 	byte           *bitvector;
 
-	// during an error shutdown message we may need to transmit
-	// the shutdown message after the server has shutdown, so
-	// specfically check for it
-	if(!sv.state)
-	{
-		return;
-	}
-
-	leafnum = CM_PointLeafnum(origin);
-	clientarea = CM_LeafArea(leafnum);
-	clientcluster = CM_LeafCluster(leafnum);
-
-	// calculate the visible areas
-	frame->areabytes = CM_WriteAreaBits(frame->areabits, clientarea);
-
-	clientpvs = CM_ClusterPVS(clientcluster);
+	set->cluster = clientcluster;
+	set->area = clientarea;
+	memset(set->visible, 0, sizeof(set->visible));
 
-	c_fullsend = 0;
-
-	playerEnt = SV_GentityNum(frame->ps.clientNum);
-	if(playerEnt->r.svFlags & SVF_SELF_PORTAL)
-	{
-		SV_AddEntitiesVisibleFromPoint(playerEnt->s.origin2, frame, eNums);
-	}
+	bitvector = CM_ClusterPVS(clientcluster);
 
 	for(e = 0; e < sv.num_entities; e++)
 	{
@@ -403,46 +634,21 @@ static void SV_AddEntitiesVisibleFromPoint(vec3_t origin, clientSnapshot_t * fra
 			continue;
 		}
 
-		// entities can be flagged to be sent to only one client
-		if(ent->r.svFlags & SVF_SINGLECLIENT)
-		{
-			if(ent->r.singleClient != frame->ps.clientNum)
-			{
-				continue;
-			}
-		}
-		// entities can be flagged to be sent to everyone but one client
-		if(ent->r.svFlags & SVF_NOTSINGLECLIENT)
-		{
-			if(ent->r.singleClient == frame->ps.clientNum)
-			{
-				continue;
-			}
-		}
-
 		svEnt = SV_SvEntityForGentity(ent);
 
-		// don't double add an entity through portals
-		if(svEnt->snapshotCounter == sv.snapshotCounter)
-		{
-			continue;
-		}
-
 		// broadcast entities are always sent
 		if(ent->r.svFlags & SVF_BROADCAST)
 		{
-			SV_AddEntToSnapshot(playerEnt, svEnt, ent, eNums);
+			set->visible[e >> 3] |= 1 << (e & 7);
 			continue;
 		}
 
-		bitvector = clientpvs;
-
 		// Gordon: just check origin for being in pvs, ignore bmodel extents
 		if(ent->r.svFlags & SVF_IGNOREBMODELEXTENTS)
 		{
 			if(bitvector[svEnt->originCluster >> 3] & (1 << (svEnt->originCluster & 7)))
 			{
-				SV_AddEntToSnapshot(playerEnt, svEnt, ent, eNums);
+				set->visible[e >> 3] |= 1 << (e & 7);
 			}
 			continue;
 		}
@@ -498,6 +704,164 @@ static void SV_AddEntitiesVisibleFromPoint(vec3_t origin, clientSnapshot_t * fra
 			}
 		}
 
+		set->visible[e >> 3] |= 1 << (e & 7);
+	}
+}
+
+/*
+===============
+SV_SnapshotVisSet
+
+Returns the cached set for cluster and area, building it if needed.
+If the cache can't take it, the set is built into scratch instead.
+===============
+*/
+static const snapshotVisSet_t *SV_SnapshotVisSet(int clientcluster, int clientarea, snapshotVisSet_t * scratch)
+{
+	int             i;
+	snapshotVisSet_t *set;
+
+	if(!snapshotVisCache.active)
+	{
+		SV_BuildSnapshotVisSet(scratch, clientcluster, clientarea);
+		return scratch;
+	}
+
+	for(i = 0, set = snapshotVisCache.sets; i < snapshotVisCache.numSets; i++, set++)
+	{
+		if(set->cluster == clientcluster && set->area == clientarea)
+		{
+			return set;
+		}
+	}
+
+	if(snapshotVisCache.frozen || snapshotVisCache.numSets == MAX_SNAPSHOT_VIS_SETS)
+	{
+		SV_BuildSnapshotVisSet(scratch, clientcluster, clientarea);
+		return scratch;
+	}
+
+	set = &snapshotVisCache.sets[snapshotVisCache.numSets++];
+	SV_BuildSnapshotVisSet(set, clientcluster, clientarea);
+	return set;
+}
+
+/*
+===============
+SV_BeginSnapshotVisCache
+===============
+*/
+static void SV_BeginSnapshotVisCache(void)
+{
+	snapshotVisCache.active = qtrue;
+	snapshotVisCache.frozen = qfalse;
+	snapshotVisCache.numSets = 0;
+}
+
+/*
+===============
+SV_EndSnapshotVisCache
+
+Entities move between frames, so the sets never outlive SV_SendClientMessages
+===============
+*/
+static void SV_EndSnapshotVisCache(void)
+{
+	snapshotVisCache.active = qfalse;
+	snapshotVisCache.numSets = 0;
+}
+
+/*
+===============
+SV_AddEntitiesVisibleFromPoint
+
+Only reads shared server state once the visibility set exists,
+so it can run for several clients at once
+===============
+*/
+static void SV_AddEntitiesVisibleFromPoint(vec3_t origin, clientSnapshot_t * frame,
+//                                  snapshotEntityNumbers_t *eNums, qboolean portal, clientSnapshot_t *oldframe, qboolean localClient ) {
+//                                  snapshotEntityNumbers_t *eNums, qboolean portal ) {
+										   snapshotEntityNumbers_t * eNums /*, qboolean portal, qboolean localClient */ ,
+										   int threadNum)
+{
+	int             e;
+	sharedEntity_t *ent, *playerEnt;
+	int             clientarea, clientcluster;
+	int             leafnum;
+	snapshotVisSet_t scratch;
+	const snapshotVisSet_t *set;
+
+	// during an error shutdown message we may need to transmit
+	// the shutdown message after the server has shutdown, so
+	// specfically check for it
+	if(!sv.state)
+	{
+		return;
+	}
+
+	leafnum = CM_PointLeafnumForThread(threadNum, origin);
+	clientarea = CM_LeafArea(leafnum);
+	clientcluster = CM_LeafCluster(leafnum);
+
+	// calculate the visible areas
+	frame->areabytes = CM_WriteAreaBits(frame->areabits, clientarea);
+
+	set = SV_SnapshotVisSet(clientcluster, clientarea, &scratch);
+
+	playerEnt = SV_GentityNum(frame->ps.clientNum);
+	if(playerEnt->r.svFlags & SVF_SELF_PORTAL)
+	{
+		SV_AddEntitiesVisibleFromPoint(playerEnt->s.origin2, frame, eNums, threadNum);
+	}
+
+	for(e = 0; e < sv.num_entities; e++)
+	{
+		// skip through the set a byte at a time
+		if(!set->visible[e >> 3])
+		{
+			e |= 7;
+			continue;
+		}
+
+		if(!(set->visible[e >> 3] & (1 << (e & 7))))
+		{
+			continue;
+		}
+
+		ent = SV_GentityNum(e);
+
+		// entities can be flagged to be sent to only one client
+		if(ent->r.svFlags & SVF_SINGLECLIENT)
+		{
+			if(ent->r.singleClient != frame->ps.clientNum)
+			{
+				continue;
+			}
+		}
+		// entities can be flagged to be sent to everyone but one client
+		if(ent->r.svFlags & SVF_NOTSINGLECLIENT)
+		{
+			if(ent->r.singleClient == frame->ps.clientNum)
+			{
+				continue;
+			}
+		}
+
+		// don't double add an entity through portals
+		if(SV_SnapshotEntityAdded(eNums, e))
+		{
+			continue;
+		}
+
+		// broadcast entities are always sent, origin only entities were
+		// already checked against the pvs
+		if(ent->r.svFlags & (SVF_BROADCAST | SVF_IGNOREBMODELEXTENTS))
+		{
+			SV_AddEntToSnapshot(ent, eNums);
+			continue;
+		}
+
 		//----(SA) added "visibility dummies"
 		if(ent->r.svFlags & SVF_VISDUMMY)
 		{
@@ -508,16 +872,12 @@ static void SV_AddEntitiesVisibleFromPoint(vec3_t origin, clientSnapshot_t * fra
 
 			if(ment)
 			{
-				svEntity_t     *master = 0;
-
-				master = SV_SvEntityForGentity(ment);
-
-				if(master->snapshotCounter == sv.snapshotCounter || !ment->r.linked)
+				if(SV_SnapshotEntityAdded(eNums, ment->s.number) || !ment->r.linked)
 				{
 					continue;
 				}
 
-				SV_AddEntToSnapshot(playerEnt, master, ment, eNums);
+				SV_AddEntToSnapshot(ment, eNums);
 			}
 			continue;			// master needs to be added, but not this dummy ent
 		}
@@ -527,7 +887,6 @@ static void SV_AddEntitiesVisibleFromPoint(vec3_t origin, clientSnapshot_t * fra
 			{
 				int             h;
 				sharedEntity_t *ment = 0;
-				svEntity_t     *master = 0;
 
 				for(h = 0; h < sv.num_entities; h++)
 				{
@@ -538,11 +897,7 @@ static void SV_AddEntitiesVisibleFromPoint(vec3_t origin, clientSnapshot_t * fra
 						continue;
 					}
 
-					if(ment)
-					{
-						master = SV_SvEntityForGentity(ment);
-					}
-					else
+					if(!ment)
 					{
 						continue;
 					}
@@ -563,14 +918,14 @@ static void SV_AddEntitiesVisibleFromPoint(vec3_t origin, clientSnapshot_t * fra
 						continue;
 					}
 
-					if(master->snapshotCounter == sv.snapshotCounter)
+					if(SV_SnapshotEntityAdded(eNums, h))
 					{
 						continue;
 					}
 
 					if(ment->s.otherEntityNum == ent->s.number)
 					{
-						SV_AddEntToSnapshot(playerEnt, master, ment, eNums);
+						SV_AddEntToSnapshot(ment, eNums);
 					}
 				}
 				continue;
@@ -578,13 +933,13 @@ static void SV_AddEntitiesVisibleFromPoint(vec3_t origin, clientSnapshot_t * fra
 		}
 
 		// add it
-		SV_AddEntToSnapshot(playerEnt, svEnt, ent, eNums);
+		SV_AddEntToSnapshot(ent, eNums);
 
 		// if its a portal entity, add everything visible from its camera position
 		if(ent->r.svFlags & SVF_PORTAL)
 		{
 //          SV_AddEntitiesVisibleFromPoint( ent->s.origin2, frame, eNums, qtrue, oldframe, localClient );
-			SV_AddEntitiesVisibleFromPoint(ent->s.origin2, frame, eNums /*, qtrue, localClient */ );
+			SV_AddEntitiesVisibleFromPoint(ent->s.origin2, frame, eNums /*, qtrue, localClient */ , threadNum);
 		}
 
 		continue;
@@ -593,40 +948,24 @@ static void SV_AddEntitiesVisibleFromPoint(vec3_t origin, clientSnapshot_t * fra
 
 /*
 =============
-SV_BuildClientSnapshot
-
-Decides which entities are going to be visible to the client, and
-copies off the playerstate and areabits.
+SV_BeginClientSnapshot
 
-This properly handles multiple recursive portals, but the render
-currently doesn't.
-
-For viewing through other player's eyes, clent can be something other than client->gentity
+Clears the frame we are creating and copies off the playerstate.
+Returns qfalse if there is no entity to build the snapshot from.
 =============
 */
-static void SV_BuildClientSnapshot(client_t * client)
+static qboolean SV_BeginClientSnapshot(client_t * client, snapshotEntityNumbers_t * eNums)
 {
-	vec3_t          org;
-
-//  clientSnapshot_t            *frame, *oldframe;
 	clientSnapshot_t *frame;
-	snapshotEntityNumbers_t entityNumbers;
-	int             i;
-	sharedEntity_t *ent;
-	entityState_t  *state;
-	svEntity_t     *svEnt;
 	sharedEntity_t *clent;
 	int             clientNum;
-	playerState_t  *ps;
-
-	// bump the counter used to prevent double adding
-	sv.snapshotCounter++;
 
 	// this is the frame we are creating
 	frame = &client->frames[client->netchan.outgoingSequence & PACKET_MASK];
 
 	// clear everything in this snapshot
-	entityNumbers.numSnapshotEntities = 0;
+	eNums->numSnapshotEntities = 0;
+	memset(eNums->added, 0, sizeof(eNums->added));
 	memset(frame->areabits, 0, sizeof(frame->areabits));
 
 	// show_bug.cgi?id=62
@@ -635,12 +974,11 @@ static void SV_BuildClientSnapshot(client_t * client)
 	clent = client->gentity;
 	if(!clent || client->state == CS_ZOMBIE)
 	{
-		return;
+		return qfalse;
 	}
 
 	// grab the current playerState_t
-	ps = SV_GameClientNum(client - svs.clients);
-	frame->ps = *ps;
+	frame->ps = *SV_GameClientNum(client - svs.clients);
 
 	// never send client's own entity, because it can
 	// be regenerated from the playerstate
@@ -649,9 +987,25 @@ static void SV_BuildClientSnapshot(client_t * client)
 	{
 		Com_Error(ERR_DROP, "SV_SvEntityForGentity: bad gEnt");
 	}
-	svEnt = &sv.svEntities[clientNum];
+	eNums->added[clientNum >> 3] |= 1 << (clientNum & 7);
+
+	return qtrue;
+}
+
+/*
+=============
+SV_ClientViewOrigin
 
-	svEnt->snapshotCounter = sv.snapshotCounter;
+Where the snapshot of a client is seen from, after SV_BeginClientSnapshot
+=============
+*/
+static void SV_ClientViewOrigin(client_t * client, vec3_t org)
+{
+	sharedEntity_t *clent;
+	playerState_t  *ps;
+
+	clent = client->gentity;
+	ps = &client->frames[client->netchan.outgoingSequence & PACKET_MASK].ps;
 
 	if(clent->r.svFlags & SVF_SELF_PORTAL_EXCLUSIVE)
 	{
@@ -666,27 +1020,50 @@ static void SV_BuildClientSnapshot(client_t * client)
 
 //----(SA)  added for 'lean'
 	// need to account for lean, so areaportal doors draw properly
-	if(frame->ps.leanf != 0)
+	if(ps->leanf != 0)
 	{
 		vec3_t          right, v3ViewAngles;
 
 		VectorCopy(ps->viewangles, v3ViewAngles);
-		v3ViewAngles[2] += frame->ps.leanf / 2.0f;
+		v3ViewAngles[2] += ps->leanf / 2.0f;
 		AngleVectors(v3ViewAngles, NULL, right, NULL);
-		VectorMA(org, frame->ps.leanf, right, org);
+		VectorMA(org, ps->leanf, right, org);
 	}
 //----(SA)  end
+}
+
+/*
+=============
+SV_AddClientSnapshotEntities
+
+Decides which entities are going to be visible to the client.
+
+This properly handles multiple recursive portals, but the render
+currently doesn't.
+
+Nothing in here touches the game VM or prints, so snapshots for
+different clients can be built concurrently.
+=============
+*/
+static void SV_AddClientSnapshotEntities(client_t * client, snapshotEntityNumbers_t * eNums, int threadNum)
+{
+	vec3_t          org;
+	clientSnapshot_t *frame;
+	int             i;
+
+	frame = &client->frames[client->netchan.outgoingSequence & PACKET_MASK];
+
+	SV_ClientViewOrigin(client, org);
 
 	// add all the entities directly visible to the eye, which
 	// may include portal entities that merge other viewpoints
-	SV_AddEntitiesVisibleFromPoint(org, frame, &entityNumbers /*, qfalse, client->netchan.remoteAddress.type == NA_LOOPBACK */ );
+	SV_AddEntitiesVisibleFromPoint(org, frame, eNums /*, qfalse, client->netchan.remoteAddress.type == NA_LOOPBACK */ , threadNum);
 
 	// if there were portals visible, there may be out of order entities
 	// in the list which will need to be resorted for the delta compression
 	// to work correctly.  This also catches the error condition
 	// of an entity being included twice.
-	qsort(entityNumbers.snapshotEntities, entityNumbers.numSnapshotEntities,
-		  sizeof(entityNumbers.snapshotEntities[0]), SV_QsortEntityNumbers);
+	qsort(eNums->snapshotEntities, eNums->numSnapshotEntities, sizeof(eNums->snapshotEntities[0]), SV_QsortEntityNumbers);
 
 	// now that all viewpoint's areabits have been OR'd together, invert
 	// all of them to make it a mask vector, which is what the renderer wants
@@ -694,13 +1071,42 @@ static void SV_BuildClientSnapshot(client_t * client)
 	{
 		((int *)frame->areabits)[i] = ((int *)frame->areabits)[i] ^ -1;
 	}
+}
+
+/*
+=============
+SV_EndClientSnapshot
+
+Asks the game about entities with a snapshotCallback and copies
+the entity states out into the circular svs.snapshotEntities
+=============
+*/
+static void SV_EndClientSnapshot(client_t * client, snapshotEntityNumbers_t * eNums)
+{
+	clientSnapshot_t *frame;
+	sharedEntity_t *ent;
+	entityState_t  *state;
+	int             i;
+	int             clientNum;
+
+	frame = &client->frames[client->netchan.outgoingSequence & PACKET_MASK];
+	clientNum = SV_GentityNum(frame->ps.clientNum)->s.number;
 
 	// copy the entity states out
 	frame->num_entities = 0;
 	frame->first_entity = svs.nextSnapshotEntities;
-	for(i = 0; i < entityNumbers.numSnapshotEntities; i++)
+	for(i = 0; i < eNums->numSnapshotEntities; i++)
 	{
-		ent = SV_GentityNum(entityNumbers.snapshotEntities[i]);
+		ent = SV_GentityNum(eNums->snapshotEntities[i]);
+
+		if(ent->r.snapshotCallback)
+		{
+			if(!(qboolean) VM_Call(gvm, GAME_SNAPSHOT_CALLBACK, ent->s.number, clientNum))
+			{
+				continue;
+			}
+		}
+
 		state = &svs.snapshotEntities[svs.nextSnapshotEntities % svs.numSnapshotEntities];
 		*state = ent->s;
 		svs.nextSnapshotEntities++;
@@ -713,6 +1119,29 @@ static void SV_BuildClientSnapshot(client_t * client)
 	}
 }
 
+/*
+=============
+SV_BuildClientSnapshot
+
+Copies off the playerstate and areabits and decides which entities
+are going to be visible to the client.
+
+For viewing through other player's eyes, clent can be something other than client->gentity
+=============
+*/
+static void SV_BuildClientSnapshot(client_t * client)
+{
+	snapshotEntityNumbers_t entityNumbers;
+
+	if(!SV_BeginClientSnapshot(client, &entityNumbers))
+	{
+		return;
+	}
+
+	SV_AddClientSnapshotEntities(client, &entityNumbers, 0);
+	SV_EndClientSnapshot(client, &entityNumbers);
+}
+
 
 /*
 ====================
@@ -874,6 +1303,34 @@ void SV_SendClientIdle(client_t * client)
 	sv.ubpsTotalBytes += msg.uncompsize / 8;	// NERVE - SMF - net debugging
 }
 
+/*
+=======================
+SV_FinishSnapshotMessage
+
+Adds download data to a written snapshot and sends it off
+=======================
+*/
+static void SV_FinishSnapshotMessage(client_t * client, msg_t * msg)
+{
+	// Add any download data if the client is downloading
+	SV_WriteDownloadToClient(client, msg);
+
+	// check for overflow
+	if(msg->overflowed)
+	{
+		Com_Printf("WARNING: msg overflowed for %s\n", client->name);
+		MSG_Clear(msg);
+
+		SV_DropClient(client, "Msg overflowed");
+		return;
+	}
+
+	SV_SendMessageToClient(msg, client);
+
+	sv.bpsTotalBytes += msg->cursize;	// NERVE - SMF - net debugging
+	sv.ubpsTotalBytes += msg->uncompsize / 8;	// NERVE - SMF - net debugging
+}
+
 /*
 =======================
 SV_SendClientSnapshot
@@ -886,6 +1343,8 @@ void SV_SendClientSnapshot(client_t * client)
 {
 	byte            msg_buf[MAX_MSGLEN];
 	msg_t           msg;
+	clientSnapshot_t *oldframe;
+	int             lastframe;
 
 	//bani
 	if(client->state < CS_ACTIVE)
@@ -921,25 +1380,227 @@ void SV_SendClientSnapshot(client_t * client)
 
 	// send over all the relevant entityState_t
 	// and the playerState_t
-	SV_WriteSnapshotToClient(client, &msg);
+	oldframe = SV_SnapshotDeltaFrame(client, &lastframe);
+	SV_WriteSnapshotToClient(client, oldframe, lastframe, &msg, 0);
 
-	// Add any download data if the client is downloading
-	SV_WriteDownloadToClient(client, &msg);
+	SV_FinishSnapshotMessage(client, &msg);
+}
 
-	// check for overflow
-	if(msg.overflowed)
+
+/*
+=============================================================================
+
+Parallel snapshots
+
+With sv_snapshotThreads > 0 the entity visibility and the delta encoding
+of all snapshots in a server frame are spread over worker threads.
+Everything touching the game VM, the svs.snapshotEntities ring, downloads
+or the network stays on the main thread, in the same client order as
+the serial path, so the produced messages match.
+
+=============================================================================
+*/
+
+typedef struct
+{
+	client_t       *client;
+	qboolean        build;		// qfalse if there is no entity to build from
+	clientSnapshot_t *oldframe;
+	int             lastframe;
+	msg_t           msg;
+	byte            msgBuffer[MAX_MSGLEN];
+	snapshotEntityNumbers_t entityNumbers;
+} snapshotJob_t;
+
+static snapshotJob_t *snapshotJobs;	// [MAX_CLIENTS] while worker threads are running
+
+/*
+=======================
+SV_InitSnapshotThreads
+=======================
+*/
+static void SV_InitSnapshotThreads(void)
+{
+	int             numThreads;
+
+	sv_snapshotThreads->modified = qfalse;
+
+	numThreads = sv_snapshotThreads->integer;
+
+	// all snapshots of a frame are in svs.snapshotEntities at once before
+	// they are encoded, which only a dedicated server sized ring can hold
+	if(numThreads > 0 && svs.numSnapshotEntities < sv_maxclients->integer * MAX_SNAPSHOT_ENTITIES)
 	{
-		Com_Printf("WARNING: msg overflowed for %s\n", client->name);
-		MSG_Clear(&msg);
+		Com_Printf("sv_snapshotThreads needs a dedicated server\n");
+		numThreads = 0;
+	}
 
-		SV_DropClient(client, "Msg overflowed");
-		return;
+	numThreads = Sys_InitJobThreads(numThreads);
+	if(numThreads)
+	{
+		if(!snapshotJobs)
+		{
+			// RF, avoid trying to allocate large chunk on a fragmented zone
+			snapshotJobs = malloc(sizeof(*snapshotJobs) * MAX_CLIENTS);
+			if(!snapshotJobs)
+			{
+				Com_Error(ERR_FATAL, "SV_InitSnapshotThreads: couldn't allocate snapshot jobs");
+			}
+		}
+		Com_Printf("Building snapshots on %i worker threads\n", numThreads);
 	}
+	else if(snapshotJobs)
+	{
+		free(snapshotJobs);
+		snapshotJobs = NULL;
+	}
+}
 
-	SV_SendMessageToClient(&msg, client);
+/*
+=======================
+SV_ShutdownSnapshotThreads
+=======================
+*/
+void SV_ShutdownSnapshotThreads(void)
+{
+	Sys_ShutdownJobThreads();
+	SV_ShutdownDeltaCaches();
 
-	sv.bpsTotalBytes += msg.cursize;	// NERVE - SMF - net debugging
-	sv.ubpsTotalBytes += msg.uncompsize / 8;	// NERVE - SMF - net debugging
+	if(snapshotJobs)
+	{
+		free(snapshotJobs);
+		snapshotJobs = NULL;
+	}
+
+	// start them again with the next server
+	if(sv_snapshotThreads)
+	{
+		sv_snapshotThreads->modified = qtrue;
+	}
+}
+
+/*
+=======================
+SV_FixEntityNumbers
+
+Does the ent->s.number repair of SV_AddEntitiesVisibleFromPoint up front,
+so the worker threads never have to write to the entities
+=======================
+*/
+static void SV_FixEntityNumbers(void)
+{
+	int             e;
+	sharedEntity_t *ent;
+
+	for(e = 0; e < sv.num_entities; e++)
+	{
+		ent = SV_GentityNum(e);
+
+		if(ent->r.linked && ent->s.number != e)
+		{
+			Com_DPrintf("FIXING ENT->S.NUMBER!!!\n");
+			ent->s.number = e;
+		}
+	}
+}
+
+/*
+=======================
+SV_SnapshotVisibilityJob
+=======================
+*/
+static void SV_SnapshotVisibilityJob(void *data, int jobNum, int threadNum)
+{
+	snapshotJob_t  *job = &((snapshotJob_t *) data)[jobNum];
+
+	if(job->build)
+	{
+		SV_AddClientSnapshotEntities(job->client, &job->entityNumbers, threadNum);
+	}
+}
+
+/*
+=======================
+SV_SnapshotEncodeJob
+=======================
+*/
+static void SV_SnapshotEncodeJob(void *data, int jobNum, int threadNum)
+{
+	snapshotJob_t  *job = &((snapshotJob_t *) data)[jobNum];
+	client_t       *client = job->client;
+
+	MSG_Init(&job->msg, job->msgBuffer, sizeof(job->msgBuffer));
+	job->msg.allowoverflow = qtrue;
+
+	// NOTE, MRE: all server->client messages now acknowledge
+	// let the client know which reliable clientCommands we have received
+	MSG_WriteLong(&job->msg, client->lastClientCommand);
+
+	// (re)send any reliable server commands
+	SV_UpdateServerCommandsToClient(client, &job->msg);
+
+	// send over all the relevant entityState_t
+	// and the playerState_t
+	SV_WriteSnapshotToClient(client, job->oldframe, job->lastframe, &job->msg, threadNum);
+}
+
+/*
+=======================
+SV_SendClientSnapshots
+
+Threaded counterpart of calling SV_SendClientSnapshot for every client in jobs
+=======================
+*/
+static void SV_SendClientSnapshots(snapshotJob_t * jobs, int numJobs)
+{
+	int             i;
+	snapshotJob_t  *job;
+
+	SV_FixEntityNumbers();
+
+	for(i = 0, job = jobs; i < numJobs; i++, job++)
+	{
+		job->build = SV_BeginClientSnapshot(job->client, &job->entityNumbers);
+
+		// build the shared visibility sets up front, the workers can
+		// only read them and fall back to private sets for portal views
+		if(job->build && sv.state)
+		{
+			vec3_t          org;
+			int             leafnum;
+			snapshotVisSet_t scratch;
+
+			SV_ClientViewOrigin(job->client, org);
+			leafnum = CM_PointLeafnum(org);
+			SV_SnapshotVisSet(CM_LeafCluster(leafnum), CM_LeafArea(leafnum), &scratch);
+		}
+	}
+
+	snapshotVisCache.frozen = qtrue;
+	Sys_RunJobs(SV_SnapshotVisibilityJob, jobs, numJobs);
+	snapshotVisCache.frozen = qfalse;
+
+	for(i = 0, job = jobs; i < numJobs; i++, job++)
+	{
+		if(job->build)
+		{
+			SV_EndClientSnapshot(job->client, &job->entityNumbers);
+		}
+	}
+
+	// only pick the delta frames once all new entities are in the ring,
+	// so none of them can roll off while the messages are encoded
+	for(i = 0, job = jobs; i < numJobs; i++, job++)
+	{
+		job->oldframe = SV_SnapshotDeltaFrame(job->client, &job->lastframe);
+	}
+
+	Sys_RunJobs(SV_SnapshotEncodeJob, jobs, numJobs);
+
+	for(i = 0, job = jobs; i < numJobs; i++, job++)
+	{
+		SV_FinishSnapshotMessage(job->client, &job->msg);
+	}
 }
 
 
@@ -954,13 +1615,26 @@ void SV_SendClientMessages(void)
 	int             i;
 	client_t       *c;
 	int             numclients = 0;	// NERVE - SMF - net debugging
+	int             numJobs = 0;
 
 	sv.bpsTotalBytes = 0;		// NERVE - SMF - net debugging
 	sv.ubpsTotalBytes = 0;		// NERVE - SMF - net debugging
 
+	deltaCacheFrame++;
+
 	// Gordon: update any changed configstrings from this frame
 	SV_UpdateConfigStrings();
 
+	if(sv_snapshotThreads->modified)
+	{
+		SV_InitSnapshotThreads();
+	}
+
+	SV_BeginSnapshotVisCache();
+
+	// queue the snapshots and send them all at once at the end of the frame
+	Sys_BeginPacketBatch();
+
 	// send a message to each connected client
 	for(i = 0; i < sv_maxclients->integer; i++)
 	{
@@ -997,9 +1671,37 @@ void SV_SendClientMessages(void)
 		}
 
 		// generate and send a new message
+		if(snapshotJobs && c->state >= CS_ACTIVE)
+		{
+			snapshotJobs[numJobs++].client = c;
+			continue;
+		}
+
 		SV_SendClientSnapshot(c);
 	}
 
+	if(numJobs)
+	{
+		SV_SendClientSnapshots(snapshotJobs, numJobs);
+	}
+
+	SV_EndSnapshotVisCache();
+
+	Sys_FlushPacketBatch();
+
+	for(i = 0; i < MAX_JOB_THREADS + 1; i++)
+	{
+		if(deltaCaches[i])
+		{
+			if(sv_showAverageBPS->integer)
+			{
+				sv.deltaCacheHits += deltaCaches[i]->hits;
+				sv.deltaCacheMisses += deltaCaches[i]->misses;
+			}
+			deltaCaches[i]->hits = deltaCaches[i]->misses = 0;
+		}
+	}
+
 	// NERVE - SMF - net debugging
 	if(sv_showAverageBPS->integer && numclients > 0)
 	{
@@ -1048,6 +1750,14 @@ void SV_SendClientMessages(void)
 			Com_DPrintf("bpspc(%2.0f) bps(%2.0f) pk(%i) ubps(%2.0f) upk(%i) cr(%2.2f) acr(%2.2f)\n",
 						ave / (float)numclients, ave, sv.bpsMaxBytes, uave, sv.ubpsMaxBytes, comp_ratio,
 						sv.ucompAve / sv.ucompNum);
+
+			if(sv.deltaCacheHits + sv.deltaCacheMisses)
+			{
+				Com_DPrintf("delta cache hits(%i) misses(%i) hr(%2.2f)\n", sv.deltaCacheHits, sv.deltaCacheMisses,
+							sv.deltaCacheHits * 100.f / (sv.deltaCacheHits + sv.deltaCacheMisses));
+			}
+			sv.deltaCacheHits = 0;
+			sv.deltaCacheMisses = 0;
 		}
 	}
 	// -NERVE - SMF
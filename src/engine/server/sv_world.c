@@ -32,14 +32,15 @@ If you have questions concerning this license or the applicable additional terms
 
 /*
 ================
-SV_ClipHandleForEntity
+SV_ClipHandleForEntityForThread
 
 Returns a headnode that can be used for testing or clipping to a
 given entity.  If the entity is a bsp model, the headnode will
-be returned, otherwise a custom box tree will be constructed.
+be returned, otherwise a custom box tree will be constructed in
+the collision state of threadNum.
 ================
 */
-clipHandle_t SV_ClipHandleForEntity(const sharedEntity_t * ent)
+static clipHandle_t SV_ClipHandleForEntityForThread(int threadNum, const sharedEntity_t * ent)
 {
 	if(ent->r.bmodel)
 	{
@@ -49,11 +50,21 @@ clipHandle_t SV_ClipHandleForEntity(const sharedEntity_t * ent)
 	if(ent->r.svFlags & SVF_CAPSULE)
 	{
 		// create a temp capsule from bounding box sizes
-		return CM_TempBoxModel(ent->r.mins, ent->r.maxs, qtrue);
+		return CM_TempBoxModelForThread(threadNum, ent->r.mins, ent->r.maxs, qtrue);
 	}
 
 	// create a temp tree from bounding box sizes
-	return CM_TempBoxModel(ent->r.mins, ent->r.maxs, qfalse);
+	return CM_TempBoxModelForThread(threadNum, ent->r.mins, ent->r.maxs, qfalse);
+}
+
+/*
+================
+SV_ClipHandleForEntity
+================
+*/
+clipHandle_t SV_ClipHandleForEntity(const sharedEntity_t * ent)
+{
+	return SV_ClipHandleForEntityForThread(0, ent);
 }
 
 
@@ -64,9 +75,45 @@ clipHandle_t SV_ClipHandleForEntity(const sharedEntity_t * ent)
 ENTITY CHECKING
 
 To avoid linearly searching through lists of entities during environment testing,
-the world is carved up with an evenly spaced, axially aligned bsp tree.  Entities
-are kept in chains either at the final leafs, or at the first node that splits
-them, which prevents having to deal with multiple fragments of a single entity.
+the entities are kept in a broadphase structure, selected with sv_broadphase
+when the world is cleared:
+
+0: the world is carved up with an evenly spaced, axially aligned bsp tree.
+   Entities are kept in chains either at the final leafs, or at the first node
+   that splits them, which prevents having to deal with multiple fragments of a
+   single entity.
+
+1: the world is carved up into a uniform grid of x/y columns, and entities are
+   linked into every cell they touch, so big entities and entities sitting on
+   a split don't end up being checked by every query.
+
+===============================================================================
+*/
+
+typedef struct
+{
+	const float    *mins;
+	const float    *maxs;
+	int            *list;
+	int             count, maxcount;
+} areaParms_t;
+
+typedef struct
+{
+	const char     *name;
+	void            (*clear) (vec3_t mins, vec3_t maxs);
+	void            (*link) (svEntity_t * ent, sharedEntity_t * gEnt);	// also relinks
+	void            (*unlink) (svEntity_t * ent);
+	void            (*areaEntities) (areaParms_t * ap);
+	void            (*list) (void);
+} broadphase_t;
+
+static broadphase_t *broadphase;
+
+/*
+===============================================================================
+
+SECTOR TREE
 
 ===============================================================================
 */
@@ -88,10 +135,10 @@ int             sv_numworldSectors;
 
 /*
 ===============
-SV_SectorList_f
+SV_SectorList
 ===============
 */
-void SV_SectorList_f(void)
+static void SV_SectorList(void)
 {
 	int             i, c;
 	worldSector_t  *sec;
@@ -159,41 +206,35 @@ worldSector_t  *SV_CreateworldSector(int depth, vec3_t mins, vec3_t maxs)
 
 /*
 ===============
-SV_ClearWorld
-
+SV_SectorClear
 ===============
 */
-void SV_ClearWorld(void)
+static void SV_SectorClear(vec3_t mins, vec3_t maxs)
 {
-	clipHandle_t    h;
-	vec3_t          mins, maxs;
+	int             i;
 
 	memset(sv_worldSectors, 0, sizeof(sv_worldSectors));
 	sv_numworldSectors = 0;
 
-	// get world map bounds
-	h = CM_InlineModel(0);
-	CM_ModelBounds(h, mins, maxs);
+	for(i = 0; i < MAX_GENTITIES; i++)
+	{
+		sv.svEntities[i].worldSector = NULL;
+		sv.svEntities[i].nextEntityInWorldSector = NULL;
+	}
+
 	SV_CreateworldSector(0, mins, maxs);
 }
 
-
 /*
 ===============
-SV_UnlinkEntity
-
+SV_SectorUnlinkEntity
 ===============
 */
-void SV_UnlinkEntity(sharedEntity_t * gEnt)
+static void SV_SectorUnlinkEntity(svEntity_t * ent)
 {
-	svEntity_t     *ent;
 	svEntity_t     *scan;
 	worldSector_t  *ws;
 
-	ent = SV_SvEntityForGentity(gEnt);
-
-	gEnt->r.linked = qfalse;
-
 	ws = ent->worldSector;
 	if(!ws)
 	{
@@ -219,6 +260,671 @@ void SV_UnlinkEntity(sharedEntity_t * gEnt)
 	Com_Printf("WARNING: SV_UnlinkEntity: not found in worldSector\n");
 }
 
+/*
+===============
+SV_SectorLinkEntity
+===============
+*/
+static void SV_SectorLinkEntity(svEntity_t * ent, sharedEntity_t * gEnt)
+{
+	worldSector_t  *node;
+
+	if(ent->worldSector)
+	{
+		SV_SectorUnlinkEntity(ent);	// unlink from old position
+	}
+
+	// find the first world sector node that the ent's box crosses
+	node = sv_worldSectors;
+	while(1)
+	{
+		if(node->axis == -1)
+		{
+			break;
+		}
+		if(gEnt->r.absmin[node->axis] > node->dist)
+		{
+			node = node->children[0];
+		}
+		else if(gEnt->r.absmax[node->axis] < node->dist)
+		{
+			node = node->children[1];
+		}
+		else
+		{
+			break;				// crosses the node
+		}
+	}
+
+	// link it in
+	ent->worldSector = node;
+	ent->nextEntityInWorldSector = node->entities;
+	node->entities = ent;
+}
+
+/*
+====================
+SV_SectorAreaEntities_r
+
+====================
+*/
+static void SV_SectorAreaEntities_r(worldSector_t * node, areaParms_t * ap)
+{
+	svEntity_t     *check, *next;
+	sharedEntity_t *gcheck;
+
+	for(check = node->entities; check; check = next)
+	{
+		next = check->nextEntityInWorldSector;
+
+		gcheck = SV_GEntityForSvEntity(check);
+
+		if(!gcheck->r.linked)
+		{
+			continue;
+		}
+
+		if(gcheck->r.absmin[0] > ap->maxs[0]
+		   || gcheck->r.absmin[1] > ap->maxs[1]
+		   || gcheck->r.absmin[2] > ap->maxs[2]
+		   || gcheck->r.absmax[0] < ap->mins[0] || gcheck->r.absmax[1] < ap->mins[1] || gcheck->r.absmax[2] < ap->mins[2])
+		{
+			continue;
+		}
+
+		if(ap->count == ap->maxcount)
+		{
+			Com_Printf("SV_AreaEntities: MAXCOUNT\n");
+			return;
+		}
+
+		ap->list[ap->count] = check - sv.svEntities;
+		ap->count++;
+	}
+
+	if(node->axis == -1)
+	{
+		return;					// terminal node
+	}
+
+	// recurse down both sides
+	if(ap->maxs[node->axis] > node->dist)
+	{
+		SV_SectorAreaEntities_r(node->children[0], ap);
+	}
+	if(ap->mins[node->axis] < node->dist)
+	{
+		SV_SectorAreaEntities_r(node->children[1], ap);
+	}
+}
+
+/*
+====================
+SV_SectorAreaEntities
+====================
+*/
+static void SV_SectorAreaEntities(areaParms_t * ap)
+{
+	SV_SectorAreaEntities_r(sv_worldSectors, ap);
+}
+
+/*
+===============================================================================
+
+UNIFORM GRID
+
+===============================================================================
+*/
+
+#define GRID_CELL_SIZE      256	// before clamping to GRID_MAX_CELLS
+#define GRID_MAX_CELLS      64	// per axis
+#define GRID_MAX_ENT_CELLS  16	// entities touching more cells go on the oversize list
+
+typedef struct gridLink_s
+{
+	svEntity_t     *ent;
+	struct gridLink_s *next;
+	struct gridLink_s **prev;	// whatever points at us, for unlinking without a search
+} gridLink_t;
+
+typedef struct
+{
+	qboolean        linked;
+	qboolean        oversize;
+	int             cellMins[2];
+	int             cellMaxs[2];
+	gridLink_t      links[GRID_MAX_ENT_CELLS];
+} gridEntity_t;
+
+typedef struct
+{
+	float           origin[2];
+	float           cellScale[2];	// cells per unit
+	int             size[2];
+	gridLink_t     *cells[GRID_MAX_CELLS * GRID_MAX_CELLS];
+	gridLink_t     *oversize;
+	gridEntity_t    entities[MAX_GENTITIES];
+} grid_t;
+
+static grid_t   sv_grid;
+
+/*
+===============
+SV_GridClear
+===============
+*/
+static void SV_GridClear(vec3_t mins, vec3_t maxs)
+{
+	int             i;
+	float           size;
+
+	memset(&sv_grid, 0, sizeof(sv_grid));
+
+	for(i = 0; i < 2; i++)
+	{
+		size = maxs[i] - mins[i];
+		if(size < 1)
+		{
+			size = 1;
+		}
+
+		sv_grid.size[i] = (int)(size / GRID_CELL_SIZE) + 1;
+		if(sv_grid.size[i] > GRID_MAX_CELLS)
+		{
+			sv_grid.size[i] = GRID_MAX_CELLS;
+		}
+
+		sv_grid.origin[i] = mins[i];
+		sv_grid.cellScale[i] = sv_grid.size[i] / size;
+	}
+}
+
+/*
+===============
+SV_GridCells
+
+Cell range touched by a box, anything outside the world
+is kept in the cells along the edges
+===============
+*/
+static void SV_GridCells(const float *mins, const float *maxs, int *cellMins, int *cellMaxs)
+{
+	int             i;
+
+	for(i = 0; i < 2; i++)
+	{
+		cellMins[i] = (int)((mins[i] - sv_grid.origin[i]) * sv_grid.cellScale[i]);
+		if(cellMins[i] < 0)
+		{
+			cellMins[i] = 0;
+		}
+		else if(cellMins[i] >= sv_grid.size[i])
+		{
+			cellMins[i] = sv_grid.size[i] - 1;
+		}
+
+		cellMaxs[i] = (int)((maxs[i] - sv_grid.origin[i]) * sv_grid.cellScale[i]);
+		if(cellMaxs[i] < 0)
+		{
+			cellMaxs[i] = 0;
+		}
+		else if(cellMaxs[i] >= sv_grid.size[i])
+		{
+			cellMaxs[i] = sv_grid.size[i] - 1;
+		}
+	}
+}
+
+/*
+===============
+SV_GridInsert
+===============
+*/
+static void SV_GridInsert(gridLink_t ** head, gridLink_t * link, svEntity_t * ent)
+{
+	link->ent = ent;
+	link->next = *head;
+	link->prev = head;
+	if(*head)
+	{
+		(*head)->prev = &link->next;
+	}
+	*head = link;
+}
+
+/*
+===============
+SV_GridUnlinkEntity
+===============
+*/
+static void SV_GridUnlinkEntity(svEntity_t * ent)
+{
+	gridEntity_t   *ge;
+	gridLink_t     *link;
+	int             i, numLinks;
+
+	ge = &sv_grid.entities[ent - sv.svEntities];
+	if(!ge->linked)
+	{
+		return;					// not linked in anywhere
+	}
+	ge->linked = qfalse;
+
+	if(ge->oversize)
+	{
+		numLinks = 1;
+	}
+	else
+	{
+		numLinks = (ge->cellMaxs[0] - ge->cellMins[0] + 1) * (ge->cellMaxs[1] - ge->cellMins[1] + 1);
+	}
+
+	for(i = 0, link = ge->links; i < numLinks; i++, link++)
+	{
+		*link->prev = link->next;
+		if(link->next)
+		{
+			link->next->prev = link->prev;
+		}
+	}
+}
+
+/*
+===============
+SV_GridLinkEntity
+===============
+*/
+static void SV_GridLinkEntity(svEntity_t * ent, sharedEntity_t * gEnt)
+{
+	gridEntity_t   *ge;
+	gridLink_t     *link;
+	int             cellMins[2], cellMaxs[2];
+	int             x, y;
+	qboolean        oversize;
+
+	ge = &sv_grid.entities[ent - sv.svEntities];
+
+	SV_GridCells(gEnt->r.absmin, gEnt->r.absmax, cellMins, cellMaxs);
+	oversize = (cellMaxs[0] - cellMins[0] + 1) * (cellMaxs[1] - cellMins[1] + 1) > GRID_MAX_ENT_CELLS;
+
+	// most relinks are small moves that stay within the same cells
+	if(ge->linked && ge->oversize == oversize &&
+	   ge->cellMins[0] == cellMins[0] && ge->cellMins[1] == cellMins[1] &&
+	   ge->cellMaxs[0] == cellMaxs[0] && ge->cellMaxs[1] == cellMaxs[1])
+	{
+		return;
+	}
+
+	SV_GridUnlinkEntity(ent);
+
+	ge->linked = qtrue;
+	ge->oversize = oversize;
+	ge->cellMins[0] = cellMins[0];
+	ge->cellMins[1] = cellMins[1];
+	ge->cellMaxs[0] = cellMaxs[0];
+	ge->cellMaxs[1] = cellMaxs[1];
+
+	if(oversize)
+	{
+		SV_GridInsert(&sv_grid.oversize, &ge->links[0], ent);
+		return;
+	}
+
+	link = ge->links;
+	for(y = cellMins[1]; y <= cellMaxs[1]; y++)
+	{
+		for(x = cellMins[0]; x <= cellMaxs[0]; x++)
+		{
+			SV_GridInsert(&sv_grid.cells[y * sv_grid.size[0] + x], link++, ent);
+		}
+	}
+}
+
+/*
+====================
+SV_GridTouchCell
+====================
+*/
+static void SV_GridTouchCell(gridLink_t * link, areaParms_t * ap, unsigned int *touched)
+{
+	sharedEntity_t *gcheck;
+	int             num;
+
+	for(; link; link = link->next)
+	{
+		num = link->ent - sv.svEntities;
+
+		// entities spanning several cells are found more than once
+		if(touched[num >> 5] & (1 << (num & 31)))
+		{
+			continue;
+		}
+
+		gcheck = SV_GEntityForSvEntity(link->ent);
+
+		if(!gcheck->r.linked)
+		{
+			continue;
+		}
+
+		if(gcheck->r.absmin[0] > ap->maxs[0]
+		   || gcheck->r.absmin[1] > ap->maxs[1]
+		   || gcheck->r.absmin[2] > ap->maxs[2]
+		   || gcheck->r.absmax[0] < ap->mins[0] || gcheck->r.absmax[1] < ap->mins[1] || gcheck->r.absmax[2] < ap->mins[2])
+		{
+			continue;
+		}
+
+		touched[num >> 5] |= 1 << (num & 31);
+	}
+}
+
+/*
+====================
+SV_GridAreaEntities
+
+Entities are handed out in entity number order, no matter
+which cells they were found in
+====================
+*/
+static void SV_GridAreaEntities(areaParms_t * ap)
+{
+	unsigned int    touched[MAX_GENTITIES / 32];
+	int             cellMins[2], cellMaxs[2];
+	int             x, y, i, j;
+
+	memset(touched, 0, sizeof(touched));
+
+	SV_GridTouchCell(sv_grid.oversize, ap, touched);
+
+	SV_GridCells(ap->mins, ap->maxs, cellMins, cellMaxs);
+	for(y = cellMins[1]; y <= cellMaxs[1]; y++)
+	{
+		for(x = cellMins[0]; x <= cellMaxs[0]; x++)
+		{
+			SV_GridTouchCell(sv_grid.cells[y * sv_grid.size[0] + x], ap, touched);
+		}
+	}
+
+	for(i = 0; i < MAX_GENTITIES / 32; i++)
+	{
+		if(!touched[i])
+		{
+			continue;
+		}
+
+		for(j = 0; j < 32; j++)
+		{
+			if(!(touched[i] & (1 << j)))
+			{
+				continue;
+			}
+
+			if(ap->count == ap->maxcount)
+			{
+				Com_Printf("SV_AreaEntities: MAXCOUNT\n");
+				return;
+			}
+
+			ap->list[ap->count] = (i << 5) + j;
+			ap->count++;
+		}
+	}
+}
+
+/*
+===============
+SV_GridList
+===============
+*/
+static void SV_GridList(void)
+{
+	int             i, c;
+	gridLink_t     *link;
+
+	Com_Printf("%ix%i grid cells of %.0fx%.0f units\n", sv_grid.size[0], sv_grid.size[1],
+			   1.0f / sv_grid.cellScale[0], 1.0f / sv_grid.cellScale[1]);
+
+	for(i = 0; i < sv_grid.size[0] * sv_grid.size[1]; i++)
+	{
+		c = 0;
+		for(link = sv_grid.cells[i]; link; link = link->next)
+		{
+			c++;
+		}
+		if(c)
+		{
+			Com_Printf("cell %i %i: %i entities\n", i % sv_grid.size[0], i / sv_grid.size[0], c);
+		}
+	}
+
+	c = 0;
+	for(link = sv_grid.oversize; link; link = link->next)
+	{
+		c++;
+	}
+	Com_Printf("oversize: %i entities\n", c);
+}
+
+//===========================================================================
+
+static broadphase_t sv_broadphases[] = {
+	{"sector tree", SV_SectorClear, SV_SectorLinkEntity, SV_SectorUnlinkEntity, SV_SectorAreaEntities, SV_SectorList},
+	{"grid", SV_GridClear, SV_GridLinkEntity, SV_GridUnlinkEntity, SV_GridAreaEntities, SV_GridList}
+};
+
+#define NUM_BROADPHASES ( sizeof( sv_broadphases ) / sizeof( sv_broadphases[0] ) )
+
+/*
+===============
+SV_SetBroadphase
+
+Clears the given broadphase and links every linked entity into it
+===============
+*/
+static void SV_SetBroadphase(broadphase_t * bp)
+{
+	clipHandle_t    h;
+	vec3_t          mins, maxs;
+	int             i;
+	sharedEntity_t *gEnt;
+
+	broadphase = bp;
+
+	// get world map bounds
+	h = CM_InlineModel(0);
+	CM_ModelBounds(h, mins, maxs);
+	broadphase->clear(mins, maxs);
+
+	for(i = 0; i < sv.num_entities; i++)
+	{
+		gEnt = SV_GentityNum(i);
+		if(gEnt->r.linked)
+		{
+			broadphase->link(SV_SvEntityForGentity(gEnt), gEnt);
+		}
+	}
+}
+
+/*
+===============
+SV_SectorList_f
+===============
+*/
+void SV_SectorList_f(void)
+{
+	if(!broadphase)
+	{
+		return;
+	}
+
+	Com_Printf("broadphase: %s\n", broadphase->name);
+	broadphase->list();
+}
+
+/*
+===============
+SV_BroadphaseBench_f
+
+Runs the same queries against all broadphases with the entity
+layout of the current map and compares what they return
+===============
+*/
+static int QDECL SV_QsortEntityNums(const void *a, const void *b)
+{
+	return *(const int *)a - *(const int *)b;
+}
+
+static int SV_BroadphaseBenchQuery(broadphase_t * bp, int entityNum, int *list)
+{
+	sharedEntity_t *gEnt;
+	areaParms_t     ap;
+	vec3_t          mins, maxs;
+
+	gEnt = SV_GentityNum(entityNum);
+	if(!gEnt->r.linked)
+	{
+		return 0;
+	}
+
+	VectorSet(mins, gEnt->r.absmin[0] - 64, gEnt->r.absmin[1] - 64, gEnt->r.absmin[2] - 64);
+	VectorSet(maxs, gEnt->r.absmax[0] + 64, gEnt->r.absmax[1] + 64, gEnt->r.absmax[2] + 64);
+
+	ap.mins = mins;
+	ap.maxs = maxs;
+	ap.list = list;
+	ap.count = 0;
+	ap.maxcount = MAX_GENTITIES;
+	bp->areaEntities(&ap);
+
+	// a linked entity always touches its own box, so 0 means no query
+	return ap.count;
+}
+
+void SV_BroadphaseBench_f(void)
+{
+	static int      lists[NUM_BROADPHASES][MAX_GENTITIES];
+	broadphase_t   *current;
+	int             i, j, e, loops, numQueries, mismatches;
+	int             counts[NUM_BROADPHASES];
+	int             start, msec;
+
+	if(!com_sv_running->integer || !broadphase)
+	{
+		Com_Printf("Server is not running.\n");
+		return;
+	}
+
+	loops = 100;
+	if(Cmd_Argc() > 1)
+	{
+		loops = atoi(Cmd_Argv(1));
+		if(loops < 1)
+		{
+			loops = 1;
+		}
+	}
+
+	current = broadphase;
+
+	// link everything into all of them, they keep separate state
+	for(i = 0; i < NUM_BROADPHASES; i++)
+	{
+		SV_SetBroadphase(&sv_broadphases[i]);
+	}
+
+	// every linked entity's box, grown by a short move, is a query
+	for(i = 0; i < NUM_BROADPHASES; i++)
+	{
+		numQueries = 0;
+		start = Sys_Milliseconds();
+		for(j = 0; j < loops; j++)
+		{
+			for(e = 0; e < sv.num_entities; e++)
+			{
+				if(!SV_BroadphaseBenchQuery(&sv_broadphases[i], e, lists[i]))
+				{
+					continue;
+				}
+				numQueries++;
+			}
+		}
+		msec = Sys_Milliseconds() - start;
+
+		Com_Printf("%-12s %i queries in %i msec\n", sv_broadphases[i].name, numQueries, msec);
+	}
+
+	// compare what they return for every query
+	mismatches = 0;
+	for(e = 0; e < sv.num_entities; e++)
+	{
+		for(i = 0; i < NUM_BROADPHASES; i++)
+		{
+			counts[i] = SV_BroadphaseBenchQuery(&sv_broadphases[i], e, lists[i]);
+			qsort(lists[i], counts[i], sizeof(lists[i][0]), SV_QsortEntityNums);
+		}
+
+		for(i = 1; i < NUM_BROADPHASES; i++)
+		{
+			if(counts[i] != counts[0] || memcmp(lists[i], lists[0], counts[0] * sizeof(lists[0][0])))
+			{
+				mismatches++;
+			}
+		}
+	}
+
+	if(mismatches)
+	{
+		Com_Printf(S_COLOR_RED "%i queries returned different entities\n", mismatches);
+	}
+
+	SV_SetBroadphase(current);
+}
+
+/*
+===============
+SV_ClearWorld
+
+===============
+*/
+void SV_ClearWorld(void)
+{
+	clipHandle_t    h;
+	vec3_t          mins, maxs;
+
+	if(sv_broadphase->integer >= 0 && sv_broadphase->integer < NUM_BROADPHASES)
+	{
+		broadphase = &sv_broadphases[sv_broadphase->integer];
+	}
+	else
+	{
+		broadphase = &sv_broadphases[0];
+	}
+
+	// get world map bounds
+	h = CM_InlineModel(0);
+	CM_ModelBounds(h, mins, maxs);
+	broadphase->clear(mins, maxs);
+}
+
+
+/*
+===============
+SV_UnlinkEntity
+
+===============
+*/
+void SV_UnlinkEntity(sharedEntity_t * gEnt)
+{
+	svEntity_t     *ent;
+
+	ent = SV_SvEntityForGentity(gEnt);
+
+	gEnt->r.linked = qfalse;
+
+	broadphase->unlink(ent);
+}
+
 
 /*
 ===============
@@ -229,7 +935,6 @@ SV_LinkEntity
 #define MAX_TOTAL_ENT_LEAFS     128
 void SV_LinkEntity(sharedEntity_t * gEnt)
 {
-	worldSector_t  *node;
 	int             leafs[MAX_TOTAL_ENT_LEAFS];
 	int             cluster;
 	int             num_leafs;
@@ -247,11 +952,6 @@ void SV_LinkEntity(sharedEntity_t * gEnt)
 		Com_DPrintf("WARNING: BBOX entity is being linked at world origin, this is probably a bug\n");
 	}
 
-	if(ent->worldSector)
-	{
-		SV_UnlinkEntity(gEnt);	// unlink from old position
-	}
-
 	// encode the size into the entityState_t for client prediction
 	if(gEnt->r.bmodel)
 	{
@@ -349,6 +1049,7 @@ void SV_LinkEntity(sharedEntity_t * gEnt)
 	// entity is outside the world and can be considered unlinked
 	if(!num_leafs)
 	{
+		SV_UnlinkEntity(gEnt);
 		return;
 	}
 
@@ -399,32 +1100,8 @@ void SV_LinkEntity(sharedEntity_t * gEnt)
 
 	gEnt->r.linkcount++;
 
-	// find the first world sector node that the ent's box crosses
-	node = sv_worldSectors;
-	while(1)
-	{
-		if(node->axis == -1)
-		{
-			break;
-		}
-		if(gEnt->r.absmin[node->axis] > node->dist)
-		{
-			node = node->children[0];
-		}
-		else if(gEnt->r.absmax[node->axis] < node->dist)
-		{
-			node = node->children[1];
-		}
-		else
-		{
-			break;				// crosses the node
-		}
-	}
-
-	// link it in
-	ent->worldSector = node;
-	ent->nextEntityInWorldSector = node->entities;
-	node->entities = ent;
+	// link it in, or move it if it already was
+	broadphase->link(ent, gEnt);
 
 	gEnt->r.linked = qtrue;
 }
@@ -439,74 +1116,6 @@ bounds.  This does NOT mean that they actually touch in the case of bmodels.
 ============================================================================
 */
 
-typedef struct
-{
-	const float    *mins;
-	const float    *maxs;
-	int            *list;
-	int             count, maxcount;
-} areaParms_t;
-
-
-/*
-====================
-SV_AreaEntities_r
-
-====================
-*/
-void SV_AreaEntities_r(worldSector_t * node, areaParms_t * ap)
-{
-	svEntity_t     *check, *next;
-	sharedEntity_t *gcheck;
-	int             count;
-
-	count = 0;
-
-	for(check = node->entities; check; check = next)
-	{
-		next = check->nextEntityInWorldSector;
-
-		gcheck = SV_GEntityForSvEntity(check);
-
-		if(!gcheck->r.linked)
-		{
-			continue;
-		}
-
-		if(gcheck->r.absmin[0] > ap->maxs[0]
-		   || gcheck->r.absmin[1] > ap->maxs[1]
-		   || gcheck->r.absmin[2] > ap->maxs[2]
-		   || gcheck->r.absmax[0] < ap->mins[0] || gcheck->r.absmax[1] < ap->mins[1] || gcheck->r.absmax[2] < ap->mins[2])
-		{
-			continue;
-		}
-
-		if(ap->count == ap->maxcount)
-		{
-			Com_Printf("SV_AreaEntities: MAXCOUNT\n");
-			return;
-		}
-
-		ap->list[ap->count] = check - sv.svEntities;
-		ap->count++;
-	}
-
-	if(node->axis == -1)
-	{
-		return;					// terminal node
-	}
-
-	// recurse down both sides
-	if(ap->maxs[node->axis] > node->dist)
-	{
-		SV_AreaEntities_r(node->children[0], ap);
-	}
-	if(ap->mins[node->axis] < node->dist)
-	{
-		SV_AreaEntities_r(node->children[1], ap);
-	}
-}
-
 /*
 ================
 SV_AreaEntities
@@ -522,7 +1131,7 @@ int SV_AreaEntities(const vec3_t mins, const vec3_t maxs, int *entityList, int m
 	ap.count = 0;
 	ap.maxcount = maxcount;
 
-	SV_AreaEntities_r(sv_worldSectors, &ap);
+	broadphase->areaEntities(&ap);
 
 	return ap.count;
 }
@@ -601,22 +1210,20 @@ void SV_ClipToEntity(trace_t * trace, const vec3_t start, const vec3_t mins, con
 
 /*
 ====================
-SV_ClipMoveToEntities
+SV_ClipMoveToEntityList
 
+threadNum selects the collision state the clips run in
 ====================
 */
-void SV_ClipMoveToEntities(moveclip_t * clip)
+static void SV_ClipMoveToEntityList(moveclip_t * clip, int *touchlist, int num, int threadNum)
 {
-	int             i, num;
-	int             touchlist[MAX_GENTITIES];
+	int             i;
 	sharedEntity_t *touch;
 	int             passOwnerNum;
 	trace_t         trace;
 	clipHandle_t    clipHandle;
 	float          *origin, *angles;
 
-	num = SV_AreaEntities(clip->boxmins, clip->boxmaxs, touchlist, MAX_GENTITIES);
-
 	if(clip->passEntityNum != ENTITYNUM_NONE)
 	{
 		passOwnerNum = (SV_GentityNum(clip->passEntityNum))->r.ownerNum;
@@ -663,7 +1270,7 @@ void SV_ClipMoveToEntities(moveclip_t * clip)
 		}
 
 		// might intersect, so do an exact clip
-		clipHandle = SV_ClipHandleForEntity(touch);
+		clipHandle = SV_ClipHandleForEntityForThread(threadNum, touch);
 
 		// ydnar: non-worldspawn entities must not use world as clip model!
 		if(clipHandle == 0)
@@ -674,7 +1281,7 @@ void SV_ClipMoveToEntities(moveclip_t * clip)
 		// DHM - Nerve :: If clipping against BBOX, set to correct contents
 		if(clipHandle == BOX_MODEL_HANDLE)
 		{
-			CM_SetTempBoxModelContents(touch->r.contents);
+			CM_SetTempBoxModelContentsForThread(threadNum, touch->r.contents);
 		}
 
 		origin = touch->r.currentOrigin;
@@ -688,12 +1295,12 @@ void SV_ClipMoveToEntities(moveclip_t * clip)
 
 #ifdef __MACOS__
 		// compiler bug with const
-		CM_TransformedBoxTrace(&trace, (float *)clip->start, (float *)clip->end,
-							   (float *)clip->mins, (float *)clip->maxs, clipHandle, clip->contentmask,
-							   origin, angles, clip->capsule);
+		CM_TransformedBoxTraceForThread(threadNum, &trace, (float *)clip->start, (float *)clip->end,
+										(float *)clip->mins, (float *)clip->maxs, clipHandle, clip->contentmask,
+										origin, angles, clip->capsule);
 #else
-		CM_TransformedBoxTrace(&trace, clip->start, clip->end,
-							   clip->mins, clip->maxs, clipHandle, clip->contentmask, origin, angles, clip->capsule);
+		CM_TransformedBoxTraceForThread(threadNum, &trace, clip->start, clip->end,
+										clip->mins, clip->maxs, clipHandle, clip->contentmask, origin, angles, clip->capsule);
 #endif
 		if(trace.allsolid)
 		{
@@ -721,26 +1328,65 @@ void SV_ClipMoveToEntities(moveclip_t * clip)
 		// DHM - Nerve :: Reset contents to default
 		if(clipHandle == BOX_MODEL_HANDLE)
 		{
-			CM_SetTempBoxModelContents(CONTENTS_BODY);
+			CM_SetTempBoxModelContentsForThread(threadNum, CONTENTS_BODY);
 		}
 	}
 }
 
+/*
+====================
+SV_ClipMoveToEntities
+
+====================
+*/
+void SV_ClipMoveToEntities(moveclip_t * clip)
+{
+	int             num;
+	int             touchlist[MAX_GENTITIES];
+
+	num = SV_AreaEntities(clip->boxmins, clip->boxmaxs, touchlist, MAX_GENTITIES);
+
+	SV_ClipMoveToEntityList(clip, touchlist, num, 0);
+}
 
 /*
 ==================
-SV_Trace
+SV_MoveBounds
 
-Moves the given mins/maxs volume through the world from start to end.
-passEntityNum and entities owned by passEntityNum are explicitly not checked.
+The bounding box of an entire move
 ==================
 */
-void SV_Trace(trace_t * results, const vec3_t start, const vec3_t mins, const vec3_t maxs, const vec3_t end, int passEntityNum,
-			  int contentmask, int capsule)
+static void SV_MoveBounds(const vec3_t start, const vec3_t mins, const vec3_t maxs, const vec3_t end,
+						  vec3_t boxmins, vec3_t boxmaxs)
 {
-	moveclip_t      clip;
 	int             i;
 
+	for(i = 0; i < 3; i++)
+	{
+		if(end[i] > start[i])
+		{
+			boxmins[i] = start[i] + mins[i] - 1;
+			boxmaxs[i] = end[i] + maxs[i] + 1;
+		}
+		else
+		{
+			boxmins[i] = end[i] + mins[i] - 1;
+			boxmaxs[i] = start[i] + maxs[i] + 1;
+		}
+	}
+}
+
+/*
+==================
+SV_BeginTrace
+
+Clips the move to the world and sets up the clip for the entities.
+Returns qfalse if there is no need to check any entities.
+==================
+*/
+static qboolean SV_BeginTrace(moveclip_t * clip, const vec3_t start, const vec3_t mins, const vec3_t maxs, const vec3_t end,
+							  int passEntityNum, int contentmask, int capsule, int threadNum)
+{
 	if(!mins)
 	{
 		mins = vec3_origin;
@@ -750,48 +1396,261 @@ void SV_Trace(trace_t * results, const vec3_t start, const vec3_t mins, const ve
 		maxs = vec3_origin;
 	}
 
-	memset(&clip, 0, sizeof(moveclip_t));
+	memset(clip, 0, sizeof(moveclip_t));
 
 	// clip to world
-	CM_BoxTrace(&clip.trace, start, end, mins, maxs, 0, contentmask, capsule);
-	clip.trace.entityNum = clip.trace.fraction != 1.0 ? ENTITYNUM_WORLD : ENTITYNUM_NONE;
-	if(clip.trace.fraction == 0 || passEntityNum == -2)
+	CM_BoxTraceForThread(threadNum, &clip->trace, start, end, mins, maxs, 0, contentmask, capsule);
+	clip->trace.entityNum = clip->trace.fraction != 1.0 ? ENTITYNUM_WORLD : ENTITYNUM_NONE;
+	if(clip->trace.fraction == 0 || passEntityNum == -2)
 	{
-		*results = clip.trace;
-		return;					// blocked immediately by the world
+		return qfalse;			// blocked immediately by the world
 	}
 
-	clip.contentmask = contentmask;
-	clip.start = start;
-//  VectorCopy( clip.trace.endpos, clip.end );
-	VectorCopy(end, clip.end);
-	clip.mins = mins;
-	clip.maxs = maxs;
-	clip.passEntityNum = passEntityNum;
-	clip.capsule = capsule;
+	clip->contentmask = contentmask;
+	clip->start = start;
+//  VectorCopy( clip->trace.endpos, clip->end );
+	VectorCopy(end, clip->end);
+	clip->mins = mins;
+	clip->maxs = maxs;
+	clip->passEntityNum = passEntityNum;
+	clip->capsule = capsule;
 
 	// create the bounding box of the entire move
 	// we can limit it to the part of the move not
 	// already clipped off by the world, which can be
 	// a significant savings for line of sight and shot traces
-	for(i = 0; i < 3; i++)
+	SV_MoveBounds(clip->start, clip->mins, clip->maxs, clip->end, clip->boxmins, clip->boxmaxs);
+
+	return qtrue;
+}
+
+
+/*
+==================
+SV_Trace
+
+Moves the given mins/maxs volume through the world from start to end.
+passEntityNum and entities owned by passEntityNum are explicitly not checked.
+==================
+*/
+void SV_Trace(trace_t * results, const vec3_t start, const vec3_t mins, const vec3_t maxs, const vec3_t end, int passEntityNum,
+			  int contentmask, int capsule)
+{
+	moveclip_t      clip;
+
+	SV_ProfileCount(PROF_TRACES);
+
+	if(SV_BeginTrace(&clip, start, mins, maxs, end, passEntityNum, contentmask, capsule, 0))
 	{
-		if(end[i] > start[i])
+		// clip to other solid entities
+		SV_ClipMoveToEntities(&clip);
+	}
+
+	*results = clip.trace;
+}
+
+#define MAX_TRACE_BATCH_GROUP   64
+#define MAX_TRACE_BATCH_JOBS    256
+#define MIN_THREADED_TRACES     16	// smaller batches aren't worth waking the job threads
+
+typedef struct
+{
+	int             first, last;	// requests [first, last)
+	vec3_t          mins, maxs;	// the shared area query
+} traceGroup_t;
+
+typedef struct
+{
+	const traceRequest_t *requests;
+	trace_t        *results;
+	traceGroup_t    groups[MAX_TRACE_BATCH_JOBS];
+} traceBatch_t;
+
+/*
+==================
+SV_BoxVolume
+==================
+*/
+static float SV_BoxVolume(const vec3_t mins, const vec3_t maxs)
+{
+	return (maxs[0] - mins[0]) * (maxs[1] - mins[1]) * (maxs[2] - mins[2]);
+}
+
+/*
+==================
+SV_TraceBatchGroup
+
+Takes in the requests from first on as long as the shared query
+doesn't get much bigger than their own ones, at most maxGroup of them
+==================
+*/
+static void SV_TraceBatchGroup(const traceRequest_t * requests, int first, int numTraces, int maxGroup, traceGroup_t * group)
+{
+	const traceRequest_t *req;
+	vec3_t          mins, maxs, boxmins, boxmaxs;
+	float           volume;
+	int             last;
+
+	req = &requests[first];
+	SV_MoveBounds(req->start, req->mins, req->maxs, req->end, group->mins, group->maxs);
+	volume = SV_BoxVolume(group->mins, group->maxs);
+
+	for(last = first + 1; last < numTraces && last - first < maxGroup; last++)
+	{
+		req = &requests[last];
+		SV_MoveBounds(req->start, req->mins, req->maxs, req->end, boxmins, boxmaxs);
+
+		VectorCopy(group->mins, mins);
+		VectorCopy(group->maxs, maxs);
+		AddPointToBounds(boxmins, mins, maxs);
+		AddPointToBounds(boxmaxs, mins, maxs);
+
+		if(SV_BoxVolume(mins, maxs) > 2 * (volume + SV_BoxVolume(boxmins, boxmaxs)))
 		{
-			clip.boxmins[i] = clip.start[i] + clip.mins[i] - 1;
-			clip.boxmaxs[i] = clip.end[i] + clip.maxs[i] + 1;
+			break;
 		}
-		else
+
+		VectorCopy(mins, group->mins);
+		VectorCopy(maxs, group->maxs);
+		volume += SV_BoxVolume(boxmins, boxmaxs);
+	}
+
+	group->first = first;
+	group->last = last;
+}
+
+/*
+==================
+SV_TraceGroup
+
+Runs the traces of a group in the collision state of threadNum.
+Every trace only keeps the entities of the shared query touching
+its own move, which is exactly what SV_AreaEntities would have
+returned for it, in the same order.
+==================
+*/
+static void SV_TraceGroup(const traceRequest_t * requests, trace_t * results, const traceGroup_t * group, int threadNum)
+{
+	int             touchlist[MAX_GENTITIES];
+	int             cliplist[MAX_GENTITIES];
+	moveclip_t      clip;
+	const traceRequest_t *req;
+	sharedEntity_t *touch;
+	int             i, j;
+	int             num, numClip;
+
+	num = -1;					// not queried yet, they might all be blocked by the world
+	for(i = group->first; i < group->last; i++)
+	{
+		req = &requests[i];
+
+		if(!SV_BeginTrace(&clip, req->start, req->mins, req->maxs, req->end, req->passEntityNum, req->contentmask,
+						  req->capsule, threadNum))
+		{
+			results[i] = clip.trace;
+			continue;
+		}
+
+		if(num < 0)
+		{
+			num = SV_AreaEntities(group->mins, group->maxs, touchlist, MAX_GENTITIES);
+		}
+
+		numClip = 0;
+		for(j = 0; j < num; j++)
 		{
-			clip.boxmins[i] = clip.end[i] + clip.mins[i] - 1;
-			clip.boxmaxs[i] = clip.start[i] + clip.maxs[i] + 1;
+			touch = SV_GentityNum(touchlist[j]);
+
+			if(touch->r.absmin[0] > clip.boxmaxs[0]
+			   || touch->r.absmin[1] > clip.boxmaxs[1]
+			   || touch->r.absmin[2] > clip.boxmaxs[2]
+			   || touch->r.absmax[0] < clip.boxmins[0]
+			   || touch->r.absmax[1] < clip.boxmins[1] || touch->r.absmax[2] < clip.boxmins[2])
+			{
+				continue;
+			}
+
+			cliplist[numClip++] = touchlist[j];
 		}
+
+		// clip to other solid entities
+		SV_ClipMoveToEntityList(&clip, cliplist, numClip, threadNum);
+
+		results[i] = clip.trace;
+	}
+}
+
+/*
+==================
+SV_TraceBatchJob
+==================
+*/
+static void SV_TraceBatchJob(void *data, int jobNum, int threadNum)
+{
+	traceBatch_t   *batch = data;
+
+	SV_TraceGroup(batch->requests, batch->results, &batch->groups[jobNum], threadNum);
+}
+
+/*
+==================
+SV_TraceBatch
+
+Fills in the same results as calling SV_Trace for every request.
+
+Requests next to each other whose moves go through about the same space,
+like the pellets of one shot or several checks from the same eye, share
+a single area query.
+
+With sv_traceBatchThreads 1 and the job threads of sv_snapshotThreads
+running, the groups are traced concurrently.  The world and entities
+are only read, every thread clips in its own collision state and writes
+its own results, so they are the same as the serial ones.
+==================
+*/
+void SV_TraceBatch(const traceRequest_t * requests, trace_t * results, int numTraces)
+{
+	static traceBatch_t batch;
+	qboolean        threaded;
+	int             first, numGroups, maxGroup, numThreads, g;
+
+	if(sv_profiling)
+	{
+		sv_profileCounters[PROF_TRACES] += numTraces;
+	}
+
+	// smaller groups so every thread gets some
+	maxGroup = MAX_TRACE_BATCH_GROUP;
+	numThreads = Sys_NumJobThreads() + 1;
+	threaded = sv_traceBatchThreads->integer && numThreads > 1 && numTraces >= MIN_THREADED_TRACES;
+	if(threaded && maxGroup > numTraces / numThreads)
+	{
+		maxGroup = numTraces / numThreads;
 	}
 
-	// clip to other solid entities
-	SV_ClipMoveToEntities(&clip);
+	batch.requests = requests;
+	batch.results = results;
 
-	*results = clip.trace;
+	for(first = 0; first < numTraces;)
+	{
+		for(numGroups = 0; first < numTraces && numGroups < MAX_TRACE_BATCH_JOBS; numGroups++)
+		{
+			SV_TraceBatchGroup(requests, first, numTraces, maxGroup, &batch.groups[numGroups]);
+			first = batch.groups[numGroups].last;
+		}
+
+		if(threaded && numGroups > 1)
+		{
+			Sys_RunJobs(SV_TraceBatchJob, &batch, numGroups);
+		}
+		else
+		{
+			for(g = 0; g < numGroups; g++)
+			{
+				SV_TraceGroup(requests, results, &batch.groups[g], 0);
+			}
+		}
+	}
 }
 
 
@@ -810,6 +1669,8 @@ int SV_PointContents(const vec3_t p, int passEntityNum)
 	clipHandle_t    clipHandle;
 	float          *angles;
 
+	SV_ProfileCount(PROF_POINTCONTENTS);
+
 	// get base contents from world
 	contents = CM_PointContents(p, 0);
 
@@ -28,6 +28,10 @@ If you have questions concerning this license or the applicable additional terms
 
 // unix_net.c
 
+#if defined( __linux__ ) && !defined( _GNU_SOURCE )
+#define _GNU_SOURCE     // recvmmsg / sendmmsg
+#endif
+
 #include "../../shared/q_shared.h"
 #include "../qcommon/qcommon.h"
 
@@ -55,6 +59,52 @@ If you have questions concerning this license or the applicable additional terms
 
 static cvar_t   *noudp;
 
+// batched receive and send with one syscall for many packets
+#if defined( __linux__ ) && !defined( NET_NO_MMSG )
+#define NET_MMSG
+#endif
+
+#ifdef NET_MMSG
+#define NET_MMSG_PACKETS    MAX_CLIENTS // packets per recvmmsg / sendmmsg
+#define NET_MMSG_SENDLEN    2048        // larger packets are sent on their own
+
+typedef struct {
+	struct mmsghdr hdrs[NET_MMSG_PACKETS];
+	struct iovec iovecs[NET_MMSG_PACKETS];
+	struct sockaddr_in addrs[NET_MMSG_PACKETS];
+	int numPackets;                     // packets in the ring
+	int nextPacket;                     // next packet to hand out or send
+	int calls;                          // syscalls made
+	int packets;                        // packets moved by those syscalls
+} netBatch_t;
+
+static cvar_t   *net_mmsg;
+
+static netBatch_t recvBatch;
+static byte recvData[NET_MMSG_PACKETS][MAX_MSGLEN];
+
+static netBatch_t sendBatch;
+static byte sendData[NET_MMSG_PACKETS][NET_MMSG_SENDLEN];
+static qboolean sendBatching;
+#endif
+
+// sleeping on an absolute timer instead of a select timeout
+#if defined( __linux__ ) && !defined( NET_NO_EPOLL )
+#define NET_EPOLL
+#endif
+
+#ifdef NET_EPOLL
+#include <sys/epoll.h>
+#include <sys/timerfd.h>
+#include <sys/prctl.h>
+
+static int net_epollFd = -1;
+static int net_timerFd = -1;
+static qboolean net_epollFailed;
+static int net_epollSocket;         // ip_socket as registered with epoll
+static qboolean net_epollStdin;
+#endif
+
 netadr_t net_local_adr;
 
 int ip_socket;
@@ -155,6 +205,151 @@ qboolean    Sys_StringToAdr( const char *s, netadr_t *a ) {
 
 //=============================================================================
 
+#ifdef NET_MMSG
+/*
+==================
+NET_GetBatchedPacket
+
+Hands out the packets of the last recvmmsg and only goes back to the
+socket once they are all used up
+==================
+*/
+static qboolean NET_GetBatchedPacket( netadr_t *net_from, msg_t *net_message ) {
+	struct mmsghdr *hdr;
+	int i, ret;
+
+	while ( 1 ) {
+		if ( recvBatch.nextPacket >= recvBatch.numPackets ) {
+			recvBatch.numPackets = recvBatch.nextPacket = 0;
+
+			for ( i = 0 ; i < NET_MMSG_PACKETS ; i++ ) {
+				hdr = &recvBatch.hdrs[i];
+				memset( hdr, 0, sizeof( *hdr ) );
+				recvBatch.iovecs[i].iov_base = recvData[i];
+				recvBatch.iovecs[i].iov_len = sizeof( recvData[i] );
+				hdr->msg_hdr.msg_iov = &recvBatch.iovecs[i];
+				hdr->msg_hdr.msg_iovlen = 1;
+				hdr->msg_hdr.msg_name = &recvBatch.addrs[i];
+				hdr->msg_hdr.msg_namelen = sizeof( recvBatch.addrs[i] );
+			}
+
+			ret = recvmmsg( ip_socket, recvBatch.hdrs, NET_MMSG_PACKETS, MSG_DONTWAIT, NULL );
+			if ( ret == -1 ) {
+				if ( errno != EWOULDBLOCK && errno != EAGAIN && errno != ECONNREFUSED ) {
+					Com_Printf( "NET_GetPacket: %s\n", NET_ErrorString() );
+				}
+				return qfalse;
+			}
+			if ( ret == 0 ) {
+				return qfalse;
+			}
+
+			recvBatch.numPackets = ret;
+			recvBatch.calls++;
+			recvBatch.packets += ret;
+		}
+
+		i = recvBatch.nextPacket++;
+		hdr = &recvBatch.hdrs[i];
+
+		SockadrToNetadr( &recvBatch.addrs[i], net_from );
+		net_message->readcount = 0;
+
+		if ( hdr->msg_len >= net_message->maxsize ) {
+			Com_Printf( "Oversize packet from %s\n", NET_AdrToString( *net_from ) );
+			continue;
+		}
+
+		memcpy( net_message->data, recvData[i], hdr->msg_len );
+		net_message->cursize = hdr->msg_len;
+		return qtrue;
+	}
+}
+
+/*
+==================
+NET_SendBatchedPackets
+
+Sends the queued packets with as few sendmmsg calls as the kernel allows
+==================
+*/
+static void NET_SendBatchedPackets( void ) {
+	netadr_t to;
+	int ret;
+
+	while ( sendBatch.nextPacket < sendBatch.numPackets ) {
+		ret = sendmmsg( ip_socket, &sendBatch.hdrs[sendBatch.nextPacket],
+						sendBatch.numPackets - sendBatch.nextPacket, 0 );
+		if ( ret == -1 ) {
+			if ( errno == EINTR ) {
+				continue;
+			}
+			// the first packet failed, report it and go on with the rest
+			SockadrToNetadr( &sendBatch.addrs[sendBatch.nextPacket], &to );
+			Com_Printf( "NET_SendPacket ERROR: %s to %s\n", NET_ErrorString(),
+						NET_AdrToString( to ) );
+			sendBatch.nextPacket++;
+			continue;
+		}
+
+		sendBatch.calls++;
+		sendBatch.packets += ret;
+		sendBatch.nextPacket += ret;
+	}
+
+	sendBatch.numPackets = sendBatch.nextPacket = 0;
+}
+
+/*
+==================
+Sys_BeginPacketBatch
+
+Queues the packets sent until Sys_FlushPacketBatch, so a whole server
+frame of snapshots goes out with one sendmmsg
+==================
+*/
+void Sys_BeginPacketBatch( void ) {
+	// anything left over from an aborted frame goes out first
+	NET_SendBatchedPackets();
+
+	sendBatching = ( ip_socket && net_mmsg && net_mmsg->integer );
+}
+
+/*
+==================
+Sys_FlushPacketBatch
+==================
+*/
+void Sys_FlushPacketBatch( void ) {
+	NET_SendBatchedPackets();
+
+	sendBatching = qfalse;
+}
+
+/*
+==================
+NET_BatchStats_f
+==================
+*/
+static void NET_BatchStats_f( void ) {
+	Com_Printf( "recvmmsg: %i calls, %i packets, %.2f packets per call\n", recvBatch.calls, recvBatch.packets,
+				recvBatch.calls ? (float)recvBatch.packets / recvBatch.calls : 0.0f );
+	Com_Printf( "sendmmsg: %i calls, %i packets, %.2f packets per call\n", sendBatch.calls, sendBatch.packets,
+				sendBatch.calls ? (float)sendBatch.packets / sendBatch.calls : 0.0f );
+
+	if ( Cmd_Argc() > 1 && !Q_stricmp( Cmd_Argv( 1 ), "reset" ) ) {
+		recvBatch.calls = recvBatch.packets = 0;
+		sendBatch.calls = sendBatch.packets = 0;
+	}
+}
+#else
+void Sys_BeginPacketBatch( void ) {
+}
+
+void Sys_FlushPacketBatch( void ) {
+}
+#endif
+
 qboolean    Sys_GetPacket( netadr_t *net_from, msg_t *net_message ) {
 	int ret;
 	struct sockaddr_in from;
@@ -163,6 +358,12 @@ qboolean    Sys_GetPacket( netadr_t *net_from, msg_t *net_message ) {
 	int protocol;
 	int err;
 
+#ifdef NET_MMSG
+	if ( ip_socket && net_mmsg && net_mmsg->integer ) {
+		return NET_GetBatchedPacket( net_from, net_message );
+	}
+#endif
+
 	for ( protocol = 0 ; protocol < 2 ; protocol++ )
 	{
 		if ( protocol == 0 ) {
@@ -232,6 +433,36 @@ void    Sys_SendPacket( int length, const void *data, netadr_t to ) {
 
 	NetadrToSockadr( &to, &addr );
 
+#ifdef NET_MMSG
+	if ( sendBatching && net_socket == ip_socket ) {
+		if ( length <= NET_MMSG_SENDLEN ) {
+			struct mmsghdr *hdr;
+			int i;
+
+			if ( sendBatch.numPackets == NET_MMSG_PACKETS ) {
+				NET_SendBatchedPackets();
+			}
+
+			i = sendBatch.numPackets++;
+			memcpy( sendData[i], data, length );
+			sendBatch.addrs[i] = addr;
+			sendBatch.iovecs[i].iov_base = sendData[i];
+			sendBatch.iovecs[i].iov_len = length;
+
+			hdr = &sendBatch.hdrs[i];
+			memset( hdr, 0, sizeof( *hdr ) );
+			hdr->msg_hdr.msg_iov = &sendBatch.iovecs[i];
+			hdr->msg_hdr.msg_iovlen = 1;
+			hdr->msg_hdr.msg_name = &sendBatch.addrs[i];
+			hdr->msg_hdr.msg_namelen = sizeof( sendBatch.addrs[i] );
+			return;
+		}
+
+		// keep the packets in order
+		NET_SendBatchedPackets();
+	}
+#endif
+
 	ret = sendto( net_socket, data, length, 0, (struct sockaddr *)&addr, sizeof( addr ) );
 	if ( ret == -1 ) {
 		Com_Printf( "NET_SendPacket ERROR: %s to %s\n", NET_ErrorString(),
@@ -538,6 +769,10 @@ NET_Init
 */
 void NET_Init( void ) {
 	noudp = Cvar_Get( "net_noudp", "0", 0 );
+#ifdef NET_MMSG
+	net_mmsg = Cvar_Get( "net_mmsg", "1", 0 );
+	Cmd_AddCommand( "net_batchstats", NET_BatchStats_f );
+#endif
 	// open sockets
 	if ( !noudp->value ) {
 		NET_OpenIP();
@@ -694,10 +929,25 @@ NET_Shutdown
 ====================
 */
 void    NET_Shutdown( void ) {
+#ifdef NET_MMSG
+	Sys_FlushPacketBatch();
+	recvBatch.numPackets = recvBatch.nextPacket = 0;
+#endif
+
 	if ( ip_socket ) {
 		close( ip_socket );
 		ip_socket = 0;
 	}
+
+#ifdef NET_EPOLL
+	if ( net_epollFd != -1 ) {
+		close( net_epollFd );
+		close( net_timerFd );
+		net_epollFd = net_timerFd = -1;
+	}
+	net_epollSocket = 0;
+	net_epollStdin = qfalse;
+#endif
 }
 
 
@@ -713,22 +963,134 @@ char *NET_ErrorString( void ) {
 	return strerror( code );
 }
 
-// sleeps msec or until net socket is ready
-void NET_Sleep( int msec ) {
+#ifdef NET_EPOLL
+/*
+====================
+NET_WatchEpoll
+
+keeps the epoll set in step with ip_socket and stdin_active
+====================
+*/
+static qboolean NET_WatchEpoll( void ) {
+	extern qboolean stdin_active;
+	struct epoll_event ev;
+
+	if ( net_epollFailed ) {
+		return qfalse;
+	}
+
+	if ( net_epollFd == -1 ) {
+		net_epollFd = epoll_create( 4 );
+		net_timerFd = timerfd_create( CLOCK_MONOTONIC, TFD_NONBLOCK );
+
+		memset( &ev, 0, sizeof( ev ) );
+		ev.events = EPOLLIN;
+		ev.data.fd = net_timerFd;
+		if ( net_epollFd == -1 || net_timerFd == -1 || epoll_ctl( net_epollFd, EPOLL_CTL_ADD, net_timerFd, &ev ) == -1 ) {
+			Com_Printf( "WARNING: NET_WatchEpoll: %s, falling back to select\n", NET_ErrorString() );
+			if ( net_epollFd != -1 ) {
+				close( net_epollFd );
+			}
+			if ( net_timerFd != -1 ) {
+				close( net_timerFd );
+			}
+			net_epollFd = net_timerFd = -1;
+			net_epollFailed = qtrue;
+			return qfalse;
+		}
+
+		// the default 50us timer slack would be most of our lateness
+		prctl( PR_SET_TIMERSLACK, 1 );
+	}
+
+	if ( net_epollSocket != ip_socket ) {
+		memset( &ev, 0, sizeof( ev ) );
+		ev.events = EPOLLIN;
+		ev.data.fd = ip_socket;
+		epoll_ctl( net_epollFd, EPOLL_CTL_ADD, ip_socket, &ev );
+		net_epollSocket = ip_socket;
+	}
+
+	if ( net_epollStdin != stdin_active ) {
+		// stdin can't be polled when it's a regular file, it's still read every frame
+		memset( &ev, 0, sizeof( ev ) );
+		ev.events = EPOLLIN;
+		ev.data.fd = 0;
+		epoll_ctl( net_epollFd, stdin_active ? EPOLL_CTL_ADD : EPOLL_CTL_DEL, 0, &ev );
+		net_epollStdin = stdin_active;
+	}
+
+	return qtrue;
+}
+#endif
+
+/*
+====================
+NET_SleepUntil
+
+sleeps until the Sys_Microseconds time usec or until stdin or
+the net socket is ready
+====================
+*/
+void NET_SleepUntil( int64_t usec ) {
 	struct timeval timeout;
 	fd_set fdset;
+	int64_t remaining;
 	extern qboolean stdin_active;
 
 	if ( !ip_socket || !com_dedicated->integer ) {
 		return; // we're not a server, just run full speed
 
 	}
+#ifdef NET_MMSG
+	// packets already read from the socket are waiting
+	if ( recvBatch.nextPacket < recvBatch.numPackets ) {
+		return;
+	}
+#endif
+
+	remaining = usec - Sys_Microseconds();
+	if ( remaining <= 0 ) {
+		return;
+	}
+
+#ifdef NET_EPOLL
+	if ( NET_WatchEpoll() ) {
+		extern int64_t sys_monoBase;
+		struct itimerspec its;
+		struct epoll_event events[3];
+		uint64_t expirations;
+		int i, n;
+
+		// Sys_Microseconds counts from sys_monoBase on the monotonic clock
+		memset( &its, 0, sizeof( its ) );
+		its.it_value.tv_sec = ( sys_monoBase + usec ) / 1000000;
+		its.it_value.tv_nsec = ( ( sys_monoBase + usec ) % 1000000 ) * 1000;
+
+		if ( timerfd_settime( net_timerFd, TFD_TIMER_ABSTIME, &its, NULL ) != -1 ) {
+			n = epoll_wait( net_epollFd, events, 3, -1 );
+			for ( i = 0; i < n; i++ ) {
+				if ( events[i].data.fd == net_timerFd ) {
+					// level triggered until read
+					read( net_timerFd, &expirations, sizeof( expirations ) );
+				}
+			}
+			return;
+		}
+	}
+#endif
+
 	FD_ZERO( &fdset );
 	if ( stdin_active ) {
 		FD_SET( 0, &fdset ); // stdin is processed too
 	}
 	FD_SET( ip_socket, &fdset ); // network socket
-	timeout.tv_sec = msec / 1000;
-	timeout.tv_usec = ( msec % 1000 ) * 1000;
+	timeout.tv_sec = remaining / 1000000;
+	timeout.tv_usec = remaining % 1000000;
 	select( ip_socket + 1, &fdset, NULL, NULL, &timeout );
 }
+
+// sleeps msec or until net socket is ready
+void NET_Sleep( int msec ) {
+	NET_SleepUntil( Sys_Microseconds() + (int64_t)msec * 1000 );
+}
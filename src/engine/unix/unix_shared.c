@@ -29,12 +29,15 @@ If you have questions concerning this license or the applicable additional terms
 #include <sys/types.h>
 #include <sys/stat.h>
 #include <errno.h>
+#include <fcntl.h>
 #include <stdio.h>
 #include <dirent.h>
 #include <unistd.h>
 #include <sys/mman.h>
 #include <sys/time.h>
+#include <time.h>
 #include <pwd.h>
+#include <pthread.h>
 
 #include "../../shared/q_shared.h"
 #include "../qcommon/qcommon.h"
@@ -67,18 +70,40 @@ unsigned long sys_timeBase = 0;
 	 (which would affect the wrap period) */
 int curtime;
 int Sys_Milliseconds( void ) {
+	curtime = (int)( Sys_Microseconds() / 1000 );
+
+	return curtime;
+}
+
+/*
+================
+Sys_Microseconds
+
+same origin as Sys_Milliseconds, so Sys_Milliseconds() * 1000 is
+the start of the current millisecond on this clock
+
+runs on the monotonic clock so stepping the wall clock doesn't stall
+or rush the frames. it starts out at the realtime of sys_timeBase so
+Sys_XTimeToSysTime still lines up with X event times
+================
+*/
+/* CLOCK_MONOTONIC time in us of our origin, NET_SleepUntil arms its timer with it */
+int64_t sys_monoBase = 0;
+int64_t Sys_Microseconds( void ) {
+	struct timespec ts;
 	struct timeval tp;
+	int64_t now;
 
-	gettimeofday( &tp, NULL );
+	clock_gettime( CLOCK_MONOTONIC, &ts );
+	now = (int64_t)ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
 
 	if ( !sys_timeBase ) {
+		gettimeofday( &tp, NULL );
 		sys_timeBase = tp.tv_sec;
-		return tp.tv_usec / 1000;
+		sys_monoBase = now - tp.tv_usec;
 	}
 
-	curtime = ( tp.tv_sec - sys_timeBase ) * 1000 + tp.tv_usec / 1000;
-
-	return curtime;
+	return now - sys_monoBase;
 }
 
 /*
@@ -392,6 +417,45 @@ void    Sys_FreeFileList( char **list ) {
 	Z_Free( list );
 }
 
+/*
+==================
+Sys_MapFile
+==================
+*/
+void *Sys_MapFile( const char *ospath, int *length ) {
+	struct stat st;
+	void *base;
+	int fd;
+
+	*length = 0;
+
+	fd = open( ospath, O_RDONLY );
+	if ( fd == -1 ) {
+		return NULL;
+	}
+
+	if ( fstat( fd, &st ) == -1 || st.st_size <= 0 ) {
+		close( fd );
+		return NULL;
+	}
+
+	base = mmap( NULL, st.st_size, PROT_READ, MAP_SHARED, fd, 0 );
+	// the mapping keeps its own reference to the file
+	close( fd );
+	if ( base == MAP_FAILED ) {
+		return NULL;
+	}
+
+	*length = st.st_size;
+	return base;
+}
+
+void Sys_UnmapFile( void *base, int length ) {
+	if ( base ) {
+		munmap( base, length );
+	}
+}
+
 char *Sys_Cwd( void ) {
 	static char cwd[MAX_OSPATH];
 
@@ -536,3 +600,155 @@ void Sys_EnterCriticalSection( void *ptr ) {
 
 void Sys_LeaveCriticalSection( void *ptr ) {
 }
+
+/*
+==================================================================
+
+JOB THREADS
+
+Workers sleep on a condition variable until Sys_RunJobs bumps the
+generation, then pull job numbers off a shared counter together with
+the calling thread.
+==================================================================
+*/
+
+typedef struct {
+	pthread_mutex_t mutex;
+	pthread_cond_t  wake;
+	pthread_cond_t  done;
+	pthread_t       threads[MAX_JOB_THREADS];
+	int             numThreads;
+
+	jobFunc_t       func;
+	void            *data;
+	int             numJobs;
+	volatile int    nextJob;
+
+	int             generation;
+	int             busyThreads;
+	qboolean        shutdown;
+} jobThreads_t;
+
+static jobThreads_t jobs;
+static qboolean jobsInitialized = qfalse;
+
+static void Sys_DoJobs( int threadNum ) {
+	int job;
+
+	while ( ( job = __sync_fetch_and_add( &jobs.nextJob, 1 ) ) < jobs.numJobs ) {
+		jobs.func( jobs.data, job, threadNum );
+	}
+}
+
+static void *Sys_JobThread( void *arg ) {
+	int threadNum = (int)(intptr_t) arg;
+	int seen = 0;
+
+	pthread_mutex_lock( &jobs.mutex );
+	while ( 1 ) {
+		while ( !jobs.shutdown && jobs.generation == seen ) {
+			pthread_cond_wait( &jobs.wake, &jobs.mutex );
+		}
+		if ( jobs.shutdown ) {
+			break;
+		}
+		seen = jobs.generation;
+		pthread_mutex_unlock( &jobs.mutex );
+
+		Sys_DoJobs( threadNum );
+
+		pthread_mutex_lock( &jobs.mutex );
+		if ( --jobs.busyThreads == 0 ) {
+			pthread_cond_signal( &jobs.done );
+		}
+	}
+	pthread_mutex_unlock( &jobs.mutex );
+
+	return NULL;
+}
+
+int Sys_InitJobThreads( int numThreads ) {
+	int i;
+
+	Sys_ShutdownJobThreads();
+
+	if ( numThreads > MAX_JOB_THREADS ) {
+		numThreads = MAX_JOB_THREADS;
+	}
+	if ( numThreads <= 0 ) {
+		return 0;
+	}
+
+	memset( &jobs, 0, sizeof( jobs ) );
+	pthread_mutex_init( &jobs.mutex, NULL );
+	pthread_cond_init( &jobs.wake, NULL );
+	pthread_cond_init( &jobs.done, NULL );
+	jobsInitialized = qtrue;
+
+	for ( i = 0; i < numThreads; i++ ) {
+		if ( pthread_create( &jobs.threads[i], NULL, Sys_JobThread, (void *)(intptr_t)( i + 1 ) ) ) {
+			Com_Printf( "Sys_InitJobThreads: pthread_create failed after %i threads\n", i );
+			break;
+		}
+		jobs.numThreads++;
+	}
+
+	return jobs.numThreads;
+}
+
+void Sys_ShutdownJobThreads( void ) {
+	int i;
+
+	if ( !jobsInitialized ) {
+		return;
+	}
+
+	pthread_mutex_lock( &jobs.mutex );
+	jobs.shutdown = qtrue;
+	pthread_cond_broadcast( &jobs.wake );
+	pthread_mutex_unlock( &jobs.mutex );
+
+	for ( i = 0; i < jobs.numThreads; i++ ) {
+		pthread_join( jobs.threads[i], NULL );
+	}
+
+	pthread_cond_destroy( &jobs.done );
+	pthread_cond_destroy( &jobs.wake );
+	pthread_mutex_destroy( &jobs.mutex );
+	jobs.numThreads = 0;
+	jobsInitialized = qfalse;
+}
+
+int Sys_NumJobThreads( void ) {
+	return jobs.numThreads;
+}
+
+void Sys_RunJobs( jobFunc_t func, void *data, int numJobs ) {
+	int i;
+
+	if ( !jobs.numThreads || numJobs <= 1 ) {
+		for ( i = 0; i < numJobs; i++ ) {
+			func( data, i, 0 );
+		}
+		return;
+	}
+
+	pthread_mutex_lock( &jobs.mutex );
+	jobs.func = func;
+	jobs.data = data;
+	jobs.numJobs = numJobs;
+	jobs.nextJob = 0;
+	jobs.busyThreads = jobs.numThreads;
+	jobs.generation++;
+	pthread_cond_broadcast( &jobs.wake );
+	pthread_mutex_unlock( &jobs.mutex );
+
+	// the calling thread works too instead of just waiting
+	Sys_DoJobs( 0 );
+
+	pthread_mutex_lock( &jobs.mutex );
+	while ( jobs.busyThreads ) {
+		pthread_cond_wait( &jobs.done, &jobs.mutex );
+	}
+	pthread_mutex_unlock( &jobs.mutex );
+}
@@ -1358,6 +1358,26 @@ void NET_Shutdown(void)
 }
 
 
+/*
+==================
+Sys_BeginPacketBatch
+
+Winsock has no batched send, packets go out as they are sent
+==================
+*/
+void Sys_BeginPacketBatch(void)
+{
+}
+
+/*
+==================
+Sys_FlushPacketBatch
+==================
+*/
+void Sys_FlushPacketBatch(void)
+{
+}
+
 /*
 ====================
 NET_Sleep
@@ -1369,6 +1389,17 @@ void NET_Sleep(int msec)
 {
 }
 
+/*
+====================
+NET_SleepUntil
+
+sleeps until the Sys_Microseconds time usec or until net socket is ready
+====================
+*/
+void NET_SleepUntil(int64_t usec)
+{
+}
+
 
 /*
 ====================
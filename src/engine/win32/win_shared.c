@@ -62,6 +62,18 @@ int Sys_Milliseconds(void)
 	return sys_curtime;
 }
 
+/*
+================
+Sys_Microseconds
+
+timeGetTime only has millisecond resolution
+================
+*/
+int64_t Sys_Microseconds(void)
+{
+	return (int64_t) Sys_Milliseconds() * 1000;
+}
+
 /*
 ================
 Sys_RandomBytes
@@ -677,3 +689,205 @@ char           *Sys_GetCurrentUser(void)
 
 	return s_userName;
 }
+
+/*
+==================
+Sys_MapFile
+==================
+*/
+void           *Sys_MapFile(const char *ospath, int *length)
+{
+	HANDLE          file, mapping;
+	DWORD           size;
+	void           *base;
+
+	*length = 0;
+
+	file = CreateFile(ospath, GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL);
+	if(file == INVALID_HANDLE_VALUE)
+	{
+		return NULL;
+	}
+
+	size = GetFileSize(file, NULL);
+	if(size == INVALID_FILE_SIZE || size == 0)
+	{
+		CloseHandle(file);
+		return NULL;
+	}
+
+	mapping = CreateFileMapping(file, NULL, PAGE_READONLY, 0, 0, NULL);
+	CloseHandle(file);
+	if(!mapping)
+	{
+		return NULL;
+	}
+
+	// the view keeps the mapping alive
+	base = MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0);
+	CloseHandle(mapping);
+	if(!base)
+	{
+		return NULL;
+	}
+
+	*length = size;
+	return base;
+}
+
+void Sys_UnmapFile(void *base, int length)
+{
+	if(base)
+	{
+		UnmapViewOfFile(base);
+	}
+}
+
+/*
+==================================================================
+
+JOB THREADS
+
+Every worker owns a start and a finished event, Sys_RunJobs signals
+all of them and then pulls job numbers off the shared counter itself.
+==================================================================
+*/
+
+typedef struct
+{
+	HANDLE          threads[MAX_JOB_THREADS];
+	HANDLE          startEvents[MAX_JOB_THREADS];
+	HANDLE          finishedEvents[MAX_JOB_THREADS];
+	int             numThreads;
+
+	jobFunc_t       func;
+	void           *data;
+	int             numJobs;
+	volatile LONG   nextJob;
+
+	qboolean        shutdown;
+} jobThreads_t;
+
+static jobThreads_t jobs;
+
+static void Sys_DoJobs(int threadNum)
+{
+	int             job;
+
+	while((job = InterlockedIncrement(&jobs.nextJob) - 1) < jobs.numJobs)
+	{
+		jobs.func(jobs.data, job, threadNum);
+	}
+}
+
+static DWORD WINAPI Sys_JobThread(LPVOID arg)
+{
+	int             index = (int)(intptr_t) arg;
+
+	while(1)
+	{
+		WaitForSingleObject(jobs.startEvents[index], INFINITE);
+		if(jobs.shutdown)
+		{
+			break;
+		}
+
+		Sys_DoJobs(index + 1);
+
+		SetEvent(jobs.finishedEvents[index]);
+	}
+
+	return 0;
+}
+
+int Sys_InitJobThreads(int numThreads)
+{
+	int             i;
+	DWORD           threadId;
+
+	Sys_ShutdownJobThreads();
+
+	if(numThreads > MAX_JOB_THREADS)
+	{
+		numThreads = MAX_JOB_THREADS;
+	}
+
+	memset(&jobs, 0, sizeof(jobs));
+
+	for(i = 0; i < numThreads; i++)
+	{
+		jobs.startEvents[i] = CreateEvent(NULL, FALSE, FALSE, NULL);
+		jobs.finishedEvents[i] = CreateEvent(NULL, FALSE, FALSE, NULL);
+		jobs.threads[i] = CreateThread(NULL, 0, Sys_JobThread, (LPVOID) (intptr_t) i, 0, &threadId);
+
+		if(!jobs.threads[i])
+		{
+			Com_Printf("Sys_InitJobThreads: CreateThread failed after %i threads\n", i);
+			CloseHandle(jobs.startEvents[i]);
+			CloseHandle(jobs.finishedEvents[i]);
+			break;
+		}
+		jobs.numThreads++;
+	}
+
+	return jobs.numThreads;
+}
+
+void Sys_ShutdownJobThreads(void)
+{
+	int             i;
+
+	if(!jobs.numThreads)
+	{
+		return;
+	}
+
+	jobs.shutdown = qtrue;
+	for(i = 0; i < jobs.numThreads; i++)
+	{
+		SetEvent(jobs.startEvents[i]);
+	}
+	WaitForMultipleObjects(jobs.numThreads, jobs.threads, TRUE, INFINITE);
+
+	for(i = 0; i < jobs.numThreads; i++)
+	{
+		CloseHandle(jobs.threads[i]);
+		CloseHandle(jobs.startEvents[i]);
+		CloseHandle(jobs.finishedEvents[i]);
+	}
+	jobs.numThreads = 0;
+}
+
+int Sys_NumJobThreads(void)
+{
+	return jobs.numThreads;
+}
+
+void Sys_RunJobs(jobFunc_t func, void *data, int numJobs)
+{
+	int             i;
+
+	if(!jobs.numThreads || numJobs <= 1)
+	{
+		for(i = 0; i < numJobs; i++)
+		{
+			func(data, i, 0);
+		}
+		return;
+	}
+
+	jobs.func = func;
+	jobs.data = data;
+	jobs.numJobs = numJobs;
+	jobs.nextJob = 0;
+
+	for(i = 0; i < jobs.numThreads; i++)
+	{
+		SetEvent(jobs.startEvents[i]);
+	}
+
+	// the calling thread works too instead of just waiting
+	Sys_DoJobs(0);
+
+	WaitForMultipleObjects(jobs.numThreads, jobs.finishedEvents, TRUE, INFINITE);
+}
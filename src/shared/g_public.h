@@ -114,6 +114,18 @@ typedef struct
 	entityShared_t  r;			// shared by both the server system and game
 } sharedEntity_t;
 
+// one trace of G_TRACEBATCH, mins and maxs are relative like for G_TRACE
+typedef struct
+{
+	vec3_t          start;
+	vec3_t          mins;
+	vec3_t          maxs;
+	vec3_t          end;
+	int             passEntityNum;
+	int             contentmask;
+	qboolean        capsule;	// trace a capsule like G_TRACECAPSULE
+} traceRequest_t;
+
 
 
 //===============================================================
@@ -458,6 +470,10 @@ typedef enum
 	G_SENDMESSAGE,
 	G_MESSAGESTATUS,
 	// -zinx
+
+	G_TRACEBATCH,				// ( const traceRequest_t *requests, trace_t *results, int numTraces );
+	// fills in the same results as a G_TRACE or G_TRACECAPSULE call for each
+	// request, but traces through the same space share the entity lookup
 } gameImport_t;
 
 
@@ -42,6 +42,18 @@ If you have questions concerning this license or the applicable additional terms
 
 #define CONVEX_EPSILON      0.3
 
+//merge face of an area found on a thread before a merge pass
+typedef struct tmp_areamerge_s
+{
+	tmp_area_t *tmparea;                //the area to merge
+	tmp_face_t *face;                   //first face the area can be merged over
+	int valid;                          //true if searched on a thread
+} tmp_areamerge_t;
+
+tmp_areamerge_t *areamerges;            //merge faces indexed by area number
+int numareamerges;
+int areamergegroundfirst;               //true if the pass merges grounded areas only
+
 //===========================================================================
 //
 // Parameter:				-
@@ -104,16 +116,16 @@ int NonConvex( tmp_face_t *face1, tmp_face_t *face2, int side1, int side2 ) {
 	return false;
 } //end of the function NonConvex
 //===========================================================================
-// try to merge the areas at both sides of the given face
+// returns true if the areas at both sides of the given face can be merged
 //
 // Parameter:				seperatingface		: face that seperates two areas
 // Returns:					-
 // Changes Globals:		-
 //===========================================================================
-int AAS_TryMergeFaceAreas( tmp_face_t *seperatingface ) {
+int AAS_TestMergeFaceAreas( tmp_face_t *seperatingface ) {
 	int side1, side2, area1faceflags, area2faceflags;
-	tmp_area_t *tmparea1, *tmparea2, *newarea;
-	tmp_face_t *face1, *face2, *nextface1, *nextface2;
+	tmp_area_t *tmparea1, *tmparea2;
+	tmp_face_t *face1, *face2;
 
 	tmparea1 = seperatingface->frontarea;
 	tmparea2 = seperatingface->backarea;
@@ -192,6 +204,22 @@ int AAS_TryMergeFaceAreas( tmp_face_t *seperatingface ) {
 //		Log_Print("   can't merge: ground/gap\n");
 		return false;
 	} //end if
+	return true;
+} //end of the function AAS_TestMergeFaceAreas
+//===========================================================================
+// merges the areas at both sides of the given face
+//
+// Parameter:				seperatingface		: face that seperates two areas
+// Returns:					-
+// Changes Globals:		-
+//===========================================================================
+void AAS_MergeFaceAreas( tmp_face_t *seperatingface ) {
+	int side1, side2;
+	tmp_area_t *tmparea1, *tmparea2, *newarea;
+	tmp_face_t *face1, *face2, *nextface1, *nextface2;
+
+	tmparea1 = seperatingface->frontarea;
+	tmparea2 = seperatingface->backarea;
 
 //	Log_Print("merged area %d & %d to %d with %d faces\n", tmparea1->areanum, tmparea2->areanum, newarea->areanum, numfaces);
 //	return false;
@@ -258,6 +286,19 @@ int AAS_TryMergeFaceAreas( tmp_face_t *seperatingface ) {
 	AAS_CheckArea( newarea );
 	AAS_FlipAreaFaces( newarea );
 //	Log_Print("merged area %d & %d to %d with %d faces\n", tmparea1->areanum, tmparea2->areanum, newarea->areanum);
+} //end of the function AAS_MergeFaceAreas
+//===========================================================================
+// try to merge the areas at both sides of the given face
+//
+// Parameter:				seperatingface		: face that seperates two areas
+// Returns:					-
+// Changes Globals:		-
+//===========================================================================
+int AAS_TryMergeFaceAreas( tmp_face_t *seperatingface ) {
+	if ( !AAS_TestMergeFaceAreas( seperatingface ) ) {
+		return false;
+	}
+	AAS_MergeFaceAreas( seperatingface );
 	return true;
 } //end of the function AAS_TryMergeFaceAreas
 //===========================================================================
@@ -371,9 +412,135 @@ int AAS_LadderArea( tmp_area_t *tmparea ) {
 	return false;
 } //end of the function AAS_GroundArea
 
+//===========================================================================
+// returns the first face of the area the area can be merged over
+//
+// Parameter:				-
+// Returns:					-
+// Changes Globals:		-
+//===========================================================================
+tmp_face_t *AAS_FindMergeFace( tmp_area_t *tmparea, int groundfirst ) {
+	int side;
+	tmp_area_t *othertmparea;
+	tmp_face_t *face;
+
+	if ( groundfirst ) {
+		if ( !AAS_GroundArea( tmparea ) ) {
+			return NULL;
+		}
+	} //end if
+	  //
+	for ( face = tmparea->tmpfaces; face; face = face->next[side] )
+	{
+		side = ( face->frontarea != tmparea );
+		//if the face has both a front and back area
+		if ( face->frontarea && face->backarea ) {
+			//
+			if ( face->frontarea == tmparea ) {
+				othertmparea = face->backarea;
+			} else { othertmparea = face->frontarea;}
+			//
+			if ( groundfirst ) {
+				if ( !AAS_GroundArea( othertmparea ) ) {
+					continue;
+				}
+			} //end if
+
+			// if the critical types are different, dont merge
+			if (    ( AAS_GroundArea( tmparea ) != AAS_GroundArea( othertmparea ) )
+					||  ( AAS_LadderArea( tmparea ) != AAS_LadderArea( othertmparea ) )
+					||  ( ( tmparea->contents & AREACONTENTS_MOVER ) != ( othertmparea->contents & AREACONTENTS_MOVER ) )
+					||  ( ( tmparea->contents & AREACONTENTS_WATER ) != ( othertmparea->contents & AREACONTENTS_WATER ) ) ) {
+				continue;
+			}
+
+			if ( AAS_TestMergeFaceAreas( face ) ) {
+				return face;
+			} //end if
+		} //end if
+	} //end for
+	return NULL;
+} //end of the function AAS_FindMergeFace
+//===========================================================================
+//
+// Parameter:				-
+// Returns:					-
+// Changes Globals:		-
+//===========================================================================
+void AAS_FindAreaMergeThread( int areanum ) {
+	tmp_areamerge_t *merge;
+
+	merge = &areamerges[areanum];
+	if ( !merge->tmparea ) {
+		return;
+	}
+	merge->face = AAS_FindMergeFace( merge->tmparea, areamergegroundfirst );
+	merge->valid = true;
+} //end of the function AAS_FindAreaMergeThread
+//===========================================================================
+// searches the merge face for all the areas of a merge pass on the threads,
+// the areas are merged afterwards in the original order so the result is
+// the same for any number of threads
+//
+// Parameter:				-
+// Returns:					-
+// Changes Globals:		-
+//===========================================================================
+void AAS_FindAreaMerges( int groundfirst ) {
+	tmp_area_t *tmparea;
+
+	numareamerges = tmpaasworld.areanum;
+	areamerges = (tmp_areamerge_t *) GetClearedMemory( numareamerges * sizeof( tmp_areamerge_t ) );
+	for ( tmparea = tmpaasworld.areas; tmparea; tmparea = tmparea->l_next )
+	{
+		if ( !tmparea->invalid ) {
+			areamerges[tmparea->areanum].tmparea = tmparea;
+		} //end if
+	} //end for
+	areamergegroundfirst = groundfirst;
+	RunThreadsOnIndividual( numareamerges, false, AAS_FindAreaMergeThread );
+} //end of the function AAS_FindAreaMerges
+//===========================================================================
+// returns true if the merge face found on a thread is still the first face
+// the area can be merged over, the faces tested before it on the thread are
+// only tested against other areas if none of those areas was merged since
+//
+// Parameter:				-
+// Returns:					-
+// Changes Globals:		-
+//===========================================================================
+int AAS_CheckAreaMerge( tmp_areamerge_t *merge ) {
+	int side;
+	tmp_face_t *face;
+
+	if ( !merge->valid ) {
+		return false;
+	}
+	for ( face = merge->tmparea->tmpfaces; face; face = face->next[side] )
+	{
+		side = ( face->frontarea != merge->tmparea );
+		//areas created by merges in this pass have higher area numbers
+		if ( face->frontarea && face->frontarea->areanum >= numareamerges ) {
+			return false;
+		}
+		if ( face->backarea && face->backarea->areanum >= numareamerges ) {
+			return false;
+		}
+		if ( face == merge->face ) {
+			break;
+		}
+	} //end for
+	return true;
+} //end of the function AAS_CheckAreaMerge
+//===========================================================================
+//
+// Parameter:				-
+// Returns:					-
+// Changes Globals:		-
+//===========================================================================
 void AAS_MergeAreas( void ) {
-	int side, nummerges, merges, groundfirst;
-	tmp_area_t *tmparea, *othertmparea;
+	int nummerges, merges, groundfirst;
+	tmp_area_t *tmparea;
 	tmp_face_t *face;
 
 	nummerges = 0;
@@ -387,6 +554,10 @@ void AAS_MergeAreas( void ) {
 		//if (i < 2) groundfirst = true;
 		//else groundfirst = false;
 		//
+		//find the merge faces of the areas on multiple threads
+		if ( numthreads > 1 ) {
+			AAS_FindAreaMerges( groundfirst );
+		} //end if
 		merges = 0;
 		//first merge grounded areas only
 		for ( tmparea = tmpaasworld.areas; tmparea; tmparea = tmparea->l_next )
@@ -396,44 +567,23 @@ void AAS_MergeAreas( void ) {
 				continue;
 			} //end if
 			  //
-			if ( groundfirst ) {
-				if ( !AAS_GroundArea( tmparea ) ) {
-					continue;
-				}
+			if ( tmparea->areanum < numareamerges
+				 && AAS_CheckAreaMerge( &areamerges[tmparea->areanum] ) ) {
+				face = areamerges[tmparea->areanum].face;
+			} else {
+				face = AAS_FindMergeFace( tmparea, groundfirst );
+			} //end else
+			if ( face ) {
+				AAS_MergeFaceAreas( face );
+				qprintf( "\r%6d", ++nummerges );
+				merges++;
 			} //end if
-			  //
-			for ( face = tmparea->tmpfaces; face; face = face->next[side] )
-			{
-				side = ( face->frontarea != tmparea );
-				//if the face has both a front and back area
-				if ( face->frontarea && face->backarea ) {
-					//
-					if ( face->frontarea == tmparea ) {
-						othertmparea = face->backarea;
-					} else { othertmparea = face->frontarea;}
-					//
-					if ( groundfirst ) {
-						if ( !AAS_GroundArea( othertmparea ) ) {
-							continue;
-						}
-					} //end if
-
-					// if the critical types are different, dont merge
-					if (    ( AAS_GroundArea( tmparea ) != AAS_GroundArea( othertmparea ) )
-							||  ( AAS_LadderArea( tmparea ) != AAS_LadderArea( othertmparea ) )
-							||  ( ( tmparea->contents & AREACONTENTS_MOVER ) != ( othertmparea->contents & AREACONTENTS_MOVER ) )
-							||  ( ( tmparea->contents & AREACONTENTS_WATER ) != ( othertmparea->contents & AREACONTENTS_WATER ) ) ) {
-						continue;
-					}
-
-					if ( AAS_TryMergeFaceAreas( face ) ) {
-						qprintf( "\r%6d", ++nummerges );
-						merges++;
-						break;
-					} //end if
-				} //end if
-			} //end for
 		} //end for
+		if ( areamerges ) {
+			FreeMemory( areamerges );
+			areamerges = NULL;
+			numareamerges = 0;
+		} //end if
 		if ( !merges ) {
 			if ( groundfirst ) {
 				groundfirst = false;
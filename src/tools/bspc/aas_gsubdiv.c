@@ -47,6 +47,38 @@ If you have questions concerning this license or the applicable additional terms
 int numgravitationalsubdivisions = 0;
 int numladdersubdivisions = 0;
 
+//plane tested by a split plane search on a thread
+typedef struct tmp_splitplane_s
+{
+	vec3_t normal;                      //snapped normal of the tested plane
+	float dist;                         //distance of the tested plane
+	int planenum;                       //map plane found, -1 if there was none
+} tmp_splitplane_t;
+
+//split plane of an area found before the gravitational subdivision
+typedef struct tmp_areasplit_s
+{
+	tmp_area_t *tmparea;                //the area to split
+	int onthread;                       //true if searched on a thread
+	int found;                          //true if a split plane was found
+	vec3_t normal;                      //normal of the best split plane
+	float dist;                         //distance of the best split plane
+	int tinywindings;                   //number of tiny windings skipped
+	int faceplanes;                     //number of face planes tried as splitter
+	int nonconvex[2];                   //non-convex first and second windings
+	int epsilonfaces;                   //epsilon faces of the last tested plane
+	int bestepsilonfaces;               //epsilon faces of the best split plane
+	int valid;                          //true while the area faces are unchanged
+	tmp_splitplane_t *planes;           //planes tested on the thread in order
+	int numplanes;
+	int maxplanes;
+} tmp_areasplit_t;
+
+tmp_areasplit_t *areasplits;            //split planes indexed by area number
+int numareasplits;
+
+void AAS_InvalidateAreaSplits( tmp_area_t *tmparea );
+
 //NOTE: only do gravitational subdivision BEFORE area merging!!!!!!!
 //			because the bsp tree isn't refreshes like with ladder subdivision
 
@@ -105,16 +137,14 @@ void AAS_SplitFace( tmp_face_t *face, vec3_t normal, float dist,
 // Returns:					-
 // Changes Globals:		-
 //===========================================================================
-winding_t *AAS_SplitWinding( tmp_area_t *tmparea, int planenum ) {
+winding_t *AAS_SplitWindingForPlane( tmp_area_t *tmparea, vec3_t normal, vec_t dist ) {
 	tmp_face_t *face;
 	plane_t *plane;
 	int side;
 	winding_t *splitwinding;
 
-	//
-	plane = &mapplanes[planenum];
 	//create a split winding, first base winding for plane
-	splitwinding = BaseWindingForPlane( plane->normal, plane->dist );
+	splitwinding = BaseWindingForPlane( normal, dist );
 	//chop with all the faces of the area
 	for ( face = tmparea->tmpfaces; face && splitwinding; face = face->next[side] )
 	{
@@ -124,6 +154,15 @@ winding_t *AAS_SplitWinding( tmp_area_t *tmparea, int planenum ) {
 		ChopWindingInPlace( &splitwinding, plane->normal, plane->dist, 0 ); // PLANESIDE_EPSILON);
 	} //end for
 	return splitwinding;
+} //end of the function AAS_SplitWindingForPlane
+//===========================================================================
+//
+// Parameter:				-
+// Returns:					-
+// Changes Globals:		-
+//===========================================================================
+winding_t *AAS_SplitWinding( tmp_area_t *tmparea, int planenum ) {
+	return AAS_SplitWindingForPlane( tmparea, mapplanes[planenum].normal, mapplanes[planenum].dist );
 } //end of the function AAS_SplitWinding
 //===========================================================================
 //
@@ -131,7 +170,37 @@ winding_t *AAS_SplitWinding( tmp_area_t *tmparea, int planenum ) {
 // Returns:					-
 // Changes Globals:		-
 //===========================================================================
-int AAS_TestSplitPlane( tmp_area_t *tmparea, vec3_t normal, float dist, int *facesplits, int *groundsplits, int *epsilonfaces, vec3_t* points ) {
+int AAS_SplitPlaneNum( vec3_t normal, float dist, vec3_t *points, tmp_areasplit_t *split ) {
+	tmp_splitplane_t *plane, *planes;
+
+	if ( !split->onthread ) {
+		return FindFloatPlane( normal, dist, 4, points );
+	} //end if
+	//don't create new map planes on the threads, FindFloatPlane is called
+	//for the same planes in the same order when the area is subdivided
+	if ( split->numplanes >= split->maxplanes ) {
+		split->maxplanes = split->maxplanes ? split->maxplanes * 2 : 64;
+		planes = (tmp_splitplane_t *) GetMemory( split->maxplanes * sizeof( tmp_splitplane_t ) );
+		if ( split->planes ) {
+			memcpy( planes, split->planes, split->numplanes * sizeof( tmp_splitplane_t ) );
+			FreeMemory( split->planes );
+		} //end if
+		split->planes = planes;
+	} //end if
+	plane = &split->planes[split->numplanes++];
+	SnapPlane( normal, &dist );
+	VectorCopy( normal, plane->normal );
+	plane->dist = dist;
+	plane->planenum = FindExistingFloatPlane( normal, dist );
+	return plane->planenum;
+} //end of the function AAS_SplitPlaneNum
+//===========================================================================
+//
+// Parameter:				-
+// Returns:					-
+// Changes Globals:		-
+//===========================================================================
+int AAS_TestSplitPlane( tmp_area_t *tmparea, vec3_t normal, float dist, int *facesplits, int *groundsplits, int *epsilonfaces, vec3_t *points, tmp_areasplit_t *split ) {
 	int j, side, front, back, planenum;
 	float d, d_front, d_back;
 	tmp_face_t *face;
@@ -139,9 +208,12 @@ int AAS_TestSplitPlane( tmp_area_t *tmparea, vec3_t normal, float dist, int *fac
 
 	*facesplits = *groundsplits = *epsilonfaces = 0;
 
-	planenum = FindFloatPlane( normal, dist, 4, points );
+	planenum = AAS_SplitPlaneNum( normal, dist, points, split );
 
-	w = AAS_SplitWinding( tmparea, planenum );
+	//a plane that isn't a map plane yet is the plane FindFloatPlane creates
+	if ( planenum >= 0 ) {
+		w = AAS_SplitWinding( tmparea, planenum );
+	} else { w = AAS_SplitWindingForPlane( tmparea, normal, dist );}
 	if ( !w ) {
 		return false;
 	}
@@ -152,8 +224,9 @@ int AAS_TestSplitPlane( tmp_area_t *tmparea, vec3_t normal, float dist, int *fac
 		//side of the face the area is on
 		side = face->frontarea != tmparea;
 
-		if ( ( face->planenum & ~1 ) == ( planenum & ~1 ) ) {
-			Log_Print( "AAS_TestSplitPlane: tried face plane as splitter\n" );
+		if ( planenum >= 0 && ( face->planenum & ~1 ) == ( planenum & ~1 ) ) {
+			//logged by the caller, the search may run on a thread
+			split->faceplanes++;
 			return false;
 		} //end if
 		w = face->winding;
@@ -218,6 +291,7 @@ void AAS_SplitArea( tmp_area_t *tmparea, int planenum, tmp_area_t **frontarea, t
 #endif //AW_DEBUG*/
 	//the original area
 
+	AAS_InvalidateAreaSplits( tmparea );
 	AAS_FlipAreaFaces( tmparea );
 	AAS_CheckArea( tmparea );
 	//
@@ -345,9 +419,9 @@ void AAS_SplitArea( tmp_area_t *tmparea, int planenum, tmp_area_t **frontarea, t
 // Returns:					-
 // Changes Globals:		-
 //===========================================================================
-int AAS_FindBestAreaSplitPlane( tmp_area_t *tmparea, vec3_t normal, float *dist ) {
+int AAS_FindBestAreaSplitPlane( tmp_area_t *tmparea, tmp_areasplit_t *split, int onthread ) {
 	int side1, side2;
-	int foundsplitter, facesplits, groundsplits, epsilonfaces, bestepsilonfaces;
+	int facesplits, groundsplits, epsilonfaces;
 	float bestvalue, value;
 	tmp_face_t *face1, *face2;
 	vec3_t tmpnormal, invgravity;
@@ -358,9 +432,10 @@ int AAS_FindBestAreaSplitPlane( tmp_area_t *tmparea, vec3_t normal, float *dist
 	VectorCopy( cfg.phys_gravitydirection, invgravity );
 	VectorInverse( invgravity );
 
-	foundsplitter = false;
+	memset( split, 0, sizeof( tmp_areasplit_t ) );
+	split->onthread = onthread;
 	bestvalue = -999999;
-	bestepsilonfaces = 0;
+	epsilonfaces = 0;
 	//
 #ifdef AW_DEBUG
 	Log_Print( "finding split plane for area %d\n", tmparea->areanum );
@@ -370,7 +445,7 @@ int AAS_FindBestAreaSplitPlane( tmp_area_t *tmparea, vec3_t normal, float *dist
 		side1 = face1->frontarea != tmparea;
 
 		if ( WindingIsTiny( face1->winding ) ) {
-			Log_Write( "gsubdiv: area %d has a tiny winding\r\n", tmparea->areanum );
+			split->tinywindings++;
 			continue;
 		}
 
@@ -383,7 +458,7 @@ int AAS_FindBestAreaSplitPlane( tmp_area_t *tmparea, vec3_t normal, float *dist
 			//side of the face the area is on
 			side2 = face2->frontarea != tmparea;
 			if ( WindingIsTiny( face1->winding ) ) {
-				Log_Write( "gsubdiv: area %d has a tiny winding\r\n", tmparea->areanum );
+				split->tinywindings++;
 				continue;
 			}
 
@@ -398,7 +473,7 @@ int AAS_FindBestAreaSplitPlane( tmp_area_t *tmparea, vec3_t normal, float *dist
 			}
 
 			//find a plane seperating the windings of the faces
-			if ( !FindPlaneSeperatingWindings( face1->winding, face2->winding, invgravity, tmpnormal, &tmpdist, points ) ) {
+			if ( !FindPlaneSeperatingWindings( face1->winding, face2->winding, invgravity, tmpnormal, &tmpdist, points, split->nonconvex ) ) {
 				continue;
 			}
 
@@ -407,7 +482,7 @@ int AAS_FindBestAreaSplitPlane( tmp_area_t *tmparea, vec3_t normal, float *dist
 #endif //AW_DEBUG
 
 			//get metrics for this vertical plane
-			if ( !AAS_TestSplitPlane( tmparea, tmpnormal, tmpdist, &facesplits, &groundsplits, &epsilonfaces, points ) ) {
+			if ( !AAS_TestSplitPlane( tmparea, tmpnormal, tmpdist, &facesplits, &groundsplits, &epsilonfaces, points, split ) ) {
 				continue;
 			} //end if
 
@@ -419,21 +494,123 @@ int AAS_FindBestAreaSplitPlane( tmp_area_t *tmparea, vec3_t normal, float *dist
 			//avoid epsilon faces
 			value += epsilonfaces * -1000;
 			if ( value > bestvalue ) {
-				VectorCopy( tmpnormal, normal );
-				*dist = tmpdist;
+				VectorCopy( tmpnormal, split->normal );
+				split->dist = tmpdist;
 				bestvalue = value;
-				bestepsilonfaces = epsilonfaces;
-				foundsplitter = true;
+				split->bestepsilonfaces = epsilonfaces;
+				split->found = true;
 			}
 		}
 	}
+	split->epsilonfaces = epsilonfaces;
+
+	return split->found;
+} //end of the function AAS_FindBestAreaSplitPlane
+//===========================================================================
+// writes the log messages of a split plane search, the search itself
+// doesn't log anything so the log is the same when it runs on threads
+//
+// Parameter:				-
+// Returns:					-
+// Changes Globals:		-
+//===========================================================================
+void AAS_LogAreaSplitPlane( tmp_area_t *tmparea, tmp_areasplit_t *split ) {
+	int i;
 
-	if ( bestepsilonfaces ) {
-		Log_Write( "found %d epsilon faces trying to split area %d\r\n", epsilonfaces, tmparea->areanum );
+	for ( i = 0; i < split->tinywindings; i++ )
+	{
+		Log_Write( "gsubdiv: area %d has a tiny winding\r\n", tmparea->areanum );
+	} //end for
+	for ( i = 0; i < split->nonconvex[0]; i++ )
+	{
+		Log_Write( "FindPlaneSeperatingWindings: winding1 non-convex\r\n" );
+	} //end for
+	for ( i = 0; i < split->nonconvex[1]; i++ )
+	{
+		Log_Write( "FindPlaneSeperatingWindings: winding2 non-convex\r\n" );
+	} //end for
+	for ( i = 0; i < split->faceplanes; i++ )
+	{
+		Log_Print( "AAS_TestSplitPlane: tried face plane as splitter\n" );
+	} //end for
+	if ( split->bestepsilonfaces ) {
+		Log_Write( "found %d epsilon faces trying to split area %d\r\n", split->epsilonfaces, tmparea->areanum );
 	}
+} //end of the function AAS_LogAreaSplitPlane
+//===========================================================================
+// the split plane found for the areas at the other side of the faces
+// of the given area is no longer valid once the area is split
+//
+// Parameter:				-
+// Returns:					-
+// Changes Globals:		-
+//===========================================================================
+void AAS_InvalidateAreaSplits( tmp_area_t *tmparea ) {
+	int side;
+	tmp_face_t *face;
+	tmp_area_t *otherarea;
 
-	return foundsplitter;
-} //end of the function AAS_FindBestAreaSplitPlane
+	if ( !areasplits ) {
+		return;
+	}
+	for ( face = tmparea->tmpfaces; face; face = face->next[side] )
+	{
+		//side of the face the area is on
+		side = face->frontarea != tmparea;
+		if ( side ) {
+			otherarea = face->frontarea;
+		} else { otherarea = face->backarea;}
+		if ( otherarea && otherarea->areanum < numareasplits ) {
+			areasplits[otherarea->areanum].valid = false;
+		} //end if
+	} //end for
+	if ( tmparea->areanum < numareasplits ) {
+		areasplits[tmparea->areanum].valid = false;
+	} //end if
+} //end of the function AAS_InvalidateAreaSplits
+//===========================================================================
+// gets the map planes for the planes tested by the search on the thread in
+// the order a serial search gets them, the search result is only the same
+// if every plane is the map plane the thread used
+//
+// Parameter:				-
+// Returns:					-
+// Changes Globals:		-
+//===========================================================================
+int AAS_CheckAreaSplitPlanes( tmp_areasplit_t *split ) {
+	int i, planenum, numplanes;
+	tmp_splitplane_t *plane;
+
+	for ( i = 0; i < split->numplanes; i++ )
+	{
+		plane = &split->planes[i];
+		numplanes = nummapplanes;
+		planenum = FindFloatPlane( plane->normal, plane->dist, 0, NULL );
+		if ( plane->planenum >= 0 ) {
+			if ( planenum != plane->planenum ) {
+				return false;
+			}
+		} //end if
+		//the thread used the plane as if it was new
+		else if ( planenum < numplanes ) {
+			return false;
+		} //end else if
+	} //end for
+	return true;
+} //end of the function AAS_CheckAreaSplitPlanes
+//===========================================================================
+//
+// Parameter:				-
+// Returns:					-
+// Changes Globals:		-
+//===========================================================================
+void AAS_FreeAreaSplitPlanes( tmp_areasplit_t *split ) {
+	if ( split->planes ) {
+		FreeMemory( split->planes );
+	}
+	split->planes = NULL;
+	split->numplanes = split->maxplanes = 0;
+} //end of the function AAS_FreeAreaSplitPlanes
 //===========================================================================
 //
 // Parameter:				-
@@ -441,21 +618,36 @@ int AAS_FindBestAreaSplitPlane( tmp_area_t *tmparea, vec3_t normal, float *dist
 // Changes Globals:		-
 //===========================================================================
 tmp_node_t *AAS_SubdivideArea_r( tmp_node_t *tmpnode ) {
-	int planenum;
+	int planenum, areanum;
 	tmp_area_t *frontarea, *backarea;
 	tmp_node_t *tmpnode1, *tmpnode2;
-	vec3_t normal;
-	float dist;
-
-	if ( AAS_FindBestAreaSplitPlane( tmpnode->tmparea, normal, &dist ) ) {
+	tmp_areasplit_t split;
+
+	areanum = tmpnode->tmparea->areanum;
+	//use the split plane found on the threads if the area didn't change since
+	//and the thread used the same map planes as a search right now would
+	if ( areanum < numareasplits && areasplits[areanum].valid
+		 && AAS_CheckAreaSplitPlanes( &areasplits[areanum] ) ) {
+		memcpy( &split, &areasplits[areanum], sizeof( tmp_areasplit_t ) );
+	} //end if
+	else
+	{
+		AAS_FindBestAreaSplitPlane( tmpnode->tmparea, &split, false );
+	} //end else
+	if ( areanum < numareasplits ) {
+		AAS_FreeAreaSplitPlanes( &areasplits[areanum] );
+	} //end if
+	AAS_LogAreaSplitPlane( tmpnode->tmparea, &split );
+	//
+	if ( split.found ) {
 		qprintf( "\r%6d", ++numgravitationalsubdivisions );
 		//
-		planenum = FindFloatPlane( normal, dist, 0, NULL );
+		planenum = FindFloatPlane( split.normal, split.dist, 0, NULL );
 		//split the area
 		AAS_SplitArea( tmpnode->tmparea, planenum, &frontarea, &backarea );
 		//
 		tmpnode->tmparea = NULL;
-		tmpnode->planenum = FindFloatPlane( normal, dist, 0, NULL );
+		tmpnode->planenum = FindFloatPlane( split.normal, split.dist, 0, NULL );
 		//
 		tmpnode1 = AAS_AllocTmpNode();
 		tmpnode1->planenum = 0;
@@ -491,6 +683,59 @@ tmp_node_t *AAS_GravitationalSubdivision_r( tmp_node_t *tmpnode ) {
 	return tmpnode;
 } //end of the function AAS_GravitationalSubdivision_r
 //===========================================================================
+//
+// Parameter:				-
+// Returns:					-
+// Changes Globals:		-
+//===========================================================================
+void AAS_SetAreaSplits_r( tmp_node_t *tmpnode ) {
+	//if this is a solid leaf
+	if ( !tmpnode ) {
+		return;
+	}
+	//if this is an area leaf
+	if ( tmpnode->tmparea ) {
+		areasplits[tmpnode->tmparea->areanum].tmparea = tmpnode->tmparea;
+		return;
+	} //end if
+	AAS_SetAreaSplits_r( tmpnode->children[0] );
+	AAS_SetAreaSplits_r( tmpnode->children[1] );
+} //end of the function AAS_SetAreaSplits_r
+//===========================================================================
+//
+// Parameter:				-
+// Returns:					-
+// Changes Globals:		-
+//===========================================================================
+void AAS_FindAreaSplitPlaneThread( int areanum ) {
+	tmp_area_t *tmparea;
+	tmp_areasplit_t *split;
+
+	split = &areasplits[areanum];
+	tmparea = split->tmparea;
+	if ( !tmparea ) {
+		return;
+	}
+	AAS_FindBestAreaSplitPlane( tmparea, split, true );
+	split->tmparea = tmparea;
+	split->valid = true;
+} //end of the function AAS_FindAreaSplitPlaneThread
+//===========================================================================
+// searches the split plane for all the areas of the tree on the threads,
+// the areas are split afterwards in the original order so the result is
+// the same for any number of threads
+//
+// Parameter:				-
+// Returns:					-
+// Changes Globals:		-
+//===========================================================================
+void AAS_FindAreaSplitPlanes( void ) {
+	numareasplits = tmpaasworld.areanum;
+	areasplits = (tmp_areasplit_t *) GetClearedMemory( numareasplits * sizeof( tmp_areasplit_t ) );
+	AAS_SetAreaSplits_r( tmpaasworld.nodes );
+	RunThreadsOnIndividual( numareasplits, false, AAS_FindAreaSplitPlaneThread );
+} //end of the function AAS_FindAreaSplitPlanes
+//===========================================================================
 // NOTE: merge faces and melt edges first
 //
 // Parameter:				-
@@ -498,13 +743,29 @@ tmp_node_t *AAS_GravitationalSubdivision_r( tmp_node_t *tmpnode ) {
 // Changes Globals:		-
 //===========================================================================
 void AAS_GravitationalSubdivision( void ) {
+	int i;
+
 	Log_Write( "AAS_GravitationalSubdivision\r\n" );
+	//find the split planes of the areas on multiple threads
+	if ( numthreads > 1 ) {
+		AAS_FindAreaSplitPlanes();
+	} //end if
 	numgravitationalsubdivisions = 0;
 	qprintf( "%6i gravitational subdivisions", numgravitationalsubdivisions );
 	//start with the head node
 	AAS_GravitationalSubdivision_r( tmpaasworld.nodes );
 	qprintf( "\n" );
 	Log_Write( "%6i gravitational subdivisions\r\n", numgravitationalsubdivisions );
+	//
+	if ( areasplits ) {
+		for ( i = 0; i < numareasplits; i++ )
+		{
+			AAS_FreeAreaSplitPlanes( &areasplits[i] );
+		} //end for
+		FreeMemory( areasplits );
+		areasplits = NULL;
+		numareasplits = 0;
+	} //end if
 } //end of the function AAS_GravitationalSubdivision
 //===========================================================================
 //
@@ -61,27 +61,43 @@ If you have questions concerning this license or the applicable additional terms
 #define VERTEX_HASHING
 #define VERTEX_HASH_SHIFT       7
 #define VERTEX_HASH_SIZE        ( ( MAX_MAP_BOUNDS >> ( VERTEX_HASH_SHIFT - 1 ) ) + 1 ) //was 64
+#define VERTEX_CELL_SIZE        4.0         //size of a vertex hash cell
+#define VERTEX_CELL_EPSILON     ( VEREX_EPSILON + 0.01 )
 //
 #define PLANE_HASHING
 #define PLANE_HASH_SIZE         1024        //must be power of 2
+#define PLANE_NORMAL_CELL_SIZE  ( 1.0 / 256 )   //size of a plane hash cell
+#define PLANE_DIST_CELL_SIZE    0.25
+#define PLANE_NORMAL_CELL_EPSILON   ( NORMAL_EPSILON * 2 )
+#define PLANE_DIST_CELL_EPSILON     ( DIST_EPSILON * 2 )
 //
 #define EDGE_HASHING
-#define EDGE_HASH_SIZE          1024        //must be power of 2
 
 // Ridah
 aas_t aasworlds[1];
 aas_t( *aasworld );
 // done.
 
-//vertex hash
-int *aas_vertexchain;                       // the next vertex in a hash chain
-int aas_hashverts[VERTEX_HASH_SIZE * VERTEX_HASH_SIZE];   // a vertex number, or 0 for no verts
-//plane hash
-int *aas_planechain;
-int aas_hashplanes[PLANE_HASH_SIZE];
-//edge hash
-int *aas_edgechain;
-int aas_hashedges[EDGE_HASH_SIZE];
+//open addressing hash table slot
+typedef struct aas_hashslot_s
+{
+	unsigned hash;                          //hash of the cell the item is in
+	int num;                                //item number, -1 for an empty slot
+} aas_hashslot_t;
+
+//open addressing hash table, several items can be stored in the same cell
+typedef struct aas_hashtable_s
+{
+	aas_hashslot_t *slots;                  //the slots of the table
+	int size;                               //number of slots, power of 2
+	int numitems;                           //number of items stored
+	int lookups;                            //number of cell lookups
+	int probes;                             //number of slots probed
+} aas_hashtable_t;
+
+aas_hashtable_t aas_vertexhash;
+aas_hashtable_t aas_planehash;
+aas_hashtable_t aas_edgehash;
 
 int allocatedaasmem = 0;
 
@@ -162,14 +178,129 @@ void AAS_InitMaxAAS( void ) {
 	max_aas.max_clusters = 0;
 } //end of the function AAS_InitMaxAAS
 //===========================================================================
+// sizes the table so it is never more than half full with the maximum
+// number of items, that way a lookup always ends at an empty slot
 //
 // Parameter:				-
 // Returns:					-
 // Changes Globals:		-
 //===========================================================================
-void AAS_AllocMaxAAS( void ) {
+void AAS_InitHashTable( aas_hashtable_t *table, int maxitems ) {
 	int i;
 
+	for ( table->size = 64; table->size < maxitems * 2; table->size <<= 1 ) ;
+	table->slots = (aas_hashslot_t *) GetMemory( table->size * sizeof( aas_hashslot_t ) );
+	for ( i = 0; i < table->size; i++ )
+	{
+		table->slots[i].hash = 0;
+		table->slots[i].num = -1;
+	} //end for
+	table->numitems = 0;
+	table->lookups = 0;
+	table->probes = 0;
+} //end of the function AAS_InitHashTable
+//===========================================================================
+//
+// Parameter:				-
+// Returns:					-
+// Changes Globals:		-
+//===========================================================================
+void AAS_FreeHashTable( aas_hashtable_t *table ) {
+	if ( table->slots ) {
+		FreeMemory( table->slots );
+	}
+	table->slots = NULL;
+	table->size = 0;
+	table->numitems = 0;
+} //end of the function AAS_FreeHashTable
+//===========================================================================
+//
+// Parameter:				-
+// Returns:					-
+// Changes Globals:		-
+//===========================================================================
+unsigned AAS_HashCell( int *cell, int numcoords ) {
+	int i;
+	unsigned hash;
+
+	hash = 2166136261u;
+	for ( i = 0; i < numcoords; i++ )
+	{
+		hash = ( hash ^ (unsigned) cell[i] ) * 16777619u;
+	} //end for
+	hash ^= hash >> 15;
+	return hash;
+} //end of the function AAS_HashCell
+//===========================================================================
+//
+// Parameter:				-
+// Returns:					-
+// Changes Globals:		-
+//===========================================================================
+void AAS_AddToHashTable( aas_hashtable_t *table, unsigned hash, int num ) {
+	int slot;
+
+	if ( ( table->numitems + 1 ) * 2 > table->size ) {
+		Error( "AAS_AddToHashTable: table full" );
+	} //end if
+	for ( slot = hash & ( table->size - 1 ); table->slots[slot].num >= 0; slot = ( slot + 1 ) & ( table->size - 1 ) ) ;
+	table->slots[slot].hash = hash;
+	table->slots[slot].num = num;
+	table->numitems++;
+} //end of the function AAS_AddToHashTable
+//===========================================================================
+// returns the next item stored with the given cell hash or -1
+// when there are no more, start with *slot set to -1
+// NOTE: items from other cells with the same hash are returned as well
+//
+// Parameter:				-
+// Returns:					-
+// Changes Globals:		-
+//===========================================================================
+int AAS_NextHashItem( aas_hashtable_t *table, unsigned hash, int *slot ) {
+	aas_hashslot_t *s;
+
+	if ( *slot < 0 ) {
+		*slot = hash & ( table->size - 1 );
+		table->lookups++;
+	} //end if
+	else
+	{
+		*slot = ( *slot + 1 ) & ( table->size - 1 );
+	} //end else
+	for ( ; ; *slot = ( *slot + 1 ) & ( table->size - 1 ) )
+	{
+		s = &table->slots[*slot];
+		table->probes++;
+		if ( s->num < 0 ) {
+			return -1;
+		}
+		if ( s->hash == hash ) {
+			return s->num;
+		}
+	} //end for
+} //end of the function AAS_NextHashItem
+//===========================================================================
+//
+// Parameter:				-
+// Returns:					-
+// Changes Globals:		-
+//===========================================================================
+void AAS_PrintHashTable( char *name, aas_hashtable_t *table ) {
+	if ( !table->slots ) {
+		return;
+	}
+	Log_Print( "%6d %s hash slots, %1.2f load, %1.2f probes per lookup\n", table->size, name,
+			   (float) table->numitems / table->size,
+			   table->lookups ? (float) table->probes / table->lookups : 0 );
+} //end of the function AAS_PrintHashTable
+//===========================================================================
+//
+// Parameter:				-
+// Returns:					-
+// Changes Globals:		-
+//===========================================================================
+void AAS_AllocMaxAAS( void ) {
 	AAS_InitMaxAAS();
 	//bounding boxes
 	( *aasworld ).numbboxes = 0;
@@ -231,19 +362,10 @@ void AAS_AllocMaxAAS( void ) {
 	Log_Print( "allocated " );
 	PrintMemorySize( allocatedaasmem );
 	Log_Print( " of AAS memory\n" );
-	//reset the has stuff
-	aas_vertexchain = (int *) GetClearedMemory( max_aas.max_vertexes * sizeof( int ) );
-	aas_planechain = (int *) GetClearedMemory( max_aas.max_planes * sizeof( int ) );
-	aas_edgechain = (int *) GetClearedMemory( max_aas.max_edges * sizeof( int ) );
-	//
-	for ( i = 0; i < max_aas.max_vertexes; i++ ) aas_vertexchain[i] = -1;
-	for ( i = 0; i < VERTEX_HASH_SIZE * VERTEX_HASH_SIZE; i++ ) aas_hashverts[i] = -1;
-	//
-	for ( i = 0; i < max_aas.max_planes; i++ ) aas_planechain[i] = -1;
-	for ( i = 0; i < PLANE_HASH_SIZE; i++ ) aas_hashplanes[i] = -1;
-	//
-	for ( i = 0; i < max_aas.max_edges; i++ ) aas_edgechain[i] = -1;
-	for ( i = 0; i < EDGE_HASH_SIZE; i++ ) aas_hashedges[i] = -1;
+	//reset the hash stuff
+	AAS_InitHashTable( &aas_vertexhash, max_aas.max_vertexes );
+	AAS_InitHashTable( &aas_planehash, max_aas.max_planes );
+	AAS_InitHashTable( &aas_edgehash, max_aas.max_edges );
 } //end of the function AAS_AllocMaxAAS
 //===========================================================================
 //
@@ -342,18 +464,9 @@ void AAS_FreeMaxAAS( void ) {
 	Log_Print( " of AAS memory\n" );
 	allocatedaasmem = 0;
 	//
-	if ( aas_vertexchain ) {
-		FreeMemory( aas_vertexchain );
-	}
-	aas_vertexchain = NULL;
-	if ( aas_planechain ) {
-		FreeMemory( aas_planechain );
-	}
-	aas_planechain = NULL;
-	if ( aas_edgechain ) {
-		FreeMemory( aas_edgechain );
-	}
-	aas_edgechain = NULL;
+	AAS_FreeHashTable( &aas_vertexhash );
+	AAS_FreeHashTable( &aas_planehash );
+	AAS_FreeHashTable( &aas_edgehash );
 } //end of the function AAS_FreeMaxAAS
 //===========================================================================
 //
@@ -376,6 +489,20 @@ unsigned AAS_HashVec( vec3_t vec ) {
 	return y * VERTEX_HASH_SIZE + x;
 } //end of the function AAS_HashVec
 //===========================================================================
+//
+// Parameter:				-
+// Returns:					-
+// Changes Globals:		-
+//===========================================================================
+void AAS_VertexCell( vec3_t v, int *cell ) {
+	int i;
+
+	for ( i = 0; i < 3; i++ )
+	{
+		cell[i] = (int) floor( v[i] / VERTEX_CELL_SIZE );
+	} //end for
+} //end of the function AAS_VertexCell
+//===========================================================================
 // returns true if the vertex was found in the list
 // stores the vertex number in *vnum
 // stores a new vertex if not stored already
@@ -391,7 +518,9 @@ qboolean AAS_GetVertex( vec3_t v, int *vnum ) {
 #endif //VERTEX_HASHING
 
 #ifdef VERTEX_HASHING
-	int h, vn;
+	int h, vn, bestvn, slot;
+	int cell[3], mins[3], maxs[3];
+	unsigned hash;
 	vec3_t vert;
 
 	for ( i = 0; i < 3; i++ )
@@ -410,15 +539,40 @@ qboolean AAS_GetVertex( vec3_t v, int *vnum ) {
 		return true;
 	} //end if
 
-	for ( vn = aas_hashverts[h]; vn >= 0; vn = aas_vertexchain[vn] )
+	//search all the cells that could hold a vertex within epsilon
+	for ( i = 0; i < 3; i++ )
 	{
-		if ( fabs( ( *aasworld ).vertexes[vn][0] - vert[0] ) < VEREX_EPSILON
-			 && fabs( ( *aasworld ).vertexes[vn][1] - vert[1] ) < VEREX_EPSILON
-			 && fabs( ( *aasworld ).vertexes[vn][2] - vert[2] ) < VEREX_EPSILON ) {
-			*vnum = vn;
-			return true;
-		} //end if
+		mins[i] = (int) floor( ( vert[i] - VERTEX_CELL_EPSILON ) / VERTEX_CELL_SIZE );
+		maxs[i] = (int) floor( ( vert[i] + VERTEX_CELL_EPSILON ) / VERTEX_CELL_SIZE );
 	} //end for
+	  //use the most recently stored vertex within the same AAS_HashVec
+	  //cell, that's the vertex the old hash chains returned
+	bestvn = -1;
+	for ( cell[0] = mins[0]; cell[0] <= maxs[0]; cell[0]++ )
+	{
+		for ( cell[1] = mins[1]; cell[1] <= maxs[1]; cell[1]++ )
+		{
+			for ( cell[2] = mins[2]; cell[2] <= maxs[2]; cell[2]++ )
+			{
+				hash = AAS_HashCell( cell, 3 );
+				slot = -1;
+				while ( ( vn = AAS_NextHashItem( &aas_vertexhash, hash, &slot ) ) >= 0 )
+				{
+					if ( vn > bestvn
+						 && fabs( ( *aasworld ).vertexes[vn][0] - vert[0] ) < VEREX_EPSILON
+						 && fabs( ( *aasworld ).vertexes[vn][1] - vert[1] ) < VEREX_EPSILON
+						 && fabs( ( *aasworld ).vertexes[vn][2] - vert[2] ) < VEREX_EPSILON
+						 && AAS_HashVec( ( *aasworld ).vertexes[vn] ) == h ) {
+						bestvn = vn;
+					} //end if
+				} //end while
+			} //end for
+		} //end for
+	} //end for
+	if ( bestvn >= 0 ) {
+		*vnum = bestvn;
+		return true;
+	} //end if
 #else //VERTEX_HASHING
 	  //check if the vertex is already stored
 	  //stupid linear search
@@ -445,8 +599,8 @@ qboolean AAS_GetVertex( vec3_t v, int *vnum ) {
 	*vnum = ( *aasworld ).numvertexes;
 
 #ifdef VERTEX_HASHING
-	aas_vertexchain[( *aasworld ).numvertexes] = aas_hashverts[h];
-	aas_hashverts[h] = ( *aasworld ).numvertexes;
+	AAS_VertexCell( ( *aasworld ).vertexes[( *aasworld ).numvertexes], cell );
+	AAS_AddToHashTable( &aas_vertexhash, AAS_HashCell( cell, 3 ), ( *aasworld ).numvertexes );
 #endif //VERTEX_HASHING
 
 	( *aasworld ).numvertexes++;
@@ -459,19 +613,19 @@ qboolean AAS_GetVertex( vec3_t v, int *vnum ) {
 // Changes Globals:		-
 //===========================================================================
 unsigned AAS_HashEdge( int v1, int v2 ) {
-	int vnum1, vnum2;
+	int vnums[2];
 	//
 	if ( v1 < v2 ) {
-		vnum1 = v1;
-		vnum2 = v2;
+		vnums[0] = v1;
+		vnums[1] = v2;
 	} //end if
 	else
 	{
-		vnum1 = v2;
-		vnum2 = v1;
+		vnums[0] = v2;
+		vnums[1] = v1;
 	} //end else
-	return ( vnum1 + vnum2 ) & ( EDGE_HASH_SIZE - 1 );
-} //end of the function AAS_HashVec
+	return AAS_HashCell( vnums, 2 );
+} //end of the function AAS_HashEdge
 //===========================================================================
 //
 // Parameter:				-
@@ -479,15 +633,11 @@ unsigned AAS_HashEdge( int v1, int v2 ) {
 // Changes Globals:		-
 //===========================================================================
 void AAS_AddEdgeToHash( int edgenum ) {
-	int hash;
 	aas_edge_t *edge;
 
 	edge = &( *aasworld ).edges[edgenum];
 
-	hash = AAS_HashEdge( edge->v[0], edge->v[1] );
-
-	aas_edgechain[edgenum] = aas_hashedges[hash];
-	aas_hashedges[hash] = edgenum;
+	AAS_AddToHashTable( &aas_edgehash, AAS_HashEdge( edge->v[0], edge->v[1] ), edgenum );
 } //end of the function AAS_AddEdgeToHash
 //===========================================================================
 //
@@ -496,11 +646,13 @@ void AAS_AddEdgeToHash( int edgenum ) {
 // Changes Globals:		-
 //===========================================================================
 qboolean AAS_FindHashedEdge( int v1num, int v2num, int *edgenum ) {
-	int e, hash;
+	int e, slot;
+	unsigned hash;
 	aas_edge_t *edge;
 
 	hash = AAS_HashEdge( v1num, v2num );
-	for ( e = aas_hashedges[hash]; e >= 0; e = aas_edgechain[e] )
+	slot = -1;
+	while ( ( e = AAS_NextHashItem( &aas_edgehash, hash, &slot ) ) >= 0 )
 	{
 		edge = &( *aasworld ).edges[e];
 		if ( edge->v[0] == v1num ) {
@@ -516,9 +668,9 @@ qboolean AAS_FindHashedEdge( int v1num, int v2num, int *edgenum ) {
 				return true;
 			} //end if
 		} //end else
-	} //end for
+	} //end while
 	return false;
-} //end of the function AAS_FindHashedPlane
+} //end of the function AAS_FindHashedEdge
 //===========================================================================
 // returns true if the edge was found
 // stores the edge number in *edgenum (negative if reversed edge)
@@ -629,16 +781,29 @@ int AAS_PlaneTypeForNormal( vec3_t normal ) {
 // Returns:					-
 // Changes Globals:		-
 //===========================================================================
+void AAS_PlaneCell( vec3_t normal, float dist, int *cell ) {
+	int i;
+
+	for ( i = 0; i < 3; i++ )
+	{
+		cell[i] = (int) floor( normal[i] / PLANE_NORMAL_CELL_SIZE );
+	} //end for
+	cell[3] = (int) floor( dist / PLANE_DIST_CELL_SIZE );
+} //end of the function AAS_PlaneCell
+//===========================================================================
+//
+// Parameter:				-
+// Returns:					-
+// Changes Globals:		-
+//===========================================================================
 void AAS_AddPlaneToHash( int planenum ) {
-	int hash;
+	int cell[4];
 	aas_plane_t *plane;
 
 	plane = &( *aasworld ).planes[planenum];
 
-	hash = ( PLANE_HASH_SIZE - 1 ) & (int) fabs( plane->dist );
-
-	aas_planechain[planenum] = aas_hashplanes[hash];
-	aas_hashplanes[hash] = planenum;
+	AAS_PlaneCell( plane->normal, plane->dist, cell );
+	AAS_AddToHashTable( &aas_planehash, AAS_HashCell( cell, 4 ), planenum );
 } //end of the function AAS_AddPlaneToHash
 //===========================================================================
 //
@@ -689,25 +854,46 @@ qboolean AAS_FindPlane( vec3_t normal, float dist, int *planenum ) {
 // Changes Globals:		-
 //===========================================================================
 qboolean AAS_FindHashedPlane( vec3_t normal, float dist, int *planenum ) {
-	int i, p;
-	aas_plane_t *plane;
-	int hash, h;
+	int i, p, slot, bestp, order, bestorder, bucket;
+	int cell[4], mins[4], maxs[4];
 
-	hash = ( PLANE_HASH_SIZE - 1 ) & (int)fabs( dist );
-
-	//search the border bins as well
-	for ( i = -1; i <= 1; i++ )
+	//search all the cells that could hold a plane within epsilon
+	for ( i = 0; i < 3; i++ )
 	{
-		h = ( hash + i ) & ( PLANE_HASH_SIZE - 1 );
-		for ( p = aas_hashplanes[h]; p >= 0; p = aas_planechain[p] )
+		mins[i] = (int) floor( ( normal[i] - PLANE_NORMAL_CELL_EPSILON ) / PLANE_NORMAL_CELL_SIZE );
+		maxs[i] = (int) floor( ( normal[i] + PLANE_NORMAL_CELL_EPSILON ) / PLANE_NORMAL_CELL_SIZE );
+	} //end for
+	mins[3] = (int) floor( ( dist - PLANE_DIST_CELL_EPSILON ) / PLANE_DIST_CELL_SIZE );
+	maxs[3] = (int) floor( ( dist + PLANE_DIST_CELL_EPSILON ) / PLANE_DIST_CELL_SIZE );
+	//the old hash chains searched the buckets below, at and above the
+	//bucket of the distance in that order, most recent plane first,
+	//pick the same plane out of all the planes within epsilon
+	bucket = ( PLANE_HASH_SIZE - 1 ) & (int)fabs( dist );
+	bestp = -1;
+	bestorder = 0;
+	for ( i = 0; i < 4; i++ ) cell[i] = mins[i];
+	do
+	{
+		slot = -1;
+		while ( ( p = AAS_NextHashItem( &aas_planehash, AAS_HashCell( cell, 4 ), &slot ) ) >= 0 )
 		{
-			plane = &( *aasworld ).planes[p];
-			if ( AAS_PlaneEqual( normal, dist, p ) ) {
-				*planenum = p;
-				return true;
+			if ( !AAS_PlaneEqual( normal, dist, p ) ) {
+				continue;
+			}
+			order = ( ( ( PLANE_HASH_SIZE - 1 ) & (int)fabs( ( *aasworld ).planes[p].dist ) ) - bucket + 1 ) & ( PLANE_HASH_SIZE - 1 );
+			if ( bestp < 0 || order < bestorder || ( order == bestorder && p > bestp ) ) {
+				bestp = p;
+				bestorder = order;
 			} //end if
-		} //end for
-	} //end for
+		} //end while
+		  //next cell
+		for ( i = 0; i < 4 && ++cell[i] > maxs[i]; i++ ) cell[i] = mins[i];
+	} while ( i < 4 );
+	//
+	if ( bestp >= 0 ) {
+		*planenum = bestp;
+		return true;
+	} //end if
 	return false;
 } //end of the function AAS_FindHashedPlane
 //===========================================================================
@@ -748,6 +934,8 @@ qboolean AAS_GetPlane( vec3_t normal, vec_t dist, int *planenum ) {
 			*plane = *( plane + 1 );
 			*( plane + 1 ) = temp;
 			*planenum = ( *aasworld ).numplanes - 1;
+			//NOTE: these planes never went into the hash, adding
+			//		them now would change the stored file
 			return false;
 		} //end if
 	} //end if
@@ -1120,5 +1308,9 @@ void AAS_StoreFile( char *filename ) {
 	AAS_StoreTree_r( tmpaasworld.nodes );
 	qprintf( "\n" );
 	Log_Write( "%6d areas stored\r\n", ( *aasworld ).numareas );
+	//
+	AAS_PrintHashTable( "vertex", &aas_vertexhash );
+	AAS_PrintHashTable( "plane", &aas_planehash );
+	AAS_PrintHashTable( "edge", &aas_edgehash );
 	( *aasworld ).loaded = true;
 } //end of the function AAS_StoreFile
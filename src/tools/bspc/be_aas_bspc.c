@@ -38,6 +38,7 @@ If you have questions concerning this license or the applicable additional terms
 #include "../game/q_shared.h"
 #include "../bspc/l_log.h"
 #include "../bspc/l_qfiles.h"
+#include "../bspc/l_threads.h"
 #include "../botlib/l_memory.h"
 #include "../botlib/l_script.h"
 #include "../botlib/l_precomp.h"
@@ -52,6 +53,7 @@ If you have questions concerning this license or the applicable additional terms
 
 extern botlib_import_t botimport;
 extern qboolean capsule_collision;
+extern qboolean threaded;
 
 //#define AAS_MOVE_DEBUG
 
@@ -119,7 +121,14 @@ char *BotImport_BSPEntityData( void ) {
 void BotImport_Trace( bsp_trace_t *bsptrace, vec3_t start, vec3_t mins, vec3_t maxs, vec3_t end, int passent, int contentmask ) {
 	trace_t result;
 
+	//the collision map keeps its trace state in thread 0 for the plain calls
+	if ( threaded ) {
+		ThreadLock();
+	}
 	CM_BoxTrace( &result, start, end, mins, maxs, worldmodel, contentmask, capsule_collision );
+	if ( threaded ) {
+		ThreadUnlock();
+	}
 
 	bsptrace->allsolid = result.allsolid;
 	bsptrace->contents = result.contents;
@@ -142,7 +151,16 @@ void BotImport_Trace( bsp_trace_t *bsptrace, vec3_t start, vec3_t mins, vec3_t m
 // Changes Globals:		-
 //===========================================================================
 int BotImport_PointContents( vec3_t p ) {
-	return CM_PointContents( p, worldmodel );
+	int contents;
+
+	if ( threaded ) {
+		ThreadLock();
+	}
+	contents = CM_PointContents( p, worldmodel );
+	if ( threaded ) {
+		ThreadUnlock();
+	}
+	return contents;
 } //end of the function BotImport_PointContents
 //===========================================================================
 //
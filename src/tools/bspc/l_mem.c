@@ -101,7 +101,10 @@ void *GetClearedMemory( int size ) {
 		Error( "out of memory" );
 	}
 	memset( ptr, 0, size );
-	allocedmemory += MemorySize( ptr );
+	//worker threads don't keep the statistics
+	if ( numthreads == 1 ) {
+		allocedmemory += MemorySize( ptr );
+	}
 	return ptr;
 } //end of the function GetClearedMemory
 //===========================================================================
@@ -116,7 +119,9 @@ void *GetMemory( unsigned long size ) {
 	if ( !ptr ) {
 		Error( "out of memory" );
 	}
-	allocedmemory += MemorySize( ptr );
+	if ( numthreads == 1 ) {
+		allocedmemory += MemorySize( ptr );
+	}
 	return ptr;
 } //end of the function GetMemory
 //===========================================================================
@@ -125,11 +130,14 @@ void *GetMemory( unsigned long size ) {
 // Returns:					-
 // Changes Globals:		-
 //===========================================================================
-int fmemsize;
 void FreeMemory( void *ptr ) {
+	int fmemsize;
+
 	// RF, modified this for better memory trash testing
 	fmemsize = MemorySize( ptr );
-	allocedmemory -= fmemsize;
+	if ( numthreads == 1 ) {
+		allocedmemory -= fmemsize;
+	}
 
 	// RF, somehow this crashes windows if size is less than or equal 8
 	if ( fmemsize <= 8 ) {
@@ -158,6 +166,8 @@ int TotalAllocatedMemory( void ) {
 int totalmemorysize;
 int numblocks;
 
+extern qboolean threaded;
+
 typedef struct memoryblock_s
 {
 	unsigned long int id;
@@ -226,9 +236,16 @@ void *GetMemory( unsigned long size )
 	block->file = file;
 	block->line = line;
 #endif //MEMDEBUG
+	//the block list is shared with the worker threads
+	if ( threaded ) {
+		ThreadLock();
+	}
 	LinkMemoryBlock( block );
 	totalmemorysize += block->size;
 	numblocks++;
+	if ( threaded ) {
+		ThreadUnlock();
+	}
 	return block->ptr;
 } //end of the function GetMemoryDebug
 //===========================================================================
@@ -310,9 +327,15 @@ void FreeMemory( void *ptr ) {
 	if ( !block ) {
 		return;
 	}
+	if ( threaded ) {
+		ThreadLock();
+	}
 	UnlinkMemoryBlock( block );
 	totalmemorysize -= block->size;
 	numblocks--;
+	if ( threaded ) {
+		ThreadUnlock();
+	}
 	//
 	delete[] block;
 } //end of the function FreeMemory
@@ -1146,7 +1146,7 @@ int PointOnWinding( winding_t *w, vec3_t normal, float dist, vec3_t point, int *
 #define NORMAL_EPSILON  0.0001
 #define DIST_EPSILON    0.02
 
-int FindPlaneSeperatingWindings( winding_t *w1, winding_t *w2, vec3_t dir, vec3_t normal, float *dist, vec3_t* points ) {
+int FindPlaneSeperatingWindings( winding_t *w1, winding_t *w2, vec3_t dir, vec3_t normal, float *dist, vec3_t* points, int *nonconvex ) {
 	int i, i2, j, j2, n;
 	int sides1[3], sides2[3];
 	float dist1, dist2, dot, diff;
@@ -1231,13 +1231,17 @@ int FindPlaneSeperatingWindings( winding_t *w1, winding_t *w2, vec3_t dir, vec3_
 
 			//if the first winding has points at both sides
 			if ( sides1[0] && sides1[1] ) {
-				Log_Write( "FindPlaneSeperatingWindings: winding1 non-convex\r\n" );
+				if ( nonconvex ) {
+					nonconvex[0]++;
+				} else { Log_Write( "FindPlaneSeperatingWindings: winding1 non-convex\r\n" );}
 				continue;
 			}
 
 			//if the second winding has points at both sides
 			if ( sides2[0] && sides2[1] ) {
-				Log_Write( "FindPlaneSeperatingWindings: winding2 non-convex\r\n" );
+				if ( nonconvex ) {
+					nonconvex[1]++;
+				} else { Log_Write( "FindPlaneSeperatingWindings: winding2 non-convex\r\n" );}
 				continue;
 			}
 
@@ -1339,7 +1343,7 @@ winding_t *AAS_MergeWindings(winding_t *w1, winding_t *w2, vec3_t windingnormal)
 	int newnumpoints;
 	int keep[2];
 
-	if (!FindPlaneSeperatingWindings(w1, w2, windingnormal, normal, &dist)) return NULL;
+	if (!FindPlaneSeperatingWindings(w1, w2, windingnormal, normal, &dist, NULL, NULL)) return NULL;
 
 	//for both windings
 	for (n = 0; n < 2; n++)
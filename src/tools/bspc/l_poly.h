@@ -127,7 +127,9 @@ int PointOnWinding( winding_t *w, vec3_t normal, float dist, vec3_t point, int *
 //this plane will contain both the piece of common edge of the two windings
 //and the vector 'dir'
 // Gordon: points returns the 4 points from the two matching edges
-int FindPlaneSeperatingWindings( winding_t *w1, winding_t *w2, vec3_t dir, vec3_t normal, float *dist, vec3_t* points );
+//when 'nonconvex' isn't NULL the non-convex windings found are counted in
+//nonconvex[0] and nonconvex[1] instead of being logged
+int FindPlaneSeperatingWindings( winding_t *w1, winding_t *w2, vec3_t dir, vec3_t normal, float *dist, vec3_t* points, int *nonconvex );
 //
 int WindingsNonConvex( winding_t *w1, winding_t *w2,
 					   vec3_t normal1, vec3_t normal2,
@@ -333,6 +333,41 @@ int FindFloatPlane( vec3_t normal, vec_t dist, int numPoints, vec3_t* points ) {
 }
 #endif
 //===========================================================================
+// returns the plane FindFloatPlane would find for the already snapped
+// normal and distance, but never creates a new plane
+//
+// Parameter:				-
+// Returns:					the plane number or -1 if there's no such plane
+// Changes Globals:		-
+//===========================================================================
+int FindExistingFloatPlane( vec3_t normal, vec_t dist ) {
+	plane_t *p;
+	int i;
+#ifdef USE_HASHING
+	int hash, h;
+
+	hash = ( PLANE_HASHES - 1 ) & (int)fabs( dist );
+
+	// search the border bins as well
+	for ( i = -1; i <= 1; i++ ) {
+
+		h = ( hash + i ) & ( PLANE_HASHES - 1 );
+		for ( p = planehash[h]; p; p = p->hash_chain ) {
+			if ( PlaneEqual( p, normal, dist ) ) {
+				return p - mapplanes;
+			}
+		}
+	}
+#else
+	for ( i = 0, p = mapplanes; i < nummapplanes; i++, p++ ) {
+		if ( PlaneEqual( p, normal, dist ) ) {
+			return i;
+		}
+	}
+#endif
+	return -1;
+} //end of the function FindExistingFloatPlane
+//===========================================================================
 //
 // Parameter:				-
 // Returns:					-
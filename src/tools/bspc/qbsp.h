@@ -306,6 +306,10 @@ extern int c_squattbrushes;
 
 //finds a float plane for the given normal and distance
 int FindFloatPlane( vec3_t normal, vec_t dist, int numPoints, vec3_t* points );
+//finds an existing float plane without creating one, -1 if there's none
+int FindExistingFloatPlane( vec3_t normal, vec_t dist );
+//snaps the plane the same way FindFloatPlane does
+void SnapPlane( vec3_t normal, vec_t *dist );
 //returns the plane type for the given normal
 int PlaneTypeForNormal( vec3_t normal );
 //returns the plane defined by the three given points
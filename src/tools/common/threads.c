@@ -26,6 +26,9 @@ Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
 // pthreads extensions like pthread_mutexattr_settype
 #define _GNU_SOURCE
 #include <pthread.h>
+#include <unistd.h>
+#else
+#include <windows.h>
 #endif
 
 #include "cmdlib.h"
@@ -79,28 +82,263 @@ int GetThreadWork(void)
 }
 
 
+/*
+===================================================================
+
+WORK STEALING
+
+RunThreadsOnIndividual deals every thread an equal range of the work
+items up front.  Threads take small chunks off the front of their own
+range and, once it runs dry, steal the back half of somebody else's.
+A range is a single 64 bit word, start in the low half and end in the
+high half, so taking and stealing are both one compare and swap and
+no lock is held while handing out work.
+
+===================================================================
+*/
+
+// a torn read of a range is harmless, the compare and swap catches it
+#ifdef WIN32
+#define AtomicRead64(ptr)					(*(ptr))
+#define AtomicCompareSwap64(ptr, old, new)	(InterlockedCompareExchange64((volatile LONGLONG *)(ptr), (new), (old)) == (LONGLONG)(old))
+#define AtomicIncrement(ptr)				InterlockedIncrement((volatile LONG *)(ptr))
+#else
+#define AtomicRead64(ptr)					__atomic_load_n((ptr), __ATOMIC_RELAXED)
+#define AtomicCompareSwap64(ptr, old, new)	__sync_bool_compare_and_swap((ptr), (old), (new))
+#define AtomicIncrement(ptr)				__sync_add_and_fetch((ptr), 1)
+#endif
+
+typedef unsigned long long workRange_t;
+
+#define RANGE_START(r)		((int)((r) & 0xFFFFFFFFu))
+#define RANGE_END(r)		((int)((r) >> 32))
+#define MAKE_RANGE(s, e)	((workRange_t)(unsigned int)(s) | ((workRange_t)(unsigned int)(e) << 32))
+
+typedef struct
+{
+	volatile workRange_t range;
+	int             steals;
+	char            pad[64 - sizeof(workRange_t) - sizeof(int)];	// one cache line per thread
+} workQueue_t;
+
+static workQueue_t workQueues[MAX_THREADS];
+static int      workChunk;
+static volatile long workDone;
+static volatile long workNext;
+static qboolean workPacifier;
+static int      workTenths;		// pacifier tenths printed so far
+
 void            (*workfunction) (int);
 
+/*
+=============
+TakeWork
+
+Takes the next chunk off the front of a thread's own range
+=============
+*/
+static qboolean TakeWork(workQueue_t * q, int *start, int *end)
+{
+	workRange_t     r;
+	int             s, e;
+
+	while(1)
+	{
+		r = AtomicRead64(&q->range);
+		s = RANGE_START(r);
+		e = RANGE_END(r);
+		if(s >= e)
+			return qfalse;
+
+		*start = s;
+		*end = (e - s > workChunk) ? s + workChunk : e;
+		if(AtomicCompareSwap64(&q->range, r, MAKE_RANGE(*end, e)))
+			return qtrue;
+	}
+}
+
+/*
+=============
+StealWork
+
+Moves the back half of another thread's range into our own, which is empty
+=============
+*/
+static qboolean StealWork(int threadnum)
+{
+	workQueue_t    *q, *own;
+	workRange_t     r, old;
+	int             i, s, e, half;
+
+	own = &workQueues[threadnum];
+	for(i = 1; i < numthreads; i++)
+	{
+		q = &workQueues[(threadnum + i) % numthreads];
+		while(1)
+		{
+			r = AtomicRead64(&q->range);
+			s = RANGE_START(r);
+			e = RANGE_END(r);
+			if(s >= e)
+				break;
+
+			half = (e - s + 1) / 2;
+			if(AtomicCompareSwap64(&q->range, r, MAKE_RANGE(s, e - half)))
+			{
+				// nobody steals from an empty range, but the store still
+				// has to be atomic for the thieves reading it
+				do
+				{
+					old = AtomicRead64(&own->range);
+				} while(!AtomicCompareSwap64(&own->range, old, MAKE_RANGE(e - half, e)));
+
+				own->steals++;
+				return qtrue;
+			}
+		}
+	}
+
+	return qfalse;
+}
+
+/*
+=============
+FinishWork
+
+Counts a finished item and prints the pacifier tenths completed so far,
+under the lock so they come out in order and Sys_Printf isn't reentered
+=============
+*/
+static void FinishWork(void)
+{
+	int             done;
+	int             f;
+
+	done = AtomicIncrement(&workDone);
+	if(!workPacifier)
+		return;
+
+	// only the items that complete a tenth take the lock
+	f = 10 * done / workcount;
+	if(f == 10 * (done - 1) / workcount)
+		return;
+
+	ThreadLock();
+	while(workTenths < f)
+	{
+		Sys_Printf("%i...", workTenths);
+		fflush(stdout);			/* ydnar */
+		workTenths++;
+	}
+	ThreadUnlock();
+}
+
 void ThreadWorkerFunction(int threadnum)
 {
+	int             start, end;
 	int             work;
 
 	while(1)
 	{
-		work = GetThreadWork();
-		if(work == -1)
-			break;
+		if(!TakeWork(&workQueues[threadnum], &start, &end))
+		{
+			if(!StealWork(threadnum))
+				break;
+			continue;
+		}
+
+		for(work = start; work < end; work++)
+		{
 //Sys_Printf ("thread %i, work %i\n", threadnum, work);
-		workfunction(work);
+			workfunction(work);
+			FinishWork();
+		}
 	}
 }
 
 void RunThreadsOnIndividual(int workcnt, qboolean showpacifier, void (*func) (int))
 {
+	int             i;
+	int             steals;
+	double          start;
+
 	if(numthreads == -1)
 		ThreadSetDefault();
+
 	workfunction = func;
-	RunThreadsOn(workcnt, showpacifier, ThreadWorkerFunction);
+	workcount = workcnt;
+	workDone = 0;
+	workTenths = 0;
+	workPacifier = showpacifier;
+
+	// chunks small enough to keep all threads busy until the end,
+	// big enough that cheap items don't spend their time on the queues
+	workChunk = workcnt / (numthreads * 32);
+	if(workChunk < 1)
+		workChunk = 1;
+
+	for(i = 0; i < numthreads; i++)
+	{
+		workQueues[i].range = MAKE_RANGE((int)((long long)workcnt * i / numthreads), (int)((long long)workcnt * (i + 1) / numthreads));
+		workQueues[i].steals = 0;
+	}
+
+	start = I_FloatTime();
+	RunThreadsOn(workcnt, qfalse, ThreadWorkerFunction);
+
+	steals = 0;
+	for(i = 0; i < numthreads; i++)
+		steals += workQueues[i].steals;
+
+	if(showpacifier)
+		Sys_Printf(" (%.2f)\n", I_FloatTime() - start);
+	Sys_FPrintf(SYS_VRB, "%9d work items on %d threads in %.2f seconds, %d steals\n", workcnt, numthreads, I_FloatTime() - start,
+				steals);
+}
+
+/*
+=============
+OrderedWorkerFunction
+
+Takes single items strictly in increasing order, for work that is sorted
+cheapest first so the later items can reuse what the earlier ones found
+=============
+*/
+static void OrderedWorkerFunction(int threadnum)
+{
+	int             work;
+
+	while(1)
+	{
+		work = AtomicIncrement(&workNext) - 1;
+		if(work >= workcount)
+			break;
+
+		workfunction(work);
+		FinishWork();
+	}
+}
+
+void RunThreadsOnInOrder(int workcnt, qboolean showpacifier, void (*func) (int))
+{
+	double          start;
+
+	if(numthreads == -1)
+		ThreadSetDefault();
+
+	workfunction = func;
+	workcount = workcnt;
+	workDone = 0;
+	workNext = 0;
+	workTenths = 0;
+	workPacifier = showpacifier;
+
+	start = I_FloatTime();
+	RunThreadsOn(workcnt, qfalse, OrderedWorkerFunction);
+
+	if(showpacifier)
+		Sys_Printf(" (%.2f)\n", I_FloatTime() - start);
+	Sys_FPrintf(SYS_VRB, "%9d work items in order on %d threads in %.2f seconds\n", workcnt, numthreads, I_FloatTime() - start);
 }
 
 
@@ -129,9 +367,11 @@ void ThreadSetDefault(void)
 	{
 		GetSystemInfo(&info);
 		numthreads = info.dwNumberOfProcessors;
-		if(numthreads < 1 || numthreads > 32)
-			numthreads = 1;
 	}
+	if(numthreads < 1)
+		numthreads = 1;
+	if(numthreads > MAX_THREADS)
+		numthreads = MAX_THREADS;
 
 	Sys_Printf("%i threads\n", numthreads);
 }
@@ -413,17 +653,20 @@ void RunThreadsOn(int workcnt, qboolean showpacifier, void (*func) (int))
 #ifdef __linux__
 #define USED
 
-int             numthreads = 4;
+int             numthreads = -1;
 
 void ThreadSetDefault(void)
 {
 	if(numthreads == -1)		// not set manually
 	{
-		/* default to one thread, only multi-thread when specifically told to */
-		numthreads = 1;
+		numthreads = sysconf(_SC_NPROCESSORS_ONLN);
 	}
-	if(numthreads > 1)
-		Sys_Printf("threads: %d\n", numthreads);
+	if(numthreads < 1)
+		numthreads = 1;
+	if(numthreads > MAX_THREADS)
+		numthreads = MAX_THREADS;
+
+	Sys_Printf("%i threads\n", numthreads);
 }
 
 #include <pthread.h>
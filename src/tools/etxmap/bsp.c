@@ -1096,6 +1096,11 @@ int BSPMain(int argc, char **argv)
 			Sys_Printf("Debug portal surfaces enabled\n");
 			debugPortals = qtrue;
 		}
+		else if(!strcmp(argv[i], "-debugweld"))
+		{
+			Sys_Printf("Debug metavertex welding enabled, checking it against a linear search\n");
+			debugWeld = qtrue;
+		}
 		else if(!strcmp(argv[i], "-altsplit"))
 		{
 			Sys_Printf("Alternate BSP splitting (by 27) enabled\n");
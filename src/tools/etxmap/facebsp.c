@@ -44,6 +44,26 @@ int             c_faceLeafs;
 int				c_faceNodes;
 
 
+/* subtrees past this depth are handed to the worker threads; only the face tree of a
+   model is threaded, ProcessModels still runs the submodels one after another and the
+   portal and tjunction stages stay serial, as they append to the shared draw surface,
+   meta triangle and portal lists in an order the output depends on */
+#define FACE_TREE_TASK_DEPTH	8
+#define GROW_FACE_TREE_TASKS	256
+
+typedef struct faceTreeTask_s
+{
+	node_t         *node;
+	face_t         *list;
+	int             numNodes, numLeafs;
+}
+faceTreeTask_t;
+
+static int      faceTreeTaskDepth;
+static int      numFaceTreeTasks, maxFaceTreeTasks;
+static faceTreeTask_t *faceTreeTasks;
+
+
 /*
 ================
 AllocBspFace
@@ -77,27 +97,164 @@ void FreeBspFace(face_t * f)
 
 
 
+/* nodes with at least this many faces score their candidate planes on all threads */
+#define MIN_THREADED_SPLIT_FACES	1024
+
+static node_t  *splitNode;
+static face_t  *splitList;
+static int      numSplitFaces, maxSplitFaces;
+static face_t **splitFaces;
+static int     *splitFaceValues;
+
+
+
 /*
-SelectSplitPlaneNum()
-finds the best split plane for this node
+ScoreSplitFace()
+rates how good a split the face's plane would make for this node
 */
 
-static void SelectSplitPlaneNum(node_t * node, face_t * list, int *splitPlaneNum, int *compileFlags)
+static int ScoreSplitFace(node_t * node, face_t * split, face_t * list)
 {
-	face_t         *split;
 	face_t         *check;
-	face_t         *bestSplit;
 	int             splits, facing, front, back;
 	int             side;
 	plane_t        *plane;
+	int             value;
+
+
+	plane = &mapplanes[split->planenum];
+	splits = 0;
+	facing = 0;
+	front = 0;
+	back = 0;
+
+	for(check = list; check; check = check->next)
+	{
+		if(check->planenum == split->planenum)
+		{
+			facing++;
+			//check->checked = qtrue;   // won't need to test this plane again
+			continue;
+		}
+		side = WindingOnPlaneSide(check->w, plane->normal, plane->dist);
+		if(side == SIDE_CROSS)
+		{
+			splits++;
+		}
+		else if(side == SIDE_FRONT)
+		{
+			front++;
+		}
+		else if(side == SIDE_BACK)
+		{
+			back++;
+		}
+	}
+
+	if(bspAlternateSplitWeights)
+	{
+		//Base score = 20000 perfectly balanced 
+		value = 0;//20000;
+		value -= abs(front - back);	// prefer centered planes
+		value -= plane->counter;	// if we've already used this plane sometime in the past try not to use it again 
+		value += facing * 5;		// if we're going to have alot of other surfs use this plane, we want to get it in quickly.
+		value -= splits * 5;		// more splits = bad
+		//value += sizeBias * 10;		// we want a huge score bias based on plane size
+
+		if(plane->type < 3)
+		{
+			value += 5;		// axial is better
+		}
+
+		// we want a huge score bias based on plane size
+		#if 0
+		{
+			winding_t      *w;
+			node_t         *n;
+			plane_t        *plane;
+			vec3_t          normal;
+			vec_t           dist;
+
+			// create temporary winding to draw the split plane
+			w = CopyWinding(split->w);
+
+			// clip by all the parents
+			for(n = node->parent; n && w;)
+			{
+				plane = &mapplanes[n->planenum];
+
+				if(n->children[0] == node)
+				{						
+					// take front
+					ChopWindingInPlace(&w, plane->normal, plane->dist, 0.001);	// BASE_WINDING_EPSILON
+				}
+				else
+				{						
+					// take back
+					VectorNegate(plane->normal, normal);
+					dist = -plane->dist;
+					ChopWindingInPlace(&w, normal, dist, 0.001); // BASE_WINDING_EPSILON
+				}
+				node = n;
+				n = n->parent;
+			}
+
+			// clip by node AABB
+			if(w != NULL)
+				ChopWindingByBounds(&w, node->mins, node->maxs, CLIP_EPSILON);
+
+			if(w != NULL)
+				value += WindingArea(w);
+		}
+		#endif
+	}
+	else
+	{
+		value = 5 * facing - 5 * splits;	// - abs(front-back);
+		if(plane->type < 3)
+		{
+			value += 5;		// axial is better
+		}
+	}
+
+	value += split->priority;	// prioritize hints higher
+
+	return value;
+}
+
+
+
+/*
+ScoreSplitFacesThread()
+scores every numthreads'th face of a large node
+*/
+
+static void ScoreSplitFacesThread(int threadnum)
+{
+	int             i;
+
+
+	for(i = threadnum; i < numSplitFaces; i += numthreads)
+		splitFaceValues[i] = ScoreSplitFace(splitNode, splitFaces[i], splitList);
+}
+
+
+
+/*
+SelectSplitPlaneNum()
+finds the best split plane for this node
+*/
+
+static void SelectSplitPlaneNum(node_t * node, face_t * list, int numFaces, qboolean threaded, int *splitPlaneNum, int *compileFlags)
+{
+	face_t         *split;
+	face_t         *bestSplit;
 	int             value, bestValue;
 	int             i;
 	vec3_t          normal;
 	float           dist;
 	int             planenum;
-	float           sizeBias;
 	//int				checks;
-	int				frontC, backC, splitsC, facingC;
 
 
 	/* ydnar: set some defaults */
@@ -139,125 +296,59 @@ static void SelectSplitPlaneNum(node_t * node, face_t * list, int *splitPlaneNum
 
 #if defined(DEBUG_SPLITS)
 	Sys_FPrintf(SYS_VRB, "split scores: [");
+	threaded = qfalse;
 #endif
-	for(split = list; split; split = split->next)
+	if(threaded && numthreads > 1 && numFaces >= MIN_THREADED_SPLIT_FACES)
 	{
-		//if(split->checked)
-		//	continue;
-
-		//checks++;
+		/* enough space? */
+		if(numFaces > maxSplitFaces)
+		{
+			free(splitFaces);
+			free(splitFaceValues);
+			maxSplitFaces = numFaces;
+			splitFaces = safe_malloc(maxSplitFaces * sizeof(*splitFaces));
+			splitFaceValues = safe_malloc(maxSplitFaces * sizeof(*splitFaceValues));
+		}
 
-		plane = &mapplanes[split->planenum];
-		splits = 0;
-		facing = 0;
-		front = 0;
-		back = 0;
+		/* score the faces on all threads */
+		numSplitFaces = 0;
+		for(split = list; split; split = split->next)
+			splitFaces[numSplitFaces++] = split;
+		splitNode = node;
+		splitList = list;
+		RunThreadsOn(numthreads, qfalse, ScoreSplitFacesThread);
 
-		for(check = list; check; check = check->next)
+		/* pick in list order so ties break the same way as the serial loop */
+		for(i = 0; i < numSplitFaces; i++)
 		{
-			if(check->planenum == split->planenum)
+			if(splitFaceValues[i] > bestValue)
 			{
-				facing++;
-				//check->checked = qtrue;   // won't need to test this plane again
-				continue;
-			}
-			side = WindingOnPlaneSide(check->w, plane->normal, plane->dist);
-			if(side == SIDE_CROSS)
-			{
-				splits++;
-			}
-			else if(side == SIDE_FRONT)
-			{
-				front++;
-			}
-			else if(side == SIDE_BACK)
-			{
-				back++;
+				bestValue = splitFaceValues[i];
+				bestSplit = splitFaces[i];
 			}
 		}
-
-		if(bspAlternateSplitWeights)
+	}
+	else
+	{
+		for(split = list; split; split = split->next)
 		{
-			//Base score = 20000 perfectly balanced 
-			value = 0;//20000;
-			value -= abs(front - back);	// prefer centered planes
-			value -= plane->counter;	// if we've already used this plane sometime in the past try not to use it again 
-			value += facing * 5;		// if we're going to have alot of other surfs use this plane, we want to get it in quickly.
-			value -= splits * 5;		// more splits = bad
-			//value += sizeBias * 10;		// we want a huge score bias based on plane size
-
-			if(plane->type < 3)
-			{
-				value += 5;		// axial is better
-			}
+			//if(split->checked)
+			//	continue;
 
-			// we want a huge score bias based on plane size
-			#if 0
-			{
-				winding_t      *w;
-				node_t         *n;
-				plane_t        *plane;
-				vec3_t          normal;
-				vec_t           dist;
-
-				// create temporary winding to draw the split plane
-				w = CopyWinding(split->w);
-
-				// clip by all the parents
-				for(n = node->parent; n && w;)
-				{
-					plane = &mapplanes[n->planenum];
-
-					if(n->children[0] == node)
-					{						
-						// take front
-						ChopWindingInPlace(&w, plane->normal, plane->dist, 0.001);	// BASE_WINDING_EPSILON
-					}
-					else
-					{						
-						// take back
-						VectorNegate(plane->normal, normal);
-						dist = -plane->dist;
-						ChopWindingInPlace(&w, normal, dist, 0.001); // BASE_WINDING_EPSILON
-					}
-					node = n;
-					n = n->parent;
-				}
+			//checks++;
 
-				// clip by node AABB
-				if(w != NULL)
-					ChopWindingByBounds(&w, node->mins, node->maxs, CLIP_EPSILON);
+			value = ScoreSplitFace(node, split, list);
 
-				if(w != NULL)
-					value += WindingArea(w);
-			}
+			#if defined(DEBUG_SPLITS)
+			Sys_FPrintf(SYS_VRB, " %d", value);
 			#endif
-		}
-		else
-		{
-			value = 5 * facing - 5 * splits;	// - abs(front-back);
-			if(plane->type < 3)
+
+			if(value > bestValue)
 			{
-				value += 5;		// axial is better
+				bestValue = value;
+				bestSplit = split;
 			}
 		}
-
-		value += split->priority;	// prioritize hints higher
-
-		#if defined(DEBUG_SPLITS)
-		Sys_FPrintf(SYS_VRB, " %d", value);
-		#endif
-
-		if(value > bestValue)
-		{
-			bestValue = value;
-			bestSplit = split;
-			
-			frontC = front;
-			backC = back;
-			splitsC = splits;
-			facingC = facing;
-		}
 	}
 #if defined(DEBUG_SPLITS)
 	Sys_FPrintf(SYS_VRB, "]\n");
@@ -269,8 +360,6 @@ static void SelectSplitPlaneNum(node_t * node, face_t * list, int *splitPlaneNum
 	if(bestValue == -99999)
 		return;
 
-	//Sys_FPrintf(SYS_VRB, "F: %9d B:%9d S:%9d FA:%9d\n", frontC, backC, splitsC, facingC);
-
 	/* set best split data */
 	*splitPlaneNum = bestSplit->planenum;
 	*compileFlags = bestSplit->compileFlags;
@@ -284,7 +373,8 @@ static void SelectSplitPlaneNum(node_t * node, face_t * list, int *splitPlaneNum
 		Sys_FPrintf(SYS_ERR, "DON'T DO SUCH SPLITS (2)\n");
 #endif
 
-	if(*splitPlaneNum > -1)
+	/* only the alternate weights read the counter, and the face tree is serial for those */
+	if(*splitPlaneNum > -1 && bspAlternateSplitWeights)
 		mapplanes[*splitPlaneNum].counter++;
 }
 
@@ -374,12 +464,72 @@ static void DrawAll(void)
 }
 
 
+/*
+NodeCrossesBlocks()
+returns true if SelectSplitPlaneNum() would still force a block split somewhere below this node
+*/
+
+static qboolean NodeCrossesBlocks(node_t * node)
+{
+	int             i;
+	float           dist;
+
+
+	for(i = 0; i < 3; i++)
+	{
+		if(blockSize[i] <= 0)
+			continue;
+
+		dist = blockSize[i] * (floor(node->mins[i] / blockSize[i]) + 1);
+		if(node->maxs[i] > dist)
+			return qtrue;
+	}
+
+	return qfalse;
+}
+
+
+
+/*
+AddFaceTreeTask()
+defers building the subtree under this node to the worker threads
+*/
+
+static void AddFaceTreeTask(node_t * node, face_t * list)
+{
+	faceTreeTask_t *temp;
+
+
+	/* enough space? */
+	if(numFaceTreeTasks >= maxFaceTreeTasks)
+	{
+		/* reallocate more room */
+		maxFaceTreeTasks += GROW_FACE_TREE_TASKS;
+		temp = safe_malloc(maxFaceTreeTasks * sizeof(faceTreeTask_t));
+		if(faceTreeTasks != NULL)
+		{
+			memcpy(temp, faceTreeTasks, numFaceTreeTasks * sizeof(faceTreeTask_t));
+			free(faceTreeTasks);
+		}
+		faceTreeTasks = temp;
+	}
+
+	/* add the task */
+	memset(&faceTreeTasks[numFaceTreeTasks], 0, sizeof(faceTreeTask_t));
+	faceTreeTasks[numFaceTreeTasks].node = node;
+	faceTreeTasks[numFaceTreeTasks].list = list;
+	numFaceTreeTasks++;
+}
+
+
+
 /*
 BuildFaceTree_r()
 recursively builds the bsp, splitting on face planes
+nodes are counted into the task when building a deferred subtree
 */
 
-void BuildFaceTree_r(node_t * node, face_t * list)
+void BuildFaceTree_r(node_t * node, face_t * list, int depth, faceTreeTask_t * task)
 {
 	face_t         *split;
 	face_t         *next;
@@ -394,6 +544,13 @@ void BuildFaceTree_r(node_t * node, face_t * list)
 	int             splits, front, back;
 
 
+	/* hand off subtrees that can't create new planes */
+	if(task == NULL && faceTreeTaskDepth > 0 && depth >= faceTreeTaskDepth && !NodeCrossesBlocks(node))
+	{
+		AddFaceTreeTask(node, list);
+		return;
+	}
+
 	/* count faces left */
 	i = CountFaceList(list);
 
@@ -402,14 +559,17 @@ void BuildFaceTree_r(node_t * node, face_t * list)
 #endif
 
 	/* select the best split plane */
-	SelectSplitPlaneNum(node, list, &splitPlaneNum, &compileFlags);
+	SelectSplitPlaneNum(node, list, i, task == NULL, &splitPlaneNum, &compileFlags);
 
 	/* if we don't have any more faces, this is a leaf */
 	if(splitPlaneNum == -1)
 	{
 		node->planenum = PLANENUM_LEAF;
 		node->has_structural_children = qfalse;
-		c_faceLeafs++;
+		if(task != NULL)
+			task->numLeafs++;
+		else
+			c_faceLeafs++;
 		return;
 	}
 
@@ -498,7 +658,10 @@ void BuildFaceTree_r(node_t * node, face_t * list)
 		VectorCopy(node->mins, node->children[i]->mins);
 		VectorCopy(node->maxs, node->children[i]->maxs);
 
-		c_faceNodes++;
+		if(task != NULL)
+			task->numNodes++;
+		else
+			c_faceNodes++;
 	}
 
 	for(i = 0; i < 3; i++)
@@ -528,7 +691,7 @@ void BuildFaceTree_r(node_t * node, face_t * list)
 
 	for(i = 0; i < 2; i++)
 	{
-		BuildFaceTree_r(node->children[i], childLists[i]);
+		BuildFaceTree_r(node->children[i], childLists[i], depth + 1, task);
 		node->has_structural_children |= node->children[i]->has_structural_children;
 	}
 
@@ -542,6 +705,48 @@ void BuildFaceTree_r(node_t * node, face_t * list)
 }
 
 
+/*
+BuildFaceTreeTask()
+threaded worker that builds one deferred subtree
+*/
+
+static void BuildFaceTreeTask(int taskNum)
+{
+	faceTreeTask_t *task;
+
+
+	task = &faceTreeTasks[taskNum];
+	BuildFaceTree_r(task->node, task->list, faceTreeTaskDepth, task);
+	task->list = NULL;
+}
+
+
+
+/*
+FinishFaceTree_r()
+propagates has_structural_children from the deferred subtrees back up to the head node
+*/
+
+static void FinishFaceTree_r(node_t * node, int depth)
+{
+	int             i;
+
+
+	/* stop at leafs and at the roots of deferred subtrees */
+	if(node->planenum == PLANENUM_LEAF)
+		return;
+	if(depth >= faceTreeTaskDepth && !NodeCrossesBlocks(node))
+		return;
+
+	for(i = 0; i < 2; i++)
+	{
+		FinishFaceTree_r(node->children[i], depth + 1);
+		node->has_structural_children |= node->children[i]->has_structural_children;
+	}
+}
+
+
+
 /*
 ================
 FaceBSP
@@ -589,7 +794,27 @@ tree_t         *FaceBSP(face_t * list, qboolean drawDebug)
 	}
 #endif
 
-	BuildFaceTree_r(tree->headnode, list);
+	/* the split choice only depends on the node's own faces, so subtrees can be built in any order */
+	faceTreeTaskDepth = 0;
+	if(numthreads > 1 && !bspAlternateSplitWeights && !drawBSP)
+		faceTreeTaskDepth = FACE_TREE_TASK_DEPTH;
+	numFaceTreeTasks = 0;
+
+	BuildFaceTree_r(tree->headnode, list, 0, NULL);
+
+	/* build the deferred subtrees */
+	if(numFaceTreeTasks > 0)
+	{
+		Sys_FPrintf(SYS_VRB, "%9d subtrees\n", numFaceTreeTasks);
+		RunThreadsOnIndividual(numFaceTreeTasks, qfalse, BuildFaceTreeTask);
+
+		for(i = 0; i < numFaceTreeTasks; i++)
+		{
+			c_faceNodes += faceTreeTasks[i].numNodes;
+			c_faceLeafs += faceTreeTasks[i].numLeafs;
+		}
+		FinishFaceTree_r(tree->headnode, 0);
+	}
 
 	Sys_FPrintf(SYS_VRB, "%9d nodes\n", c_faceNodes);
 	Sys_FPrintf(SYS_VRB, "%9d leafs\n", c_faceLeafs);
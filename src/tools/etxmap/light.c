@@ -742,11 +742,14 @@ float PointToPolygonFormFactor(const vec3_t point, const vec3_t normal, const wi
 
 
 /*
-LightContributionTosample()
-determines the amount of light reaching a sample (luxel or vertex) from a given light
+SetupContributionToSample()
+everything LightContributionToSample() does before tracing, returns CONTRIBUTION_TRACE
+with the light's scale in *traceAdd if the sample still has to be traced to the light
 */
 
-int LightContributionToSample(trace_t * trace)
+#define CONTRIBUTION_TRACE		2
+
+static int SetupContributionToSample(trace_t * trace, float *traceAdd)
 {
 	light_t        *light;
 	float           angle;
@@ -1105,16 +1108,8 @@ int LightContributionToSample(trace_t * trace)
 		/* trace to point */
 		if(trace->testOcclusion && !trace->forceSunlight)
 		{
-			/* trace */
-			TraceLine(trace);
-			trace->forceSubsampling *= add;
-			if(!(trace->compileFlags & C_SKY) || trace->opaque)
-			{
-				VectorClear(trace->color);
-				VectorClear(trace->directionContribution);
-
-				return -1;
-			}
+			*traceAdd = add;
+			return CONTRIBUTION_TRACE;
 		}
 
 		/* return to sender */
@@ -1163,9 +1158,33 @@ int LightContributionToSample(trace_t * trace)
 	VectorScale(light->color, add, trace->color);
 
 	/* raytrace */
-	TraceLine(trace);
+	*traceAdd = add;
+	return CONTRIBUTION_TRACE;
+}
+
+
+
+/*
+FinishContributionToSample()
+applies the trace result to a sample set up by SetupContributionToSample()
+*/
+
+static int FinishContributionToSample(trace_t * trace, float add)
+{
 	trace->forceSubsampling *= add;
-	if(trace->passSolid || trace->opaque)
+
+	/* sunlight has to reach the sky */
+	if(trace->light->type == EMIT_SUN)
+	{
+		if(!(trace->compileFlags & C_SKY) || trace->opaque)
+		{
+			VectorClear(trace->color);
+			VectorClear(trace->directionContribution);
+
+			return -1;
+		}
+	}
+	else if(trace->passSolid || trace->opaque)
 	{
 		VectorClear(trace->color);
 		VectorClear(trace->directionContribution);
@@ -1179,6 +1198,61 @@ int LightContributionToSample(trace_t * trace)
 
 
 
+/*
+LightContributionTosample()
+determines the amount of light reaching a sample (luxel or vertex) from a given light
+*/
+
+int LightContributionToSample(trace_t * trace)
+{
+	int             result;
+	float           add;
+
+
+	result = SetupContributionToSample(trace, &add);
+	if(result != CONTRIBUTION_TRACE)
+		return result;
+
+	TraceLine(trace);
+	return FinishContributionToSample(trace, add);
+}
+
+
+
+/*
+LightContributionToSamplePacket()
+LightContributionToSample() for up to TRACE_PACKET_SIZE samples, traced as one ray packet
+*/
+
+void LightContributionToSamplePacket(trace_t * traces, int numTraces, int *results)
+{
+	int             i, numTraced;
+	float           adds[TRACE_PACKET_SIZE];
+	trace_t        *traced[TRACE_PACKET_SIZE];
+
+
+	/* set up the samples, collecting the ones that have to be traced */
+	numTraced = 0;
+	for(i = 0; i < numTraces; i++)
+	{
+		results[i] = SetupContributionToSample(&traces[i], &adds[i]);
+		if(results[i] == CONTRIBUTION_TRACE)
+			traced[numTraced++] = &traces[i];
+	}
+
+	/* trace them together */
+	TraceLinePacket(traced, numTraced);
+
+	/* finish */
+	for(i = 0; i < numTraces; i++)
+	{
+		if(results[i] == CONTRIBUTION_TRACE)
+			results[i] = FinishContributionToSample(&traces[i], adds[i]);
+	}
+}
+
+
+
 /*
 LightingAtSample()
 determines the amount of light reaching a sample (luxel or vertex)
@@ -1247,12 +1321,12 @@ void LightingAtSample(trace_t * trace, byte styles[MAX_LIGHTMAPS], vec3_t colors
 
 
 /*
-LightContributionToPoint()
-for a given light, how much light/color reaches a given point in space (with no facing)
-note: this is similar to LightContributionToSample() but optimized for omnidirectional sampling
+SetupContributionToPoint()
+everything LightContributionToPoint() does before tracing, returns CONTRIBUTION_TRACE
+if the point still has to be traced to the light
 */
 
-int LightContributionToPoint(trace_t * trace)
+static int SetupContributionToPoint(trace_t * trace)
 {
 	light_t        *light;
 	float           add, dist;
@@ -1410,15 +1484,7 @@ int LightContributionToPoint(trace_t * trace)
 
 		/* trace to point */
 		if(trace->testOcclusion && !trace->forceSunlight)
-		{
-			/* trace */
-			TraceLine(trace);
-			if(!(trace->compileFlags & C_SKY) || trace->opaque)
-			{
-				VectorClear(trace->color);
-				return -1;
-			}
-		}
+			return CONTRIBUTION_TRACE;
 
 		/* return to sender */
 		return qtrue;
@@ -1437,8 +1503,28 @@ int LightContributionToPoint(trace_t * trace)
 	VectorScale(light->color, add, trace->color);
 
 	/* trace */
-	TraceLine(trace);
-	if(trace->passSolid)
+	return CONTRIBUTION_TRACE;
+}
+
+
+
+/*
+FinishContributionToPoint()
+applies the trace result to a point set up by SetupContributionToPoint()
+*/
+
+static int FinishContributionToPoint(trace_t * trace)
+{
+	/* sunlight has to reach the sky */
+	if(trace->light->type == EMIT_SUN)
+	{
+		if(!(trace->compileFlags & C_SKY) || trace->opaque)
+		{
+			VectorClear(trace->color);
+			return -1;
+		}
+	}
+	else if(trace->passSolid)
 	{
 		VectorClear(trace->color);
 		return qfalse;
@@ -1450,6 +1536,60 @@ int LightContributionToPoint(trace_t * trace)
 
 
 
+/*
+LightContributionToPoint()
+for a given light, how much light/color reaches a given point in space (with no facing)
+note: this is similar to LightContributionToSample() but optimized for omnidirectional sampling
+*/
+
+int LightContributionToPoint(trace_t * trace)
+{
+	int             result;
+
+
+	result = SetupContributionToPoint(trace);
+	if(result != CONTRIBUTION_TRACE)
+		return result;
+
+	TraceLine(trace);
+	return FinishContributionToPoint(trace);
+}
+
+
+
+/*
+LightContributionToPointPacket()
+LightContributionToPoint() for up to TRACE_PACKET_SIZE traces, traced as one ray packet
+*/
+
+void LightContributionToPointPacket(trace_t * traces, int numTraces, int *results)
+{
+	int             i, numTraced;
+	trace_t        *traced[TRACE_PACKET_SIZE];
+
+
+	/* set up the traces, collecting the ones that have to be traced */
+	numTraced = 0;
+	for(i = 0; i < numTraces; i++)
+	{
+		results[i] = SetupContributionToPoint(&traces[i]);
+		if(results[i] == CONTRIBUTION_TRACE)
+			traced[numTraced++] = &traces[i];
+	}
+
+	/* trace them together */
+	TraceLinePacket(traced, numTraced);
+
+	/* finish */
+	for(i = 0; i < numTraces; i++)
+	{
+		if(results[i] == CONTRIBUTION_TRACE)
+			results[i] = FinishContributionToPoint(&traces[i]);
+	}
+}
+
+
+
 /*
 TraceGrid()
 grid samples are for quickly determining the lighting
@@ -1469,13 +1609,15 @@ contribution_t;
 
 void TraceGrid(int num)
 {
-	int             i, j, x, y, z, mod, numCon, numStyles;
+	int             i, j, x, y, z, mod, numCon, numStyles, numTraces, packetSize;
+	int             results[TRACE_PACKET_SIZE];
 	float           d, step;
 	vec3_t          baseOrigin, cheapColor, color, thisdir;
 	rawGridPoint_t *gp;
 	bspGridPoint_t *bgp;
 	contribution_t  contributions[MAX_CONTRIBUTIONS];
-	trace_t         trace;
+	trace_t         trace, traces[TRACE_PACKET_SIZE], *last;
+	light_t        *light;
 
 	/* get grid points */
 	gp = &rawGridPoints[num];
@@ -1540,40 +1682,62 @@ void TraceGrid(int num)
 
 	/* trace to all the lights, find the major light direction, and divide the
 	   total light between that along the direction and the remaining in the ambient */
-	for(trace.light = lights; trace.light != NULL; trace.light = trace.light->next)
+	packetSize = rayPacket ? TRACE_PACKET_SIZE : 1;
+	last = NULL;
+	light = lights;
+	while(light != NULL)
 	{
-		float           addSize;
+		/* sample a packet of lights */
+		for(numTraces = 0; numTraces < packetSize && light != NULL; numTraces++, light = light->next)
+		{
+			traces[numTraces] = trace;
+			traces[numTraces].light = light;
+		}
+		LightContributionToPointPacket(traces, numTraces, results);
 
+		for(j = 0; j < numTraces; j++)
+		{
+			float           addSize;
+			trace_t        *tr;
 
-		/* sample light */
-		if(!LightContributionToPoint(&trace))
-			continue;
 
-		/* handle negative light */
-		if(trace.light->flags & LIGHT_NEGATIVE)
-			VectorScale(trace.color, -1.0f, trace.color);
-
-		/* add a contribution */
-		VectorCopy(trace.color, contributions[numCon].color);
-		VectorCopy(trace.direction, contributions[numCon].dir);
-		VectorClear(contributions[numCon].ambient);
-		contributions[numCon].style = trace.light->style;
-		numCon++;
-
-		/* push average direction around */
-		addSize = VectorLength(trace.color);
-		VectorMA(gp->dir, addSize, trace.direction, gp->dir);
-
-		/* stop after a while */
-		if(numCon >= (MAX_CONTRIBUTIONS - 1))
-			break;
+			/* sample light */
+			tr = last = &traces[j];
+			if(!results[j])
+				continue;
+
+			/* handle negative light */
+			if(tr->light->flags & LIGHT_NEGATIVE)
+				VectorScale(tr->color, -1.0f, tr->color);
 
-		/* ydnar: cheap mode */
-		VectorAdd(cheapColor, trace.color, cheapColor);
-		if(cheapgrid && cheapColor[0] >= 255.0f && cheapColor[1] >= 255.0f && cheapColor[2] >= 255.0f)
+			/* add a contribution */
+			VectorCopy(tr->color, contributions[numCon].color);
+			VectorCopy(tr->direction, contributions[numCon].dir);
+			VectorClear(contributions[numCon].ambient);
+			contributions[numCon].style = tr->light->style;
+			numCon++;
+
+			/* push average direction around */
+			addSize = VectorLength(tr->color);
+			VectorMA(gp->dir, addSize, tr->direction, gp->dir);
+
+			/* stop after a while */
+			if(numCon >= (MAX_CONTRIBUTIONS - 1))
+				break;
+
+			/* ydnar: cheap mode */
+			VectorAdd(cheapColor, tr->color, cheapColor);
+			if(cheapgrid && cheapColor[0] >= 255.0f && cheapColor[1] >= 255.0f && cheapColor[2] >= 255.0f)
+				break;
+		}
+		if(j < numTraces)
 			break;
 	}
 
+	/* carry on with the last light's trace, like a single trace walking the light list would */
+	if(last != NULL)
+		trace = *last;
+
 	/////// Floodlighting for point //////////////////
 	//do our floodlight ambient occlusion loop, and add a single contribution based on the brightest dir
 	if(floodlighty)
@@ -2593,6 +2757,29 @@ int LightMain(int argc, char **argv)
 			noTrace = qtrue;
 			Sys_Printf("Shadow occlusion disabled\n");
 		}
+		else if(!strcmp(argv[i], "-raypacket"))
+		{
+			rayPacket = qtrue;
+			Sys_Printf("Tracing shadow, dirt and grid rays in packets of %d\n", TRACE_PACKET_SIZE);
+		}
+		else if(!strcmp(argv[i], "-bvh"))
+		{
+			traceBVH = qtrue;
+			Sys_Printf("Tracing world triangles through a bounding volume hierarchy\n");
+		}
+		else if(!strcmp(argv[i], "-lightcache"))
+		{
+			lightCache = qtrue;
+			Sys_Printf("Reusing unchanged lightmaps from the previous run\n");
+		}
+		else if(!strcmp(argv[i], "-tracebench"))
+		{
+			traceBenchmark = atoi(argv[i + 1]);
+			if(traceBenchmark < 1)
+				traceBenchmark = 1;
+			Sys_Printf("Benchmarking %d ray packets, no lighting will be done\n", traceBenchmark);
+			i++;
+		}
 		else if(!strcmp(argv[i], "-patchshadows"))
 		{
 			patchShadows = qtrue;
@@ -2869,12 +3056,27 @@ int LightMain(int argc, char **argv)
 	SetupFloodLight();
 	SetupSurfaceLightmaps();
 
+	/* set up the relighting cache, before the occluders go in */
+	if(lightCache && !traceBenchmark)
+		SetupLightCache(source, argc, argv);
+
 	/* initialize the surface facet tracing */
 	SetupTraceNodes();
 
+	/* measure the raytracer and bail */
+	if(traceBenchmark)
+	{
+		TraceBenchmark(traceBenchmark);
+		return 0;
+	}
+
 	/* light the world */
 	LightWorld();
 
+	/* replace the relighting cache */
+	if(lightCache)
+		FinishLightCache();
+
 	/* ydnar: store off lightmaps */
 	StoreSurfaceLightmaps();
 
@@ -0,0 +1,790 @@
+/* -------------------------------------------------------------------------------
+
+Copyright (C) 1999-2007 id Software, Inc. and contributors.
+For a list of contributors, see the accompanying CONTRIBUTORS file.
+
+This file is part of GtkRadiant.
+
+GtkRadiant is free software; you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation; either version 2 of the License, or
+(at your option) any later version.
+
+GtkRadiant is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with GtkRadiant; if not, write to the Free Software
+Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+
+----------------------------------------------------------------------------------
+
+This code has been altered significantly from its original form, to support
+several games based on the Quake III Arena engine, in the form of "Q3Map2."
+
+------------------------------------------------------------------------------- */
+
+
+
+/* marker */
+#define LIGHT_CACHE_C
+
+
+
+/* dependencies */
+#include "q3map2.h"
+
+
+
+/* -------------------------------------------------------------------------------
+
+incremental relighting cache (<map>.lightcache)
+
+------------------------------------------------------------------------------- */
+
+/*
+with -lightcache the luxels of each raw lightmap are saved once IlluminateRawLightmap() is done,
+keyed on everything that went into them: the light settings, the lightmap's luxel origins,
+normals and dirt, its shaders, every light left after culling, and the shadow casting geometry
+in the region between the lightmap and each of those lights. the next run reloads the lightmaps
+whose key didn't change instead of lighting them again.
+
+the geometry is keyed through a coarse grid of summed occluder keys, so moving a brush only
+relights the lightmaps that can see a light across the cells it touches
+*/
+
+#define LIGHT_CACHE_IDENT			(('C' << 24) + ('L' << 16) + ('X' << 8) + 'E')
+#define LIGHT_CACHE_VERSION			1
+
+#define LIGHT_CACHE_CELL_SIZE		256.0f	/* smallest occluder grid cell */
+#define MAX_LIGHT_CACHE_CELLS		128	/* per axis, cells grow for bigger worlds */
+#define LIGHT_CACHE_REGION_EPSILON	16.0f	/* subsamples reach a little past the lightmap bounds */
+
+#define LCF_DELUXELS				(1 << MAX_LIGHTMAPS)	/* the low bits note which superLuxels are stored */
+
+typedef struct lightCacheHeader_s
+{
+	int             ident, version;
+	lightCacheKey_t settings;
+	int             numEntries;
+}
+lightCacheHeader_t;
+
+typedef struct lightCacheEntry_s
+{
+	lightCacheKey_t key;
+	int             sw, sh;
+	int             flags;
+	int             size;		/* bytes of luxel data following the entry */
+	byte            styles[MAX_LIGHTMAPS];
+}
+lightCacheEntry_t;
+
+static char     cachePath[1024];
+static lightCacheKey_t cacheSettings, skyboxOccluders;
+
+static byte    *oldCache = NULL;
+static int      numOldEntries = 0;
+static lightCacheEntry_t **oldEntries = NULL;
+
+static FILE    *newCache = NULL;
+static int      numNewEntries = 0, numCacheHits = 0;
+
+static vec3_t   occluderOrigin;
+static float    occluderCellSize;
+static int      occluderSize[3];
+static lightCacheKey_t *occluderGrid = NULL;	/* per cell, then a 3d prefix sum once populated */
+
+
+
+/*
+ClearLightCacheKey()
+HashLightCacheData()
+HashLightCacheString()
+keys are two independent 32 bit hashes, a fnv-1a and a multiplicative one
+*/
+
+void ClearLightCacheKey(lightCacheKey_t * key)
+{
+	key->a = 2166136261u;
+	key->b = 0;
+}
+
+void HashLightCacheData(lightCacheKey_t * key, const void *data, int size)
+{
+	int             i;
+	const byte     *bytes;
+
+
+	bytes = data;
+	for(i = 0; i < size; i++)
+	{
+		key->a = (key->a ^ bytes[i]) * 16777619u;
+		key->b = (key->b + bytes[i] + 1) * 2654435761u;
+		key->b ^= key->b >> 15;
+	}
+}
+
+void HashLightCacheString(lightCacheKey_t * key, const char *string)
+{
+	HashLightCacheData(key, string, strlen(string) + 1);
+}
+
+
+
+/*
+CompareLightCacheKeys()
+CompareLightCacheEntries()
+qsort/bsearch callbacks for the previous cache's entries
+*/
+
+static int CompareLightCacheKeys(const lightCacheKey_t * a, const lightCacheKey_t * b)
+{
+	if(a->a != b->a)
+		return a->a < b->a ? -1 : 1;
+	if(a->b != b->b)
+		return a->b < b->b ? -1 : 1;
+	return 0;
+}
+
+static int CompareLightCacheEntries(const void *a, const void *b)
+{
+	return CompareLightCacheKeys(&(*(lightCacheEntry_t **) a)->key, &(*(lightCacheEntry_t **) b)->key);
+}
+
+
+
+/*
+LightCacheCell()
+gets the occluder grid cell of a point, clamped to the grid
+*/
+
+static void LightCacheCell(vec3_t point, int cell[3])
+{
+	int             i;
+
+
+	for(i = 0; i < 3; i++)
+	{
+		cell[i] = (int)floor((point[i] - occluderOrigin[i]) / occluderCellSize);
+		if(cell[i] < 0)
+			cell[i] = 0;
+		else if(cell[i] >= occluderSize[i])
+			cell[i] = occluderSize[i] - 1;
+	}
+}
+
+#define OCCLUDER_CELL( x, y, z )	(occluderGrid + ((((z) * (occluderSize[1] + 1)) + (y)) * (occluderSize[0] + 1) + (x)))
+
+
+
+/*
+AddLightCacheOccluder()
+adds the key of a shadow casting item to all grid cells its bounds touch, items without
+bounds (the skybox) go into every lightmap's key
+*/
+
+void AddLightCacheOccluder(vec3_t mins, vec3_t maxs, lightCacheKey_t * key)
+{
+	int             x, y, z, lo[3], hi[3];
+	lightCacheKey_t *cell;
+
+
+	/* dummy check */
+	if(occluderGrid == NULL)
+		return;
+
+	/* skybox */
+	if(mins == NULL)
+	{
+		skyboxOccluders.a += key->a;
+		skyboxOccluders.b += key->b;
+		return;
+	}
+
+	/* the first row on each axis stays zero for the prefix sum */
+	LightCacheCell(mins, lo);
+	LightCacheCell(maxs, hi);
+	for(z = lo[2]; z <= hi[2]; z++)
+	{
+		for(y = lo[1]; y <= hi[1]; y++)
+		{
+			for(x = lo[0]; x <= hi[0]; x++)
+			{
+				cell = OCCLUDER_CELL(x + 1, y + 1, z + 1);
+				cell->a += key->a;
+				cell->b += key->b;
+			}
+		}
+	}
+}
+
+
+
+/*
+FinishLightCacheOccluders()
+turns the occluder grid into a prefix sum, so the occluders of any box of cells can be summed
+from its eight corners (the sums wrap around, which inclusion-exclusion doesn't mind)
+*/
+
+void FinishLightCacheOccluders(void)
+{
+	int             x, y, z;
+	lightCacheKey_t *cell, *prev;
+
+
+	/* dummy check */
+	if(occluderGrid == NULL)
+		return;
+
+	for(z = 1; z <= occluderSize[2]; z++)
+	{
+		for(y = 1; y <= occluderSize[1]; y++)
+		{
+			for(x = 1; x <= occluderSize[0]; x++)
+			{
+				cell = OCCLUDER_CELL(x, y, z);
+				prev = OCCLUDER_CELL(x - 1, y, z);
+				cell->a += prev->a;
+				cell->b += prev->b;
+			}
+		}
+	}
+	for(z = 1; z <= occluderSize[2]; z++)
+	{
+		for(y = 1; y <= occluderSize[1]; y++)
+		{
+			for(x = 1; x <= occluderSize[0]; x++)
+			{
+				cell = OCCLUDER_CELL(x, y, z);
+				prev = OCCLUDER_CELL(x, y - 1, z);
+				cell->a += prev->a;
+				cell->b += prev->b;
+			}
+		}
+	}
+	for(z = 1; z <= occluderSize[2]; z++)
+	{
+		for(y = 1; y <= occluderSize[1]; y++)
+		{
+			for(x = 1; x <= occluderSize[0]; x++)
+			{
+				cell = OCCLUDER_CELL(x, y, z);
+				prev = OCCLUDER_CELL(x, y, z - 1);
+				cell->a += prev->a;
+				cell->b += prev->b;
+			}
+		}
+	}
+}
+
+
+
+/*
+LightCacheOccludersForBounds()
+sums the occluder keys of all grid cells touching a box
+*/
+
+static void LightCacheOccludersForBounds(vec3_t mins, vec3_t maxs, lightCacheKey_t * sum)
+{
+	int             i, lo[3], hi[3];
+	lightCacheKey_t *cell;
+
+
+	LightCacheCell(mins, lo);
+	LightCacheCell(maxs, hi);
+
+	sum->a = sum->b = 0;
+	for(i = 0; i < 8; i++)
+	{
+		cell = OCCLUDER_CELL((i & 1) ? hi[0] + 1 : lo[0], (i & 2) ? hi[1] + 1 : lo[1], (i & 4) ? hi[2] + 1 : lo[2]);
+
+		/* corners with an odd number of high coordinates add, the others subtract */
+		if(((i & 1) + ((i >> 1) & 1) + ((i >> 2) & 1)) & 1)
+		{
+			sum->a += cell->a;
+			sum->b += cell->b;
+		}
+		else
+		{
+			sum->a -= cell->a;
+			sum->b -= cell->b;
+		}
+	}
+}
+
+
+
+/*
+AddBrushOccluders()
+solid leaves stop traces too, so key the world brushes by their axial bounds
+*/
+
+static void AddBrushOccluders(void)
+{
+	int             i, j, k;
+	bspModel_t     *model;
+	bspBrush_t     *brush;
+	bspPlane_t     *plane;
+	vec3_t          mins, maxs;
+	lightCacheKey_t key;
+
+
+	model = &bspModels[0];
+	for(i = 0; i < model->numBSPBrushes; i++)
+	{
+		brush = &bspBrushes[model->firstBSPBrush + i];
+
+		ClearLightCacheKey(&key);
+		HashLightCacheString(&key, bspShaders[brush->shaderNum].shader);
+		VectorSet(mins, MIN_WORLD_COORD, MIN_WORLD_COORD, MIN_WORLD_COORD);
+		VectorSet(maxs, MAX_WORLD_COORD, MAX_WORLD_COORD, MAX_WORLD_COORD);
+
+		for(j = 0; j < brush->numSides; j++)
+		{
+			plane = &bspPlanes[bspBrushSides[brush->firstSide + j].planeNum];
+			HashLightCacheData(&key, plane, sizeof(*plane));
+
+			/* the axial bevels bound the brush */
+			for(k = 0; k < 3; k++)
+			{
+				if(plane->normal[k] == 1.0f)
+					maxs[k] = plane->dist;
+				else if(plane->normal[k] == -1.0f)
+					mins[k] = -plane->dist;
+			}
+		}
+
+		AddLightCacheOccluder(mins, maxs, &key);
+	}
+}
+
+
+
+/*
+SetupLightCache()
+keys the light settings, sets up the occluder grid and loads the previous cache, must be
+called before SetupTraceNodes() adds the shadow casting surfaces
+*/
+
+void SetupLightCache(const char *path, int argc, char **argv)
+{
+	int             i, size, offset;
+	char            tempPath[1024];
+	epair_t        *ep;
+	bspModel_t     *model;
+	lightCacheHeader_t header;
+	lightCacheEntry_t *entry;
+
+
+	/* note it */
+	Sys_Printf("--- SetupLightCache ---\n");
+	strcpy(cachePath, path);
+	StripExtension(cachePath);
+	strcat(cachePath, ".lightcache");
+
+	/* key the settings: the command line (less the options that don't change the lighting) and worldspawn */
+	ClearLightCacheKey(&cacheSettings);
+	HashLightCacheString(&cacheSettings, Q3MAP_VERSION);
+	HashLightCacheString(&cacheSettings, game->arg);
+	for(i = 1; i < (argc - 1); i++)
+	{
+		if(!strcmp(argv[i], "-threads"))
+		{
+			i++;
+			continue;
+		}
+		if(!strcmp(argv[i], "-v") || !strcmp(argv[i], "-lightcache"))
+			continue;
+		HashLightCacheString(&cacheSettings, argv[i]);
+	}
+	for(ep = entities[0].epairs; ep != NULL; ep = ep->next)
+	{
+		/* the compile history grows with every run */
+		if(!Q_strncasecmp(ep->key, "_etxmap_", 8))
+			continue;
+		HashLightCacheString(&cacheSettings, ep->key);
+		HashLightCacheString(&cacheSettings, ep->value);
+	}
+
+	/* size the occluder grid, cells are aligned to the world origin so they don't move when the world grows */
+	model = &bspModels[0];
+	occluderCellSize = LIGHT_CACHE_CELL_SIZE;
+	for(;;)
+	{
+		for(i = 0; i < 3; i++)
+		{
+			occluderOrigin[i] = floor(model->mins[i] / occluderCellSize) * occluderCellSize;
+			occluderSize[i] = (int)ceil((model->maxs[i] - occluderOrigin[i]) / occluderCellSize);
+			if(occluderSize[i] < 1)
+				occluderSize[i] = 1;
+		}
+		if(occluderSize[0] <= MAX_LIGHT_CACHE_CELLS && occluderSize[1] <= MAX_LIGHT_CACHE_CELLS && occluderSize[2] <= MAX_LIGHT_CACHE_CELLS)
+			break;
+		occluderCellSize *= 2.0f;
+	}
+	size = (occluderSize[0] + 1) * (occluderSize[1] + 1) * (occluderSize[2] + 1) * sizeof(*occluderGrid);
+	occluderGrid = safe_malloc(size);
+	memset(occluderGrid, 0, size);
+	skyboxOccluders.a = skyboxOccluders.b = 0;
+	AddBrushOccluders();
+
+	/* load the previous cache */
+	size = TryLoadFile(cachePath, (void **)&oldCache);
+	if(size >= (int)sizeof(header))
+	{
+		memcpy(&header, oldCache, sizeof(header));
+		if(header.ident != LIGHT_CACHE_IDENT || header.version != LIGHT_CACHE_VERSION)
+			Sys_Printf("%s is from another version, relighting everything\n", cachePath);
+		else if(CompareLightCacheKeys(&header.settings, &cacheSettings))
+			Sys_Printf("Light settings changed since %s was written, relighting everything\n", cachePath);
+		else
+		{
+			/* index the entries */
+			oldEntries = safe_malloc((header.numEntries + 1) * sizeof(*oldEntries));
+			offset = sizeof(header);
+			for(i = 0; i < header.numEntries; i++)
+			{
+				if(offset + (int)sizeof(*entry) > size)
+					break;
+				entry = (lightCacheEntry_t *) (oldCache + offset);
+				if(entry->size < 0 || offset + (int)sizeof(*entry) + entry->size > size)
+					break;
+				oldEntries[numOldEntries++] = entry;
+				offset += sizeof(*entry) + entry->size;
+			}
+			if(i < header.numEntries)
+				Sys_Printf("WARNING: %s is truncated, using the first %d lightmaps\n", cachePath, numOldEntries);
+			qsort(oldEntries, numOldEntries, sizeof(*oldEntries), CompareLightCacheEntries);
+		}
+	}
+	Sys_Printf("%9d cached lightmaps in %s\n", numOldEntries, cachePath);
+
+	/* start the new cache, it replaces the old one once lighting is done */
+	if(snprintf(tempPath, sizeof(tempPath), "%s.tmp", cachePath) >= (int)sizeof(tempPath))
+	{
+		Sys_Printf("WARNING: %s is too long to write a new light cache next to it\n", cachePath);
+		return;
+	}
+	newCache = SafeOpenWrite(tempPath);
+	memset(&header, 0, sizeof(header));
+	SafeWrite(newCache, &header, sizeof(header));
+	numNewEntries = 0;
+	numCacheHits = 0;
+}
+
+
+
+/*
+LightCacheKeyForRawLightmap()
+keys the inputs of IlluminateRawLightmap() for a raw lightmap and its culled light list.
+cluster numbers and pvs envelopes change all over the map on every bsp compile and only cull
+lights that are occluded anyway, so they are left out
+*/
+
+void LightCacheKeyForRawLightmap(rawLightmap_t * lm, trace_t * trace, lightCacheKey_t * key)
+{
+	int             i, size, cluster;
+	vec3_t          mins, maxs, offset;
+	surfaceInfo_t  *info;
+	light_t        *light;
+	lightCacheKey_t region;
+
+
+	/* settings and pass */
+	*key = cacheSettings;
+	HashLightCacheData(key, &skyboxOccluders, sizeof(skyboxOccluders));
+	HashLightCacheData(key, &bouncing, sizeof(bouncing));
+	if(bouncing)
+		HashLightCacheData(key, &bounce, sizeof(bounce));
+	if(debugSurfaces)
+	{
+		i = lm - rawLightmaps;
+		HashLightCacheData(key, &i, sizeof(i));
+	}
+
+	/* lightmap */
+	HashLightCacheData(key, &lm->splotchFix, sizeof(lm->splotchFix));
+	HashLightCacheData(key, &lm->filterRadius, sizeof(lm->filterRadius));
+	HashLightCacheData(key, &lm->sampleSize, sizeof(lm->sampleSize));
+	HashLightCacheData(key, &lm->actualSampleSize, sizeof(lm->actualSampleSize));
+	HashLightCacheData(key, &lm->floodlightDirectionScale, sizeof(lm->floodlightDirectionScale));
+	HashLightCacheData(key, lm->floodlightRGB, sizeof(lm->floodlightRGB));
+	HashLightCacheData(key, &lm->floodlightIntensity, sizeof(lm->floodlightIntensity));
+	HashLightCacheData(key, &lm->floodlightDistance, sizeof(lm->floodlightDistance));
+	HashLightCacheData(key, &lm->recvShadows, sizeof(lm->recvShadows));
+	HashLightCacheData(key, lm->mins, sizeof(lm->mins));
+	HashLightCacheData(key, lm->maxs, sizeof(lm->maxs));
+	HashLightCacheData(key, lm->axis, sizeof(lm->axis));
+	if(lm->plane != NULL)
+		HashLightCacheData(key, lm->plane, 4 * sizeof(float));
+	HashLightCacheData(key, &lm->w, sizeof(lm->w));
+	HashLightCacheData(key, &lm->h, sizeof(lm->h));
+	HashLightCacheData(key, &lm->sw, sizeof(lm->sw));
+	HashLightCacheData(key, &lm->sh, sizeof(lm->sh));
+	HashLightCacheData(key, lm->styles, sizeof(lm->styles));
+
+	/* luxels */
+	size = lm->sw * lm->sh;
+	HashLightCacheData(key, lm->superOrigins, size * SUPER_ORIGIN_SIZE * sizeof(float));
+	HashLightCacheData(key, lm->superNormals, size * SUPER_NORMAL_SIZE * sizeof(float));
+	if(lm->superFloodLight != NULL)
+		HashLightCacheData(key, lm->superFloodLight, size * SUPER_FLOODLIGHT_SIZE * sizeof(float));
+	for(i = 0; i < size; i++)
+	{
+		cluster = lm->superClusters[i] < 0 ? lm->superClusters[i] : 0;
+		HashLightCacheData(key, &cluster, sizeof(cluster));
+	}
+
+	/* surfaces */
+	for(i = 0; i < lm->numLightSurfaces; i++)
+	{
+		info = &surfaceInfos[lightSurfaces[lm->firstLightSurface + i]];
+		HashLightCacheString(key, info->si->shader);
+		HashLightCacheData(key, &info->castShadows, sizeof(info->castShadows));
+		HashLightCacheData(key, &info->recvShadows, sizeof(info->recvShadows));
+		HashLightCacheData(key, &info->sampleSize, sizeof(info->sampleSize));
+	}
+
+	/* lights */
+	for(i = 0; i < trace->numLights; i++)
+	{
+		light = trace->lights[i];
+
+		HashLightCacheData(key, &light->type, sizeof(light->type));
+		HashLightCacheData(key, &light->flags, sizeof(light->flags));
+		if(light->si != NULL)
+			HashLightCacheString(key, light->si->shader);
+		HashLightCacheData(key, light->origin, sizeof(light->origin));
+		HashLightCacheData(key, light->radius, sizeof(light->radius));
+		HashLightCacheData(key, light->normal, sizeof(light->normal));
+		HashLightCacheData(key, &light->dist, sizeof(light->dist));
+		HashLightCacheData(key, &light->photons, sizeof(light->photons));
+		HashLightCacheData(key, &light->style, sizeof(light->style));
+		HashLightCacheData(key, light->color, sizeof(light->color));
+		HashLightCacheData(key, &light->radiusByDist, sizeof(light->radiusByDist));
+		HashLightCacheData(key, &light->fade, sizeof(light->fade));
+		HashLightCacheData(key, &light->angleScale, sizeof(light->angleScale));
+		HashLightCacheData(key, &light->extraDist, sizeof(light->extraDist));
+		HashLightCacheData(key, &light->add, sizeof(light->add));
+		HashLightCacheData(key, &light->envelope, sizeof(light->envelope));
+		HashLightCacheData(key, light->emitColor, sizeof(light->emitColor));
+		HashLightCacheData(key, &light->falloffTolerance, sizeof(light->falloffTolerance));
+		HashLightCacheData(key, &light->filterRadius, sizeof(light->filterRadius));
+		if(light->w != NULL)
+			HashLightCacheData(key, light->w->p, light->w->numpoints * sizeof(vec3_t));
+
+		/* the occluders between the lightmap and the light */
+		VectorSet(offset, LIGHT_CACHE_REGION_EPSILON, LIGHT_CACHE_REGION_EPSILON, LIGHT_CACHE_REGION_EPSILON);
+		VectorSubtract(lm->mins, offset, mins);
+		VectorAdd(lm->maxs, offset, maxs);
+		if(light->type == EMIT_SUN)
+		{
+			/* sun traces end at sample + light origin */
+			VectorAdd(lm->mins, light->origin, offset);
+			AddPointToBounds(offset, mins, maxs);
+			VectorAdd(lm->maxs, light->origin, offset);
+			AddPointToBounds(offset, mins, maxs);
+		}
+		else
+		{
+			AddPointToBounds(light->origin, mins, maxs);
+			if(light->w != NULL)
+			{
+				for(size = 0; size < light->w->numpoints; size++)
+					AddPointToBounds(light->w->p[size], mins, maxs);
+			}
+		}
+		LightCacheOccludersForBounds(mins, maxs, &region);
+		HashLightCacheData(key, &region, sizeof(region));
+	}
+}
+
+
+
+/*
+WriteLightCacheEntry()
+appends an entry and its luxel data to the new cache
+*/
+
+static void WriteLightCacheEntry(rawLightmap_t * lm, lightCacheEntry_t * entry)
+{
+	int             i, size;
+
+
+	size = lm->sw * lm->sh;
+
+	ThreadLock();
+	SafeWrite(newCache, entry, sizeof(*entry));
+	for(i = 0; i < MAX_LIGHTMAPS; i++)
+	{
+		if(entry->flags & (1 << i))
+			SafeWrite(newCache, lm->superLuxels[i], size * SUPER_LUXEL_SIZE * sizeof(float));
+	}
+	if(entry->flags & LCF_DELUXELS)
+		SafeWrite(newCache, lm->superDeluxels, size * SUPER_DELUXEL_SIZE * sizeof(float));
+	SafeWrite(newCache, lm->superClusters, size * sizeof(int));
+	numNewEntries++;
+	ThreadUnlock();
+}
+
+
+
+/*
+LoadCachedRawLightmap()
+restores the luxels of a raw lightmap from the previous cache, returns qfalse if it has to be lit
+*/
+
+qboolean LoadCachedRawLightmap(rawLightmap_t * lm, lightCacheKey_t * key)
+{
+	int             i, size, dataSize;
+	lightCacheEntry_t search, *searchPtr, **found, *entry;
+	byte           *data;
+
+
+	/* find it */
+	if(numOldEntries <= 0)
+		return qfalse;
+	search.key = *key;
+	searchPtr = &search;
+	found = bsearch(&searchPtr, oldEntries, numOldEntries, sizeof(*oldEntries), CompareLightCacheEntries);
+	if(found == NULL)
+		return qfalse;
+	entry = *found;
+
+	/* make sure it fits */
+	size = lm->sw * lm->sh;
+	dataSize = size * sizeof(int);
+	for(i = 0; i < MAX_LIGHTMAPS; i++)
+	{
+		if(entry->flags & (1 << i))
+			dataSize += size * SUPER_LUXEL_SIZE * sizeof(float);
+	}
+	if(entry->flags & LCF_DELUXELS)
+		dataSize += size * SUPER_DELUXEL_SIZE * sizeof(float);
+	if(entry->sw != lm->sw || entry->sh != lm->sh || entry->size != dataSize ||
+	   ((entry->flags & LCF_DELUXELS) != 0) != (lm->superDeluxels != NULL))
+		return qfalse;
+
+	/* copy the luxels */
+	data = (byte *) (entry + 1);
+	for(i = 0; i < MAX_LIGHTMAPS; i++)
+	{
+		if(entry->flags & (1 << i))
+		{
+			if(lm->superLuxels[i] == NULL)
+				lm->superLuxels[i] = safe_malloc(size * SUPER_LUXEL_SIZE * sizeof(float));
+			memcpy(lm->superLuxels[i], data, size * SUPER_LUXEL_SIZE * sizeof(float));
+			data += size * SUPER_LUXEL_SIZE * sizeof(float);
+		}
+		else if(lm->superLuxels[i] != NULL)
+			memset(lm->superLuxels[i], 0, size * SUPER_LUXEL_SIZE * sizeof(float));
+	}
+	if(entry->flags & LCF_DELUXELS)
+	{
+		memcpy(lm->superDeluxels, data, size * SUPER_DELUXEL_SIZE * sizeof(float));
+		data += size * SUPER_DELUXEL_SIZE * sizeof(float);
+	}
+	memcpy(lm->superClusters, data, size * sizeof(int));
+	memcpy(lm->styles, entry->styles, sizeof(lm->styles));
+
+	/* carry it over */
+	WriteLightCacheEntry(lm, entry);
+	ThreadLock();
+	numCacheHits++;
+	ThreadUnlock();
+	return qtrue;
+}
+
+
+
+/*
+StoreCachedRawLightmap()
+saves the luxels of a freshly lit raw lightmap
+*/
+
+void StoreCachedRawLightmap(rawLightmap_t * lm, lightCacheKey_t * key)
+{
+	int             i, size;
+	lightCacheEntry_t entry;
+
+
+	/* dummy check */
+	if(newCache == NULL)
+		return;
+
+	memset(&entry, 0, sizeof(entry));
+	entry.key = *key;
+	entry.sw = lm->sw;
+	entry.sh = lm->sh;
+	memcpy(entry.styles, lm->styles, sizeof(entry.styles));
+
+	size = lm->sw * lm->sh;
+	entry.size = size * sizeof(int);
+	for(i = 0; i < MAX_LIGHTMAPS; i++)
+	{
+		if(lm->superLuxels[i] != NULL)
+		{
+			entry.flags |= (1 << i);
+			entry.size += size * SUPER_LUXEL_SIZE * sizeof(float);
+		}
+	}
+	if(lm->superDeluxels != NULL)
+	{
+		entry.flags |= LCF_DELUXELS;
+		entry.size += size * SUPER_DELUXEL_SIZE * sizeof(float);
+	}
+
+	WriteLightCacheEntry(lm, &entry);
+}
+
+
+
+/*
+FinishLightCache()
+replaces the previous cache with the lightmaps of this run
+*/
+
+void FinishLightCache(void)
+{
+	char            tempPath[1024];
+	lightCacheHeader_t header;
+
+
+	/* dummy check */
+	if(newCache == NULL)
+		return;
+
+	/* finish the header */
+	memset(&header, 0, sizeof(header));
+	header.ident = LIGHT_CACHE_IDENT;
+	header.version = LIGHT_CACHE_VERSION;
+	header.settings = cacheSettings;
+	header.numEntries = numNewEntries;
+	fseek(newCache, 0, SEEK_SET);
+	SafeWrite(newCache, &header, sizeof(header));
+	fclose(newCache);
+	newCache = NULL;
+
+	/* swap it in, SetupLightCache() made sure the name fits */
+	if(snprintf(tempPath, sizeof(tempPath), "%s.tmp", cachePath) >= (int)sizeof(tempPath))
+		Error("FinishLightCache: %s is too long", cachePath);
+	remove(cachePath);
+	if(rename(tempPath, cachePath))
+		Sys_Printf("WARNING: Unable to rename %s to %s\n", tempPath, cachePath);
+
+	/* emit some stats */
+	Sys_Printf("%9d lightmaps reused from %s\n", numCacheHits, cachePath);
+	Sys_Printf("%9d lightmaps written to %s\n", numNewEntries, cachePath);
+
+	/* free the previous cache */
+	free(oldCache);
+	oldCache = NULL;
+	free(oldEntries);
+	oldEntries = NULL;
+	numOldEntries = 0;
+	free(occluderGrid);
+	occluderGrid = NULL;
+}
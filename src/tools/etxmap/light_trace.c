@@ -59,6 +59,22 @@ several games based on the Quake III Arena engine, in the form of "Q3Map2."
 #define TRACE_LEAF				-1
 #define TRACE_LEAF_SOLID		-2
 
+/* test a packet of rays against each triangle with SSE, only where the scalar float math
+   is SSE too so the packet prefilter rounds exactly like TraceTriangle() */
+#if !defined(C_ONLY) && !defined(DOUBLEVEC_T) && (defined(__SSE_MATH__) || defined(_M_X64)) && !defined(__FMA__)
+#define TRACE_PACKET_SSE
+#include <xmmintrin.h>
+#endif
+
+#define GROW_BVH_NODES			65536
+#define BVH_BINS				16
+#define BVH_MAX_LEAF_ITEMS		4
+#define BVH_MAX_DEPTH			64
+#define BVH_TRAVERSAL_COST		1.0f	/* relative to one triangle test */
+
+#define MAX_PACKET_MASKS		8192	/* per packet, nodes that don't fit are traced scalar */
+#define MAX_PACKET_NODE_HASH	(TRACE_PACKET_SIZE * MAX_TRACE_TEST_NODES * 2)
+
 typedef struct traceVert_s
 {
 	vec3_t          xyz;
@@ -100,6 +116,16 @@ typedef struct traceNode_s
 }
 traceNode_t;
 
+typedef struct traceBVHNode_s
+{
+	vec3_t          mins, maxs;
+	int             numItems;	/* 0 for interior nodes */
+	int             first;		/* first bvhItems entry of a leaf, second child of an interior node (the first child follows it) */
+	int             axis;		/* split axis, so children can be visited front to back */
+	int             pad;
+}
+traceBVHNode_t;
+
 
 int             noDrawContentFlags, noDrawSurfaceFlags, noDrawCompileFlags;
 
@@ -116,6 +142,10 @@ int             headNodeNum = 0, skyboxNodeNum = 0, maxTraceDepth = 0, numTraceL
 int             numTraceNodes = 0, maxTraceNodes = 0;
 traceNode_t    *traceNodes = NULL;
 
+int             numBVHNodes = 0, maxBVHNodes = 0, numBVHItems = 0, maxBVHDepth = 0;
+traceBVHNode_t *bvhNodes = NULL;
+int            *bvhItems = NULL;
+
 
 
 /* -------------------------------------------------------------------------------
@@ -530,6 +560,43 @@ void ClipTraceWinding(traceWinding_t * tw, vec4_t plane, traceWinding_t * front,
 
 
 
+/*
+AddTraceWindingToLightCache()
+keys a shadow casting winding for -lightcache by its verts and how it is traced
+*/
+
+static void AddTraceWindingToLightCache(traceWinding_t * tw, qboolean skybox)
+{
+	int             i;
+	vec3_t          mins, maxs;
+	traceInfo_t    *ti;
+	lightCacheKey_t key;
+
+
+	/* key the shader */
+	ti = &traceInfos[tw->infoNum];
+	ClearLightCacheKey(&key);
+	HashLightCacheString(&key, ti->si->shader);
+	HashLightCacheData(&key, &ti->si->compileFlags, sizeof(ti->si->compileFlags));
+	if(ti->si->lightImage != NULL)
+		HashLightCacheString(&key, ti->si->lightImage->name);
+	HashLightCacheData(&key, &ti->castShadows, sizeof(ti->castShadows));
+	HashLightCacheData(&key, &ti->skipGrid, sizeof(ti->skipGrid));
+
+	/* key the verts */
+	ClearBounds(mins, maxs);
+	for(i = 0; i < tw->numVerts; i++)
+	{
+		HashLightCacheData(&key, &tw->v[i], sizeof(tw->v[i]));
+		AddPointToBounds(tw->v[i].xyz, mins, maxs);
+	}
+
+	/* skybox geometry isn't in world space */
+	AddLightCacheOccluder(skybox ? NULL : mins, maxs, &key);
+}
+
+
+
 /*
 FilterTraceWindingIntoNodes_r() - ydnar
 filters a trace winding into the raytracing tree
@@ -547,6 +614,10 @@ static void FilterTraceWindingIntoNodes_r(traceWinding_t * tw, int nodeNum)
 	if(nodeNum < 0 || nodeNum >= numTraceNodes)
 		return;
 
+	/* key the occluders of the world and skybox as they come in */
+	if(lightCache && (nodeNum == headNodeNum || nodeNum == skyboxNodeNum))
+		AddTraceWindingToLightCache(tw, nodeNum == skyboxNodeNum);
+
 	/* get node */
 	node = &traceNodes[nodeNum];
 
@@ -1278,6 +1349,314 @@ trace initialization
 
 ------------------------------------------------------------------------------- */
 
+/*
+bounding volume hierarchy (-bvh)
+the bvh is an alternative to subdividing the trace nodes: the trace node tree is left as the
+bare bsp (still used for solid tests), and the triangles of all its leaves go into one bvh
+built with a binned surface area heuristic. dense model geometry that runs the subdivided
+tree into its depth and size limits stays cheap to trace.
+*/
+
+#define BVH_BOUNDS_EPSILON		0.5f
+#define BVH_BARY_SLACK			0.05f	/* TraceTriangle() accepts hits up to BARY_EPSILON outside the edges */
+
+typedef struct bvhRef_s
+{
+	vec3_t          mins, maxs, center;
+	int             num;
+}
+bvhRef_t;
+
+
+
+/*
+AllocBVHNode()
+allocates a bvh node
+*/
+
+static int AllocBVHNode(void)
+{
+	traceBVHNode_t *temp;
+
+
+	/* enough space? */
+	if(numBVHNodes >= maxBVHNodes)
+	{
+		/* reallocate more room */
+		maxBVHNodes += GROW_BVH_NODES;
+		temp = safe_malloc(maxBVHNodes * sizeof(traceBVHNode_t));
+		if(bvhNodes != NULL)
+		{
+			memcpy(temp, bvhNodes, numBVHNodes * sizeof(traceBVHNode_t));
+			free(bvhNodes);
+		}
+		bvhNodes = temp;
+	}
+
+	/* add the node */
+	memset(&bvhNodes[numBVHNodes], 0, sizeof(traceBVHNode_t));
+	numBVHNodes++;
+
+	/* return the count */
+	return (numBVHNodes - 1);
+}
+
+
+
+/*
+CollectBVHRefs_r()
+gathers the triangles of all leaves below a trace node, with bounds that cover everything
+TraceTriangle() can hit
+*/
+
+static void CollectBVHRefs_r(int nodeNum, bvhRef_t * refs, int *numRefs)
+{
+	int             i, j;
+	float           expand, length;
+	traceNode_t    *node;
+	traceTriangle_t *tt;
+	bvhRef_t       *ref;
+
+
+	/* dummy check */
+	if(nodeNum < 0 || nodeNum >= numTraceNodes)
+		return;
+
+	/* get node */
+	node = &traceNodes[nodeNum];
+
+	/* is this a decision node? */
+	if(node->type >= 0)
+	{
+		CollectBVHRefs_r(node->children[0], refs, numRefs);
+		CollectBVHRefs_r(node->children[1], refs, numRefs);
+		return;
+	}
+
+	/* add the leaf triangles */
+	for(i = 0; i < node->numItems; i++)
+	{
+		tt = &traceTriangles[node->items[i]];
+		ref = &refs[(*numRefs)++];
+		ref->num = node->items[i];
+
+		ClearBounds(ref->mins, ref->maxs);
+		for(j = 0; j < 3; j++)
+			AddPointToBounds(tt->v[j].xyz, ref->mins, ref->maxs);
+
+		expand = VectorLength(tt->edge1);
+		length = VectorLength(tt->edge2);
+		if(length > expand)
+			expand = length;
+		expand = expand * BVH_BARY_SLACK + BVH_BOUNDS_EPSILON;
+
+		for(j = 0; j < 3; j++)
+		{
+			ref->mins[j] -= expand;
+			ref->maxs[j] += expand;
+			ref->center[j] = 0.5f * (ref->mins[j] + ref->maxs[j]);
+		}
+	}
+}
+
+
+
+/*
+BoundsArea()
+half the surface area of a bounding box
+*/
+
+static float BoundsArea(vec3_t mins, vec3_t maxs)
+{
+	vec3_t          size;
+
+
+	VectorSubtract(maxs, mins, size);
+	if(size[0] < 0.0f || size[1] < 0.0f || size[2] < 0.0f)
+		return 0.0f;
+	return size[0] * size[1] + size[1] * size[2] + size[2] * size[0];
+}
+
+
+
+/*
+BuildTraceBVH_r()
+builds the bvh over a range of triangle refs, splitting at the cheapest of BVH_BINS
+candidate planes along the longest centroid axis, returns the node number
+*/
+
+static int BuildTraceBVH_r(bvhRef_t * refs, int numRefs, int depth)
+{
+	int             i, j, nodeNum, axis, bin, bestBin, numLeft, binCounts[BVH_BINS];
+	float           scale, cost, bestCost, area, leftArea[BVH_BINS];
+	vec3_t          mins, maxs, centerMins, centerMaxs, size, binMins[BVH_BINS], binMaxs[BVH_BINS], tmins, tmaxs;
+	int             leftCount[BVH_BINS];
+	bvhRef_t        temp;
+
+
+	/* allocate the node */
+	nodeNum = AllocBVHNode();
+	if(depth > maxBVHDepth)
+		maxBVHDepth = depth;
+
+	/* bound the refs and their centers */
+	ClearBounds(mins, maxs);
+	ClearBounds(centerMins, centerMaxs);
+	for(i = 0; i < numRefs; i++)
+	{
+		AddPointToBounds(refs[i].mins, mins, maxs);
+		AddPointToBounds(refs[i].maxs, mins, maxs);
+		AddPointToBounds(refs[i].center, centerMins, centerMaxs);
+	}
+	VectorCopy(mins, bvhNodes[nodeNum].mins);
+	VectorCopy(maxs, bvhNodes[nodeNum].maxs);
+
+	/* split along the longest center axis */
+	VectorSubtract(centerMaxs, centerMins, size);
+	if(size[0] >= size[1] && size[0] >= size[2])
+		axis = 0;
+	else if(size[1] >= size[0] && size[1] >= size[2])
+		axis = 1;
+	else
+		axis = 2;
+
+	/* small enough, too deep or nothing to split? */
+	bestBin = -1;
+	if(numRefs > BVH_MAX_LEAF_ITEMS && depth < BVH_MAX_DEPTH && size[axis] > 0.0f)
+	{
+		/* bin the refs */
+		scale = BVH_BINS / size[axis];
+		for(i = 0; i < BVH_BINS; i++)
+		{
+			binCounts[i] = 0;
+			ClearBounds(binMins[i], binMaxs[i]);
+		}
+		for(i = 0; i < numRefs; i++)
+		{
+			bin = (int)((refs[i].center[axis] - centerMins[axis]) * scale);
+			if(bin >= BVH_BINS)
+				bin = BVH_BINS - 1;
+			binCounts[bin]++;
+			AddPointToBounds(refs[i].mins, binMins[bin], binMaxs[bin]);
+			AddPointToBounds(refs[i].maxs, binMins[bin], binMaxs[bin]);
+		}
+
+		/* sweep from the left */
+		ClearBounds(tmins, tmaxs);
+		for(i = 0, j = 0; i < BVH_BINS - 1; i++)
+		{
+			j += binCounts[i];
+			if(binCounts[i])
+			{
+				AddPointToBounds(binMins[i], tmins, tmaxs);
+				AddPointToBounds(binMaxs[i], tmins, tmaxs);
+			}
+			leftCount[i] = j;
+			leftArea[i] = BoundsArea(tmins, tmaxs);
+		}
+
+		/* sweep from the right, evaluating the split after bin i */
+		area = BoundsArea(mins, maxs);
+		bestCost = numRefs;
+		ClearBounds(tmins, tmaxs);
+		for(i = BVH_BINS - 1; i > 0; i--)
+		{
+			if(binCounts[i])
+			{
+				AddPointToBounds(binMins[i], tmins, tmaxs);
+				AddPointToBounds(binMaxs[i], tmins, tmaxs);
+			}
+			if(leftCount[i - 1] == 0 || leftCount[i - 1] == numRefs)
+				continue;
+
+			cost = BVH_TRAVERSAL_COST;
+			if(area > 0.0f)
+				cost += (leftArea[i - 1] * leftCount[i - 1] + BoundsArea(tmins, tmaxs) * (numRefs - leftCount[i - 1])) / area;
+			if(cost < bestCost)
+			{
+				bestCost = cost;
+				bestBin = i;
+			}
+		}
+
+		/* big leaves are slower than a poor split */
+		if(bestBin < 0 && numRefs > BVH_MAX_LEAF_ITEMS * 4)
+			bestBin = BVH_BINS / 2;
+	}
+
+	/* partition the refs */
+	numLeft = 0;
+	if(bestBin >= 0)
+	{
+		for(i = 0; i < numRefs; i++)
+		{
+			bin = (int)((refs[i].center[axis] - centerMins[axis]) * scale);
+			if(bin < bestBin)
+			{
+				temp = refs[i];
+				refs[i] = refs[numLeft];
+				refs[numLeft++] = temp;
+			}
+		}
+	}
+
+	/* make a leaf */
+	if(numLeft == 0 || numLeft == numRefs)
+	{
+		bvhNodes[nodeNum].numItems = numRefs;
+		bvhNodes[nodeNum].first = numBVHItems;
+		for(i = 0; i < numRefs; i++)
+			bvhItems[numBVHItems++] = refs[i].num;
+		return nodeNum;
+	}
+
+	/* build the children, the first one right after this node */
+	bvhNodes[nodeNum].axis = axis;
+	BuildTraceBVH_r(refs, numLeft, depth + 1);
+	i = BuildTraceBVH_r(refs + numLeft, numRefs - numLeft, depth + 1);
+	bvhNodes[nodeNum].first = i;
+	return nodeNum;
+}
+
+
+
+/*
+SetupTraceBVH()
+builds the bvh over the triangles in the trace node tree
+*/
+
+static void SetupTraceBVH(void)
+{
+	int             numRefs;
+	bvhRef_t       *refs;
+	clock_t         start;
+
+
+	/* note it */
+	Sys_FPrintf(SYS_VRB, "--- SetupTraceBVH ---\n");
+	start = clock();
+
+	/* gather the world triangles */
+	refs = safe_malloc((numTraceTriangles + 1) * sizeof(*refs));
+	numRefs = 0;
+	CollectBVHRefs_r(headNodeNum, refs, &numRefs);
+
+	/* build it */
+	bvhItems = safe_malloc((numRefs + 1) * sizeof(*bvhItems));
+	numBVHItems = 0;
+	if(numRefs > 0)
+		BuildTraceBVH_r(refs, numRefs, 0);
+	free(refs);
+
+	/* emit some stats */
+	Sys_Printf("%9d bvh nodes (%.2fMB)\n", numBVHNodes,
+			   (float)(numBVHNodes * sizeof(*bvhNodes) + numBVHItems * sizeof(*bvhItems)) / (1024.0f * 1024.0f));
+	Sys_Printf("%9d bvh triangles, %d max bvh depth\n", numBVHItems, maxBVHDepth);
+	Sys_Printf("%9.2f seconds to build the bvh\n", (double)(clock() - start) / CLOCKS_PER_SEC);
+}
+
+
+
 /*
 SetupTraceNodes() - ydnar
 creates a balanced bsp with axis-aligned splits for efficient raytracing
@@ -1285,8 +1664,12 @@ creates a balanced bsp with axis-aligned splits for efficient raytracing
 
 void SetupTraceNodes(void)
 {
+	clock_t         start;
+
+
 	/* note it */
 	Sys_FPrintf(SYS_VRB, "--- SetupTraceNodes ---\n");
+	start = clock();
 
 	/* find nodraw bit */
 	noDrawContentFlags = noDrawSurfaceFlags = noDrawCompileFlags = 0;
@@ -1301,10 +1684,10 @@ void SetupTraceNodes(void)
 	/* populate the tree with triangles from the world and shadow casting entities */
 	PopulateTraceNodes();
 
-	/* create the raytracing bsp */
+	/* create the raytracing bsp (the bvh replaces it) */
 #if 1
 	// Tr3B: this requires ridiculous much memory
-	if(loMem == qfalse)
+	if(loMem == qfalse && !traceBVH)
 	{
 		SubdivideTraceNode_r(headNodeNum, 0);
 		SubdivideTraceNode_r(skyboxNodeNum, 0);
@@ -1315,6 +1698,14 @@ void SetupTraceNodes(void)
 	TriangulateTraceNode_r(headNodeNum);
 	TriangulateTraceNode_r(skyboxNodeNum);
 
+	/* build the bvh */
+	if(traceBVH)
+		SetupTraceBVH();
+
+	/* all occluders are in, sum up the light cache's grid */
+	if(lightCache)
+		FinishLightCacheOccluders();
+
 	/* emit some stats */
 	//% Sys_FPrintf( SYS_VRB, "%9d original triangles\n", numOriginalTriangles );
 	Sys_FPrintf(SYS_VRB, "%9d trace windings (%.2fMB)\n", numTraceWindings,
@@ -1328,6 +1719,10 @@ void SetupTraceNodes(void)
 	//% Sys_FPrintf( SYS_VRB, "%9d average triangles per leaf node\n", numTraceTriangles / numTraceLeafNodes );
 	Sys_FPrintf(SYS_VRB, "%9d average windings per leaf node\n", numTraceWindings / (numTraceLeafNodes + 1));
 	Sys_FPrintf(SYS_VRB, "%9d max trace depth\n", maxTraceDepth);
+	Sys_Printf("%9.2f seconds to set up %s tracing (%.2fMB)\n", (double)(clock() - start) / CLOCKS_PER_SEC,
+			   traceBVH ? "bvh" : "trace node",
+			   (float)(numTraceNodes * sizeof(*traceNodes) + numTraceTriangles * sizeof(*traceTriangles) +
+					   numBVHNodes * sizeof(*bvhNodes) + numBVHItems * sizeof(*bvhItems)) / (1024.0f * 1024.0f));
 
 	/* free trace windings */
 	free(traceWindings);
@@ -1610,6 +2005,7 @@ static qboolean TraceLine_r(int nodeNum, vec3_t origin, vec3_t end, trace_t * tr
 
 	/* get node */
 	node = &traceNodes[nodeNum];
+	trace->numTraversed++;
 
 	/* solid? */
 	if(node->type == TRACE_LEAF_SOLID)
@@ -1690,39 +2086,36 @@ static qboolean TraceLine_r(int nodeNum, vec3_t origin, vec3_t end, trace_t * tr
 
 
 /*
-TraceLine() - ydnar
-rewrote this function a bit :)
+TraceLineNodes()
+sets up the trace output and finds the leaf nodes the trace passes through,
+returns qtrue if the items in trace->testNodes still have to be tested
 */
 
-void TraceLine(trace_t * trace)
+static qboolean TraceLineNodes(trace_t * trace)
 {
-	int             i, j;
-	traceNode_t    *node;
-	traceTriangle_t *tt;
-	traceInfo_t    *ti;
-
-
 	/* setup output (note: this code assumes the input data is completely filled out) */
 	trace->passSolid = qfalse;
 	trace->opaque = qfalse;
 	trace->compileFlags = 0;
 	trace->numTestNodes = 0;
+	trace->numTraversed = 0;
+	trace->numTested = 0;
 
 	/* early outs */
 	if(!trace->recvShadows || !trace->testOcclusion || trace->distance <= 0.00001f)
-		return;
+		return qfalse;
 
 	/* trace through nodes */
 	TraceLine_r(headNodeNum, trace->origin, trace->end, trace);
 	if(trace->passSolid && !trace->testAll)
 	{
 		trace->opaque = qtrue;
-		return;
+		return qfalse;
 	}
 
 	/* skip surfaces? */
 	if(noSurfaces)
-		return;
+		return qfalse;
 
 	/* testall means trace through sky */
 	if(trace->testAll && trace->numTestNodes < MAX_TRACE_TEST_NODES &&
@@ -1732,10 +2125,162 @@ void TraceLine(trace_t * trace)
 		TraceLine_r(skyboxNodeNum, trace->origin, trace->end, trace);
 	}
 
+	return trace->numTestNodes > 0;
+}
+
+
+
+/*
+RayHitsBVHNode()
+slab test of the trace segment against a bvh node's bounds
+*/
+
+static qboolean RayHitsBVHNode(traceBVHNode_t * node, vec3_t origin, vec3_t invDirection, float distance)
+{
+	int             i;
+	float           t0, t1, temp, tmin, tmax;
+
+
+	tmin = 0.0f;
+	tmax = distance;
+	for(i = 0; i < 3; i++)
+	{
+		t0 = (node->mins[i] - origin[i]) * invDirection[i];
+		t1 = (node->maxs[i] - origin[i]) * invDirection[i];
+		if(t0 > t1)
+		{
+			temp = t0;
+			t0 = t1;
+			t1 = temp;
+		}
+		if(t0 > tmin)
+			tmin = t0;
+		if(t1 < tmax)
+			tmax = t1;
+		if(tmin > tmax)
+			return qfalse;
+	}
+	return qtrue;
+}
+
+
+
+/*
+TraceBVHItems()
+tests the world triangles in the bvh, nearest child first, until one stops the trace.
+returns qtrue if the trace was stopped
+*/
+
+static qboolean TraceBVHItems(trace_t * trace)
+{
+	int             i, nodeNum, numStack, stack[BVH_MAX_DEPTH + 1];
+	float           distance;
+	vec3_t          invDirection, delta;
+	traceBVHNode_t *node;
+	traceTriangle_t *tt;
+	qboolean        r;
+
+
+	/* empty? */
+	if(numBVHNodes <= 0)
+		return qfalse;
+
+	/* tiny direction components get a huge but finite inverse so the slab test never sees a nan */
+	for(i = 0; i < 3; i++)
+	{
+		if(fabs(trace->direction[i]) > 1e-20f)
+			invDirection[i] = 1.0f / trace->direction[i];
+		else
+			invDirection[i] = trace->direction[i] < 0.0f ? -1e20f : 1e20f;
+	}
+
+	/* testall traces stop at the first solid leaf, so don't test triangles past it */
+	distance = trace->distance;
+	if(trace->passSolid)
+	{
+		VectorSubtract(trace->hit, trace->origin, delta);
+		trace->distance = VectorLength(delta) + TRACE_ON_EPSILON;
+		if(trace->distance > distance)
+			trace->distance = distance;
+	}
+
+	/* walk the tree */
+	r = qfalse;
+	nodeNum = 0;
+	numStack = 0;
+	for(;;)
+	{
+		node = &bvhNodes[nodeNum];
+		trace->numTraversed++;
+		if(RayHitsBVHNode(node, trace->origin, invDirection, trace->distance))
+		{
+			/* interior node, visit the near child first */
+			if(node->numItems == 0)
+			{
+				if(trace->direction[node->axis] < 0.0f)
+				{
+					stack[numStack++] = nodeNum + 1;
+					nodeNum = node->first;
+				}
+				else
+				{
+					stack[numStack++] = node->first;
+					nodeNum++;
+				}
+				continue;
+			}
+
+			/* test the leaf triangles */
+			for(i = 0; i < node->numItems; i++)
+			{
+				tt = &traceTriangles[bvhItems[node->first + i]];
+				trace->numTested++;
+				if(TraceTriangle(&traceInfos[tt->infoNum], tt, trace))
+				{
+					r = qtrue;
+					break;
+				}
+			}
+			if(r)
+				break;
+		}
+
+		/* pop */
+		if(numStack == 0)
+			break;
+		nodeNum = stack[--numStack];
+	}
+
+	/* restore and return */
+	trace->distance = distance;
+	return r;
+}
+
+
+
+/*
+TraceLineItems()
+tests the items of the leaf nodes found by TraceLineNodes(), in order, until one stops the trace
+*/
+
+static void TraceLineItems(trace_t * trace)
+{
+	int             i, j;
+	traceNode_t    *node;
+	traceTriangle_t *tt;
+	traceInfo_t    *ti;
+
+
+	/* the bvh holds the world triangles, leaving only the skybox in the node list */
+	if(traceBVH && TraceBVHItems(trace))
+		return;
+
 	/* walk node list */
 	for(i = 0; i < trace->numTestNodes; i++)
 	{
 		/* get node */
+		if(traceBVH && trace->testNodes[i] != skyboxNodeNum)
+			continue;
 		node = &traceNodes[trace->testNodes[i]];
 
 		/* walk node item list */
@@ -1743,6 +2288,7 @@ void TraceLine(trace_t * trace)
 		{
 			tt = &traceTriangles[node->items[j]];
 			ti = &traceInfos[tt->infoNum];
+			trace->numTested++;
 			if(TraceTriangle(ti, tt, trace))
 				return;
 			//% if( TraceWinding( &traceWindings[ node->items[ j ] ], trace ) )
@@ -1753,6 +2299,273 @@ void TraceLine(trace_t * trace)
 
 
 
+/*
+TraceLine() - ydnar
+rewrote this function a bit :)
+*/
+
+void TraceLine(trace_t * trace)
+{
+	if(TraceLineNodes(trace))
+		TraceLineItems(trace);
+}
+
+
+
+#ifdef TRACE_PACKET_SSE
+
+/*
+tracePacket_t
+structure of arrays copy of up to four rays, plus the per leaf node hit masks
+*/
+
+typedef struct tracePacket_s
+{
+	__m128          origin[3], direction[3];
+	__m128          inhibitRadius, distance;
+
+	int             hashSize;
+	int             hashNodes[MAX_PACKET_NODE_HASH];
+	int             hashMasks[MAX_PACKET_NODE_HASH];
+
+	int             numMasks;
+	byte            masks[MAX_PACKET_MASKS];
+}
+tracePacket_t;
+
+
+
+/*
+TracePacketTriangles()
+runs the geometric part of TraceTriangle() for all rays of the packet against every
+item of a node, setting bit n of masks[ item ] if ray n may hit it. every lane does the
+same float operations in the same order as the scalar code, so a clear bit means
+TraceTriangle() would have returned qfalse without touching the trace.
+*/
+
+static void TracePacketTriangles(tracePacket_t * packet, traceNode_t * node, byte * masks)
+{
+	int             i;
+	traceTriangle_t *tt;
+	__m128          e1[3], e2[3], pvec[3], tvec[3], qvec[3];
+	__m128          det, invDet, u, v, depth, reject;
+
+
+	for(i = 0; i < node->numItems; i++)
+	{
+		tt = &traceTriangles[node->items[i]];
+
+		e1[0] = _mm_set1_ps(tt->edge1[0]);
+		e1[1] = _mm_set1_ps(tt->edge1[1]);
+		e1[2] = _mm_set1_ps(tt->edge1[2]);
+		e2[0] = _mm_set1_ps(tt->edge2[0]);
+		e2[1] = _mm_set1_ps(tt->edge2[1]);
+		e2[2] = _mm_set1_ps(tt->edge2[2]);
+
+		/* CrossProduct( trace->direction, tt->edge2, pvec ) */
+		pvec[0] = _mm_sub_ps(_mm_mul_ps(packet->direction[1], e2[2]), _mm_mul_ps(packet->direction[2], e2[1]));
+		pvec[1] = _mm_sub_ps(_mm_mul_ps(packet->direction[2], e2[0]), _mm_mul_ps(packet->direction[0], e2[2]));
+		pvec[2] = _mm_sub_ps(_mm_mul_ps(packet->direction[0], e2[1]), _mm_mul_ps(packet->direction[1], e2[0]));
+
+		/* coplanar */
+		det = _mm_add_ps(_mm_add_ps(_mm_mul_ps(e1[0], pvec[0]), _mm_mul_ps(e1[1], pvec[1])), _mm_mul_ps(e1[2], pvec[2]));
+		reject = _mm_cmplt_ps(_mm_andnot_ps(_mm_set1_ps(-0.0f), det), _mm_set1_ps(COPLANAR_EPSILON));
+		invDet = _mm_div_ps(_mm_set1_ps(1.0f), det);
+
+		/* u */
+		tvec[0] = _mm_sub_ps(packet->origin[0], _mm_set1_ps(tt->v[0].xyz[0]));
+		tvec[1] = _mm_sub_ps(packet->origin[1], _mm_set1_ps(tt->v[0].xyz[1]));
+		tvec[2] = _mm_sub_ps(packet->origin[2], _mm_set1_ps(tt->v[0].xyz[2]));
+		u = _mm_mul_ps(_mm_add_ps(_mm_add_ps(_mm_mul_ps(tvec[0], pvec[0]), _mm_mul_ps(tvec[1], pvec[1])),
+								  _mm_mul_ps(tvec[2], pvec[2])), invDet);
+		reject = _mm_or_ps(reject, _mm_cmplt_ps(u, _mm_set1_ps(-BARY_EPSILON)));
+		reject = _mm_or_ps(reject, _mm_cmpgt_ps(u, _mm_set1_ps(1.0f + BARY_EPSILON)));
+
+		/* CrossProduct( tvec, tt->edge1, qvec ) */
+		qvec[0] = _mm_sub_ps(_mm_mul_ps(tvec[1], e1[2]), _mm_mul_ps(tvec[2], e1[1]));
+		qvec[1] = _mm_sub_ps(_mm_mul_ps(tvec[2], e1[0]), _mm_mul_ps(tvec[0], e1[2]));
+		qvec[2] = _mm_sub_ps(_mm_mul_ps(tvec[0], e1[1]), _mm_mul_ps(tvec[1], e1[0]));
+
+		/* v */
+		v = _mm_mul_ps(_mm_add_ps(_mm_add_ps(_mm_mul_ps(packet->direction[0], qvec[0]), _mm_mul_ps(packet->direction[1], qvec[1])),
+								  _mm_mul_ps(packet->direction[2], qvec[2])), invDet);
+		reject = _mm_or_ps(reject, _mm_cmplt_ps(v, _mm_set1_ps(-BARY_EPSILON)));
+		reject = _mm_or_ps(reject, _mm_cmpgt_ps(_mm_add_ps(u, v), _mm_set1_ps(1.0f + BARY_EPSILON)));
+
+		/* depth */
+		depth = _mm_mul_ps(_mm_add_ps(_mm_add_ps(_mm_mul_ps(e2[0], qvec[0]), _mm_mul_ps(e2[1], qvec[1])),
+									  _mm_mul_ps(e2[2], qvec[2])), invDet);
+		reject = _mm_or_ps(reject, _mm_cmple_ps(depth, packet->inhibitRadius));
+		reject = _mm_or_ps(reject, _mm_cmpge_ps(depth, packet->distance));
+
+		masks[i] = (byte) (~_mm_movemask_ps(reject) & 15);
+	}
+}
+
+
+
+/*
+TracePacketNodeMasks()
+returns the hit masks of a node for the packet, testing it on first use,
+or NULL if there's no room left and the node has to be tested scalar
+*/
+
+static byte    *TracePacketNodeMasks(tracePacket_t * packet, int nodeNum)
+{
+	int             h;
+	traceNode_t    *node;
+
+
+	/* find it */
+	h = (nodeNum * 2654435761u) & (packet->hashSize - 1);
+	while(packet->hashNodes[h] != -1)
+	{
+		if(packet->hashNodes[h] == nodeNum)
+			return packet->hashMasks[h] < 0 ? NULL : &packet->masks[packet->hashMasks[h]];
+		h = (h + 1) & (packet->hashSize - 1);
+	}
+
+	/* test it */
+	node = &traceNodes[nodeNum];
+	packet->hashNodes[h] = nodeNum;
+	if(packet->numMasks + node->numItems > MAX_PACKET_MASKS)
+	{
+		packet->hashMasks[h] = -1;
+		return NULL;
+	}
+	packet->hashMasks[h] = packet->numMasks;
+	packet->numMasks += node->numItems;
+	TracePacketTriangles(packet, node, &packet->masks[packet->hashMasks[h]]);
+	return &packet->masks[packet->hashMasks[h]];
+}
+
+
+
+/*
+TracePacketItems()
+TraceLineItems() for each ray of the packet, skipping the items the packet test ruled out
+*/
+
+static void TracePacketItems(tracePacket_t * packet, trace_t ** traces, int numTraces, int needsItems)
+{
+	int             i, j, k, total, bit;
+	float           lanes[8][TRACE_PACKET_SIZE];
+	trace_t        *trace;
+	traceNode_t    *node;
+	traceTriangle_t *tt;
+	byte           *masks;
+
+
+	/* build the ray lanes, unused lanes get a zero distance so they never hit anything */
+	memset(lanes, 0, sizeof(lanes));
+	total = 0;
+	for(k = 0; k < numTraces; k++)
+	{
+		if(!(needsItems & (1 << k)))
+			continue;
+		trace = traces[k];
+		for(j = 0; j < 3; j++)
+		{
+			lanes[j][k] = trace->origin[j];
+			lanes[3 + j][k] = trace->direction[j];
+		}
+		lanes[6][k] = trace->inhibitRadius;
+		lanes[7][k] = trace->distance;
+		total += trace->numTestNodes;
+	}
+	for(j = 0; j < 3; j++)
+	{
+		packet->origin[j] = _mm_loadu_ps(lanes[j]);
+		packet->direction[j] = _mm_loadu_ps(lanes[3 + j]);
+	}
+	packet->inhibitRadius = _mm_loadu_ps(lanes[6]);
+	packet->distance = _mm_loadu_ps(lanes[7]);
+
+	/* size the node hash for the nodes actually touched */
+	for(packet->hashSize = 16; packet->hashSize < total * 2; packet->hashSize <<= 1);
+	memset(packet->hashNodes, -1, packet->hashSize * sizeof(int));
+	packet->numMasks = 0;
+
+	/* walk each ray's own node list in order, so hits and stacked flags match TraceLine() */
+	for(k = 0; k < numTraces; k++)
+	{
+		if(!(needsItems & (1 << k)))
+			continue;
+		trace = traces[k];
+		bit = 1 << k;
+		for(i = 0; i < trace->numTestNodes; i++)
+		{
+			node = &traceNodes[trace->testNodes[i]];
+			masks = TracePacketNodeMasks(packet, trace->testNodes[i]);
+			for(j = 0; j < node->numItems; j++)
+			{
+				if(masks != NULL && !(masks[j] & bit))
+					continue;
+				tt = &traceTriangles[node->items[j]];
+				trace->numTested++;
+				if(TraceTriangle(&traceInfos[tt->infoNum], tt, trace))
+					break;
+			}
+			if(j < node->numItems)
+				break;
+		}
+	}
+}
+
+#endif
+
+
+
+/*
+TraceLinePacket()
+traces a packet of rays, with the same results as calling TraceLine() on each of them.
+coherent rays (neighbouring luxels, rays from one sample) share most of their leaf nodes,
+so with -raypacket their triangles are tested four rays at a time
+*/
+
+void TraceLinePacket(trace_t ** traces, int numTraces)
+{
+	int             i, k, n, needsItems, numNeedsItems;
+#ifdef TRACE_PACKET_SSE
+	tracePacket_t   packet;
+#endif
+
+
+	for(i = 0; i < numTraces; i += TRACE_PACKET_SIZE)
+	{
+		/* walk the tree for each ray */
+		n = numTraces - i < TRACE_PACKET_SIZE ? numTraces - i : TRACE_PACKET_SIZE;
+		needsItems = 0;
+		numNeedsItems = 0;
+		for(k = 0; k < n; k++)
+		{
+			if(TraceLineNodes(traces[i + k]))
+			{
+				needsItems |= 1 << k;
+				numNeedsItems++;
+			}
+		}
+
+#ifdef TRACE_PACKET_SSE
+		/* test the items as a packet (the bvh is traced one ray at a time) */
+		if(rayPacket && !traceBVH && numNeedsItems > 1)
+		{
+			TracePacketItems(&packet, &traces[i], n, needsItems);
+			continue;
+		}
+#endif
+
+		/* test the items one ray at a time */
+		for(k = 0; k < n; k++)
+		{
+			if(needsItems & (1 << k))
+				TraceLineItems(traces[i + k]);
+		}
+	}
+}
+
+
+
 /*
 SetupTrace() - ydnar
 sets up certain trace values
@@ -1765,3 +2578,149 @@ float SetupTrace(trace_t * trace)
 	VectorCopy(trace->origin, trace->hit);
 	return trace->distance;
 }
+
+
+
+/*
+TraceBenchmark()
+traces packets of coherent rays (neighbouring points to a common end point, like a light
+seen from neighbouring luxels) through the world one ray at a time and as packets,
+reporting the single threaded rays per second (cpu time, I_FloatTime() only has
+whole seconds) of both, the traversal cost per ray and whether their results agree
+*/
+
+#define BENCHMARK_LUXEL_SPACING	4.0f
+
+typedef struct traceResult_s
+{
+	qboolean        opaque, passSolid;
+	int             compileFlags;
+	vec3_t          hit, color;
+}
+traceResult_t;
+
+static void InitBenchmarkTrace(trace_t * trace, vec3_t origin, vec3_t end)
+{
+	trace->testOcclusion = qtrue;
+	trace->forceSunlight = qfalse;
+	trace->testAll = qfalse;
+	trace->recvShadows = WORLDSPAWN_RECV_SHADOWS;
+	trace->numSurfaces = 0;
+	trace->surfaces = NULL;
+	trace->inhibitRadius = DEFAULT_INHIBIT_RADIUS;
+	VectorCopy(origin, trace->origin);
+	VectorCopy(end, trace->end);
+	VectorSet(trace->color, 1.0f, 1.0f, 1.0f);
+	trace->forceSubsampling = 0.0f;
+	SetupTrace(trace);
+}
+
+static void StoreBenchmarkResult(trace_t * trace, traceResult_t * result)
+{
+	memset(result, 0, sizeof(*result));
+	result->opaque = trace->opaque;
+	result->passSolid = trace->passSolid;
+	result->compileFlags = trace->compileFlags;
+	VectorCopy(trace->hit, result->hit);
+	VectorCopy(trace->color, result->color);
+}
+
+void TraceBenchmark(int numPackets)
+{
+	int             i, j, k, numRays, numOpaque, numMismatches;
+	double          numTraversed, numTested;
+	clock_t         start;
+	double          singleTime, packetTime;
+	float          *origins, *ends;
+	qboolean        oldRayPacket;
+	traceResult_t  *results, result;
+	bspModel_t     *model;
+	trace_t         trace, traces[TRACE_PACKET_SIZE], *packet[TRACE_PACKET_SIZE];
+
+
+	/* note it */
+	Sys_Printf("--- TraceBenchmark ---\n");
+#ifndef TRACE_PACKET_SSE
+	Sys_Printf("WARNING: SSE packet tracing isn't compiled in, packets are traced one ray at a time\n");
+#endif
+
+	/* make the rays (fixed seed, so runs are comparable) */
+	numRays = numPackets * TRACE_PACKET_SIZE;
+	origins = safe_malloc(numRays * sizeof(vec3_t));
+	ends = safe_malloc(numPackets * sizeof(vec3_t));
+	results = safe_malloc(numRays * sizeof(*results));
+	model = &bspModels[0];
+	srand(0);
+	for(i = 0; i < numPackets; i++)
+	{
+		for(j = 0; j < 3; j++)
+		{
+			origins[i * TRACE_PACKET_SIZE * 3 + j] = model->mins[j] + Random() * (model->maxs[j] - model->mins[j]);
+			ends[i * 3 + j] = model->mins[j] + Random() * (model->maxs[j] - model->mins[j]);
+		}
+		for(k = 1; k < TRACE_PACKET_SIZE; k++)
+		{
+			VectorCopy(&origins[i * TRACE_PACKET_SIZE * 3], &origins[(i * TRACE_PACKET_SIZE + k) * 3]);
+			origins[(i * TRACE_PACKET_SIZE + k) * 3 + 0] += (k & 1) * BENCHMARK_LUXEL_SPACING;
+			origins[(i * TRACE_PACKET_SIZE + k) * 3 + 1] += (k >> 1) * BENCHMARK_LUXEL_SPACING;
+		}
+	}
+
+	/* one ray at a time */
+	numOpaque = 0;
+	numTraversed = numTested = 0.0;
+	start = clock();
+	for(i = 0; i < numRays; i++)
+	{
+		InitBenchmarkTrace(&trace, &origins[i * 3], &ends[(i / TRACE_PACKET_SIZE) * 3]);
+		TraceLine(&trace);
+		StoreBenchmarkResult(&trace, &results[i]);
+		if(trace.opaque)
+			numOpaque++;
+		numTraversed += trace.numTraversed;
+		numTested += trace.numTested;
+	}
+	singleTime = (double)(clock() - start) / CLOCKS_PER_SEC;
+
+	/* as packets */
+	oldRayPacket = rayPacket;
+	rayPacket = qtrue;
+	numMismatches = 0;
+	start = clock();
+	for(i = 0; i < numPackets; i++)
+	{
+		for(k = 0; k < TRACE_PACKET_SIZE; k++)
+		{
+			InitBenchmarkTrace(&traces[k], &origins[(i * TRACE_PACKET_SIZE + k) * 3], &ends[i * 3]);
+			packet[k] = &traces[k];
+		}
+		TraceLinePacket(packet, TRACE_PACKET_SIZE);
+		for(k = 0; k < TRACE_PACKET_SIZE; k++)
+		{
+			StoreBenchmarkResult(&traces[k], &result);
+			if(memcmp(&result, &results[i * TRACE_PACKET_SIZE + k], sizeof(result)))
+				numMismatches++;
+		}
+	}
+	packetTime = (double)(clock() - start) / CLOCKS_PER_SEC;
+	rayPacket = oldRayPacket;
+
+	/* emit some stats */
+	if(singleTime <= 0.0)
+		singleTime = 0.001;
+	if(packetTime <= 0.0)
+		packetTime = 0.001;
+	Sys_Printf("%9d rays (%d%% blocked)\n", numRays, numOpaque * 100 / numRays);
+	Sys_Printf("%9.1f %s nodes, %.1f triangle tests per ray\n", numTraversed / numRays, traceBVH ? "bsp + bvh" : "trace",
+			   numTested / numRays);
+	Sys_Printf("%9.0f rays/sec single rays (%.2fs)\n", numRays / singleTime, singleTime);
+	Sys_Printf("%9.0f rays/sec packets of %d (%.2fs, %.2fx)\n", numRays / packetTime, TRACE_PACKET_SIZE, packetTime,
+			   singleTime / packetTime);
+	if(numMismatches)
+		Sys_Printf("WARNING: %d packet rays differ from single rays\n", numMismatches);
+
+	/* free the rays */
+	free(origins);
+	free(ends);
+	free(results);
+}
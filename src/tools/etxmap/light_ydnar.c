@@ -1532,6 +1532,25 @@ void SetupDirt(void)
 }
 
 
+/*
+DirtForTrace()
+how much a traced dirt ray adds to the gathered dirt
+*/
+
+static float DirtForTrace(trace_t * trace, float ooDepth, qboolean skipSky)
+{
+	vec3_t          displacement;
+
+
+	if(!trace->opaque || (skipSky && (trace->compileFlags & C_SKY)))
+		return 0.0f;
+
+	VectorSubtract(trace->hit, trace->origin, displacement);
+	return 1.0f - ooDepth * VectorLength(displacement);
+}
+
+
+
 /*
 DirtForSample()
 calculates dirt value for a given sample
@@ -1539,9 +1558,11 @@ calculates dirt value for a given sample
 
 float DirtForSample(trace_t * trace)
 {
-	int             i;
+	int             i, j, n, numDirections;
 	float           gatherDirt, outDirt, angle, elevation, ooDepth;
-	vec3_t          normal, worldUp, myUp, myRt, temp, direction, displacement;
+	vec3_t          normal, worldUp, myUp, myRt, temp;
+	vec3_t          directions[DIRT_NUM_VECTORS + 1];
+	trace_t         traces[TRACE_PACKET_SIZE], *packet[TRACE_PACKET_SIZE];
 
 
 	/* dummy check */
@@ -1592,21 +1613,9 @@ float DirtForSample(trace_t * trace)
 			temp[2] = cos(elevation);
 
 			/* transform into tangent space */
-			direction[0] = myRt[0] * temp[0] + myUp[0] * temp[1] + normal[0] * temp[2];
-			direction[1] = myRt[1] * temp[0] + myUp[1] * temp[1] + normal[1] * temp[2];
-			direction[2] = myRt[2] * temp[0] + myUp[2] * temp[1] + normal[2] * temp[2];
-
-			/* set endpoint */
-			VectorMA(trace->origin, dirtDepth, direction, trace->end);
-			SetupTrace(trace);
-
-			/* trace */
-			TraceLine(trace);
-			if(trace->opaque && !(trace->compileFlags & C_SKY))
-			{
-				VectorSubtract(trace->hit, trace->origin, displacement);
-				gatherDirt += 1.0f - ooDepth * VectorLength(displacement);
-			}
+			directions[i][0] = myRt[0] * temp[0] + myUp[0] * temp[1] + normal[0] * temp[2];
+			directions[i][1] = myRt[1] * temp[0] + myUp[1] * temp[1] + normal[1] * temp[2];
+			directions[i][2] = myRt[2] * temp[0] + myUp[2] * temp[1] + normal[2] * temp[2];
 		}
 	}
 	else
@@ -1615,34 +1624,47 @@ float DirtForSample(trace_t * trace)
 		for(i = 0; i < numDirtVectors; i++)
 		{
 			/* transform vector into tangent space */
-			direction[0] = myRt[0] * dirtVectors[i][0] + myUp[0] * dirtVectors[i][1] + normal[0] * dirtVectors[i][2];
-			direction[1] = myRt[1] * dirtVectors[i][0] + myUp[1] * dirtVectors[i][1] + normal[1] * dirtVectors[i][2];
-			direction[2] = myRt[2] * dirtVectors[i][0] + myUp[2] * dirtVectors[i][1] + normal[2] * dirtVectors[i][2];
+			directions[i][0] = myRt[0] * dirtVectors[i][0] + myUp[0] * dirtVectors[i][1] + normal[0] * dirtVectors[i][2];
+			directions[i][1] = myRt[1] * dirtVectors[i][0] + myUp[1] * dirtVectors[i][1] + normal[1] * dirtVectors[i][2];
+			directions[i][2] = myRt[2] * dirtVectors[i][0] + myUp[2] * dirtVectors[i][1] + normal[2] * dirtVectors[i][2];
+		}
+	}
 
-			/* set endpoint */
-			VectorMA(trace->origin, dirtDepth, direction, trace->end);
-			SetupTrace(trace);
+	/* direct ray */
+	VectorCopy(normal, directions[numDirtVectors]);
+	numDirections = numDirtVectors + 1;
 
-			/* trace */
-			TraceLine(trace);
-			if(trace->opaque)
+	/* trace (random mode rays ignore sky hits, the direct ray never does) */
+	if(rayPacket)
+	{
+		/* all rays leave the same point, so they make good packets */
+		for(i = 0; i < numDirections; i += n)
+		{
+			n = numDirections - i < TRACE_PACKET_SIZE ? numDirections - i : TRACE_PACKET_SIZE;
+			for(j = 0; j < n; j++)
 			{
-				VectorSubtract(trace->hit, trace->origin, displacement);
-				gatherDirt += 1.0f - ooDepth * VectorLength(displacement);
+				traces[j] = *trace;
+				VectorMA(trace->origin, dirtDepth, directions[i + j], traces[j].end);
+				SetupTrace(&traces[j]);
+				packet[j] = &traces[j];
 			}
+			TraceLinePacket(packet, n);
+			for(j = 0; j < n; j++)
+				gatherDirt += DirtForTrace(&traces[j], ooDepth, dirtMode == 1 && i + j < numDirtVectors);
 		}
 	}
-
-	/* direct ray */
-	VectorMA(trace->origin, dirtDepth, normal, trace->end);
-	SetupTrace(trace);
-
-	/* trace */
-	TraceLine(trace);
-	if(trace->opaque)
+	else
 	{
-		VectorSubtract(trace->hit, trace->origin, displacement);
-		gatherDirt += 1.0f - ooDepth * VectorLength(displacement);
+		for(i = 0; i < numDirections; i++)
+		{
+			/* set endpoint */
+			VectorMA(trace->origin, dirtDepth, directions[i], trace->end);
+			SetupTrace(trace);
+
+			/* trace */
+			TraceLine(trace);
+			gatherDirt += DirtForTrace(trace, ooDepth, dirtMode == 1 && i < numDirtVectors);
+		}
 	}
 
 	/* early out */
@@ -2109,7 +2131,8 @@ illuminates the luxels
 
 void IlluminateRawLightmap(int rawLightmapNum)
 {
-	int             i, t, x, y, sx, sy, size, luxelFilterRadius, lightmapNum;
+	int             i, p, t, x, y, sx, sy, size, luxelFilterRadius, lightmapNum;
+	int             numTraces, packetSize, results[TRACE_PACKET_SIZE], packetLuxels[TRACE_PACKET_SIZE];
 	int            *cluster, *cluster2, mapped, lighted, totalLighted;
 	size_t          llSize, ldSize;
 	rawLightmap_t  *lm;
@@ -2121,8 +2144,9 @@ void IlluminateRawLightmap(int rawLightmapNum)
 	float          *lightLuxels, *lightDeluxels, *lightLuxel, *lightDeluxel, samples, filterRadius, weight;
 	vec3_t          color, direction, averageColor, averageDir, total, temp, temp2;
 	float           tests[4][2] = { {0.0f, 0}, {1, 0}, {0, 1}, {1, 1} };
-	trace_t         trace;
+	trace_t         trace, traces[TRACE_PACKET_SIZE];
 	float           stackLightLuxels[STACK_LL_SIZE];
+	lightCacheKey_t cacheKey;
 
 
 	/* bail if this number exceeds the number of raw lightmaps */
@@ -2158,6 +2182,17 @@ void IlluminateRawLightmap(int rawLightmapNum)
 	/* create a culled light list for this raw lightmap */
 	CreateTraceLightsForBounds(lm->mins, lm->maxs, lm->plane, lm->numLightClusters, lm->lightClusters, LIGHT_SURFACES, &trace);
 
+	/* reuse the luxels from the last run if nothing that lights them changed */
+	if(lightCache)
+	{
+		LightCacheKeyForRawLightmap(lm, &trace, &cacheKey);
+		if(LoadCachedRawLightmap(lm, &cacheKey))
+		{
+			FreeTraceLights(&trace);
+			return;
+		}
+	}
+
 	/* -----------------------------------------------------------------
 	   fill pass
 	   ----------------------------------------------------------------- */
@@ -2337,63 +2372,66 @@ void IlluminateRawLightmap(int rawLightmapNum)
 				memset((void *)lm->superFlags, 0, size);
 			}
 
-			/* initial pass, one sample per luxel */
-			for(y = 0; y < lm->sh; y++)
+			/* initial pass, one sample per luxel (-raypacket traces neighbouring luxels together) */
+			packetSize = rayPacket ? TRACE_PACKET_SIZE : 1;
+			numTraces = 0;
+			for(p = 0; p <= lm->sw * lm->sh; p++)
 			{
-				for(x = 0; x < lm->sw; x++)
+				/* gather mapped luxels until the packet is full or the lightmap is done */
+				if(p < lm->sw * lm->sh)
 				{
 					/* get cluster */
-					cluster = SUPER_CLUSTER(x, y);
+					cluster = SUPER_CLUSTER(p % lm->sw, p / lm->sw);
 					if(*cluster < 0)
 						continue;
 
+					/* setup trace */
+					traces[numTraces] = trace;
+					traces[numTraces].cluster = *cluster;
+					VectorCopy(SUPER_ORIGIN(p % lm->sw, p / lm->sw), traces[numTraces].origin);
+					VectorCopy(SUPER_NORMAL(p % lm->sw, p / lm->sw), traces[numTraces].normal);
+					packetLuxels[numTraces++] = p;
+					if(numTraces < packetSize)
+						continue;
+				}
+				if(numTraces == 0)
+					continue;
+
+				/* get light for these samples */
+				LightContributionToSamplePacket(traces, numTraces, results);
+
+				for(t = 0; t < numTraces; t++)
+				{
 					/* get particulars */
+					x = packetLuxels[t] % lm->sw;
+					y = packetLuxels[t] / lm->sw;
 					lightLuxel = LIGHT_LUXEL(x, y);
 					lightDeluxel = LIGHT_DELUXEL(x, y);
-					origin = SUPER_ORIGIN(x, y);
-					normal = SUPER_NORMAL(x, y);
 					flag = SUPER_FLAG(x, y);
 
-#if 0
-					////////// 27's temp hack for testing edge clipping ////
-					if(origin[0] == 0 && origin[1] == 0 && origin[2] == 0)
-					{
-						lightLuxel[1] = 255;
-						lightLuxel[3] = 1.0f;
-						totalLighted++;
-					}
-					else
-#endif
-					{
-						/* set contribution count */
-						lightLuxel[3] = 1.0f;
-
-						/* setup trace */
-						trace.cluster = *cluster;
-						VectorCopy(origin, trace.origin);
-						VectorCopy(normal, trace.normal);
+					/* set contribution count */
+					lightLuxel[3] = 1.0f;
 
-						/* get light for this sample */
-						LightContributionToSample(&trace);
-						VectorCopy(trace.color, lightLuxel);
+					/* get light for this sample */
+					VectorCopy(traces[t].color, lightLuxel);
 
-						/* add the contribution to the deluxemap */
-						if(deluxemap)
-						{
-							VectorCopy(trace.directionContribution, lightDeluxel);
-						}
+					/* add the contribution to the deluxemap */
+					if(deluxemap)
+					{
+						VectorCopy(traces[t].directionContribution, lightDeluxel);
+					}
 
-						/* check for evilness */
-						if(trace.forceSubsampling > 1.0f && (lightSamples > 1 || lightRandomSamples) && luxelFilterRadius == 0)
-						{
-							totalLighted++;
-							*flag |= FLAG_FORCE_SUBSAMPLING;	/* force */
-						}
-						/* add to count */
-						else if(trace.color[0] || trace.color[1] || trace.color[2])
-							totalLighted++;
+					/* check for evilness */
+					if(traces[t].forceSubsampling > 1.0f && (lightSamples > 1 || lightRandomSamples) && luxelFilterRadius == 0)
+					{
+						totalLighted++;
+						*flag |= FLAG_FORCE_SUBSAMPLING;	/* force */
 					}
+					/* add to count */
+					else if(traces[t].color[0] || traces[t].color[1] || traces[t].color[2])
+						totalLighted++;
 				}
+				numTraces = 0;
 			}
 
 			/* don't even bother with everything else if nothing was lit */
@@ -2827,6 +2865,10 @@ void IlluminateRawLightmap(int rawLightmapNum)
 		}
 	}
 
+	/* save the luxels for the next run */
+	if(lightCache)
+		StoreCachedRawLightmap(lm, &cacheKey);
+
 
 #if 0
 	// audit pass
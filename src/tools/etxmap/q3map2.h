@@ -248,6 +248,7 @@ constants
 #define LIGHT_WOLF_DEFAULT		(LIGHT_ATTEN_LINEAR | LIGHT_ATTEN_DISTANCE | LIGHT_GRID | LIGHT_SURFACES | LIGHT_FAST)
 
 #define MAX_TRACE_TEST_NODES	256
+#define TRACE_PACKET_SIZE		4
 #define DEFAULT_INHIBIT_RADIUS	1.5f
 
 #define LUXEL_EPSILON			0.125f
@@ -1283,7 +1284,8 @@ leaf_t;
 
 typedef struct pstack_s
 {
-	byte            mightsee[MAX_PORTALS / 8];
+	byte           *mightsee;	/* [portalbytes], one per depth from the thread's pool */
+	int             mightstart, mightend;	/* longs outside this range are all zero and may be stale */
 	struct pstack_s *next;
 	leaf_t         *leaf;
 	vportal_t      *portal;		/* portal exiting */
@@ -1308,6 +1310,8 @@ typedef struct
 	vportal_t      *base;
 	int             c_chains;
 	pstack_t        pstack_head;
+	int             maxmightdepth;
+	byte          **mightpool;	/* [maxmightdepth] */
 }
 threaddata_t;
 
@@ -1398,6 +1402,8 @@ typedef struct
 	/* working data */
 	int             numTestNodes;
 	int             testNodes[MAX_TRACE_TEST_NODES];
+	int             numTraversed;	/* nodes visited, for -tracebench */
+	int             numTested;	/* triangles tested, for -tracebench */
 }
 trace_t;
 
@@ -1498,6 +1504,14 @@ typedef struct rawLightmap_s
 rawLightmap_t;
 
 
+/* light_cache.c: two independent 32 bit hashes */
+typedef struct lightCacheKey_s
+{
+	unsigned int    a, b;
+}
+lightCacheKey_t;
+
+
 typedef struct rawGridPoint_s
 {
 	vec3_t          ambient[MAX_LIGHTMAPS];
@@ -1795,6 +1809,7 @@ int             VisMain(int argc, char **argv);
 
 /* visflow.c */
 int             CountBits(byte * bits, int numbits);
+void            BeginFlowProgress(void);
 void            PassageFlow(int portalnum);
 void            CreatePassages(int portalnum);
 void            PassageMemory(void);
@@ -1808,15 +1823,19 @@ void            PassagePortalFlow(int portalnum);
 /* light.c  */
 float           PointToPolygonFormFactor(const vec3_t point, const vec3_t normal, const winding_t * w);
 int             LightContributionToSample(trace_t * trace);
+void            LightContributionToSamplePacket(trace_t * traces, int numTraces, int *results);
 void            LightingAtSample(trace_t * trace, byte styles[MAX_LIGHTMAPS], vec3_t colors[MAX_LIGHTMAPS]);
 int             LightContributionToPoint(trace_t * trace);
+void            LightContributionToPointPacket(trace_t * traces, int numTraces, int *results);
 int             LightMain(int argc, char **argv);
 
 
 /* light_trace.c */
 void            SetupTraceNodes(void);
 void            TraceLine(trace_t * trace);
+void            TraceLinePacket(trace_t ** traces, int numTraces);
 float           SetupTrace(trace_t * trace);
+void            TraceBenchmark(int numPackets);
 
 
 /* light_bounce.c */
@@ -1829,6 +1848,19 @@ void            RadCreateDiffuseLights(void);
 void            RadFreeLights();
 
 
+/* light_cache.c */
+void            ClearLightCacheKey(lightCacheKey_t * key);
+void            HashLightCacheData(lightCacheKey_t * key, const void *data, int size);
+void            HashLightCacheString(lightCacheKey_t * key, const char *string);
+void            SetupLightCache(const char *path, int argc, char **argv);
+void            AddLightCacheOccluder(vec3_t mins, vec3_t maxs, lightCacheKey_t * key);
+void            FinishLightCacheOccluders(void);
+void            LightCacheKeyForRawLightmap(rawLightmap_t * lm, trace_t * trace, lightCacheKey_t * key);
+qboolean        LoadCachedRawLightmap(rawLightmap_t * lm, lightCacheKey_t * key);
+void            StoreCachedRawLightmap(rawLightmap_t * lm, lightCacheKey_t * key);
+void            FinishLightCache(void);
+
+
 /* light_ydnar.c */
 void            ColorToBytes(const float *color, byte * colorBytes, float scale);
 void            ColorToFloats(const float *color, float * colorFloats, float scale);
@@ -2058,6 +2090,7 @@ Q_EXTERN qboolean			emitFlares Q_ASSIGN( qfalse );
 Q_EXTERN qboolean			debugSurfaces Q_ASSIGN( qfalse );
 Q_EXTERN qboolean			debugInset Q_ASSIGN( qfalse );
 Q_EXTERN qboolean			debugPortals Q_ASSIGN( qfalse );
+Q_EXTERN qboolean			debugWeld Q_ASSIGN( qfalse );
 Q_EXTERN qboolean           lightmapTriangleCheck Q_ASSIGN(qfalse);
 Q_EXTERN qboolean           lightmapExtraVisClusterNudge Q_ASSIGN(qfalse);
 Q_EXTERN qboolean           lightmapFill Q_ASSIGN(qfalse);
@@ -2185,6 +2218,8 @@ Q_EXTERN qboolean			mergevis;
 Q_EXTERN qboolean			mergevisportals;
 Q_EXTERN qboolean			nosort;
 Q_EXTERN qboolean			hint;	/* ydnar */
+Q_EXTERN int				visMaxDepth Q_ASSIGN( 0 );		/* 0 = flow through as many leafs as it takes */
+Q_EXTERN qboolean			visDepthCheck;
 Q_EXTERN char				inbase[ MAX_QPATH ];
 
 /* other bits */
@@ -2239,6 +2274,10 @@ Q_EXTERN qboolean			noVertexLighting Q_ASSIGN( qfalse );
 Q_EXTERN qboolean			noGridLighting Q_ASSIGN( qfalse );
 
 Q_EXTERN qboolean			noTrace Q_ASSIGN( qfalse );
+Q_EXTERN qboolean			rayPacket Q_ASSIGN( qfalse );
+Q_EXTERN int				traceBenchmark Q_ASSIGN( 0 );
+Q_EXTERN qboolean			traceBVH Q_ASSIGN( qfalse );
+Q_EXTERN qboolean			lightCache Q_ASSIGN( qfalse );
 Q_EXTERN qboolean			noSurfaces Q_ASSIGN( qfalse );
 Q_EXTERN qboolean			patchShadows Q_ASSIGN( qtrue );
 Q_EXTERN qboolean			cpmaHack Q_ASSIGN( qfalse );
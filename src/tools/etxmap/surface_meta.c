@@ -49,6 +49,10 @@ several games based on the Quake III Arena engine, in the form of "Q3Map2."
 #define GROW_META_VERTS		1024
 #define GROW_META_TRIANGLES	1024
 
+#define META_VERT_HASHES	65536	/* must be a power of 2 */
+#define SMOOTH_HASHES		65536	/* must be a power of 2 */
+#define SMOOTH_HASH_CELL	4.0f
+
 static int      numMetaSurfaces, numPatchMetaSurfaces;
 
 static int      maxMetaVerts = 0;
@@ -56,6 +60,10 @@ static int      numMetaVerts = 0;
 static int      firstSearchMetaVert = 0;
 static bspDrawVert_t *metaVerts = NULL;
 
+/* metaVertHash[] holds 1 + the newest metavert in each bucket, 0 ends a chain */
+static int      metaVertHash[META_VERT_HASHES];
+static int     *metaVertHashChain = NULL;
+
 static int      maxMetaTriangles = 0;
 static int      numMetaTriangles = 0;
 static metaTriangle_t *metaTriangles = NULL;
@@ -71,6 +79,33 @@ void ClearMetaTriangles(void)
 {
 	numMetaVerts = 0;
 	numMetaTriangles = 0;
+	memset(metaVertHash, 0, sizeof(metaVertHash));
+}
+
+
+
+/*
+HashMetaVertex()
+hashes every bit of a drawvert, so that memcmp-equal verts always share a bucket
+*/
+
+static int HashMetaVertex(const bspDrawVert_t * v)
+{
+	int             i;
+	unsigned int    hash, *words;
+
+
+	/* fnv-1a over the raw words (bspDrawVert_t is all floats, so no padding) */
+	words = (unsigned int *)v;
+	hash = 2166136261u;
+	for(i = 0; i < sizeof(*v) / sizeof(*words); i++)
+	{
+		hash ^= words[i];
+		hash *= 16777619u;
+	}
+	hash ^= hash >> 16;
+
+	return hash & (META_VERT_HASHES - 1);
 }
 
 
@@ -82,31 +117,63 @@ finds a matching metavertex in the global list, returning its index
 
 static int FindMetaVertex(bspDrawVert_t * src)
 {
-	int             i;
-	bspDrawVert_t  *v, *temp;
+	int             i, hash, found, *tempChain;
+	bspDrawVert_t  *temp;
 
 
-	/* try to find an existing drawvert */
-	for(i = firstSearchMetaVert, v = &metaVerts[i]; i < numMetaVerts; i++, v++)
+	/* try to find an existing drawvert; chains run newest first, so stop at the first vert
+	   below firstSearchMetaVert (a vert is only ever added once per search window, so the
+	   match found here is the same one a linear scan from firstSearchMetaVert would find) */
+	hash = HashMetaVertex(src);
+	found = -1;
+	for(i = metaVertHash[hash] - 1; i >= firstSearchMetaVert; i = metaVertHashChain[i] - 1)
 	{
-		if(memcmp(src, v, sizeof(bspDrawVert_t)) == 0)
-			return i;
+		if(memcmp(src, &metaVerts[i], sizeof(bspDrawVert_t)) == 0)
+		{
+			found = i;
+			break;
+		}
 	}
 
+	/* -debugweld: check the hash against the linear scan it replaced */
+	if(debugWeld)
+	{
+		for(i = firstSearchMetaVert; i < numMetaVerts; i++)
+		{
+			if(memcmp(src, &metaVerts[i], sizeof(bspDrawVert_t)) == 0)
+				break;
+		}
+		if(i == numMetaVerts)
+			i = -1;
+		if(i != found)
+			Error("FindMetaVertex: hashed weld found metavert %d, linear search found %d", found, i);
+	}
+
+	if(found >= 0)
+		return found;
+
 	/* enough space? */
 	if(numMetaVerts >= maxMetaVerts)
 	{
 		/* reallocate more room */
 		maxMetaVerts += GROW_META_VERTS;
 		temp = safe_malloc(maxMetaVerts * sizeof(bspDrawVert_t));
+		tempChain = safe_malloc(maxMetaVerts * sizeof(int));
 		if(metaVerts != NULL)
 		{
 			memcpy(temp, metaVerts, numMetaVerts * sizeof(bspDrawVert_t));
+			memcpy(tempChain, metaVertHashChain, numMetaVerts * sizeof(int));
 			free(metaVerts);
+			free(metaVertHashChain);
 		}
 		metaVerts = temp;
+		metaVertHashChain = tempChain;
 	}
 
+	/* link it into the hash */
+	metaVertHashChain[numMetaVerts] = metaVertHash[hash];
+	metaVertHash[hash] = numMetaVerts + 1;
+
 	/* add the triangle */
 	memcpy(&metaVerts[numMetaVerts], src, sizeof(bspDrawVert_t));
 	numMetaVerts++;
@@ -1200,6 +1267,119 @@ void FixMetaTJunctions(void)
 
 
 
+/*
+SmoothHashCell()
+returns the smoothing grid bucket for a cell coordinate
+*/
+
+static int SmoothHashCell(int x, int y, int z)
+{
+	return ((x * 73856093) ^ (y * 19349663) ^ (z * 83492791)) & (SMOOTH_HASHES - 1);
+}
+
+
+
+/*
+CompareSmoothCandidates()
+qsort callback, sorts metavert indexes ascending
+*/
+
+static int CompareSmoothCandidates(const void *a, const void *b)
+{
+	return *((const int *)a) - *((const int *)b);
+}
+
+
+
+/*
+FindSmoothCandidates()
+collects every metavert at or after index i that could be VectorCompare()-equal to it,
+in ascending order, so the caller visits them exactly like a linear scan would
+*/
+
+static int FindSmoothCandidates(int i, int *hashHeads, int *hashChain, int *candidates)
+{
+	int             j, k, x, y, z, numBuckets, numCandidates, bucket;
+	int             mins[3], maxs[3], buckets[8];
+	float          *xyz;
+
+
+	/* get the range of cells within EQUAL_EPSILON of the vert (padded against rounding) */
+	xyz = metaVerts[i].xyz;
+	for(k = 0; k < 3; k++)
+	{
+		mins[k] = (int)floor((xyz[k] - 2 * EQUAL_EPSILON) / SMOOTH_HASH_CELL);
+		maxs[k] = (int)floor((xyz[k] + 2 * EQUAL_EPSILON) / SMOOTH_HASH_CELL);
+	}
+
+	/* gather the distinct buckets they fall in */
+	numBuckets = 0;
+	for(x = mins[0]; x <= maxs[0]; x++)
+	{
+		for(y = mins[1]; y <= maxs[1]; y++)
+		{
+			for(z = mins[2]; z <= maxs[2]; z++)
+			{
+				bucket = SmoothHashCell(x, y, z);
+				for(k = 0; k < numBuckets; k++)
+				{
+					if(buckets[k] == bucket)
+						break;
+				}
+				if(k == numBuckets)
+					buckets[numBuckets++] = bucket;
+			}
+		}
+	}
+
+	/* walk the chains (each one runs in ascending order) */
+	numCandidates = 0;
+	for(k = 0; k < numBuckets; k++)
+	{
+		for(j = hashHeads[buckets[k]] - 1; j >= 0; j = hashChain[j] - 1)
+		{
+			if(j >= i)
+				candidates[numCandidates++] = j;
+		}
+	}
+
+	/* merge multiple chains back into index order */
+	if(numBuckets > 1)
+		qsort(candidates, numCandidates, sizeof(int), CompareSmoothCandidates);
+
+	return numCandidates;
+}
+
+
+
+/*
+CheckSmoothCandidates()
+-debugweld: makes sure the grid yields the same coincident verts, in the same order,
+as the linear scan from i it replaced
+*/
+
+static void CheckSmoothCandidates(int i, const int *candidates, int numCandidates)
+{
+	int             j, c;
+
+
+	c = 0;
+	for(j = i; j < numMetaVerts; j++)
+	{
+		if(VectorCompare(metaVerts[i].xyz, metaVerts[j].xyz) == qfalse)
+			continue;
+
+		/* skip the candidates that aren't coincident */
+		while(c < numCandidates && VectorCompare(metaVerts[i].xyz, metaVerts[candidates[c]].xyz) == qfalse)
+			c++;
+		if(c == numCandidates || candidates[c] != j)
+			Error("SmoothMetaTriangles: smoothing grid missed metavert %d coincident with %d", j, i);
+		c++;
+	}
+}
+
+
+
 /*
 SmoothMetaTriangles()
 averages coincident vertex normals in the meta triangles
@@ -1211,7 +1391,8 @@ averages coincident vertex normals in the meta triangles
 
 void SmoothMetaTriangles(void)
 {
-	int             i, j, k, f, fOld, start, cs, numVerts, numVotes, numSmoothed;
+	int             i, j, k, c, f, fOld, start, cs, numVerts, numVotes, numSmoothed, numCandidates;
+	int            *hashHeads, *hashChain, *candidates;
 	float           shadeAngle, defaultShadeAngle, maxShadeAngle, dot, testAngle;
 	metaTriangle_t *tri;
 	float          *shadeAngles;
@@ -1273,6 +1454,21 @@ void SmoothMetaTriangles(void)
 		return;
 	}
 
+	/* bucket the verts on a coarse grid so coincident verts can be found without
+	   scanning the whole list; chains are built back to front so they run ascending */
+	hashHeads = safe_malloc(SMOOTH_HASHES * sizeof(int));
+	memset(hashHeads, 0, SMOOTH_HASHES * sizeof(int));
+	hashChain = safe_malloc((numMetaVerts + 1) * sizeof(int));
+	candidates = safe_malloc((numMetaVerts + 1) * sizeof(int));
+	for(i = numMetaVerts - 1; i >= 0; i--)
+	{
+		c = SmoothHashCell((int)floor(metaVerts[i].xyz[0] / SMOOTH_HASH_CELL),
+						   (int)floor(metaVerts[i].xyz[1] / SMOOTH_HASH_CELL),
+						   (int)floor(metaVerts[i].xyz[2] / SMOOTH_HASH_CELL));
+		hashChain[i] = hashHeads[c];
+		hashHeads[c] = i + 1;
+	}
+
 	/* init pacifier */
 	fOld = -1;
 	start = I_FloatTime();
@@ -1299,8 +1495,13 @@ void SmoothMetaTriangles(void)
 		numVotes = 0;
 
 		/* build a table of coincident vertexes */
-		for(j = i; j < numMetaVerts && numVerts < MAX_SAMPLES; j++)
+		numCandidates = FindSmoothCandidates(i, hashHeads, hashChain, candidates);
+		if(debugWeld)
+			CheckSmoothCandidates(i, candidates, numCandidates);
+		for(c = 0; c < numCandidates && numVerts < MAX_SAMPLES; c++)
 		{
+			j = candidates[c];
+
 			/* already smoothed? */
 			if(smoothed[j >> 3] & (1 << (j & 7)))
 				continue;
@@ -1363,6 +1564,9 @@ void SmoothMetaTriangles(void)
 	/* free the tables */
 	free(shadeAngles);
 	free(smoothed);
+	free(hashHeads);
+	free(hashChain);
+	free(candidates);
 
 	/* print time */
 	Sys_FPrintf(SYS_VRB, " (%d)\n", (int)(I_FloatTime() - start));
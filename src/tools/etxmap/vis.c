@@ -136,6 +136,13 @@ int LeafVectorFromPortalVector(byte * portalbits, byte * leafbits)
 
 	for(i = 0; i < numportals * 2; i++)
 	{
+		/* skip empty bytes */
+		if(portalbits[i >> 3] == 0)
+		{
+			i |= 7;
+			continue;
+		}
+
 		if(portalbits[i >> 3] & (1 << (i & 7)))
 		{
 			p = portals + i;
@@ -227,12 +234,14 @@ CalcPortalVis
 */
 void CalcPortalVis(void)
 {
+	/* in sorted order, so the smaller portals are done by the time the bigger ones look at them */
+	BeginFlowProgress();
 #ifdef MREDEBUG
 	Sys_Printf("%6d portals out of %d", 0, numportals * 2);
 	//get rid of the counter
-	RunThreadsOnIndividual(numportals * 2, qfalse, PortalFlow);
+	RunThreadsOnInOrder(numportals * 2, qfalse, PortalFlow);
 #else
-	RunThreadsOnIndividual(numportals * 2, qtrue, PortalFlow);
+	RunThreadsOnInOrder(numportals * 2, qfalse, PortalFlow);
 #endif
 
 }
@@ -251,14 +260,16 @@ void CalcPassageVis(void)
 	RunThreadsOnIndividual(numportals * 2, qfalse, CreatePassages);
 	_printf("\n");
 	_printf("%6d portals out of %d", 0, numportals * 2);
-	RunThreadsOnIndividual(numportals * 2, qfalse, PassageFlow);
+	BeginFlowProgress();
+	RunThreadsOnInOrder(numportals * 2, qfalse, PassageFlow);
 	_printf("\n");
 #else
 	Sys_Printf("\n--- CreatePassages (%d) ---\n", numportals * 2);
 	RunThreadsOnIndividual(numportals * 2, qtrue, CreatePassages);
 
 	Sys_Printf("\n--- PassageFlow (%d) ---\n", numportals * 2);
-	RunThreadsOnIndividual(numportals * 2, qtrue, PassageFlow);
+	BeginFlowProgress();
+	RunThreadsOnInOrder(numportals * 2, qfalse, PassageFlow);
 #endif
 }
 
@@ -276,14 +287,16 @@ void CalcPassagePortalVis(void)
 	RunThreadsOnIndividual(numportals * 2, qfalse, CreatePassages);
 	Sys_Printf("\n");
 	Sys_Printf("%6d portals out of %d", 0, numportals * 2);
-	RunThreadsOnIndividual(numportals * 2, qfalse, PassagePortalFlow);
+	BeginFlowProgress();
+	RunThreadsOnInOrder(numportals * 2, qfalse, PassagePortalFlow);
 	Sys_Printf("\n");
 #else
 	Sys_Printf("\n--- CreatePassages (%d) ---\n", numportals * 2);
 	RunThreadsOnIndividual(numportals * 2, qtrue, CreatePassages);
 
 	Sys_Printf("\n--- PassagePortalFlow (%d) ---\n", numportals * 2);
-	RunThreadsOnIndividual(numportals * 2, qtrue, PassagePortalFlow);
+	BeginFlowProgress();
+	RunThreadsOnInOrder(numportals * 2, qfalse, PassagePortalFlow);
 #endif
 }
 
@@ -304,6 +317,120 @@ void CalcFastVis(void)
 	}
 }
 
+/*
+CountClusterVis()
+sums the visible clusters over all clusters, like ClusterMerge() without writing anything
+uses the mightsee flood instead of the vis when flood is set
+*/
+
+static double CountClusterVis(qboolean flood)
+{
+	int             i, j, leafnum, mergedleafnum;
+	double          total;
+	leaf_t         *leaf;
+	vportal_t      *p;
+	int             pnum;
+	byte            portalvector[MAX_PORTALS / 8];
+	byte            uncompressed[MAX_MAP_LEAFS / 8];
+
+
+	total = 0;
+	for(leafnum = 0; leafnum < portalclusters; leafnum++)
+	{
+		mergedleafnum = leafnum;
+		while(leafs[mergedleafnum].merged >= 0)
+			mergedleafnum = leafs[mergedleafnum].merged;
+
+		memset(portalvector, 0, portalbytes);
+		leaf = &leafs[mergedleafnum];
+		for(i = 0; i < leaf->numportals; i++)
+		{
+			p = leaf->portals[i];
+			if(p->removed)
+				continue;
+
+			for(j = 0; j < portallongs; j++)
+				((long *)portalvector)[j] |= ((long *)(flood ? p->portalflood : p->portalvis))[j];
+			pnum = p - portals;
+			portalvector[pnum >> 3] |= 1 << (pnum & 7);
+		}
+
+		memset(uncompressed, 0, leafbytes);
+		uncompressed[mergedleafnum >> 3] |= (1 << (mergedleafnum & 7));
+		total += LeafVectorFromPortalVector(portalvector, uncompressed) + 1;
+	}
+
+	return total;
+}
+
+
+
+/*
+ReportApproximateVis()
+compares the -depth limited vis against the mightsee bound, and against the full vis with -depthcheck
+*/
+
+static void ReportApproximateVis(void)
+{
+	int             i, j, depth, missing;
+	byte           *approx, *vis, bits;
+	double          approxVis, fullVis, floodVis;
+
+
+	approxVis = CountClusterVis(qfalse);
+	floodVis = CountClusterVis(qtrue);
+	Sys_Printf("Depth %d vis: %.0f visible clusters, %.1f%% of the -fast bound (%.0f)\n", visMaxDepth, approxVis,
+			   floodVis > 0 ? approxVis / floodVis * 100.0 : 100.0, floodVis);
+
+	if(!visDepthCheck)
+		return;
+
+	/* keep the approximate vis and flow again without the limit */
+	approx = safe_malloc(numportals * 2 * portalbytes);
+	for(i = 0; i < numportals * 2; i++)
+	{
+		memcpy(approx + i * portalbytes, portals[i].portalvis, portalbytes);
+		memset(portals[i].portalvis, 0, portalbytes);
+		portals[i].status = stat_none;
+	}
+
+	depth = visMaxDepth;
+	visMaxDepth = 0;
+	Sys_Printf("\n--- Full vis for -depthcheck (%d) ---\n", numportals * 2);
+	BeginFlowProgress();
+	if(noPassageVis)
+		RunThreadsOnInOrder(numportals * 2, qfalse, PortalFlow);
+	else if(passageVisOnly)
+		RunThreadsOnInOrder(numportals * 2, qfalse, PassageFlow);
+	else
+		RunThreadsOnInOrder(numportals * 2, qfalse, PassagePortalFlow);
+	visMaxDepth = depth;
+
+	/* the approximation must never hide anything the full vis sees */
+	missing = 0;
+	fullVis = CountClusterVis(qfalse);
+	for(i = 0; i < numportals * 2; i++)
+	{
+		vis = approx + i * portalbytes;
+		for(j = 0; j < portalbytes; j++)
+		{
+			bits = portals[i].portalvis[j] & ~vis[j];
+			missing += CountBits(&bits, 8);
+		}
+		memcpy(portals[i].portalvis, vis, portalbytes);
+	}
+
+	Sys_Printf("Full vis: %.0f visible clusters, depth %d vis is %.1f%% larger\n", fullVis, visMaxDepth,
+			   fullVis > 0 ? (approxVis / fullVis - 1.0) * 100.0 : 0.0);
+	/* the seperator cache makes the full flow depend on which portals it tried first, so a few are expected */
+	if(missing > 0)
+		Sys_Printf("%d portal bits of the full vis aren't in the depth %d vis\n", missing, visMaxDepth);
+
+	free(approx);
+}
+
+
+
 /*
 ==================
 CalcVis
@@ -360,6 +487,10 @@ void CalcVis(void)
 	//
 	// assemble the leaf vis lists by oring and compressing the portal lists
 	//
+	/* approximate vis: see how much it gave away */
+	if(visMaxDepth > 0 && !fastvis)
+		ReportApproximateVis();
+
 	Sys_Printf("creating leaf vis...\n");
 	for(i = 0; i < portalclusters; i++)
 		ClusterMerge(i);
@@ -1107,6 +1238,27 @@ int VisMain(int argc, char **argv)
 			Sys_Printf("passageOnly = true\n");
 			passageVisOnly = qtrue;
 		}
+		else if(!strcmp(argv[i], "-depth"))
+		{
+			visMaxDepth = atoi(argv[i + 1]);
+			if(visMaxDepth < 0)
+				visMaxDepth = 0;
+			Sys_Printf("Flowing through at most %d leafs per portal\n", visMaxDepth);
+			i++;
+		}
+		else if(!strcmp(argv[i], "-depthcheck"))
+		{
+			Sys_Printf("Comparing the depth limited vis against the full vis\n");
+			visDepthCheck = qtrue;
+		}
+		else if(!strcmp(argv[i], "-approx"))
+		{
+			Sys_Printf("approx = true\n");
+			if(visMaxDepth <= 0)
+				visMaxDepth = 8;
+			mergevis = qtrue;
+			mergevisportals = qtrue;
+		}
 		else if(!strcmp(argv[i], "-nosort"))
 		{
 			Sys_Printf("nosort = true\n");
@@ -1141,6 +1293,13 @@ int VisMain(int argc, char **argv)
 		}
 	}
 
+	/* -depthcheck only has something to compare with a depth limited flow */
+	if(visDepthCheck && (visMaxDepth <= 0 || fastvis))
+	{
+		Sys_Printf("WARNING: -depthcheck needs -depth or -approx without -fast, no check will be run\n");
+		visDepthCheck = qfalse;
+	}
+
 	if(i != argc - 1)
 		Error("usage: vis [-threads #] [-level 0-4] [-fast] [-v] bspfile");
 
@@ -36,6 +36,17 @@ several games based on the Quake III Arena engine, in the form of "Q3Map2."
 /* dependencies */
 #include "q3map2.h"
 
+/* and the mightsee vectors 16 bytes at a time */
+#if !defined(C_ONLY) && (defined(__SSE2__) || defined(_M_X64))
+#define VIS_FLOW_SSE2
+#include <emmintrin.h>
+#endif
+
+/* bits outside a stack's mightsee range are zero */
+#define STACK_MIGHT_SEE(stack, pnum) \
+	((int)((pnum) / (8 * sizeof(long))) >= (stack)->mightstart && (int)((pnum) / (8 * sizeof(long))) < (stack)->mightend && \
+	 ((stack)->mightsee[(pnum) >> 3] & (1 << ((pnum) & 7))))
+
 
 
 
@@ -58,19 +69,209 @@ several games based on the Quake III Arena engine, in the form of "Q3Map2."
   void CalcMightSee (leaf_t *leaf, 
 */
 
+/* set bits per byte value; constant so the flow workers never fill it */
+#define BITS2(n)		n, n + 1, n + 1, n + 2
+#define BITS4(n)		BITS2(n), BITS2(n + 1), BITS2(n + 1), BITS2(n + 2)
+#define BITS6(n)		BITS4(n), BITS4(n + 1), BITS4(n + 1), BITS4(n + 2)
+
+static const byte bitsInByte[256] = { BITS6(0), BITS6(1), BITS6(1), BITS6(2) };
+
+#undef BITS2
+#undef BITS4
+#undef BITS6
+
 int CountBits(byte * bits, int numbits)
 {
 	int             i;
 	int             c;
 
+	/* whole bytes, then whatever is left */
 	c = 0;
-	for(i = 0; i < numbits; i++)
+	for(i = 0; i < (numbits >> 3); i++)
+		c += bitsInByte[bits[i]];
+	for(i <<= 3; i < numbits; i++)
 		if(bits[i >> 3] & (1 << (i & 7)))
 			c++;
 
 	return c;
 }
 
+
+
+/*
+StackMightSee()
+returns the mightsee vector for a recursion depth, the vectors are kept for the whole flow
+so the stack frames stay small and the same few buffers stay in cache
+*/
+
+static byte    *StackMightSee(threaddata_t * thread, int depth)
+{
+	byte          **temp;
+
+
+	/* enough space? */
+	if(depth >= thread->maxmightdepth)
+	{
+		/* reallocate more room */
+		temp = safe_malloc((depth + 32) * sizeof(*temp));
+		memset(temp, 0, (depth + 32) * sizeof(*temp));
+		if(thread->mightpool != NULL)
+		{
+			memcpy(temp, thread->mightpool, thread->maxmightdepth * sizeof(*temp));
+			free(thread->mightpool);
+		}
+		thread->mightpool = temp;
+		thread->maxmightdepth = depth + 32;
+	}
+
+	/* allocate the vector */
+	if(thread->mightpool[depth] == NULL)
+		thread->mightpool[depth] = safe_malloc(portalbytes);
+
+	return thread->mightpool[depth];
+}
+
+
+
+/*
+FreeStackMightSee()
+frees the thread's mightsee vectors after a flow
+*/
+
+static void FreeStackMightSee(threaddata_t * thread)
+{
+	int             i;
+
+
+	for(i = 0; i < thread->maxmightdepth; i++)
+		free(thread->mightpool[i]);
+	free(thread->mightpool);
+	thread->mightpool = NULL;
+	thread->maxmightdepth = 0;
+}
+
+
+
+/*
+TrimMightSee()
+shrinks the stack's mightsee range to its nonzero longs
+*/
+
+static void TrimMightSee(pstack_t * stack)
+{
+	long           *might;
+
+
+	might = (long *)stack->mightsee;
+	while(stack->mightstart < stack->mightend && might[stack->mightstart] == 0)
+		stack->mightstart++;
+	while(stack->mightend > stack->mightstart && might[stack->mightend - 1] == 0)
+		stack->mightend--;
+}
+
+
+
+/*
+SetupStackMightSee()
+copies the base portal's flood into the head of the stack
+*/
+
+static void SetupStackMightSee(threaddata_t * thread, vportal_t * p)
+{
+	thread->pstack_head.mightsee = StackMightSee(thread, 0);
+	memcpy(thread->pstack_head.mightsee, p->portalflood, portalbytes);
+	thread->pstack_head.mightstart = 0;
+	thread->pstack_head.mightend = portallongs;
+	TrimMightSee(&thread->pstack_head);
+}
+
+
+
+/*
+SeeAllMightSee()
+marks everything the stack might see as visible, used past -depth
+*/
+
+static void SeeAllMightSee(threaddata_t * thread, pstack_t * stack)
+{
+	int             i;
+	long           *might, *vis;
+
+
+	might = (long *)stack->mightsee;
+	vis = (long *)thread->base->portalvis;
+	for(i = stack->mightstart; i < stack->mightend; i++)
+		vis[i] |= might[i];
+}
+
+
+
+/*
+FlowMightSee()
+stack mightsee = prevstack mightsee & a & b, b is optional
+returns nonzero if the new vector has bits the base portal's vis doesn't have yet
+*/
+
+static long FlowMightSee(pstack_t * stack, pstack_t * prevstack, byte * a, byte * b, byte * vis)
+{
+	int             i, start, end;
+	long           *might, *prevmight, *la, *lb, *lvis, more;
+
+#ifdef VIS_FLOW_SSE2
+	__m128i         m, mm;
+	int             bytes;
+	byte           *bmight, *bprevmight;
+#endif
+
+
+	start = prevstack->mightstart;
+	end = prevstack->mightend;
+	might = (long *)stack->mightsee;
+	prevmight = (long *)prevstack->mightsee;
+	la = (long *)a;
+	lb = (long *)b;
+	lvis = (long *)vis;
+	more = 0;
+	i = start;
+
+#ifdef VIS_FLOW_SSE2
+	/* whole 16 byte blocks of the range */
+	bytes = (end - start) * sizeof(long);
+	bytes &= ~15;
+	bmight = (byte *)(might + start);
+	bprevmight = (byte *)(prevmight + start);
+	a = (byte *)(la + start);
+	b = b != NULL ? (byte *)(lb + start) : NULL;
+	vis = (byte *)(lvis + start);
+	mm = _mm_setzero_si128();
+	for(i = 0; i < bytes; i += 16)
+	{
+		m = _mm_and_si128(_mm_loadu_si128((__m128i *) (bprevmight + i)), _mm_loadu_si128((__m128i *) (a + i)));
+		if(b != NULL)
+			m = _mm_and_si128(m, _mm_loadu_si128((__m128i *) (b + i)));
+		_mm_storeu_si128((__m128i *) (bmight + i), m);
+		mm = _mm_or_si128(mm, _mm_andnot_si128(_mm_loadu_si128((__m128i *) (vis + i)), m));
+	}
+	more = _mm_movemask_epi8(_mm_cmpeq_epi8(mm, _mm_setzero_si128())) != 0xFFFF;
+	i = start + bytes / sizeof(long);
+#endif
+
+	/* the rest one long at a time */
+	for(; i < end; i++)
+	{
+		might[i] = prevmight[i] & la[i];
+		if(lb != NULL)
+			might[i] &= lb[i];
+		more |= might[i] & ~lvis[i];
+	}
+
+	stack->mightstart = start;
+	stack->mightend = end;
+	TrimMightSee(stack);
+
+	return more;
+}
+
 int             c_fullskip;
 int             c_portalskip, c_leafskip;
 int             c_vistest, c_mighttest;
@@ -402,6 +603,60 @@ fixedWinding_t *ClipToSeperators(fixedWinding_t * source, fixedWinding_t * pass,
 	return target;
 }
 
+/*
+BeginFlowProgress()
+sets up the estimated time left for PortalFlow() and the passage flows
+the portals are flowed smallest mightsee first and the big ones take far longer,
+so each one is weighted by its mightsee squared
+*/
+
+static double   flowStart, flowWeightTotal, flowWeightDone;
+static int      flowTenth;
+
+static double FlowWeight(vportal_t * p)
+{
+	return 1.0 + (double)p->nummightsee * p->nummightsee;
+}
+
+void BeginFlowProgress(void)
+{
+	int             i;
+
+
+	flowStart = I_FloatTime();
+	flowWeightTotal = 0;
+	flowWeightDone = 0;
+	flowTenth = 0;
+	for(i = 0; i < numportals * 2; i++)
+		flowWeightTotal += FlowWeight(&portals[i]);
+}
+
+
+
+/*
+FlowProgress()
+counts a finished portal and prints every tenth of the estimated work
+*/
+
+static void FlowProgress(vportal_t * p)
+{
+	double          elapsed, left;
+
+
+	ThreadLock();
+	flowWeightDone += FlowWeight(p);
+	while(flowTenth < 10 && flowWeightDone * 10 >= (flowTenth + 1) * flowWeightTotal)
+	{
+		flowTenth++;
+		elapsed = I_FloatTime() - flowStart;
+		left = elapsed * (flowWeightTotal - flowWeightDone) / flowWeightDone;
+		Sys_Printf("%3d%%  %6.0f seconds elapsed  %6.0f seconds left\n", flowTenth * 10, elapsed, left);
+	}
+	ThreadUnlock();
+}
+
+
+
 /*
 ==================
 RecursiveLeafFlow
@@ -416,8 +671,9 @@ void RecursiveLeafFlow(int leafnum, threaddata_t * thread, pstack_t * prevstack)
 	vportal_t      *p;
 	visPlane_t      backplane;
 	leaf_t         *leaf;
-	int             i, j, n;
-	long           *test, *might, *prevmight, *vis, more;
+	int             i, n;
+	byte           *test;
+	long            more;
 	int             pnum;
 
 	thread->c_chains++;
@@ -431,15 +687,20 @@ void RecursiveLeafFlow(int leafnum, threaddata_t * thread, pstack_t * prevstack)
 	stack.leaf = leaf;
 	stack.portal = NULL;
 	stack.depth = prevstack->depth + 1;
+	stack.mightsee = StackMightSee(thread, stack.depth);
+
+	/* approximate vis: past the depth limit, anything the flow still might see counts as seen */
+	if(visMaxDepth > 0 && stack.depth > visMaxDepth)
+	{
+		SeeAllMightSee(thread, prevstack);
+		return;
+	}
 
 #ifdef SEPERATORCACHE
 	stack.numseperators[0] = 0;
 	stack.numseperators[1] = 0;
 #endif
 
-	might = (long *)stack.mightsee;
-	vis = (long *)thread->base->portalvis;
-
 	// check all portals for flowing into other leafs   
 	for(i = 0; i < leaf->numportals; i++)
 	{
@@ -467,7 +728,7 @@ void RecursiveLeafFlow(int leafnum, threaddata_t * thread, pstack_t * prevstack)
 		   }
 		 */
 
-		if(!(prevstack->mightsee[pnum >> 3] & (1 << (pnum & 7))))
+		if(!STACK_MIGHT_SEE(prevstack, pnum))
 		{
 			continue;			// can't possibly see it
 		}
@@ -475,20 +736,14 @@ void RecursiveLeafFlow(int leafnum, threaddata_t * thread, pstack_t * prevstack)
 		// if the portal can't see anything we haven't allready seen, skip it
 		if(p->status == stat_done)
 		{
-			test = (long *)p->portalvis;
+			test = p->portalvis;
 		}
 		else
 		{
-			test = (long *)p->portalflood;
+			test = p->portalflood;
 		}
 
-		more = 0;
-		prevmight = (long *)prevstack->mightsee;
-		for(j = 0; j < portallongs; j++)
-		{
-			might[j] = prevmight[j] & test[j];
-			more |= (might[j] & ~vis[j]);
-		}
+		more = FlowMightSee(&stack, prevstack, test, NULL, thread->base->portalvis);
 
 		if(!more && (thread->base->portalvis[pnum >> 3] & (1 << (pnum & 7))))
 		{						// can't see anything new
@@ -640,7 +895,6 @@ generates the portalvis bit vector
 void PortalFlow(int portalnum)
 {
 	threaddata_t    data;
-	int             i;
 	vportal_t      *p;
 	int             c_might, c_can;
 
@@ -653,6 +907,7 @@ void PortalFlow(int portalnum)
 	if(p->removed)
 	{
 		p->status = stat_done;
+		FlowProgress(p);
 		return;
 	}
 
@@ -667,12 +922,13 @@ void PortalFlow(int portalnum)
 	data.pstack_head.source = p->winding;
 	data.pstack_head.portalplane = p->plane;
 	data.pstack_head.depth = 0;
-	for(i = 0; i < portallongs; i++)
-		((long *)data.pstack_head.mightsee)[i] = ((long *)p->portalflood)[i];
+	SetupStackMightSee(&data, p);
 
 	RecursiveLeafFlow(p->leaf, &data, &data.pstack_head);
+	FreeStackMightSee(&data);
 
 	p->status = stat_done;
+	FlowProgress(p);
 
 	c_can = CountBits(p->portalvis, numportals * 2);
 
@@ -690,8 +946,9 @@ void RecursivePassageFlow(vportal_t * portal, threaddata_t * thread, pstack_t *
 	vportal_t      *p;
 	leaf_t         *leaf;
 	passage_t      *passage, *nextpassage;
-	int             i, j;
-	long           *might, *vis, *prevmight, *cansee, *portalvis, more;
+	int             i;
+	byte           *portalvis;
+	long            more;
 	int             pnum;
 
 	leaf = &leafs[portal->leaf];
@@ -700,8 +957,14 @@ void RecursivePassageFlow(vportal_t * portal, threaddata_t * thread, pstack_t *
 
 	stack.next = NULL;
 	stack.depth = prevstack->depth + 1;
+	stack.mightsee = StackMightSee(thread, stack.depth);
 
-	vis = (long *)thread->base->portalvis;
+	/* approximate vis: past the depth limit, anything the flow still might see counts as seen */
+	if(visMaxDepth > 0 && stack.depth > visMaxDepth)
+	{
+		SeeAllMightSee(thread, prevstack);
+		return;
+	}
 
 	passage = portal->passages;
 	nextpassage = passage;
@@ -716,7 +979,7 @@ void RecursivePassageFlow(vportal_t * portal, threaddata_t * thread, pstack_t *
 		nextpassage = passage->next;
 		pnum = p - portals;
 
-		if(!(prevstack->mightsee[pnum >> 3] & (1 << (pnum & 7))))
+		if(!STACK_MIGHT_SEE(prevstack, pnum))
 		{
 			continue;			// can't possibly see it
 		}
@@ -724,29 +987,11 @@ void RecursivePassageFlow(vportal_t * portal, threaddata_t * thread, pstack_t *
 		// mark the portal as visible
 		thread->base->portalvis[pnum >> 3] |= (1 << (pnum & 7));
 
-		prevmight = (long *)prevstack->mightsee;
-		cansee = (long *)passage->cansee;
-		might = (long *)stack.mightsee;
-		memcpy(might, prevmight, portalbytes);
 		if(p->status == stat_done)
-			portalvis = (long *)p->portalvis;
+			portalvis = p->portalvis;
 		else
-			portalvis = (long *)p->portalflood;
-		more = 0;
-		for(j = 0; j < portallongs; j++)
-		{
-			if(*might)
-			{
-				*might &= *cansee++ & *portalvis++;
-				more |= (*might & ~vis[j]);
-			}
-			else
-			{
-				cansee++;
-				portalvis++;
-			}
-			might++;
-		}
+			portalvis = p->portalflood;
+		more = FlowMightSee(&stack, prevstack, passage->cansee, portalvis, thread->base->portalvis);
 
 		if(!more)
 		{
@@ -769,7 +1014,6 @@ PassageFlow
 void PassageFlow(int portalnum)
 {
 	threaddata_t    data;
-	int             i;
 	vportal_t      *p;
 
 //  int             c_might, c_can;
@@ -783,6 +1027,7 @@ void PassageFlow(int portalnum)
 	if(p->removed)
 	{
 		p->status = stat_done;
+		FlowProgress(p);
 		return;
 	}
 
@@ -797,12 +1042,13 @@ void PassageFlow(int portalnum)
 	data.pstack_head.source = p->winding;
 	data.pstack_head.portalplane = p->plane;
 	data.pstack_head.depth = 0;
-	for(i = 0; i < portallongs; i++)
-		((long *)data.pstack_head.mightsee)[i] = ((long *)p->portalflood)[i];
+	SetupStackMightSee(&data, p);
 
 	RecursivePassageFlow(p, &data, &data.pstack_head);
+	FreeStackMightSee(&data);
 
 	p->status = stat_done;
+	FlowProgress(p);
 
 	/*
 	   c_can = CountBits (p->portalvis, numportals*2);
@@ -824,8 +1070,9 @@ void RecursivePassagePortalFlow(vportal_t * portal, threaddata_t * thread, pstac
 	leaf_t         *leaf;
 	visPlane_t      backplane;
 	passage_t      *passage, *nextpassage;
-	int             i, j, n;
-	long           *might, *vis, *prevmight, *cansee, *portalvis, more;
+	int             i, n;
+	byte           *portalvis;
+	long            more;
 	int             pnum;
 
 //  thread->c_chains++;
@@ -839,14 +1086,20 @@ void RecursivePassagePortalFlow(vportal_t * portal, threaddata_t * thread, pstac
 	stack.leaf = leaf;
 	stack.portal = NULL;
 	stack.depth = prevstack->depth + 1;
+	stack.mightsee = StackMightSee(thread, stack.depth);
+
+	/* approximate vis: past the depth limit, anything the flow still might see counts as seen */
+	if(visMaxDepth > 0 && stack.depth > visMaxDepth)
+	{
+		SeeAllMightSee(thread, prevstack);
+		return;
+	}
 
 #ifdef SEPERATORCACHE
 	stack.numseperators[0] = 0;
 	stack.numseperators[1] = 0;
 #endif
 
-	vis = (long *)thread->base->portalvis;
-
 	passage = portal->passages;
 	nextpassage = passage;
 	// check all portals for flowing into other leafs   
@@ -858,32 +1111,14 @@ void RecursivePassagePortalFlow(vportal_t * portal, threaddata_t * thread, pstac
 		nextpassage = passage->next;
 		pnum = p - portals;
 
-		if(!(prevstack->mightsee[pnum >> 3] & (1 << (pnum & 7))))
+		if(!STACK_MIGHT_SEE(prevstack, pnum))
 			continue;			// can't possibly see it
 
-		prevmight = (long *)prevstack->mightsee;
-		cansee = (long *)passage->cansee;
-		might = (long *)stack.mightsee;
-		memcpy(might, prevmight, portalbytes);
 		if(p->status == stat_done)
-			portalvis = (long *)p->portalvis;
+			portalvis = p->portalvis;
 		else
-			portalvis = (long *)p->portalflood;
-		more = 0;
-		for(j = 0; j < portallongs; j++)
-		{
-			if(*might)
-			{
-				*might &= *cansee++ & *portalvis++;
-				more |= (*might & ~vis[j]);
-			}
-			else
-			{
-				cansee++;
-				portalvis++;
-			}
-			might++;
-		}
+			portalvis = p->portalflood;
+		more = FlowMightSee(&stack, prevstack, passage->cansee, portalvis, thread->base->portalvis);
 
 		if(!more && (thread->base->portalvis[pnum >> 3] & (1 << (pnum & 7))))
 		{						// can't see anything new
@@ -1033,7 +1268,6 @@ PassagePortalFlow
 void PassagePortalFlow(int portalnum)
 {
 	threaddata_t    data;
-	int             i;
 	vportal_t      *p;
 
 //  int             c_might, c_can;
@@ -1047,6 +1281,7 @@ void PassagePortalFlow(int portalnum)
 	if(p->removed)
 	{
 		p->status = stat_done;
+		FlowProgress(p);
 		return;
 	}
 
@@ -1061,12 +1296,13 @@ void PassagePortalFlow(int portalnum)
 	data.pstack_head.source = p->winding;
 	data.pstack_head.portalplane = p->plane;
 	data.pstack_head.depth = 0;
-	for(i = 0; i < portallongs; i++)
-		((long *)data.pstack_head.mightsee)[i] = ((long *)p->portalflood)[i];
+	SetupStackMightSee(&data, p);
 
 	RecursivePassagePortalFlow(p, &data, &data.pstack_head);
+	FreeStackMightSee(&data);
 
 	p->status = stat_done;
+	FlowProgress(p);
 
 	/*
 	   c_can = CountBits (p->portalvis, numportals*2);